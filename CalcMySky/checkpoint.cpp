@@ -0,0 +1,371 @@
+#include "checkpoint.hpp"
+
+#include <set>
+#include <memory>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <filesystem>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QSaveFile>
+#include <QFile>
+
+#include "dependencies.hpp"
+#include "data.hpp"
+#include "util.hpp"
+
+namespace
+{
+
+namespace fs=std::filesystem;
+
+constexpr char MANIFEST_HEADER[]="# CalcMySky checkpoint manifest. Don't edit.";
+constexpr char ATMO_HASH_KEY[]="atmo-sha256";
+constexpr char OPTIONS_KEY[]="options";
+constexpr char SNAPSHOT_KEY[]="snapshot";
+constexpr char DONE_KEY[]="done";
+
+std::set<std::pair<unsigned/*texIndex*/,QString/*stage name*/>> stagesDone;
+// Snapshot 0 means there's none
+unsigned currentSnapshot=0;
+unsigned pendingSnapshot=0;
+
+std::string checkpointDir()
+{
+    return atmo.textureOutputDir+"/checkpoint";
+}
+
+std::string manifestPath()
+{
+    return checkpointDir()+"/manifest";
+}
+
+std::string snapshotDir(const unsigned snapshot)
+{
+    return checkpointDir()+"/snapshot-"+std::to_string(snapshot);
+}
+
+QString atmoHash()
+{
+    return QCryptographicHash::hash(atmo.descriptionFileText.toUtf8(), QCryptographicHash::Sha256).toHex();
+}
+
+// Options that change what is computed and how it's accumulated. The ones that affect the values are shared with the
+// product fingerprints, so that a checkpoint can't be resumed with output settings different from the saved results.
+QString optionsFingerprint()
+{
+    return QString("%1 wlsets=%2-%3 merged-shards=%4").arg(computationSettings())
+                                                      .arg(opts.firstWavelengthSet)
+                                                      .arg(opts.lastWavelengthSet)
+                                                      .arg(opts.shardsToMerge.size());
+}
+
+void removeDir(std::string const& path)
+{
+    std::error_code err;
+    fs::remove_all(fs::u8path(path), err);
+    if(err)
+    {
+        std::cerr << "Failed to remove directory \"" << path << "\": "
+                  << QString::fromLocal8Bit(err.message().c_str()) << "\n";
+        throw MustQuit{};
+    }
+}
+
+// Removes all the snapshots except the current one, e.g. left from a crash in the middle of checkpoint saving
+void removeStaleSnapshots()
+{
+    std::error_code err;
+    const auto currentName=fs::u8path(snapshotDir(currentSnapshot)).filename();
+    for(const auto& entry : fs::directory_iterator(fs::u8path(checkpointDir()), err))
+    {
+        if(!entry.is_directory()) continue;
+        if(entry.path().filename()==currentName) continue;
+        removeDir(entry.path().u8string());
+    }
+}
+
+void writeManifest()
+{
+    const auto path=manifestPath();
+    QSaveFile file(QString::fromStdString(path));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "Failed to open checkpoint manifest \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream out(&file);
+    out << MANIFEST_HEADER << "\n";
+    out << ATMO_HASH_KEY << ": " << atmoHash() << "\n";
+    out << OPTIONS_KEY << ": " << optionsFingerprint() << "\n";
+    out << SNAPSHOT_KEY << ": " << currentSnapshot << "\n";
+    for(const auto& [texIndex, stage] : stagesDone)
+        out << DONE_KEY << ": " << texIndex << " " << stage << "\n";
+    out.flush();
+    if(!file.commit())
+    {
+        std::cerr << "Failed to write checkpoint manifest \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+}
+
+bool readManifest()
+{
+    const auto path=manifestPath();
+    QFile file(QString::fromStdString(path));
+    if(!file.exists())
+        return false;
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open checkpoint manifest \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto badManifest=[&path](int lineNumber, QString const& message)
+    {
+        std::cerr << path << ":" << lineNumber << ": " << message << "\n";
+        throw MustQuit{};
+    };
+
+    QTextStream in(&file);
+    bool hashChecked=false, optionsChecked=false;
+    for(int lineNumber=1; !in.atEnd(); ++lineNumber)
+    {
+        const auto line=in.readLine();
+        if(line.startsWith('#') || line.trimmed().isEmpty())
+            continue;
+        const auto colonPos=line.indexOf(':');
+        if(colonPos<0)
+            badManifest(lineNumber, "bad line format");
+        const auto key=line.left(colonPos);
+        const auto value=line.mid(colonPos+1).trimmed();
+        if(key==ATMO_HASH_KEY)
+        {
+            if(value!=atmoHash())
+            {
+                std::cerr << "Checkpoint in \"" << checkpointDir() << "\" was made for a different atmosphere description, can't resume\n";
+                throw MustQuit{};
+            }
+            hashChecked=true;
+        }
+        else if(key==OPTIONS_KEY)
+        {
+            if(value!=optionsFingerprint())
+            {
+                std::cerr << "Checkpoint in \"" << checkpointDir() << "\" was made with different options (" << value
+                          << "), can't resume with current ones (" << optionsFingerprint() << ")\n";
+                throw MustQuit{};
+            }
+            optionsChecked=true;
+        }
+        else if(key==SNAPSHOT_KEY)
+        {
+            bool ok=false;
+            currentSnapshot=value.toUInt(&ok);
+            if(!ok)
+                badManifest(lineNumber, "failed to parse snapshot number");
+        }
+        else if(key==DONE_KEY)
+        {
+            const auto spacePos=value.indexOf(' ');
+            bool ok=false;
+            const auto texIndex=value.left(spacePos).toUInt(&ok);
+            if(spacePos<0 || !ok)
+                badManifest(lineNumber, "failed to parse stage record");
+            stagesDone.emplace(texIndex, value.mid(spacePos+1));
+        }
+        else
+        {
+            badManifest(lineNumber, "unknown key \""+key+"\"");
+        }
+    }
+    if(!hashChecked || !optionsChecked)
+        badManifest(1, "incomplete manifest");
+    return true;
+}
+
+QString entryPath(const unsigned snapshot, QString const& name)
+{
+    return QString("%1/%2.f32").arg(snapshotDir(snapshot).c_str()).arg(name);
+}
+
+void writeEntry(QString const& name, const char* data, const qint64 size)
+{
+    const auto path=entryPath(pendingSnapshot, name);
+    QFile out(path);
+    if(!out.open(QFile::WriteOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+    out.write(data, size);
+    out.close();
+    if(out.error())
+    {
+        std::cerr << "Failed to write \"" << path << "\": " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+}
+
+QByteArray readEntry(QString const& name)
+{
+    const auto path=entryPath(currentSnapshot, name);
+    QFile in(path);
+    if(!in.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << in.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto data=in.readAll();
+    if(in.error())
+    {
+        std::cerr << "Failed to read \"" << path << "\": " << in.errorString() << "\n";
+        throw MustQuit{};
+    }
+    return data;
+}
+
+}
+
+QString CheckpointStage::name() const
+{
+    switch(kind)
+    {
+    case Transmittance:            return "transmittance";
+    case DirectIrradiance:         return "direct-irradiance";
+    case LightPollution:           return "light-pollution";
+    case ScatteringOrder:          return QString("scattering-order-%1").arg(scatteringOrder);
+    case EclipsedDoubleScattering: return "eclipsed-double-scattering";
+    }
+    assert(!"Unknown stage kind");
+    return {};
+}
+
+void initCheckpoints()
+{
+    if(opts.resume)
+    {
+        if(readManifest())
+        {
+            std::cerr << "Resuming from checkpoint with " << stagesDone.size() << " stages done\n";
+            removeStaleSnapshots();
+            return;
+        }
+        std::cerr << "No checkpoint found in \"" << checkpointDir() << "\", starting from scratch\n";
+    }
+    removeDir(checkpointDir());
+    stagesDone.clear();
+    currentSnapshot=0;
+    createDirs(checkpointDir());
+    writeManifest();
+}
+
+bool stageIsDone(const unsigned texIndex, CheckpointStage const& stage)
+{
+    return stagesDone.count({texIndex, stage.name()});
+}
+
+bool haveCheckpointSnapshot()
+{
+    return currentSnapshot!=0;
+}
+
+void beginCheckpoint()
+{
+    pendingSnapshot=currentSnapshot+1;
+    const auto dir=snapshotDir(pendingSnapshot);
+    removeDir(dir);
+    createDirs(dir);
+}
+
+void saveTextureToCheckpoint(const GLenum target, const GLuint texture, QString const& name)
+{
+    assert(pendingSnapshot);
+
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glBindTexture(target,texture);
+    int w=1,h=1,d=1;
+    gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_WIDTH,&w);
+    gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_HEIGHT,&h);
+    if(target==GL_TEXTURE_3D)
+        gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_DEPTH,&d);
+
+    const auto subpixelCount=4*size_t(w)*h*d;
+    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
+    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, subpixels.get());
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error while reading texture \"" << name << "\" for checkpoint: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    writeEntry(name, reinterpret_cast<const char*>(subpixels.get()), subpixelCount*sizeof subpixels[0]);
+}
+
+void saveDataToCheckpoint(std::vector<glm::vec4> const& data, QString const& name)
+{
+    assert(pendingSnapshot);
+    writeEntry(name, reinterpret_cast<const char*>(data.data()), data.size()*sizeof data[0]);
+}
+
+void commitCheckpoint(const unsigned texIndex, CheckpointStage const& stage)
+{
+    assert(pendingSnapshot);
+
+    const auto oldSnapshot=currentSnapshot;
+    currentSnapshot=pendingSnapshot;
+    pendingSnapshot=0;
+    stagesDone.emplace(texIndex, stage.name());
+    writeManifest();
+    if(oldSnapshot)
+        removeDir(snapshotDir(oldSnapshot));
+}
+
+bool checkpointHasEntry(QString const& name)
+{
+    return currentSnapshot && QFile::exists(entryPath(currentSnapshot, name));
+}
+
+void loadTextureFromCheckpoint(const GLenum target, const GLuint texture, QString const& name,
+                               const GLsizei width, const GLsizei height, const GLsizei depth)
+{
+    std::cerr << indentOutput() << "Restoring " << name << " from checkpoint... ";
+    const auto data=readEntry(name);
+    const auto expectedSize=4*sizeof(GLfloat)*width*height*depth;
+    if(size_t(data.size())!=expectedSize)
+    {
+        std::cerr << "unexpected size of checkpoint entry: " << data.size() << " bytes instead of " << expectedSize << "\n";
+        throw MustQuit{};
+    }
+    gl.glBindTexture(target,texture);
+    if(target==GL_TEXTURE_3D)
+        gl.glTexImage3D(target,0,GL_RGBA32F,width,height,depth,0,GL_RGBA,GL_FLOAT,data.data());
+    else
+        gl.glTexImage2D(target,0,GL_RGBA32F,width,height,0,GL_RGBA,GL_FLOAT,data.data());
+    gl.glBindTexture(target,0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
+
+std::vector<glm::vec4> loadDataFromCheckpoint(QString const& name)
+{
+    std::cerr << indentOutput() << "Restoring " << name << " from checkpoint... ";
+    const auto data=readEntry(name);
+    if(data.size() % sizeof(glm::vec4))
+    {
+        std::cerr << "bad size of checkpoint entry: " << data.size() << " bytes\n";
+        throw MustQuit{};
+    }
+    std::vector<glm::vec4> out(data.size()/sizeof(glm::vec4));
+    std::memcpy(out.data(), data.data(), data.size());
+    std::cerr << "done\n";
+    return out;
+}
+
+void removeCheckpoints()
+{
+    removeDir(checkpointDir());
+}
@@ -0,0 +1,50 @@
+#ifndef INCLUDE_ONCE_911B9805_FA0F_4239_AC42_F9B65B8FA8C3
+#define INCLUDE_ONCE_911B9805_FA0F_4239_AC42_F9B65B8FA8C3
+
+#include <vector>
+#include <QString>
+#include <glm/glm.hpp>
+#include <QOpenGLFunctions_3_3_Core>
+
+/* Checkpoints let an interrupted calcmysky run continue where it stopped (see --resume option).
+ *
+ * The output directory gets a "checkpoint" subdirectory containing a manifest and a snapshot of the state
+ * that can't be recovered from the output files alone: textures that are carried from one stage to the next
+ * (e.g. delta scattering of the previous order), as well as the luminance accumulators that collect data
+ * from all wavelength sets. Each new checkpoint is written into a fresh snapshot directory, and only after
+ * the manifest referring to it is atomically replaced is the previous snapshot removed. Thus a crash at any
+ * moment leaves a consistent checkpoint.
+ */
+
+struct CheckpointStage
+{
+    enum Kind
+    {
+        Transmittance,
+        DirectIrradiance,
+        LightPollution,
+        ScatteringOrder, //!< Order 2 stage also includes single scattering
+        EclipsedDoubleScattering,
+    } kind;
+    unsigned scatteringOrder=0;
+
+    QString name() const;
+};
+
+void initCheckpoints();
+bool stageIsDone(unsigned texIndex, CheckpointStage const& stage);
+bool haveCheckpointSnapshot();
+
+void beginCheckpoint();
+void saveTextureToCheckpoint(GLenum target, GLuint texture, QString const& name);
+void saveDataToCheckpoint(std::vector<glm::vec4> const& data, QString const& name);
+void commitCheckpoint(unsigned texIndex, CheckpointStage const& stage);
+
+bool checkpointHasEntry(QString const& name);
+void loadTextureFromCheckpoint(GLenum target, GLuint texture, QString const& name,
+                               GLsizei width, GLsizei height, GLsizei depth=1);
+std::vector<glm::vec4> loadDataFromCheckpoint(QString const& name);
+
+void removeCheckpoints();
+
+#endif
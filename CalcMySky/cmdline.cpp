@@ -171,7 +171,15 @@ void handleCmdLine()
     const QCommandLineOption printOpenGLInfoAndQuit("opengl-info","Print OpenGL info and quit");
     const QCommandLineOption textureOutputDirOpt("out-dir","Directory for the textures computed","output directory",".");
     const QCommandLineOption saveResultAsRadianceOpt("radiance","Save result as radiance instead of XYZW components");
+    const QCommandLineOption resumeOpt("resume","Continue an interrupted computation from the checkpoint saved in the output directory");
+    const QCommandLineOption wavelengthSetsOpt("wlsets","Only compute the given range of wavelength sets, e.g. 0-3 (requires --radiance). "
+                                                        "Results of several such runs can be combined with --merge-shard option.","first-last");
+    const QCommandLineOption mergeShardOpt("merge-shard","Instead of computing, take radiance textures from the output directory of a run with --radiance "
+                                                         "and accumulate them into the final luminance model. Repeat this option for each shard.","shard directory");
+    const QCommandLineOption reuseFromOpt("reuse-from","Take the textures whose inputs haven't changed from a previous output directory instead of recomputing them","previous output directory");
+    const QCommandLineOption cpuTransmittanceOpt("cpu-transmittance","Compute transmittance and direct ground irradiance on CPU instead of GPU");
     const QCommandLineOption textureSavePrecisionOpt("texture-save-precision","Number of bits of precision when saving 3D textures, from 1 to 24. Smaller number improves compressibility. Too small destroys fidelity.","bits");
+    const QCommandLineOption halfFloatOpt("half-float","Save 3D textures as 16-bit floating-point numbers. This halves their size on disk and in video memory at the cost of precision.");
     const QCommandLineOption dbgNoSaveTexturesOpt("no-save-tex","Don't save textures, only save shaders and other fast-to-compute data; don't run the long 4D "
                                                                 "textures computations (for debugging)");
     const QCommandLineOption dbgNoEDSTexturesOpt("no-eds-tex","Don't compute/save eclipsed double scattering textures (for debugging)");
@@ -186,7 +194,13 @@ void handleCmdLine()
                         versionOpt,
                         textureOutputDirOpt,
                         saveResultAsRadianceOpt,
+                        resumeOpt,
+                        reuseFromOpt,
+                        wavelengthSetsOpt,
+                        mergeShardOpt,
+                        cpuTransmittanceOpt,
                         textureSavePrecisionOpt,
+                        halfFloatOpt,
                         dbgNoEDSTexturesOpt,
                         dbgNoSaveTexturesOpt,
                         printOpenGLInfoAndQuit,
@@ -226,6 +240,65 @@ void handleCmdLine()
         opts.dbgNoEDSTextures=true;
     if(parser.isSet(saveResultAsRadianceOpt))
         opts.saveResultAsRadiance=true;
+    if(parser.isSet(cpuTransmittanceOpt))
+        opts.computeTransmittanceOnCPU=true;
+    if(parser.isSet(halfFloatOpt))
+        opts.saveHalfFloatTextures=true;
+    if(parser.isSet(resumeOpt))
+        opts.resume=true;
+    if(parser.isSet(reuseFromOpt))
+    {
+        opts.reuseFromDir=parser.value(reuseFromOpt).toStdString();
+        if(opts.reuseFromDir.length() && opts.reuseFromDir.back()=='/')
+            opts.reuseFromDir.pop_back();
+    }
+    for(auto dir : parser.values(mergeShardOpt))
+    {
+        if(dir.endsWith('/')) dir.chop(1);
+        opts.shardsToMerge.emplace_back(dir.toStdString());
+    }
+    if(!opts.shardsToMerge.empty())
+    {
+        if(opts.saveResultAsRadiance)
+        {
+            std::cerr << "Merging of shards produces luminance textures, so it can't be used with --radiance\n";
+            throw MustQuit{};
+        }
+        if(parser.isSet(reuseFromOpt))
+        {
+            std::cerr << "Merging of shards can't be combined with reuse of a previous output\n";
+            throw MustQuit{};
+        }
+        if(parser.isSet(wavelengthSetsOpt))
+        {
+            std::cerr << "Merging of shards must be done for all wavelength sets at once\n";
+            throw MustQuit{};
+        }
+    }
+    std::optional<std::pair<unsigned,unsigned>> wavelengthSets;
+    if(parser.isSet(wavelengthSetsOpt))
+    {
+        if(!opts.saveResultAsRadiance)
+        {
+            std::cerr << "Computing a subset of wavelength sets is only supported in radiance mode\n";
+            throw MustQuit{};
+        }
+        const auto value=parser.value(wavelengthSetsOpt);
+        const auto match=QRegularExpression("^([0-9]+)(?:-([0-9]+))?$").match(value);
+        if(!match.hasMatch())
+        {
+            std::cerr << "Failed to parse range of wavelength sets \"" << value << "\"\n";
+            throw MustQuit{};
+        }
+        const auto first=match.captured(1).toUInt();
+        const auto last=match.captured(2).isEmpty() ? first : match.captured(2).toUInt();
+        if(last<first)
+        {
+            std::cerr << "Bad range of wavelength sets: last one is less than the first one\n";
+            throw MustQuit{};
+        }
+        wavelengthSets={first, last};
+    }
     if(parser.isSet(dbgSaveGroundIrradianceOpt))
         opts.dbgSaveGroundIrradiance=true;
     if(parser.isSet(dbgSaveScatDensityOrder2FromGroundOpt))
@@ -270,6 +343,24 @@ void handleCmdLine()
     {
         const auto atmoDescrFileName=posArgs[0];
         atmo.parse(atmoDescrFileName, AtmosphereParameters::ForceNoEDSTextures{opts.dbgNoEDSTextures});
+        // The renderer doesn't check the function bodies: it uses the shaders compiled from them here
+        atmo.checkGLSLFunctionBodies(atmoDescrFileName);
+        if(wavelengthSets)
+        {
+            if(wavelengthSets->second >= atmo.allWavelengths.size())
+            {
+                std::cerr << "Wavelength set " << wavelengthSets->second << " is out of range: there are only "
+                          << atmo.allWavelengths.size() << " sets, numbered from 0\n";
+                throw MustQuit{};
+            }
+            opts.firstWavelengthSet=wavelengthSets->first;
+            opts.lastWavelengthSet=wavelengthSets->second;
+        }
+        else
+        {
+            opts.firstWavelengthSet=0;
+            opts.lastWavelengthSet=atmo.allWavelengths.size()-1;
+        }
     }
     else if(!opts.printOpenGLInfoAndQuit)
     {
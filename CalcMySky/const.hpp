@@ -9,6 +9,7 @@ constexpr char PHASE_FUNCTIONS_SHADER_FILENAME[]="phase-functions.frag";
 constexpr char TOTAL_SCATTERING_COEFFICIENT_SHADER_FILENAME[]="total-scattering-coefficient.frag";
 constexpr char COMPUTE_TRANSMITTANCE_SHADER_FILENAME[]="compute-transmittance-functions.frag";
 constexpr char CONSTANTS_HEADER_FILENAME[]="const.h.glsl";
+constexpr char WAVELENGTH_SET_CONSTANTS_HEADER_FILENAME[]="wavelength-set-constants.h.glsl";
 constexpr char DENSITIES_HEADER_FILENAME[]="densities.h.glsl";
 constexpr char GLSL_EXTENSIONS_HEADER_FILENAME[]="version.h.glsl";
 constexpr char RADIANCE_TO_LUMINANCE_HEADER_FILENAME[]="radiance-to-luminance.h.glsl";
@@ -19,5 +20,14 @@ constexpr char COMPUTE_ECLIPSED_DOUBLE_SCATTERING_FILENAME[]="compute-eclipsed-d
 constexpr char SINGLE_SCATTERING_ECLIPSED_FILENAME[]="single-scattering-eclipsed.frag";
 constexpr char DOUBLE_SCATTERING_ECLIPSED_FILENAME[]="double-scattering-eclipsed.frag";
 constexpr char COMPUTE_INDIRECT_IRRADIANCE_FILENAME[]="compute-indirect-irradiance.frag";
+constexpr char TABULATE_NUMBER_DENSITY_FILENAME[]="tabulate-number-density.frag";
+constexpr char MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS_FILENAME[]="multiple-scattering-all-wavelength-sets.frag";
+constexpr char MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS_HEADER_FILENAME[]="multiple-scattering-all-wavelength-sets.h.glsl";
+constexpr char ZERO_ORDER_SCATTERING_ALL_WAVELENGTH_SETS_FILENAME[]="zero-order-scattering-all-wavelength-sets.frag";
+constexpr char ZERO_ORDER_SCATTERING_ALL_WAVELENGTH_SETS_HEADER_FILENAME[]="zero-order-scattering-all-wavelength-sets.h.glsl";
+// OpenGL 3.3 guarantees 16 texture image units for a fragment shader, and each wavelength set needs two of them: for
+// the lower and the upper altitude slices of multiple scattering, or for transmittance and irradiance of zero-order
+// scattering
+constexpr unsigned MAX_WAVELENGTH_SETS_RENDERED_AT_ONCE=8;
 
 #endif
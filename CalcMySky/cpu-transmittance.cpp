@@ -0,0 +1,191 @@
+#include "cpu-transmittance.hpp"
+#include <cmath>
+#include <algorithm>
+#include "../common/parallel.hpp"
+
+namespace
+{
+
+// The functions below are kept close to their GLSL counterparts, including the use of single precision,
+// so that the results match the GPU ones as much as possible.
+
+float sqr(const float x) { return x*x; }
+
+float safeSqrt(const float x)
+{
+    return std::sqrt(std::max(x,0.f));
+}
+
+float clampDistance(const float d)
+{
+    return std::max(d, 0.f);
+}
+
+float texCoordToUnitRange(const float texCoord, const float texSize)
+{
+    return (texSize*texCoord-0.5f)/(texSize-1);
+}
+
+float unitRangeToTexCoord(const float u, const float texSize)
+{
+    return (0.5f+(texSize-1)*u)/texSize;
+}
+
+// Texture coordinate of the center of the texel, as it's seen by the fragment shader rendering a full-viewport quad
+float texelCenterTexCoord(const int index, const int texSize)
+{
+    return (index+0.5f)/texSize;
+}
+
+class Geometry
+{
+    const float earthRadius;
+    const float atmosphereHeight;
+    const float lengthOfHorizRayFromGroundToTOA;
+public:
+    Geometry(CPUTransmittanceParameters const& params)
+        : earthRadius(params.earthRadius)
+        , atmosphereHeight(params.atmosphereHeight)
+        , lengthOfHorizRayFromGroundToTOA(std::sqrt(atmosphereHeight*(atmosphereHeight+2*earthRadius)))
+    {
+    }
+
+    float distanceToAtmosphereBorder(const float cosZenithAngle, const float observerAltitude) const
+    {
+        const float Robs=earthRadius+observerAltitude;
+        const float Ratm=earthRadius+atmosphereHeight;
+        const float discriminant=sqr(Ratm)-sqr(Robs)*(1-sqr(cosZenithAngle));
+        return clampDistance(safeSqrt(discriminant)-Robs*cosZenithAngle);
+    }
+
+    // Output: (cosViewZenithAngle, altitude)
+    glm::vec2 transmittanceTexCoordToTexVars(const glm::vec2 texCoord, const glm::vec2 texSize) const
+    {
+        const float distToHorizon=lengthOfHorizRayFromGroundToTOA * texCoordToUnitRange(texCoord.t,texSize.t);
+        // Distance from Earth center to camera
+        const float r=std::sqrt(sqr(distToHorizon)+sqr(earthRadius));
+        const float altitude=r-earthRadius;
+
+        const float dMin=atmosphereHeight-altitude; // distance to zenith
+        const float dMax=lengthOfHorizRayFromGroundToTOA+distToHorizon;
+        // distance to border of visible atmosphere from the view point
+        const float d=dMin+(dMax-dMin)*texCoordToUnitRange(texCoord.s,texSize.s);
+        // d==0 can happen when altitude==atmosphereHeight
+        const float cosVZA = d==0 ? 1 : (2*r*dMin+sqr(dMin)-sqr(d))/(2*r*d);
+        return {cosVZA,altitude};
+    }
+
+    glm::vec2 transmittanceTexVarsToTexCoord(const float cosVZA, float altitude, const glm::vec2 texSize) const
+    {
+        if(altitude<0)
+            altitude=0;
+
+        const float distToHorizon=std::sqrt(sqr(altitude)+2*altitude*earthRadius);
+        const float t=unitRangeToTexCoord(distToHorizon / lengthOfHorizRayFromGroundToTOA, texSize.t);
+        const float dMin=atmosphereHeight-altitude; // distance to zenith
+        const float dMax=lengthOfHorizRayFromGroundToTOA+distToHorizon;
+        const float d=distanceToAtmosphereBorder(cosVZA,altitude);
+        const float s=unitRangeToTexCoord((d-dMin)/(dMax-dMin), texSize.s);
+        return {s,t};
+    }
+
+    // Output: (cosSunZenithAngle, altitude)
+    glm::vec2 irradianceTexCoordToTexVars(const glm::vec2 texCoord, const glm::vec2 texSize) const
+    {
+        const float cosSZA=2*texCoordToUnitRange(texCoord.s, texSize.s)-1;
+        const float alt=atmosphereHeight*texCoordToUnitRange(texCoord.t, texSize.t);
+        return {cosSZA,alt};
+    }
+};
+
+// Equivalent of GL_LINEAR filtering with GL_CLAMP_TO_EDGE wrapping. Note that GPUs use reduced precision for
+// the interpolation weights, so the results may differ slightly from those of texture() in GLSL.
+glm::vec4 sampleTexture(std::vector<glm::vec4> const& texture, const int width, const int height, const glm::vec2 texCoord)
+{
+    const float x=texCoord.s*width-0.5f, y=texCoord.t*height-0.5f;
+    const float xFloor=std::floor(x), yFloor=std::floor(y);
+    const float alphaX=x-xFloor, alphaY=y-yFloor;
+    const int x0=std::clamp(int(xFloor),0,width-1), x1=std::clamp(int(xFloor)+1,0,width-1);
+    const int y0=std::clamp(int(yFloor),0,height-1), y1=std::clamp(int(yFloor)+1,0,height-1);
+    const auto lower=texture[y0*width+x0]*(1-alphaX) + texture[y0*width+x1]*alphaX;
+    const auto upper=texture[y1*width+x0]*(1-alphaX) + texture[y1*width+x1]*alphaX;
+    return lower*(1-alphaY) + upper*alphaY;
+}
+
+}
+
+std::vector<glm::vec4> computeTransmittanceOnCPU(CPUTransmittanceParameters const& params,
+                                                 std::vector<AbsorbingSpecies> const& species)
+{
+    const Geometry geom(params);
+    const int width=params.transmittanceTexW, height=params.transmittanceTexH;
+    const glm::vec2 texSize(width, height);
+    const int numPoints=params.numTransmittanceIntegrationPoints;
+    const float R=params.earthRadius;
+
+    std::vector<glm::vec4> texels(size_t(width)*height);
+    forEachInParallel(height, [&](const int row, int)
+    {
+        for(int col=0; col<width; ++col)
+        {
+            const glm::vec2 texCoord(texelCenterTexCoord(col,width), texelCenterTexCoord(row,height));
+            const auto vars=geom.transmittanceTexCoordToTexVars(texCoord, texSize);
+            const float mu=vars[0], altitude=vars[1];
+
+            const float integrInterval=geom.distanceToAtmosphereBorder(mu, altitude);
+            const float r1=R+altitude;
+            // Using midpoint rule for quadrature
+            const float dl=integrInterval/numPoints;
+            // Number densities don't depend on wavelength, so the quadrature is done in scalars, and only the
+            // final weighting by cross sections works on all four wavelengths at once.
+            glm::vec4 depth(0);
+            for(auto const& s : species)
+            {
+                float sum=0;
+                for(int n=0;n<numPoints;++n)
+                {
+                    const float dist=(n+0.5f)*dl;
+                    /* From law of cosines: r₂²=r₁²+l²+2r₁lμ */
+                    const float currAlt=-R+safeSqrt(sqr(r1)+sqr(dist)+2*r1*dist*mu);
+                    sum+=s.numberDensity(currAlt);
+                }
+                depth += sum*dl*s.crossSection;
+            }
+            texels[size_t(row)*width+col]=depth;
+        }
+    });
+    return texels;
+}
+
+std::vector<glm::vec4> computeDirectGroundIrradianceOnCPU(CPUTransmittanceParameters const& params,
+                                                          std::vector<glm::vec4> const& transmittanceTexture,
+                                                          glm::vec4 const& solarIrradianceAtTOA)
+{
+    const Geometry geom(params);
+    const int width=params.irradianceTexW, height=params.irradianceTexH;
+    const glm::vec2 texSize(width, height);
+    const glm::vec2 transmittanceTexSize(params.transmittanceTexW, params.transmittanceTexH);
+    const float sunAngularRadius=params.sunAngularRadius;
+
+    std::vector<glm::vec4> texels(size_t(width)*height);
+    forEachInParallel(height, [&](const int row, int)
+    {
+        for(int col=0; col<width; ++col)
+        {
+            const glm::vec2 texCoord(texelCenterTexCoord(col,width), texelCenterTexCoord(row,height));
+            const auto vars=geom.irradianceTexCoordToTexVars(texCoord, texSize);
+            const float cosSunZenithAngle=vars[0], altitude=vars[1];
+
+            // See compute-direct-irradiance.frag for the approximations used here
+            const float averageCosFactor = cosSunZenithAngle < -sunAngularRadius ? 0
+                                              : cosSunZenithAngle > sunAngularRadius ? cosSunZenithAngle
+                                              : sqr(cosSunZenithAngle+sunAngularRadius)/(4*sunAngularRadius);
+            const auto transmittanceTexCoord=geom.transmittanceTexVarsToTexCoord(cosSunZenithAngle, altitude,
+                                                                                 transmittanceTexSize);
+            const auto opticalDepth=sampleTexture(transmittanceTexture, params.transmittanceTexW,
+                                                  params.transmittanceTexH, transmittanceTexCoord);
+            texels[size_t(row)*width+col] = solarIrradianceAtTOA * glm::exp(-opticalDepth) * averageCosFactor;
+        }
+    });
+    return texels;
+}
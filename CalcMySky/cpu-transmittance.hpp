@@ -0,0 +1,45 @@
+#ifndef INCLUDE_ONCE_6F0D3B52_1C8E_4A97_9E64_B2A75C10D8E3
+#define INCLUDE_ONCE_6F0D3B52_1C8E_4A97_9E64_B2A75C10D8E3
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+/* CPU implementation of transmittance and direct ground irradiance computation.
+ *
+ * This mirrors compute-transmittance.frag (with the functions generated by makeTransmittanceComputeFunctionsSrc())
+ * and compute-direct-irradiance.frag, using the same texture parametrization and the same midpoint quadrature, so
+ * the results can be used in place of the GPU ones, or as a reference to check the GPU output against.
+ *
+ * The code here deliberately doesn't depend on the global state of CalcMySky, so that it can be tested separately.
+ */
+
+struct CPUTransmittanceParameters
+{
+    float earthRadius;
+    float atmosphereHeight;
+    float sunAngularRadius;
+    int transmittanceTexW, transmittanceTexH;
+    int irradianceTexW, irradianceTexH;
+    int numTransmittanceIntegrationPoints;
+};
+
+struct AbsorbingSpecies
+{
+    std::function<float(float)> numberDensity; //!< Takes altitude in meters, returns number density in m^-3
+    glm::vec4 crossSection;                    //!< Extinction cross section for scatterers, absorption one for absorbers
+};
+
+/* Returns the texels of transmittance texture, row by row, starting from the lowest altitude. Like in the GPU
+ * version, the values are optical depths to the atmosphere border rather than transmittances.
+ */
+std::vector<glm::vec4> computeTransmittanceOnCPU(CPUTransmittanceParameters const& params,
+                                                 std::vector<AbsorbingSpecies> const& species);
+/* Returns the texels of direct ground irradiance texture, row by row, starting from the lowest altitude.
+ * Transmittance is sampled from the texture returned by computeTransmittanceOnCPU() with bilinear filtering.
+ */
+std::vector<glm::vec4> computeDirectGroundIrradianceOnCPU(CPUTransmittanceParameters const& params,
+                                                          std::vector<glm::vec4> const& transmittanceTexture,
+                                                          glm::vec4 const& solarIrradianceAtTOA);
+
+#endif
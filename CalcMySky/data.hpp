@@ -38,7 +38,6 @@ enum TextureId
     TEX_DELTA_SCATTERING,
     TEX_MULTIPLE_SCATTERING,
     TEX_DELTA_SCATTERING_DENSITY,
-    TEX_ECLIPSED_DOUBLE_SCATTERING,
     TEX_LIGHT_POLLUTION_SCATTERING,
     TEX_LIGHT_POLLUTION_DELTA_SCATTERING,
     TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE,
@@ -53,10 +52,17 @@ inline std::map<QString/*scatterer name*/, GLuint> accumulatedSingleScatteringTe
 struct Options
 {
     unsigned textureSavePrecision = 0; // 0 means not reduced
+    bool saveHalfFloatTextures=false;
     bool openglDebug=false;
     bool openglDebugFull=false;
     bool printOpenGLInfoAndQuit=false;
     bool saveResultAsRadiance=false;
+    bool resume=false;
+    std::string reuseFromDir; // empty means no reuse
+    // Range of wavelength sets to compute, inclusive
+    unsigned firstWavelengthSet=0, lastWavelengthSet=0;
+    std::vector<std::string> shardsToMerge;
+    bool computeTransmittanceOnCPU=false;
     bool dbgNoSaveTextures=false;
     bool dbgNoEDSTextures=false;
     bool dbgSaveGroundIrradiance=false;
@@ -0,0 +1,410 @@
+#include "dependencies.hpp"
+
+#include <map>
+#include <cassert>
+#include <iostream>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QFile>
+
+#include "config.h"
+#include "data.hpp"
+#include "util.hpp"
+
+namespace
+{
+
+constexpr char FINGERPRINTS_FILE_NAME[]="input-fingerprints";
+constexpr char FINGERPRINTS_HEADER[]="# CalcMySky input fingerprints. Don't edit.";
+constexpr char WAVELENGTH_SETS_KEY[]="wavelength-sets";
+
+constexpr ModelProduct allProducts[]={ModelProduct::Transmittance, ModelProduct::Scattering,
+                                      ModelProduct::LightPollution, ModelProduct::EclipsedDoubleScattering};
+
+// Indexed as previousFingerprints[{product name, texIndex}]
+std::map<std::pair<QString,unsigned>, QByteArray> previousFingerprints;
+unsigned previousWavelengthSetCount=0;
+std::map<std::pair<ModelProduct,unsigned>, bool> reusabilityCache;
+
+std::string fingerprintsPath(std::string const& dir)
+{
+    return dir+"/"+FINGERPRINTS_FILE_NAME;
+}
+
+QString inputValue(const ModelInput input, const unsigned texIndex)
+{
+    const auto& wavelengths=atmo.allWavelengths[texIndex];
+    QString value;
+    switch(input)
+    {
+    case ModelInput::Geometry:
+        return toString(atmo.earthRadius)+" "+toString(atmo.atmosphereHeight);
+    case ModelInput::Wavelengths:
+        return toString(wavelengths);
+    case ModelInput::ScattererDensities:
+        for(const auto& scatterer : atmo.scatterers)
+            value += scatterer.name+":\n"+scatterer.numberDensity+"\n";
+        return value;
+    case ModelInput::ScatteringCrossSections:
+        for(const auto& scatterer : atmo.scatterers)
+            value += scatterer.name+": "+toString(scatterer.scatteringCrossSection(wavelengths))+"\n";
+        return value;
+    case ModelInput::ExtinctionCrossSections:
+        for(const auto& scatterer : atmo.scatterers)
+            value += scatterer.name+": "+toString(scatterer.extinctionCrossSection(wavelengths))+"\n";
+        return value;
+    case ModelInput::PhaseFunctions:
+        for(const auto& scatterer : atmo.scatterers)
+            value += scatterer.name+" "+toString(int(scatterer.phaseFunctionType))+":\n"+scatterer.phaseFunction+"\n";
+        return value;
+    case ModelInput::AbsorberDensities:
+        for(const auto& absorber : atmo.absorbers)
+            value += absorber.name+":\n"+absorber.numberDensity+"\n";
+        return value;
+    case ModelInput::AbsorptionCrossSections:
+        for(const auto& absorber : atmo.absorbers)
+            value += absorber.name+": "+toString(absorber.crossSection(wavelengths))+"\n";
+        return value;
+    case ModelInput::GroundAlbedo:
+        return toString(atmo.groundAlbedo[texIndex]);
+    case ModelInput::SolarIrradiance:
+        return toString(atmo.solarIrradianceAtTOA[texIndex])+" "+toString(atmo.sunAngularRadius);
+    case ModelInput::LightPollutionRadiance:
+        return toString(atmo.lightPollutionRelativeRadiance[texIndex]);
+    case ModelInput::MoonOrbit:
+        return toString(atmo.earthMoonDistance);
+    case ModelInput::InterpolationGuides:
+        for(const auto& scatterer : atmo.scatterers)
+            value += scatterer.name+": "+toString(int(scatterer.needsInterpolationGuides))+"\n";
+        return value;
+    case ModelInput::ScatteringOrders:
+        return QString::number(atmo.scatteringOrdersToCompute);
+    case ModelInput::TransmittanceTextureSize:
+        return toString(atmo.transmittanceTexW)+"x"+toString(atmo.transmittanceTexH);
+    case ModelInput::IrradianceTextureSize:
+        return toString(atmo.irradianceTexW)+"x"+toString(atmo.irradianceTexH);
+    case ModelInput::ScatteringTextureSize:
+    {
+        const auto& size=atmo.scatteringTextureSize;
+        return QString("%1x%2x%3x%4").arg(size[0]).arg(size[1]).arg(size[2]).arg(size[3]);
+    }
+    case ModelInput::LightPollutionTextureSize:
+    {
+        const auto& size=atmo.lightPollutionTextureSize;
+        return QString("%1x%2").arg(size[0]).arg(size[1]);
+    }
+    case ModelInput::EclipsedSingleScatteringTextureSize:
+    {
+        const auto& size=atmo.eclipsedSingleScatteringTextureSize;
+        return QString("%1x%2").arg(size[0]).arg(size[1]);
+    }
+    case ModelInput::EclipsedDoubleScatteringSampling:
+    {
+        const auto& size=atmo.eclipsedDoubleScatteringTextureSize;
+        return QString("%1x%2x%3x%4 azimuth pairs: %5, elevation pairs: %6")
+                    .arg(size[0]).arg(size[1]).arg(size[2]).arg(size[3])
+                    .arg(atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample)
+                    .arg(atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample);
+    }
+    case ModelInput::TransmittanceIntegrationPoints:
+        return toString(atmo.numTransmittanceIntegrationPoints);
+    case ModelInput::RadialIntegrationPoints:
+        return toString(atmo.radialIntegrationPoints);
+    case ModelInput::AngularIntegrationPoints:
+        return toString(atmo.angularIntegrationPoints);
+    case ModelInput::LightPollutionAngularIntegrationPoints:
+        return toString(atmo.lightPollutionAngularIntegrationPoints);
+    case ModelInput::EclipseAngularIntegrationPoints:
+        return toString(atmo.eclipseAngularIntegrationPoints);
+    }
+    assert(!"Unknown model input");
+    return {};
+}
+
+std::string wlsetSuffix(const unsigned texIndex)
+{
+    return "-wlset"+std::to_string(texIndex)+".f32";
+}
+
+// Returns paths relative to output directory
+std::vector<std::string> productOutputFiles(const ModelProduct product, const unsigned texIndex)
+{
+    const bool lastWavelengthSet = texIndex+1==atmo.allWavelengths.size();
+    std::vector<std::string> files;
+    switch(product)
+    {
+    case ModelProduct::Transmittance:
+        files.emplace_back("transmittance"+wlsetSuffix(texIndex));
+        break;
+    case ModelProduct::Scattering:
+    {
+        files.emplace_back("irradiance"+wlsetSuffix(texIndex));
+        if(atmo.scatteringOrdersToCompute>=2)
+        {
+            if(opts.saveResultAsRadiance)
+                files.emplace_back("multiple-scattering"+wlsetSuffix(texIndex));
+            else if(lastWavelengthSet)
+                files.emplace_back("multiple-scattering-xyzw.f32");
+        }
+        for(const auto& scatterer : atmo.scatterers)
+        {
+            std::string pathBase;
+            if(scatterer.phaseFunctionType==PhaseFunctionType::General)
+                pathBase="single-scattering/"+std::to_string(texIndex)+"/"+scatterer.name.toStdString();
+            else if(lastWavelengthSet)
+                pathBase="single-scattering/"+scatterer.name.toStdString()+"-xyzw";
+            else
+                continue;
+            files.emplace_back(pathBase+".f32");
+            if(scatterer.needsInterpolationGuides)
+            {
+                files.emplace_back(pathBase+"-dims01.guides2d");
+                files.emplace_back(pathBase+"-dims02.guides2d");
+            }
+        }
+        break;
+    }
+    case ModelProduct::LightPollution:
+        if(opts.saveResultAsRadiance)
+            files.emplace_back("light-pollution"+wlsetSuffix(texIndex));
+        else if(lastWavelengthSet)
+            files.emplace_back("light-pollution-xyzw.f32");
+        break;
+    case ModelProduct::EclipsedDoubleScattering:
+        if(opts.dbgNoEDSTextures)
+            break;
+        if(opts.saveResultAsRadiance)
+            files.emplace_back("eclipsed-double-scattering"+wlsetSuffix(texIndex));
+        else if(lastWavelengthSet)
+            files.emplace_back("eclipsed-double-scattering-xyzw.f32");
+        break;
+    }
+    return files;
+}
+
+// In luminance mode all the wavelength sets are accumulated into the same textures
+bool productIsAccumulated(const ModelProduct product)
+{
+    return product!=ModelProduct::Transmittance && !opts.saveResultAsRadiance;
+}
+
+bool outputIsInPlace()
+{
+    return QFileInfo(QString::fromStdString(opts.reuseFromDir)).canonicalFilePath() ==
+           QFileInfo(QString::fromStdString(atmo.textureOutputDir)).canonicalFilePath();
+}
+
+bool fingerprintMatches(const ModelProduct product, const unsigned texIndex)
+{
+    const auto it=previousFingerprints.find({productName(product), texIndex});
+    return it!=previousFingerprints.end() && it->second==productFingerprint(product, texIndex);
+}
+
+bool previousOutputHasFiles(const ModelProduct product, const unsigned texIndex)
+{
+    for(const auto& file : productOutputFiles(product, texIndex))
+        if(!QFile::exists(QString::fromStdString(opts.reuseFromDir+"/"+file)))
+            return false;
+    return true;
+}
+
+bool checkReusability(const ModelProduct product, const unsigned texIndex)
+{
+    if(!productIsAccumulated(product))
+        return fingerprintMatches(product, texIndex) && previousOutputHasFiles(product, texIndex);
+
+    if(previousWavelengthSetCount!=atmo.allWavelengths.size())
+        return false;
+    for(unsigned i=0; i<atmo.allWavelengths.size(); ++i)
+    {
+        if(!fingerprintMatches(product, i) || !previousOutputHasFiles(product, i))
+            return false;
+    }
+    return true;
+}
+
+void readPreviousFingerprints()
+{
+    const auto path=fingerprintsPath(opts.reuseFromDir);
+    QFile file(QString::fromStdString(path));
+    if(!file.exists())
+    {
+        std::cerr << "No input fingerprints found in \"" << opts.reuseFromDir << "\", everything will be recomputed\n";
+        return;
+    }
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto badFile=[&path](int lineNumber, QString const& message)
+    {
+        std::cerr << path << ":" << lineNumber << ": " << message << "\n";
+        throw MustQuit{};
+    };
+
+    QTextStream in(&file);
+    for(int lineNumber=1; !in.atEnd(); ++lineNumber)
+    {
+        const auto line=in.readLine();
+        if(line.startsWith('#') || line.trimmed().isEmpty())
+            continue;
+        if(line.startsWith(QString(WAVELENGTH_SETS_KEY)+":"))
+        {
+            bool ok=false;
+            previousWavelengthSetCount=line.mid(sizeof WAVELENGTH_SETS_KEY).trimmed().toUInt(&ok);
+            if(!ok)
+                badFile(lineNumber, "failed to parse number of wavelength sets");
+            continue;
+        }
+        const auto fields=line.split(' ');
+        bool ok=false;
+        const auto texIndex = fields.size()==3 ? fields[1].toUInt(&ok) : 0;
+        if(!ok)
+            badFile(lineNumber, "bad line format");
+        previousFingerprints[{fields[0], texIndex}]=fields[2].toLatin1();
+    }
+}
+
+}
+
+QString computationSettings()
+{
+    return QString("version=%1 format=%2 radiance=%3 no-eds-tex=%4 precision=%5 half-float=%6 cpu-transmittance=%7")
+                .arg(PROJECT_VERSION)
+                .arg(AtmosphereParameters::FORMAT_VERSION)
+                .arg(int(opts.saveResultAsRadiance))
+                .arg(int(opts.dbgNoEDSTextures))
+                .arg(opts.textureSavePrecision)
+                .arg(int(opts.saveHalfFloatTextures))
+                .arg(int(opts.computeTransmittanceOnCPU));
+}
+
+QString productName(const ModelProduct product)
+{
+    switch(product)
+    {
+    case ModelProduct::Transmittance:            return "transmittance";
+    case ModelProduct::Scattering:               return "scattering";
+    case ModelProduct::LightPollution:           return "light-pollution";
+    case ModelProduct::EclipsedDoubleScattering: return "eclipsed-double-scattering";
+    }
+    assert(!"Unknown model product");
+    return {};
+}
+
+ProductDependencies dependenciesOf(const ModelProduct product)
+{
+    using In=ModelInput;
+    switch(product)
+    {
+    case ModelProduct::Transmittance:
+        return {{},
+                {In::Geometry, In::Wavelengths, In::ScattererDensities, In::ExtinctionCrossSections,
+                 In::AbsorberDensities, In::AbsorptionCrossSections,
+                 In::TransmittanceTextureSize, In::TransmittanceIntegrationPoints}};
+    case ModelProduct::Scattering:
+        return {{ModelProduct::Transmittance},
+                {In::Geometry, In::Wavelengths, In::ScattererDensities, In::ScatteringCrossSections,
+                 In::PhaseFunctions, In::GroundAlbedo, In::SolarIrradiance, In::InterpolationGuides,
+                 In::ScatteringOrders, In::IrradianceTextureSize, In::ScatteringTextureSize,
+                 In::RadialIntegrationPoints, In::AngularIntegrationPoints}};
+    case ModelProduct::LightPollution:
+        return {{ModelProduct::Transmittance},
+                {In::Geometry, In::Wavelengths, In::ScattererDensities, In::ScatteringCrossSections,
+                 In::PhaseFunctions, In::LightPollutionRadiance, In::ScatteringOrders,
+                 In::LightPollutionTextureSize, In::RadialIntegrationPoints,
+                 In::LightPollutionAngularIntegrationPoints}};
+    case ModelProduct::EclipsedDoubleScattering:
+        return {{ModelProduct::Transmittance},
+                {In::Geometry, In::Wavelengths, In::ScattererDensities, In::ScatteringCrossSections,
+                 In::PhaseFunctions, In::GroundAlbedo, In::SolarIrradiance, In::MoonOrbit,
+                 In::EclipsedSingleScatteringTextureSize, In::EclipsedDoubleScatteringSampling,
+                 In::RadialIntegrationPoints, In::EclipseAngularIntegrationPoints}};
+    }
+    assert(!"Unknown model product");
+    return {};
+}
+
+QByteArray productFingerprint(const ModelProduct product, const unsigned texIndex)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(computationSettings().toUtf8());
+    hash.addData(productName(product).toUtf8());
+    const auto dependencies=dependenciesOf(product);
+    for(const auto upstream : dependencies.upstreamProducts)
+        hash.addData(productFingerprint(upstream, texIndex));
+    for(const auto input : dependencies.inputs)
+    {
+        // Prefixing each value with the input id avoids ambiguity of concatenation
+        hash.addData(QString("\n%1: ").arg(int(input)).toUtf8());
+        hash.addData(inputValue(input, texIndex).toUtf8());
+    }
+    return hash.result().toHex();
+}
+
+void initIncrementalComputation()
+{
+    if(!opts.reuseFromDir.empty())
+    {
+        if(opts.dbgNoSaveTextures)
+            std::cerr << "Textures aren't going to be saved, so the previous output won't be used\n";
+        else
+            readPreviousFingerprints();
+    }
+    // Until the current computation is complete, the output directory doesn't match any fingerprints
+    QFile::remove(QString::fromStdString(fingerprintsPath(atmo.textureOutputDir)));
+}
+
+bool productIsReusable(const ModelProduct product, const unsigned texIndex)
+{
+    if(previousFingerprints.empty())
+        return false;
+    const auto it=reusabilityCache.find({product, texIndex});
+    if(it!=reusabilityCache.end())
+        return it->second;
+    const bool reusable=checkReusability(product, texIndex);
+    reusabilityCache[{product, texIndex}]=reusable;
+    return reusable;
+}
+
+void copyProductFromPreviousOutput(const ModelProduct product, const unsigned texIndex)
+{
+    assert(productIsReusable(product, texIndex));
+    std::cerr << indentOutput() << "Inputs of " << productName(product) << " haven't changed, reusing previous output\n";
+    if(outputIsInPlace()) return;
+
+    OutputIndentIncrease incr;
+    for(const auto& file : productOutputFiles(product, texIndex))
+        copyFile(opts.reuseFromDir+"/"+file, atmo.textureOutputDir+"/"+file);
+}
+
+void saveFingerprints()
+{
+    if(opts.dbgNoSaveTextures) return;
+
+    const auto path=fingerprintsPath(atmo.textureOutputDir);
+    std::cerr << "Saving input fingerprints to \"" << path << "\"... ";
+    QSaveFile file(QString::fromStdString(path));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "failed to open file: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream out(&file);
+    out << FINGERPRINTS_HEADER << "\n";
+    out << WAVELENGTH_SETS_KEY << ": " << atmo.allWavelengths.size() << "\n";
+    // Only the wavelength sets actually computed (see --wlsets option) are listed
+    for(const auto product : allProducts)
+        for(unsigned texIndex=opts.firstWavelengthSet; texIndex<=opts.lastWavelengthSet; ++texIndex)
+            out << productName(product) << " " << texIndex << " " << productFingerprint(product, texIndex) << "\n";
+    out.flush();
+    if(!file.commit())
+    {
+        std::cerr << "failed to write file: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
@@ -0,0 +1,82 @@
+#ifndef INCLUDE_ONCE_27DBF915_A6A9_48C2_83D8_70ECDF7C20B3
+#define INCLUDE_ONCE_27DBF915_A6A9_48C2_83D8_70ECDF7C20B3
+
+#include <string>
+#include <vector>
+#include <QString>
+#include <QByteArray>
+
+/* Dependencies of the computed data on the atmosphere description (see also doc/data-dependencies.dot.m4).
+ *
+ * The products here are the groups of output files that are computed together: e.g. single scattering can't be
+ * computed separately from multiple scattering, because the former is interleaved with scattering density and
+ * irradiance computation. Each product depends on a set of inputs, which are groups of AtmosphereParameters
+ * fields, and on upstream products. A product's fingerprint is a hash of its inputs for the given wavelength
+ * set, including the fingerprints of upstream products, so a change of any input of e.g. transmittance
+ * invalidates all the products computed from it.
+ *
+ * The fingerprints of the products computed are saved to the output directory. When the user passes a
+ * previous output directory (see --reuse-from option), the products whose fingerprints haven't changed are
+ * taken from there instead of being recomputed.
+ */
+
+enum class ModelInput
+{
+    Geometry,                    //!< Earth radius and atmosphere height
+    Wavelengths,
+    ScattererDensities,
+    ScatteringCrossSections,
+    ExtinctionCrossSections,     //!< Includes single scattering albedo
+    PhaseFunctions,              //!< Also phase function types, since they change the way the results are saved
+    AbsorberDensities,
+    AbsorptionCrossSections,
+    GroundAlbedo,
+    SolarIrradiance,             //!< Solar irradiance at TOA and angular radius of the Sun
+    LightPollutionRadiance,
+    MoonOrbit,                   //!< Earth-Moon distance
+    InterpolationGuides,         //!< Whether scatterers need interpolation guides
+    ScatteringOrders,
+    TransmittanceTextureSize,
+    IrradianceTextureSize,
+    ScatteringTextureSize,
+    LightPollutionTextureSize,
+    EclipsedSingleScatteringTextureSize,
+    EclipsedDoubleScatteringSampling, //!< Texture size and numbers of azimuth and elevation pairs to sample
+    TransmittanceIntegrationPoints,
+    RadialIntegrationPoints,
+    AngularIntegrationPoints,
+    LightPollutionAngularIntegrationPoints,
+    EclipseAngularIntegrationPoints,
+};
+
+enum class ModelProduct
+{
+    Transmittance,
+    Scattering,                  //!< Direct and indirect irradiance, single and multiple scattering
+    LightPollution,
+    EclipsedDoubleScattering,
+};
+
+struct ProductDependencies
+{
+    std::vector<ModelProduct> upstreamProducts;
+    std::vector<ModelInput> inputs;
+};
+
+// Options that affect the values of all the products. The fingerprints of the products include them.
+QString computationSettings();
+QString productName(ModelProduct product);
+ProductDependencies dependenciesOf(ModelProduct product);
+QByteArray productFingerprint(ModelProduct product, unsigned texIndex);
+
+// Reads fingerprints of the previous output, if it was requested to be reused
+void initIncrementalComputation();
+// Tells whether the product for the given wavelength set can be taken from the previous output. In
+// luminance mode this requires the product to be unchanged for all wavelength sets, since all of them
+// contribute to a single output file.
+bool productIsReusable(ModelProduct product, unsigned texIndex);
+// Copies the product's output files for the given wavelength set from the previous output directory
+void copyProductFromPreviousOutput(ModelProduct product, unsigned texIndex);
+void saveFingerprints();
+
+#endif
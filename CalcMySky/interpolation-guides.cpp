@@ -5,9 +5,9 @@
 #include <limits>
 #include <sstream>
 #include <iostream>
-#include <QFile>
 #include "util.hpp"
 #include "../common/util.hpp"
+#include "../common/TextureFile.hpp"
 
 /* Glossary:
  *  * Guide line — a line originating at the guide row and ending at a neighboring
@@ -409,21 +409,9 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
         std::cerr << indentOutput() << "Generating interpolation guides for VZA-dotViewSun dimensions... ";
 
         const auto outputFilePath = filePathQt.left(filePathQt.size() - ext.size()) + "-dims01.guides2d";
-        QFile out(outputFilePath);
-        if(!out.open(QFile::WriteOnly))
-        {
-            std::cerr << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
-        {
-            // Guides represent points between rows, so there's one less of them than rows.
-            uint16_t outputSizes[4] = {uint16_t(sizes[0]), uint16_t(sizes[1]-1), uint16_t(sizes[2]), uint16_t(sizes[3])};
-            if(out.write(reinterpret_cast<const char*>(outputSizes), sizeof outputSizes) != sizeof outputSizes)
-            {
-                std::cerr << "failed to write interpolation guides header: " << out.errorString().toStdString() << "\n";
-                throw MustQuit{};
-            }
-        }
+        // Guides represent points between rows, so there's one less of them than rows.
+        TextureFileWriter out(QString::fromUtf8(outputFilePath), TextureElementType::SNorm16, 1,
+                              {uint64_t(sizes[0]), uint64_t(sizes[1]-1), uint64_t(sizes[2]), uint64_t(sizes[3])});
 
         uint16_t rowStride = vzaPointCount, height = dVSLayerCount;
         std::vector<int16_t> angles(rowStride*(height-1));
@@ -443,7 +431,7 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
                 generateInterpolationGuides2D(&pixels[altSliceOffset + szaSubsliceOffset + aboveHorizonHalfSpaceOffset],
                                               aboveHorizonHalfSpaceSize, height, rowStride,
                                               angles.data()+aboveHorizonHalfSpaceOffset, altIndex, szaIndex, "SZA", true);
-                out.write(reinterpret_cast<const char*>(angles.data()), angles.size()*sizeof angles[0]);
+                out.write(angles.data(), angles.size()*sizeof angles[0]);
             }
 
             // Clear previous status and reset cursor position
@@ -454,12 +442,7 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
         std::cerr << "done\n";
         std::cerr << indentOutput() << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
 
-        out.close();
-        if(out.error())
-        {
-            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
+        out.finish();
         std::cerr << "done\n";
     }
     // Handle dimensions VZA-SZA
@@ -468,21 +451,9 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
         std::cerr << indentOutput() << "Generating interpolation guides for VZA-SZA dimensions... ";
 
         const auto outputFilePath = filePathQt.left(filePathQt.size() - ext.size()) + "-dims02.guides2d";
-        QFile out(outputFilePath);
-        if(!out.open(QFile::WriteOnly))
-        {
-            std::cerr << "failed to open interpolation guides file for writing: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
-        {
-            // Guides represent points between rows, so there's one less of them than rows.
-            uint16_t outputSizes[4] = {uint16_t(sizes[0]), uint16_t(sizes[1]), uint16_t(sizes[2]-1), uint16_t(sizes[3])};
-            if(out.write(reinterpret_cast<const char*>(outputSizes), sizeof outputSizes) != sizeof outputSizes)
-            {
-                std::cerr << "failed to write interpolation guides header: " << out.errorString().toStdString() << "\n";
-                throw MustQuit{};
-            }
-        }
+        // Guides represent points between rows, so there's one less of them than rows.
+        TextureFileWriter out(QString::fromUtf8(outputFilePath), TextureElementType::SNorm16, 1,
+                              {uint64_t(sizes[0]), uint64_t(sizes[1]), uint64_t(sizes[2]-1), uint64_t(sizes[3])});
 
         uint16_t rowStride = vzaPointCount*dVSLayerCount, height = szaLayerCount;
         std::vector<int16_t> angles(rowStride*(height-1));
@@ -504,7 +475,7 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
                                               angles.data() + dVSSubsliceOffset + aboveHorizonHalfSpaceOffset,
                                               altIndex, dVSIndex, "dotViewSun", false/*same rows, no need to recheck*/);
             }
-            out.write(reinterpret_cast<const char*>(angles.data()), angles.size()*sizeof angles[0]);
+            out.write(angles.data(), angles.size()*sizeof angles[0]);
 
             // Clear previous status and reset cursor position
             const auto statusWidth=ss.tellp();
@@ -514,12 +485,7 @@ void generateInterpolationGuidesForScatteringTexture(const std::string_view file
         std::cerr << "done\n";
         std::cerr << indentOutput() << "Saving interpolation guides to \"" << outputFilePath.toStdString() << "\"... ";
 
-        out.close();
-        if(out.error())
-        {
-            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
+        out.finish();
         std::cerr << "done\n";
     }
 }
@@ -8,6 +8,7 @@
 #include <chrono>
 #include <cmath>
 #include <map>
+#include <algorithm>
 #include <set>
 
 #include <QRegularExpression>
@@ -15,7 +16,10 @@
 #include <QSurfaceFormat>
 #include <QApplication>
 #include <QImage>
+#include <QDir>
 #include <QFile>
+#include <QSaveFile>
+#include <QCryptographicHash>
 
 #include "config.h"
 #include "data.hpp"
@@ -24,8 +28,14 @@
 #include "cmdline.hpp"
 #include "shaders.hpp"
 #include "interpolation-guides.hpp"
+#include "checkpoint.hpp"
+#include "dependencies.hpp"
+#include "shards.hpp"
+#include "cpu-transmittance.hpp"
+#include "../common/GLSLSnippet.hpp"
+#include "../common/TextureFile.hpp"
 #include "../common/EclipsedDoubleScatteringPrecomputer.hpp"
-#include "../common/TextureAverageComputer.hpp"
+#include "../common/TextureLayerSumComputer.hpp"
 #include "../common/timing.hpp"
 
 QOpenGLFunctions_3_3_Core gl;
@@ -98,8 +108,144 @@ void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view wha
     std::cerr << "done\n";
 }
 
+// Evaluates the number density function on a fine grid of altitudes, so that CPU code can interpolate it
+std::function<float(float)> tabulateNumberDensity(QString const& densityFunctionName)
+{
+    constexpr int tableWidth=1024, tableHeight=64;
+    constexpr int numSamples=tableWidth*tableHeight;
+    const float altitudeStep=atmo.atmosphereHeight/(numSamples-1);
+
+    virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeScattererDensityFunctionsSrc();
+    virtualSourceFiles[TABULATE_NUMBER_DENSITY_FILENAME]=makeNumberDensityTabulationSrc(densityFunctionName);
+    const auto program=compileShaderProgram(TABULATE_NUMBER_DENSITY_FILENAME, "number density tabulation shader program");
+
+    GLuint texture=0, fbo=0;
+    gl.glGenTextures(1, &texture);
+    gl.glBindTexture(GL_TEXTURE_2D, texture);
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,tableWidth,tableHeight,0,GL_RGBA,GL_FLOAT,nullptr);
+    gl.glGenFramebuffers(1, &fbo);
+    gl.glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,texture,0);
+    checkFramebufferStatus("framebuffer for number density tabulation");
+
+    program->bind();
+    program->setUniformValue("altitudeStep", altitudeStep);
+    program->setUniformValue("tableWidth", tableWidth);
+    gl.glViewport(0, 0, tableWidth, tableHeight);
+    renderQuad();
+
+    std::vector<glm::vec4> texels(numSamples);
+    gl.glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, texels.data());
+    gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
+    gl.glDeleteFramebuffers(1, &fbo);
+    gl.glDeleteTextures(1, &texture);
+    OPENGL_DEBUG_CHECK_ERROR("Failed to tabulate number density");
+
+    std::vector<float> table(numSamples);
+    for(int i=0; i<numSamples; ++i)
+        table[i]=texels[i][0];
+    return [table=std::move(table), altitudeStep](const float altitude)
+    {
+        const float position=std::clamp(altitude/altitudeStep, 0.f, float(table.size()-1));
+        const auto i=std::min(size_t(position), table.size()-2);
+        const float alpha=position-i;
+        return table[i]*(1-alpha)+table[i+1]*alpha;
+    };
+}
+
+// Compiles the density function for evaluation on CPU, falling back to its tabulation on GPU if it uses GLSL features
+// that GLSLSnippet doesn't support
+std::function<float(float)> numberDensityFunction(QString const& body, QString const& densityFunctionName,
+                                                  glm::vec4 const& wavelengths)
+{
+    try
+    {
+        const GLSLSnippet snippet(body.toStdString(), GLSLSnippet::Type::Float, "altitude", atmo.snippetConstants(wavelengths));
+        return [snippet](const float altitude){ return snippet.evaluate(altitude)[0]; };
+    }
+    catch(GLSLSnippet::Error const& error)
+    {
+        if(!error.unsupported)
+        {
+            std::cerr << "Failed to compile " << densityFunctionName << " for CPU: " << error.message << "\n";
+            throw MustQuit{};
+        }
+        std::cerr << indentOutput() << densityFunctionName << " can't be compiled for CPU (" << error.message
+                  << "), will tabulate it on GPU\n";
+        return tabulateNumberDensity(densityFunctionName);
+    }
+}
+
+CPUTransmittanceParameters cpuTransmittanceParameters()
+{
+    CPUTransmittanceParameters params;
+    params.earthRadius=atmo.earthRadius;
+    params.atmosphereHeight=atmo.atmosphereHeight;
+    params.sunAngularRadius=atmo.sunAngularRadius;
+    params.transmittanceTexW=atmo.transmittanceTexW;
+    params.transmittanceTexH=atmo.transmittanceTexH;
+    params.irradianceTexW=atmo.irradianceTexW;
+    params.irradianceTexH=atmo.irradianceTexH;
+    params.numTransmittanceIntegrationPoints=atmo.numTransmittanceIntegrationPoints;
+    return params;
+}
+
+void computeTransmittanceWithCPU(const unsigned texIndex)
+{
+    const auto& wavelengths=atmo.allWavelengths[texIndex];
+    std::vector<AbsorbingSpecies> species;
+    for(auto const& scatterer : atmo.scatterers)
+    {
+        species.push_back({numberDensityFunction(scatterer.numberDensity, "scattererNumberDensity_"+scatterer.name, wavelengths),
+                           scatterer.extinctionCrossSection(wavelengths)});
+    }
+    for(auto const& absorber : atmo.absorbers)
+    {
+        species.push_back({numberDensityFunction(absorber.numberDensity, "absorberNumberDensity_"+absorber.name, wavelengths),
+                           absorber.crossSection(wavelengths)});
+    }
+
+    std::cerr << indentOutput() << "Computing transmittance on CPU... ";
+    const auto texels=computeTransmittanceOnCPU(cpuTransmittanceParameters(), species);
+    gl.glBindTexture(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE]);
+    gl.glTexSubImage2D(GL_TEXTURE_2D,0,0,0,atmo.transmittanceTexW,atmo.transmittanceTexH,GL_RGBA,GL_FLOAT,texels.data());
+    std::cerr << "done\n";
+
+    saveTexture(GL_TEXTURE_2D,textures[TEX_TRANSMITTANCE],"transmittance texture",
+                atmo.textureOutputDir+"/transmittance-wlset"+std::to_string(texIndex)+".f32",
+                {atmo.transmittanceTexW, atmo.transmittanceTexH});
+}
+
+void computeDirectGroundIrradianceWithCPU(const unsigned texIndex)
+{
+    std::cerr << indentOutput() << "Computing direct ground irradiance on CPU... ";
+
+    // Transmittance may have been restored from a checkpoint or reused, so take it from the texture
+    std::vector<glm::vec4> transmittance(size_t(atmo.transmittanceTexW)*atmo.transmittanceTexH);
+    gl.glBindTexture(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE]);
+    gl.glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, transmittance.data());
+
+    const auto wlI=atmo.wavelengthsIndex(atmo.allWavelengths[texIndex]);
+    const auto texels=computeDirectGroundIrradianceOnCPU(cpuTransmittanceParameters(), transmittance,
+                                                         atmo.solarIrradianceAtTOA[wlI]);
+    for(const auto tex : {TEX_DELTA_IRRADIANCE, TEX_IRRADIANCE})
+    {
+        gl.glBindTexture(GL_TEXTURE_2D, textures[tex]);
+        gl.glTexSubImage2D(GL_TEXTURE_2D,0,0,0,atmo.irradianceTexW,atmo.irradianceTexH,GL_RGBA,GL_FLOAT,texels.data());
+    }
+    std::cerr << "done\n";
+
+    saveIrradiance(1,texIndex);
+}
+
 void computeTransmittance(const unsigned texIndex)
 {
+    if(opts.computeTransmittanceOnCPU)
+    {
+        computeTransmittanceWithCPU(texIndex);
+        return;
+    }
+
     const auto program=compileShaderProgram("compute-transmittance.frag", "transmittance computation shader program");
 
     std::cerr << indentOutput() << "Computing transmittance... ";
@@ -125,6 +271,12 @@ void computeTransmittance(const unsigned texIndex)
 
 void computeDirectGroundIrradiance(const unsigned texIndex)
 {
+    if(opts.computeTransmittanceOnCPU)
+    {
+        computeDirectGroundIrradianceWithCPU(texIndex);
+        return;
+    }
+
     const auto program=compileShaderProgram("compute-direct-irradiance.frag", "direct ground irradiance computation shader program");
 
     std::cerr << indentOutput() << "Computing direct ground irradiance... ";
@@ -152,6 +304,39 @@ void computeDirectGroundIrradiance(const unsigned texIndex)
 static constexpr char renderShaderFileName[]="render.frag";
 constexpr char viewDirFuncFileName[]="calc-view-dir.frag";
 constexpr char viewDirStubFunc[]="#version 330\nvec3 calcViewDir() { return vec3(0); }";
+
+void writeShaderFile(QString const& filePath, QByteArray const& data)
+{
+    std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
+    QSaveFile file(filePath);
+    if(!file.open(QFile::WriteOnly) || file.write(data)!=data.size() || !file.commit())
+    {
+        std::cerr << " failed: " << file.errorString().toStdString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
+
+// Each source is stored once in the shared directory under the name derived from its hash, so that the sources that
+// are the same for several wavelength sets, scatterers or programs take space only once, and the renderer can compile
+// them once. The directory of the program only gets the references to the stored sources.
+void saveShaderSources(std::vector<std::pair<QString, QString>> const& sourcesToSave, QString const& programDir)
+{
+    const auto sourcesDir=QString("%1/shaders/%2").arg(atmo.textureOutputDir.c_str()).arg(SHADER_SOURCES_DIR_NAME);
+    for(const auto& [filename, src] : sourcesToSave)
+    {
+        if(filename==viewDirFuncFileName) continue;
+
+        const auto data=src.toUtf8();
+        const auto storedName=QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex())+".frag";
+        if(const auto storedPath=sourcesDir+"/"+storedName; !QFile::exists(storedPath))
+            writeShaderFile(storedPath, data);
+        // A full copy of the source, left here by an older version, would be compiled along with the referenced one
+        QFile::remove(programDir+"/"+filename);
+        writeShaderFile(programDir+"/"+filename+SHADER_SOURCE_REFERENCE_SUFFIX, storedName.toUtf8());
+    }
+}
+
 void saveZeroOrderScatteringRenderingShader(const unsigned texIndex)
 {
     std::vector<std::pair<QString, QString>> sourcesToSave;
@@ -162,28 +347,8 @@ void saveZeroOrderScatteringRenderingShader(const unsigned texIndex)
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "zero-order scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath=QString("%1/shaders/zero-order-scattering/%2/%3")
-                                .arg(atmo.textureOutputDir.c_str()).arg(texIndex).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = QString("%1/shaders/zero-order-scattering/%2").arg(atmo.textureOutputDir.c_str()).arg(texIndex);
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 void saveEclipsedZeroOrderScatteringRenderingShader(const unsigned texIndex)
@@ -196,28 +361,8 @@ void saveEclipsedZeroOrderScatteringRenderingShader(const unsigned texIndex)
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "eclipsed zero-order scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath=QString("%1/shaders/eclipsed-zero-order-scattering/%2/%3")
-                                .arg(atmo.textureOutputDir.c_str()).arg(texIndex).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = QString("%1/shaders/eclipsed-zero-order-scattering/%2").arg(atmo.textureOutputDir.c_str()).arg(texIndex);
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 void saveMultipleScatteringRenderingShader(const unsigned texIndex)
@@ -230,28 +375,56 @@ void saveMultipleScatteringRenderingShader(const unsigned texIndex)
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "multiple scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
+    const auto programDir = opts.saveResultAsRadiance ? QString("%1/shaders/multiple-scattering/%2").arg(atmo.textureOutputDir.c_str()).arg(texIndex)
+                                                      : QString("%1/shaders/multiple-scattering").arg(atmo.textureOutputDir.c_str());
+    saveShaderSources(sourcesToSave, programDir);
+}
 
-        const auto filePath = opts.saveResultAsRadiance ? QString("%1/shaders/multiple-scattering/%2/%3").arg(atmo.textureOutputDir.c_str()).arg(texIndex).arg(filename)
-                                                        : QString("%1/shaders/multiple-scattering/%2").arg(atmo.textureOutputDir.c_str()).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+bool canRenderAllWavelengthSetsAtOnce()
+{
+    return atmo.allWavelengths.size()>1 && atmo.allWavelengths.size()<=MAX_WAVELENGTH_SETS_RENDERED_AT_ONCE;
+}
+
+// In luminance mode multiple scattering of all the wavelength sets is accumulated into a single texture anyway
+bool canRenderMultipleScatteringOfAllWavelengthSetsAtOnce()
+{
+    return opts.saveResultAsRadiance && canRenderAllWavelengthSetsAtOnce();
+}
+
+QString allWavelengthSetsShaderDir(QString const& shadersSubdir)
+{
+    return QString("%1/shaders/%2/%3").arg(atmo.textureOutputDir.c_str()).arg(shadersSubdir).arg(ALL_WAVELENGTH_SETS_SHADER_DIR_NAME);
+}
+
+// The program samples the textures of all the wavelength sets and only outputs luminance, which lets the renderer
+// replace a draw call per wavelength set with a single one when radiance isn't requested
+void saveAllWavelengthSetsMultipleScatteringRenderingShader()
+{
+    std::vector<std::pair<QString, QString>> sourcesToSave;
+    virtualSourceFiles[viewDirFuncFileName]=viewDirStubFunc;
+    virtualSourceFiles[MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS_FILENAME]=makeMultipleScatteringAllWavelengthSetsSrc();
+    virtualSourceFiles[renderShaderFileName]=getShaderSrc(renderShaderFileName,IgnoreCache{})
+        .replace(QRegularExpression("\\b(RENDERING_MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS)\\b"), "1 /*\\1*/");
+    const auto program=compileShaderProgram(renderShaderFileName,
+                                            "multiple scattering rendering shader program for all wavelength sets",
+                                            UseGeomShader{false}, &sourcesToSave);
+    saveShaderSources(sourcesToSave, allWavelengthSetsShaderDir("multiple-scattering"));
+}
+
+// Same as above, for zero-order scattering. Unlike multiple scattering, it's rendered per wavelength set in luminance
+// mode too, so the program is saved in both modes.
+void saveAllWavelengthSetsZeroOrderScatteringRenderingShader()
+{
+    std::vector<std::pair<QString, QString>> sourcesToSave;
+    virtualSourceFiles[viewDirFuncFileName]=viewDirStubFunc;
+    virtualSourceFiles[ZERO_ORDER_SCATTERING_ALL_WAVELENGTH_SETS_FILENAME]=makeZeroOrderScatteringAllWavelengthSetsSrc();
+    virtualSourceFiles[renderShaderFileName]=getShaderSrc(renderShaderFileName,IgnoreCache{})
+        .replace(QRegularExpression("\\b(RENDERING_ANY_ZERO_SCATTERING)\\b"), "1 /*\\1*/")
+        .replace(QRegularExpression("\\b(RENDERING_ZERO_SCATTERING_ALL_WAVELENGTH_SETS)\\b"), "1 /*\\1*/");
+    const auto program=compileShaderProgram(renderShaderFileName,
+                                            "zero-order scattering rendering shader program for all wavelength sets",
+                                            UseGeomShader{false}, &sourcesToSave);
+    saveShaderSources(sourcesToSave, allWavelengthSetsShaderDir("zero-order-scattering"));
 }
 
 void saveSingleScatteringRenderingShader(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer, const SingleScatteringRenderMode renderMode)
@@ -273,29 +446,10 @@ void saveSingleScatteringRenderingShader(const unsigned texIndex, AtmospherePara
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "single scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath = scatterer.phaseFunctionType==PhaseFunctionType::General || renderMode==SSRM_ON_THE_FLY ?
-           QString("%1/shaders/single-scattering/%2/%3/%4/%5").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(texIndex).arg(scatterer.name).arg(filename) :
-           QString("%1/shaders/single-scattering/%2/%3/%4").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(scatterer.name).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = scatterer.phaseFunctionType==PhaseFunctionType::General || renderMode==SSRM_ON_THE_FLY ?
+           QString("%1/shaders/single-scattering/%2/%3/%4").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(texIndex).arg(scatterer.name) :
+           QString("%1/shaders/single-scattering/%2/%3").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(scatterer.name);
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 void saveEclipsedSingleScatteringRenderingShader(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer, const SingleScatteringRenderMode renderMode)
@@ -316,29 +470,10 @@ void saveEclipsedSingleScatteringRenderingShader(const unsigned texIndex, Atmosp
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "single scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath = scatterer.phaseFunctionType==PhaseFunctionType::General || renderMode==SSRM_ON_THE_FLY ?
-            QString("%1/shaders/single-scattering-eclipsed/%2/%3/%4/%5").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(texIndex).arg(scatterer.name).arg(filename) :
-            QString("%1/shaders/single-scattering-eclipsed/%2/%3/%4").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(scatterer.name).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = scatterer.phaseFunctionType==PhaseFunctionType::General || renderMode==SSRM_ON_THE_FLY ?
+            QString("%1/shaders/single-scattering-eclipsed/%2/%3/%4").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(texIndex).arg(scatterer.name) :
+            QString("%1/shaders/single-scattering-eclipsed/%2/%3").arg(atmo.textureOutputDir.c_str()).arg(toString(renderMode)).arg(scatterer.name);
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 void saveEclipsedSingleScatteringComputationShader(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
@@ -355,31 +490,11 @@ void saveEclipsedSingleScatteringComputationShader(const unsigned texIndex, Atmo
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "single scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath = QString("%1/shaders/single-scattering-eclipsed/precomputation/%2/%3/%4")
-                                    .arg(atmo.textureOutputDir.c_str())
-                                    .arg(texIndex)
-                                    .arg(scatterer.name)
-                                    .arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = QString("%1/shaders/single-scattering-eclipsed/precomputation/%2/%3")
+                                .arg(atmo.textureOutputDir.c_str())
+                                .arg(texIndex)
+                                .arg(scatterer.name);
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 void saveEclipsedDoubleScatteringRenderingShader(const unsigned texIndex)
@@ -395,33 +510,12 @@ void saveEclipsedDoubleScatteringRenderingShader(const unsigned texIndex)
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "double scattering rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath = opts.saveResultAsRadiance ? QString("%1/shaders/double-scattering-eclipsed/precomputed/%2/%3")
-                                                                    .arg(atmo.textureOutputDir.c_str())
-                                                                    .arg(texIndex)
-                                                                    .arg(filename)
-                                                        : QString("%1/shaders/double-scattering-eclipsed/precomputed/%2")
-                                                                    .arg(atmo.textureOutputDir.c_str())
-                                                                    .arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = opts.saveResultAsRadiance ? QString("%1/shaders/double-scattering-eclipsed/precomputed/%2")
+                                                                .arg(atmo.textureOutputDir.c_str())
+                                                                .arg(texIndex)
+                                                      : QString("%1/shaders/double-scattering-eclipsed/precomputed")
+                                                                .arg(atmo.textureOutputDir.c_str());
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 void saveLightPollutionRenderingShader(const unsigned texIndex)
@@ -441,31 +535,23 @@ void saveLightPollutionRenderingShader(const unsigned texIndex)
     const auto program=compileShaderProgram(renderShaderFileName,
                                             "light pollution rendering shader program",
                                             UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
-
-        const auto filePath = opts.saveResultAsRadiance ? QString("%1/shaders/light-pollution/%2/%3").arg(atmo.textureOutputDir.c_str()).arg(texIndex).arg(filename)
-                                                        : QString("%1/shaders/light-pollution/%2").arg(atmo.textureOutputDir.c_str()).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
-        {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    const auto programDir = opts.saveResultAsRadiance ? QString("%1/shaders/light-pollution/%2").arg(atmo.textureOutputDir.c_str()).arg(texIndex)
+                                                      : QString("%1/shaders/light-pollution").arg(atmo.textureOutputDir.c_str());
+    saveShaderSources(sourcesToSave, programDir);
 }
 
 
+void createAccumulatedSingleScatteringTexture(GLuint& texture)
+{
+    gl.glGenTextures(1, &texture);
+    gl.glBindTexture(GL_TEXTURE_3D,texture);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
+    setupTexture(texture, atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth());
+}
+
 void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
 {
     gl.glBlendFunc(GL_ONE, GL_ONE);
@@ -473,13 +559,7 @@ void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::S
     auto& targetTexture=accumulatedSingleScatteringTextures[scatterer.name];
     if(!targetTexture)
     {
-        gl.glGenTextures(1, &targetTexture);
-        gl.glBindTexture(GL_TEXTURE_3D,targetTexture);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
-        setupTexture(targetTexture, atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth());
+        createAccumulatedSingleScatteringTexture(targetTexture);
         gl.glDisable(GL_BLEND);
     }
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_SINGLE_SCATTERING]);
@@ -510,6 +590,25 @@ void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::S
     }
 }
 
+void setupCurrentScattererSources(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
+{
+    const auto src=makeScattererDensityFunctionsSrc()+
+                    "float scattererDensity(float alt) { return scattererNumberDensity_"+scatterer.name+"(alt); }\n"+
+                    "vec4 scatteringCrossSection() { return "+toString(scatterer.scatteringCrossSection(atmo.allWavelengths[texIndex]))+"; }\n";
+    virtualSourceFiles[DENSITIES_SHADER_FILENAME]=src;
+    virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc()+
+        "vec4 currentPhaseFunction(float dotViewSun) { return phaseFunction_"+scatterer.name+"(dotViewSun); }\n";
+}
+
+void saveSingleScatteringShaders(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
+{
+    saveSingleScatteringRenderingShader(texIndex, scatterer, SSRM_ON_THE_FLY);
+    saveSingleScatteringRenderingShader(texIndex, scatterer, SSRM_PRECOMPUTED);
+    saveEclipsedSingleScatteringRenderingShader(texIndex, scatterer, SSRM_ON_THE_FLY);
+    saveEclipsedSingleScatteringRenderingShader(texIndex, scatterer, SSRM_PRECOMPUTED);
+    saveEclipsedSingleScatteringComputationShader(texIndex, scatterer);
+}
+
 void computeSingleScattering(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
 {
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_DELTA_SCATTERING]);
@@ -518,12 +617,7 @@ void computeSingleScattering(const unsigned texIndex, AtmosphereParameters::Scat
 
     gl.glViewport(0, 0, atmo.scatTexWidth(), atmo.scatTexHeight());
 
-    const auto src=makeScattererDensityFunctionsSrc()+
-                    "float scattererDensity(float alt) { return scattererNumberDensity_"+scatterer.name+"(alt); }\n"+
-                    "vec4 scatteringCrossSection() { return "+toString(scatterer.scatteringCrossSection(atmo.allWavelengths[texIndex]))+"; }\n";
-    virtualSourceFiles[DENSITIES_SHADER_FILENAME]=src;
-    virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc()+
-        "vec4 currentPhaseFunction(float dotViewSun) { return phaseFunction_"+scatterer.name+"(dotViewSun); }\n";
+    setupCurrentScattererSources(texIndex, scatterer);
     const auto program=compileShaderProgram("compute-single-scattering.frag",
                                             "single scattering computation shader program",
                                             UseGeomShader{});
@@ -554,11 +648,7 @@ void computeSingleScattering(const unsigned texIndex, AtmosphereParameters::Scat
         break;
     }
 
-    saveSingleScatteringRenderingShader(texIndex, scatterer, SSRM_ON_THE_FLY);
-    saveSingleScatteringRenderingShader(texIndex, scatterer, SSRM_PRECOMPUTED);
-    saveEclipsedSingleScatteringRenderingShader(texIndex, scatterer, SSRM_ON_THE_FLY);
-    saveEclipsedSingleScatteringRenderingShader(texIndex, scatterer, SSRM_PRECOMPUTED);
-    saveEclipsedSingleScatteringComputationShader(texIndex, scatterer);
+    saveSingleScatteringShaders(texIndex, scatterer);
 }
 
 void computeIndirectIrradianceOrder1(unsigned scattererIndex);
@@ -746,7 +836,10 @@ void accumulateMultipleScattering(const unsigned scatteringOrder, const unsigned
     // Now it's time to do this by only holding the accumulator and delta scattering texture in VRAM.
     gl.glActiveTexture(GL_TEXTURE0);
     gl.glBlendFunc(GL_ONE, GL_ONE);
-    if(scatteringOrder>2 || (texIndex>0 && !opts.saveResultAsRadiance))
+    // When merging shards, the accumulator only receives the final radiance of each wavelength set
+    const bool accumulatorHasData = mergingShards() ? texIndex>0
+                                                    : scatteringOrder>2 || (texIndex>0 && !opts.saveResultAsRadiance);
+    if(accumulatorHasData)
         gl.glEnable(GL_BLEND);
     else
         gl.glDisable(GL_BLEND);
@@ -815,10 +908,151 @@ void computeMultipleScatteringFromDensity(const unsigned scatteringOrder, const
     accumulateMultipleScattering(scatteringOrder, texIndex);
 }
 
+// Saves the data needed to continue the computation after the stage just completed
+void saveCheckpoint(const unsigned texIndex, CheckpointStage const& stage)
+{
+    // With --no-save-tex the textures aren't actually computed, so there's nothing to save
+    if(opts.dbgNoSaveTextures) return;
+
+    std::cerr << indentOutput() << "Saving checkpoint... ";
+    beginCheckpoint();
+
+    using Stage=CheckpointStage;
+    const unsigned lastScatteringOrder=std::max(2u, atmo.scatteringOrdersToCompute);
+    const bool moreScatteringOrdersFollow = stage.kind<Stage::ScatteringOrder ||
+                                            (stage.kind==Stage::ScatteringOrder && stage.scatteringOrder<lastScatteringOrder);
+
+    // Data of the current wavelength set
+    if(stage.kind<Stage::EclipsedDoubleScattering)
+        saveTextureToCheckpoint(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE], "transmittance");
+    if(stage.kind>=Stage::DirectIrradiance && moreScatteringOrdersFollow)
+    {
+        saveTextureToCheckpoint(GL_TEXTURE_2D, textures[TEX_DELTA_IRRADIANCE], "delta-irradiance");
+        saveTextureToCheckpoint(GL_TEXTURE_2D, textures[TEX_IRRADIANCE], "irradiance");
+    }
+    if(stage.kind==Stage::ScatteringOrder && moreScatteringOrdersFollow)
+        saveTextureToCheckpoint(GL_TEXTURE_3D, textures[TEX_DELTA_SCATTERING], "delta-scattering");
+
+    // Accumulators, which in luminance mode collect data from all wavelength sets
+    if(atmo.scatteringOrdersToCompute>=2)
+    {
+        const bool accumulatorInUse = opts.saveResultAsRadiance ? stage.kind==Stage::ScatteringOrder && moreScatteringOrdersFollow
+                                                                : texIndex>0 || stage.kind>=Stage::ScatteringOrder;
+        if(accumulatorInUse)
+            saveTextureToCheckpoint(GL_TEXTURE_3D, textures[TEX_MULTIPLE_SCATTERING], "multiple-scattering");
+    }
+    if(!opts.saveResultAsRadiance)
+    {
+        // If light pollution is reused, the accumulator is never set up
+        if((texIndex>0 || stage.kind>=Stage::LightPollution) && !productIsReusable(ModelProduct::LightPollution, texIndex))
+            saveTextureToCheckpoint(GL_TEXTURE_2D, textures[TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE], "light-pollution-luminance");
+        for(const auto& [scattererName, texture] : accumulatedSingleScatteringTextures)
+            saveTextureToCheckpoint(GL_TEXTURE_3D, texture, "single-scattering-luminance-"+scattererName);
+        if(!eclipsedDoubleScatteringAccumulatorTexture.empty())
+            saveDataToCheckpoint(eclipsedDoubleScatteringAccumulatorTexture, "eclipsed-double-scattering-luminance");
+    }
+
+    commitCheckpoint(texIndex, stage);
+    std::cerr << "done\n";
+}
+
+void restoreFromCheckpoint()
+{
+    if(!haveCheckpointSnapshot()) return;
+
+    std::cerr << "Restoring intermediate data from checkpoint:\n";
+    OutputIndentIncrease incr;
+
+    const auto scatW=atmo.scatTexWidth(), scatH=atmo.scatTexHeight(), scatD=atmo.scatTexDepth();
+    if(checkpointHasEntry("transmittance"))
+        loadTextureFromCheckpoint(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE], "transmittance", atmo.transmittanceTexW, atmo.transmittanceTexH);
+    if(checkpointHasEntry("delta-irradiance"))
+        loadTextureFromCheckpoint(GL_TEXTURE_2D, textures[TEX_DELTA_IRRADIANCE], "delta-irradiance", atmo.irradianceTexW, atmo.irradianceTexH);
+    if(checkpointHasEntry("irradiance"))
+        loadTextureFromCheckpoint(GL_TEXTURE_2D, textures[TEX_IRRADIANCE], "irradiance", atmo.irradianceTexW, atmo.irradianceTexH);
+    if(checkpointHasEntry("delta-scattering"))
+        loadTextureFromCheckpoint(GL_TEXTURE_3D, textures[TEX_DELTA_SCATTERING], "delta-scattering", scatW, scatH, scatD);
+    if(checkpointHasEntry("multiple-scattering"))
+        loadTextureFromCheckpoint(GL_TEXTURE_3D, textures[TEX_MULTIPLE_SCATTERING], "multiple-scattering", scatW, scatH, scatD);
+    if(checkpointHasEntry("light-pollution-luminance"))
+    {
+        // The accumulator is normally set up in accumulateLightPollutionLuminanceTexture() for the first wavelength set
+        const auto w=atmo.lightPollutionTextureSize[0], h=atmo.lightPollutionTextureSize[1];
+        setupTexture(TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE, w, h);
+        loadTextureFromCheckpoint(GL_TEXTURE_2D, textures[TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE], "light-pollution-luminance", w, h);
+    }
+    for(const auto& scatterer : atmo.scatterers)
+    {
+        const auto name="single-scattering-luminance-"+scatterer.name;
+        if(!checkpointHasEntry(name)) continue;
+        auto& texture=accumulatedSingleScatteringTextures[scatterer.name];
+        createAccumulatedSingleScatteringTexture(texture);
+        loadTextureFromCheckpoint(GL_TEXTURE_3D, texture, name, scatW, scatH, scatD);
+    }
+    if(checkpointHasEntry("eclipsed-double-scattering-luminance"))
+        eclipsedDoubleScatteringAccumulatorTexture=loadDataFromCheckpoint("eclipsed-double-scattering-luminance");
+}
+
+// Returns false if the stage has been done in a previous run, true if it's been computed now
+template<typename Computation>
+bool runStageIfNotDone(const unsigned texIndex, CheckpointStage const& stage, Computation const& compute)
+{
+    if(stageIsDone(texIndex, stage))
+    {
+        std::cerr << indentOutput() << "Stage \"" << stage.name() << "\" is already done, skipping it\n";
+        return false;
+    }
+    compute();
+    saveCheckpoint(texIndex, stage);
+    return true;
+}
+
+// Like runStageIfNotDone(), but instead of computing the product of the stage it may take it from elsewhere:
+// from the shards being merged (see --merge-shard option), or, if the product hasn't changed since the
+// previous output (see --reuse-from option), from there.
+template<typename Computation, typename Reuse, typename Merge>
+bool runStage(const unsigned texIndex, CheckpointStage const& stage, const ModelProduct product,
+              Computation const& compute, Reuse const& reuse, Merge const& merge)
+{
+    return runStageIfNotDone(texIndex, stage, [&]
+    {
+        if(mergingShards())
+            merge();
+        else if(productIsReusable(product, texIndex))
+            reuse();
+        else
+            compute();
+    });
+}
+
+void reuseTransmittance(const unsigned texIndex)
+{
+    copyProductFromPreviousOutput(ModelProduct::Transmittance, texIndex);
+    // Transmittance is needed for the products that are going to be recomputed
+    loadTexture(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE], "transmittance texture",
+                opts.reuseFromDir+"/transmittance-wlset"+std::to_string(texIndex)+".f32",
+                {atmo.transmittanceTexW, atmo.transmittanceTexH}, atmo.transmittanceTexW, atmo.transmittanceTexH);
+}
+
+void reuseScattering(const unsigned texIndex)
+{
+    copyProductFromPreviousOutput(ModelProduct::Scattering, texIndex);
+    // The shaders are cheap to generate, and they are needed even if the output directory is new
+    for(const auto& scatterer : atmo.scatterers)
+    {
+        std::cerr << indentOutput() << "Processing scatterer \""+scatterer.name.toStdString()+"\":\n";
+        OutputIndentIncrease incr;
+        setupCurrentScattererSources(texIndex, scatterer);
+        saveSingleScatteringShaders(texIndex, scatterer);
+    }
+}
+
+void mergeScattering(unsigned texIndex);
 void computeMultipleScattering(const unsigned texIndex)
 {
     // Due to interleaving of calculations of first scattering for each scatterer with the
     // second-order scattering density and irradiance we have to do this iteration separately.
+    const bool orders1and2Computed = runStage(texIndex, {CheckpointStage::ScatteringOrder, 2}, ModelProduct::Scattering, [texIndex]
     {
         std::cerr << indentOutput() << "Working on scattering orders 1 and 2:\n";
         OutputIndentIncrease incr;
@@ -828,15 +1062,26 @@ void computeMultipleScattering(const unsigned texIndex)
         {
             computeMultipleScatteringFromDensity(2,texIndex);
         }
+    }, [texIndex]{ reuseScattering(texIndex); },
+       [texIndex]{ mergeScattering(texIndex); });
+    if(!orders1and2Computed && !atmo.scatterers.empty())
+    {
+        // Subsequent shaders are compiled with the sources left by the last scatterer's single scattering computation
+        setupCurrentScattererSources(texIndex, atmo.scatterers.back());
+        virtualSourceFiles.erase(SINGLE_SCATTERING_ECLIPSED_FILENAME);
     }
     for(unsigned scatteringOrder=3; scatteringOrder<=atmo.scatteringOrdersToCompute; ++scatteringOrder)
     {
-        std::cerr << indentOutput() << "Working on scattering order " << scatteringOrder << ":\n";
-        OutputIndentIncrease incr;
+        runStage(texIndex, {CheckpointStage::ScatteringOrder, scatteringOrder}, ModelProduct::Scattering, [=]
+        {
+            std::cerr << indentOutput() << "Working on scattering order " << scatteringOrder << ":\n";
+            OutputIndentIncrease incr;
 
-        computeScatteringDensity(scatteringOrder,texIndex);
-        computeIndirectIrradiance(scatteringOrder,texIndex);
-        computeMultipleScatteringFromDensity(scatteringOrder,texIndex);
+            computeScatteringDensity(scatteringOrder,texIndex);
+            computeIndirectIrradiance(scatteringOrder,texIndex);
+            computeMultipleScatteringFromDensity(scatteringOrder,texIndex);
+        }, []{ /* Already done in the reuse of orders 1 and 2 */ },
+           []{ /* Already done in the merge of orders 1 and 2 */ });
     }
 }
 
@@ -873,29 +1118,57 @@ std::unique_ptr<QOpenGLShaderProgram> saveEclipsedDoubleScatteringComputationSha
     auto program=compileShaderProgram(COMPUTE_ECLIPSED_DOUBLE_SCATTERING_FILENAME,
                                       "eclipsed double scattering computation shader program",
                                       UseGeomShader{false}, &sourcesToSave);
-    for(const auto& [filename, src] : sourcesToSave)
-    {
-        if(filename==viewDirFuncFileName) continue;
+    const auto programDir = QString("%1/shaders/double-scattering-eclipsed/precomputation/%2").arg(atmo.textureOutputDir.c_str()).arg(texIndex);
+    saveShaderSources(sourcesToSave, programDir);
+    return program;
+}
 
-        const auto filePath = QString("%1/shaders/double-scattering-eclipsed/precomputation/%2/%3").arg(atmo.textureOutputDir.c_str())
-                                    .arg(texIndex).arg(filename);
-        std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
-        QFile file(filePath);
-        if(!file.open(QFile::WriteOnly))
+// Saves the data in radiance mode, otherwise accumulates them and saves the result after the last wavelength set
+void accumulateEclipsedDoubleScattering(const unsigned texIndex, std::vector<glm::vec4>& data, const size_t numPointsPerSet)
+{
+    if(!opts.saveResultAsRadiance)
+    {
+        std::cerr << indentOutput() << "Blending eclipsed double scattering texture into accumulator... ";
+        const auto time0=std::chrono::steady_clock::now();
+        const auto rad2lum = radianceToLuminance(texIndex, atmo.allWavelengths);
+        if(texIndex == 0)
         {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
+            // Initialize the accumulator with the first layer...
+            eclipsedDoubleScatteringAccumulatorTexture = std::move(data);
+            // ... and apply the weight.
+            for(auto& v : eclipsedDoubleScatteringAccumulatorTexture)
+                v = rad2lum*v;
         }
-        file.write(src.toUtf8());
-        file.flush();
-        if(file.error())
+        else
         {
-            std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
-            throw MustQuit{};
+            // Blend the new texture data into the accumulator.
+            auto& accum = eclipsedDoubleScatteringAccumulatorTexture;
+            const auto& src = data;
+            for(size_t i = 0; i < accum.size(); ++i)
+                accum[i] += rad2lum * src[i];
         }
+        const auto time1=std::chrono::steady_clock::now();
+        std::cerr << "done in " << formatDeltaTime(time0, time1) << "\n";
+    }
+
+    if(opts.saveResultAsRadiance || texIndex+1 == atmo.allWavelengths.size())
+    {
+        const auto path = atmo.textureOutputDir+"/eclipsed-double-scattering" +
+                          (opts.saveResultAsRadiance ? "-wlset"+std::to_string(texIndex) : "-xyzw") +
+                          ".f32";
+        std::cerr << "Saving eclipsed double scattering texture to \"" << path << "\"... ";
+        auto& texture = opts.saveResultAsRadiance ? data : eclipsedDoubleScatteringAccumulatorTexture;
+        const uint64_t texSizeBySZA = atmo.eclipsedDoubleScatteringTextureSize[2];
+        const uint64_t texSizeByAltitude = atmo.eclipsedDoubleScatteringTextureSize[3];
+        assert(texture.size() == numPointsPerSet*texSizeBySZA*texSizeByAltitude);
+        if(opts.textureSavePrecision)
+            roundTexData(&texture[0][0], 4*texture.size(), opts.textureSavePrecision);
+        TextureFileWriter out(QString::fromStdString(path), TextureElementType::Float32, 4,
+                              {numPointsPerSet, texSizeBySZA, texSizeByAltitude});
+        out.write(texture.data(), texture.size()*sizeof texture[0]);
+        out.finish();
         std::cerr << "done\n";
     }
-    return program;
 }
 
 void computeEclipsedDoubleScattering(const unsigned texIndex)
@@ -915,102 +1188,68 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
     const unsigned texSizeBySZA = atmo.eclipsedDoubleScatteringTextureSize[2];
     const unsigned texSizeByAltitude = atmo.eclipsedDoubleScatteringTextureSize[3];
 
+    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample() and EclipsedDoubleScatteringPrecomputer's constructor
+    TextureLayerSumComputer layerSummer(gl, atmo.eclipseAngularIntegrationPoints, atmo.radialIntegrationPoints,
+                                        EclipsedDoubleScatteringPrecomputer::coarseGridSampleCount(atmo));
     gl.glBindFramebuffer(GL_FRAMEBUFFER, fbos[FBO_ECLIPSED_DOUBLE_SCATTERING]);
-    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textures[TEX_ECLIPSED_DOUBLE_SCATTERING],0);
+    layerSummer.attachLayer(0);
     checkFramebufferStatus("framebuffer for eclipsed double scattering");
     program->bind();
     int unusedTextureUnitNum=0;
     setUniformTexture(*program,GL_TEXTURE_2D,TEX_TRANSMITTANCE,unusedTextureUnitNum++,"transmittanceTexture");
 
-    EclipsedDoubleScatteringPrecomputer precomputer(gl, atmo, texSizeByViewAzimuth, texSizeByViewElevation,
-                                                    texSizeBySZA, texSizeByAltitude);
+    // Two precomputers take turns, so that the GPU already integrates for the next point while the samples of the
+    // previous one are being read back and saved.
+    static_assert(TextureLayerSumComputer::MAX_PENDING_SUMMATIONS >= 2);
+    EclipsedDoubleScatteringPrecomputer precomputerA(gl, atmo, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA);
+    EclipsedDoubleScatteringPrecomputer precomputerB(gl, atmo, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA);
+    EclipsedDoubleScatteringPrecomputer*const precomputers[]={&precomputerA, &precomputerB};
 
 	gl.glBindVertexArray(vao);
     std::vector<glm::vec4> dataToSave;
     size_t numPointsPerSet=0;
-    for(unsigned altIndex=0; altIndex<texSizeByAltitude; ++altIndex)
+    const unsigned pointCount=texSizeBySZA*texSizeByAltitude;
+    for(unsigned pointIndex=0; pointIndex<=pointCount; ++pointIndex)
     {
-        // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
-        const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*atmo.lengthOfHorizRayFromGroundToBorderOfAtmo;
-        // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
-        // To avoid too many zeros that would make log interpolation problematic, we clamp the bottom value at 1 m. The same at the top.
-        const float cameraAltitude=clamp(sqrt(sqr(distToHorizon)+sqr(atmo.earthRadius))-atmo.earthRadius, 1.f, atmo.atmosphereHeight-1);
-
-        for(unsigned szaIndex=0; szaIndex<texSizeBySZA; ++szaIndex)
+        std::ostringstream ss;
+        if(pointIndex<pointCount)
         {
-            std::ostringstream ss;
-            ss << altIndex*texSizeBySZA+szaIndex << " of " << texSizeBySZA*texSizeByAltitude << " samples done ";
+            ss << pointIndex << " of " << pointCount << " samples done ";
             std::cerr << ss.str();
 
+            const unsigned altIndex=pointIndex/texSizeBySZA;
+            const unsigned szaIndex=pointIndex%texSizeBySZA;
+            // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
+            const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*atmo.lengthOfHorizRayFromGroundToBorderOfAtmo;
+            // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
+            // To avoid too many zeros that would make log interpolation problematic, we clamp the bottom value at 1 m. The same at the top.
+            const float cameraAltitude=clamp(sqrt(sqr(distToHorizon)+sqr(atmo.earthRadius))-atmo.earthRadius, 1.f, atmo.atmosphereHeight-1);
+
             const double cosSunZenithAngle=unitRangeTexCoordToCosSZA(float(szaIndex)/(texSizeBySZA-1));
             const double sunZenithAngle=acos(cosSunZenithAngle);
 
-            precomputer.computeRadianceOnCoarseGrid(*program, textures[TEX_ECLIPSED_DOUBLE_SCATTERING], unusedTextureUnitNum,
-                                                    cameraAltitude, sunZenithAngle, sunZenithAngle, 0, atmo.earthMoonDistance);
-            numPointsPerSet = precomputer.appendCoarseGridSamplesTo(dataToSave);
-
-            // Clear previous status and reset cursor position
-            const auto statusWidth=ss.tellp();
-            std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
-                      << std::string(statusWidth, '\b');
+            precomputers[pointIndex%2]->startComputingRadianceOnCoarseGrid(*program, layerSummer, unusedTextureUnitNum,
+                                                                           cameraAltitude, sunZenithAngle, sunZenithAngle,
+                                                                           0, atmo.earthMoonDistance);
         }
+        if(pointIndex>0)
+        {
+            auto& precomputer=*precomputers[(pointIndex-1)%2];
+            precomputer.finishComputingRadianceOnCoarseGrid(layerSummer);
+            numPointsPerSet = precomputer.interpolator().appendCoarseGridSamplesTo(dataToSave);
+        }
+
+        // Clear previous status and reset cursor position
+        const auto statusWidth=ss.tellp();
+        std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
+                  << std::string(statusWidth, '\b');
     }
 	gl.glBindVertexArray(0);
 
     const auto time1=std::chrono::steady_clock::now();
     std::cerr << "done in " << formatDeltaTime(time0, time1) << "\n";
 
-    if(!opts.saveResultAsRadiance)
-    {
-        std::cerr << indentOutput() << "Blending eclipsed double scattering texture into accumulator... ";
-        const auto time0=std::chrono::steady_clock::now();
-        const auto rad2lum = radianceToLuminance(texIndex, atmo.allWavelengths);
-        if(texIndex == 0)
-        {
-            // Initialize the accumulator with the first layer...
-            eclipsedDoubleScatteringAccumulatorTexture = std::move(dataToSave);
-            // ... and apply the weight.
-            for(auto& v : eclipsedDoubleScatteringAccumulatorTexture)
-                v = rad2lum*v;
-        }
-        else
-        {
-            // Blend the new texture data into the accumulator.
-            auto& accum = eclipsedDoubleScatteringAccumulatorTexture;
-            const auto& src = dataToSave;
-            for(size_t i = 0; i < accum.size(); ++i)
-                accum[i] += rad2lum * src[i];
-        }
-        const auto time1=std::chrono::steady_clock::now();
-        std::cerr << "done in " << formatDeltaTime(time0, time1) << "\n";
-    }
-
-    if(opts.saveResultAsRadiance || texIndex+1 == atmo.allWavelengths.size())
-    {
-        const auto path = atmo.textureOutputDir+"/eclipsed-double-scattering" +
-                          (opts.saveResultAsRadiance ? "-wlset"+std::to_string(texIndex) : "-xyzw") +
-                          ".f32";
-        std::cerr << "Saving eclipsed double scattering texture to \"" << path << "\"... ";
-        QFile out(QString::fromStdString(path));
-        if(!out.open(QFile::WriteOnly))
-        {
-            std::cerr << "failed to open file: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
-        for(const uint16_t size : {numPointsPerSet})
-            out.write(reinterpret_cast<const char*>(&size), sizeof size);
-        auto& texture = opts.saveResultAsRadiance ? dataToSave : eclipsedDoubleScatteringAccumulatorTexture;
-        if(opts.textureSavePrecision)
-            roundTexData(&texture[0][0], 4*texture.size(), opts.textureSavePrecision);
-        out.write(reinterpret_cast<const char*>(texture.data()), texture.size()*sizeof texture[0]);
-        out.close();
-        if(out.error())
-        {
-            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
-    }
+    accumulateEclipsedDoubleScattering(texIndex, dataToSave, numPointsPerSet);
 }
 
 void computeLightPollutionSingleScattering(const unsigned texIndex)
@@ -1135,6 +1374,82 @@ void accumulateLightPollutionLuminanceTexture(const unsigned texIndex)
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
 
+void mergeTransmittance(const unsigned texIndex)
+{
+    copyFileFromShard(texIndex, "transmittance-wlset"+std::to_string(texIndex)+".f32");
+}
+
+void mergeLightPollution(const unsigned texIndex)
+{
+    const auto w=atmo.lightPollutionTextureSize[0], h=atmo.lightPollutionTextureSize[1];
+    loadTexture(GL_TEXTURE_2D, textures[TEX_LIGHT_POLLUTION_SCATTERING], "light pollution texture",
+                shardFilePath(texIndex, "light-pollution-wlset"+std::to_string(texIndex)+".f32"), {w, h}, w, h);
+    gl.glViewport(0, 0, w, h);
+    accumulateLightPollutionLuminanceTexture(texIndex);
+    virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeScattererDensityFunctionsSrc(); // as the computation would leave it
+}
+
+void mergeScattering(const unsigned texIndex)
+{
+    const std::vector<int> sizes{atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
+                                 atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
+    const auto scatW=atmo.scatTexWidth(), scatH=atmo.scatTexHeight(), scatD=atmo.scatTexDepth();
+    gl.glViewport(0, 0, scatW, scatH);
+
+    copyFileFromShard(texIndex, "irradiance-wlset"+std::to_string(texIndex)+".f32");
+    for(const auto& scatterer : atmo.scatterers)
+    {
+        std::cerr << indentOutput() << "Processing scatterer \""+scatterer.name.toStdString()+"\":\n";
+        OutputIndentIncrease incr;
+
+        setupCurrentScattererSources(texIndex, scatterer);
+        // Shards are computed in radiance mode, where all phase functions are treated as general
+        const auto fileBase="single-scattering/"+std::to_string(texIndex)+"/"+scatterer.name.toStdString();
+        if(scatterer.phaseFunctionType==PhaseFunctionType::General)
+        {
+            copyFileFromShard(texIndex, fileBase+".f32");
+            if(scatterer.needsInterpolationGuides)
+            {
+                copyFileFromShard(texIndex, fileBase+"-dims01.guides2d");
+                copyFileFromShard(texIndex, fileBase+"-dims02.guides2d");
+            }
+        }
+        else
+        {
+            loadTexture(GL_TEXTURE_3D, textures[TEX_DELTA_SCATTERING], "single scattering texture",
+                        shardFilePath(texIndex, fileBase+".f32"), sizes, scatW, scatH, scatD);
+            accumulateSingleScattering(texIndex, scatterer);
+        }
+        saveSingleScatteringShaders(texIndex, scatterer);
+    }
+
+    if(atmo.scatteringOrdersToCompute >= 2)
+    {
+        loadTexture(GL_TEXTURE_3D, textures[TEX_DELTA_SCATTERING], "multiple scattering texture",
+                    shardFilePath(texIndex, "multiple-scattering-wlset"+std::to_string(texIndex)+".f32"),
+                    sizes, scatW, scatH, scatD);
+        accumulateMultipleScattering(atmo.scatteringOrdersToCompute, texIndex);
+    }
+}
+
+void mergeEclipsedDoubleScattering(const unsigned texIndex)
+{
+    saveEclipsedDoubleScatteringComputationShader(texIndex);
+    if(opts.dbgNoEDSTextures) return;
+
+    const auto path=shardFilePath(texIndex, "eclipsed-double-scattering-wlset"+std::to_string(texIndex)+".f32");
+    std::cerr << indentOutput() << "Loading eclipsed double scattering texture from \"" << path << "\"... ";
+    TextureFileReader in(QString::fromStdString(path));
+    in.checkFormat(TextureElementType::Float32, 4, {0, uint64_t(atmo.eclipsedDoubleScatteringTextureSize[2]),
+                                                    uint64_t(atmo.eclipsedDoubleScatteringTextureSize[3])});
+    const auto numPointsPerSet=in.sizes()[0];
+    std::vector<glm::vec4> data(in.elementCount());
+    in.readChunks(0, in.chunkCount(), reinterpret_cast<char*>(data.data()));
+    std::cerr << "done\n";
+
+    accumulateEclipsedDoubleScattering(texIndex, data, numPointsPerSet);
+}
+
 int main(int argc, char** argv)
 {
     [[maybe_unused]] UTF8Console utf8console;
@@ -1187,6 +1502,7 @@ int main(int argc, char** argv)
                            scatterer.name.toStdString());
             }
         }
+        createDirs(atmo.textureOutputDir+"/shaders/"+SHADER_SOURCES_DIR_NAME);
         createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputed/");
         for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
         {
@@ -1201,6 +1517,15 @@ int main(int argc, char** argv)
         if(opts.saveResultAsRadiance)
             for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
                 createDirs(atmo.textureOutputDir+"/shaders/multiple-scattering/"+std::to_string(texIndex));
+        // A program for all wavelength sets left by a previous run would mismatch the textures
+        if(canRenderMultipleScatteringOfAllWavelengthSetsAtOnce())
+            createDirs(allWavelengthSetsShaderDir("multiple-scattering").toStdString());
+        else
+            QDir(allWavelengthSetsShaderDir("multiple-scattering")).removeRecursively();
+        if(canRenderAllWavelengthSetsAtOnce())
+            createDirs(allWavelengthSetsShaderDir("zero-order-scattering").toStdString());
+        else
+            QDir(allWavelengthSetsShaderDir("zero-order-scattering")).removeRecursively();
         createDirs(atmo.textureOutputDir+"/shaders/light-pollution/");
         if(opts.saveResultAsRadiance)
             for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
@@ -1239,11 +1564,13 @@ int main(int argc, char** argv)
 
         const auto timeBegin=std::chrono::steady_clock::now();
 
-        // Initialize texture averager before anything to make it emit possible
-        // warnings not mixing them into computation status reports.
-        TextureAverageComputer{gl, 10, 10, GL_RGBA32F, 0};
+        initCheckpoints();
+        restoreFromCheckpoint();
+        initIncrementalComputation();
+        initShardMerging();
+        initShardOutput();
 
-        for(unsigned texIndex=0;texIndex<atmo.allWavelengths.size();++texIndex)
+        for(unsigned texIndex=opts.firstWavelengthSet;texIndex<=opts.lastWavelengthSet;++texIndex)
         {
             std::cerr << "Working on wavelengths " << atmo.allWavelengths[texIndex][0] << ", "
                                                    << atmo.allWavelengths[texIndex][1] << ", "
@@ -1267,24 +1594,38 @@ int main(int argc, char** argv)
                 std::cerr << indentOutput() << "Computing parts of scattering order 1:\n";
                 OutputIndentIncrease incr;
 
-                computeTransmittance(texIndex);
+                runStage(texIndex, {CheckpointStage::Transmittance}, ModelProduct::Transmittance,
+                         [texIndex]{ computeTransmittance(texIndex); },
+                         [texIndex]{ reuseTransmittance(texIndex); },
+                         [texIndex]{ mergeTransmittance(texIndex); });
                 // We'll use ground irradiance to take into account the contribution of light scattered by the ground to the
                 // sky color. Irradiance will also be needed when we want to draw the ground itself.
-                computeDirectGroundIrradiance(texIndex);
+                // Direct irradiance is only an intermediate result for scattering, so it's not needed if the latter is reused.
+                runStage(texIndex, {CheckpointStage::DirectIrradiance}, ModelProduct::Scattering,
+                         [texIndex]{ computeDirectGroundIrradiance(texIndex); }, []{}, []{});
             }
 
-            computeLightPollutionSingleScattering(texIndex);
-            computeLightPollutionMultipleScattering(texIndex);
-            if(opts.saveResultAsRadiance)
+            const bool lightPollutionComputed = runStage(texIndex, {CheckpointStage::LightPollution}, ModelProduct::LightPollution, [texIndex]
             {
-                saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING],"light pollution texture",
-                            atmo.textureOutputDir+"/light-pollution-wlset"+std::to_string(texIndex)+".f32",
-                            {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]});
-            }
-            else
+                computeLightPollutionSingleScattering(texIndex);
+                computeLightPollutionMultipleScattering(texIndex);
+                if(opts.saveResultAsRadiance)
+                {
+                    saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING],"light pollution texture",
+                                atmo.textureOutputDir+"/light-pollution-wlset"+std::to_string(texIndex)+".f32",
+                                {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]});
+                }
+                else
+                {
+                    accumulateLightPollutionLuminanceTexture(texIndex);
+                }
+            }, [texIndex]
             {
-                accumulateLightPollutionLuminanceTexture(texIndex);
-            }
+                copyProductFromPreviousOutput(ModelProduct::LightPollution, texIndex);
+                virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeScattererDensityFunctionsSrc(); // as the computation would leave it
+            }, [texIndex]{ mergeLightPollution(texIndex); });
+            if(!lightPollutionComputed)
+                virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeScattererDensityFunctionsSrc(); // as the skipped stage would leave it
             saveLightPollutionRenderingShader(texIndex);
 
             computeMultipleScattering(texIndex);
@@ -1294,14 +1635,29 @@ int main(int argc, char** argv)
                 saveEclipsedDoubleScatteringRenderingShader(texIndex);
             }
 
-            computeEclipsedDoubleScattering(texIndex);
-
+            runStage(texIndex, {CheckpointStage::EclipsedDoubleScattering}, ModelProduct::EclipsedDoubleScattering,
+                     [texIndex]{ computeEclipsedDoubleScattering(texIndex); },
+                     [texIndex]
+                     {
+                         saveEclipsedDoubleScatteringComputationShader(texIndex);
+                         copyProductFromPreviousOutput(ModelProduct::EclipsedDoubleScattering, texIndex);
+                     },
+                     [texIndex]{ mergeEclipsedDoubleScattering(texIndex); });
         }
         if(!opts.saveResultAsRadiance)
         {
             saveMultipleScatteringRenderingShader(-1);
             saveEclipsedDoubleScatteringRenderingShader(-1);
         }
+        if(canRenderMultipleScatteringOfAllWavelengthSetsAtOnce())
+            saveAllWavelengthSetsMultipleScatteringRenderingShader();
+        if(canRenderAllWavelengthSetsAtOnce())
+            saveAllWavelengthSetsZeroOrderScatteringRenderingShader();
+
+        saveFingerprints();
+        markShardComplete();
+        // The output is complete, so the checkpoint is of no use anymore
+        removeCheckpoints();
 
         const auto timeEnd=std::chrono::steady_clock::now();
         std::cerr << "Finished in " << formatDeltaTime(timeBegin, timeEnd) << "\n";
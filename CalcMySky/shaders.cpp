@@ -17,43 +17,28 @@ QString withHeadersIncluded(QString src, QString const& filename);
 
 void initConstHeader(glm::vec4 const& wavelengths)
 {
+    // The declarations come from the same lists as the constants for CPU evaluation of GLSL snippets, so that they
+    // can't diverge
     QString header=1+R"(
 #ifndef INCLUDE_ONCE_2B59AE86_E78B_4D75_ACDF_5DA644F8E9A3
 #define INCLUDE_ONCE_2B59AE86_E78B_4D75_ACDF_5DA644F8E9A3
-const float earthRadius=)"+QString::number(atmo.earthRadius)+"; // must be in meters\n"
-                         "const float atmosphereHeight="+QString::number(atmo.atmosphereHeight)+"; // must be in meters\n"
-                         R"(
-const vec3 earthCenter=vec3(0,0,-earthRadius);
-
-const float dobsonUnit = 2.687e20; // molecules/m^2
-const float PI=3.1415926535897932;
-const float km=1000;
-#define sqr(x) ((x)*(x))
-
-uniform float sunAngularRadius=)" + toString(atmo.sunAngularRadius) + R"(;
-const float moonRadius=)" + toString(moonRadius) + R"(;
-const vec4 scatteringTextureSize=)" + toString(glm::vec4(atmo.scatteringTextureSize)) + R"(;
-const vec2 irradianceTextureSize=)" + toString(glm::vec2(atmo.irradianceTexW, atmo.irradianceTexH)) + R"(;
-const vec2 transmittanceTextureSize=)" + toString(glm::vec2(atmo.transmittanceTexW,atmo.transmittanceTexH)) + R"(;
-const vec2 eclipsedSingleScatteringTextureSize=)" + toString(glm::vec2(atmo.eclipsedSingleScatteringTextureSize)) +R"(;
-const vec2 lightPollutionTextureSize=)" + toString(glm::vec2(atmo.lightPollutionTextureSize)) +R"(;
-const int radialIntegrationPoints=)" + toString(atmo.radialIntegrationPoints) + R"(;
-const int angularIntegrationPoints=)" + toString(atmo.angularIntegrationPoints) + R"(;
-const int lightPollutionAngularIntegrationPoints=)" + toString(atmo.lightPollutionAngularIntegrationPoints) + R"(;
-const int eclipseAngularIntegrationPoints=)" + toString(atmo.eclipseAngularIntegrationPoints) + R"(;
-const int numTransmittanceIntegrationPoints=)" + toString(atmo.numTransmittanceIntegrationPoints) + R"(;
 )";
-    for(auto const& scatterer : atmo.scatterers)
-        header += "const vec4 scatteringCrossSection_"+scatterer.name+"="+toString(scatterer.scatteringCrossSection(wavelengths))+";\n";
-    const auto wlI=atmo.wavelengthsIndex(wavelengths);
-    header += "const vec4 groundAlbedo="+toString(atmo.groundAlbedo[wlI])+";\n";
-    header += "const vec4 solarIrradianceAtTOA="+toString(atmo.solarIrradianceAtTOA[wlI])+";\n";
-    header += "const vec4 lightPollutionRelativeRadiance="+toString(atmo.lightPollutionRelativeRadiance[wlI])+";\n";
-    header += "const vec4 wavelengths="+toString(wavelengths)+";\n";
-    header += "const int wlSetIndex="+toString(int(wlI))+";\n";
-
-    header+="#endif\n"; // close the include guard
+    for(auto const& constant : atmo.glslConstants())
+        header += constant.declaration+"\n";
+    header += "#define sqr(x) ((x)*(x))\n"
+              "#endif\n";
     virtualHeaderFiles[CONSTANTS_HEADER_FILENAME]=header;
+
+    // The constants that depend on the wavelength set live in a separate header, so that the shaders which don't
+    // include it come out the same for all the wavelength sets, and are saved only once.
+    QString wlSetHeader=1+R"(
+#ifndef INCLUDE_ONCE_1622A682_48F3_4630_A702_C15B99FB33A5
+#define INCLUDE_ONCE_1622A682_48F3_4630_A702_C15B99FB33A5
+)";
+    for(auto const& constant : atmo.wavelengthSetGLSLConstants(wavelengths))
+        wlSetHeader += constant.declaration+"\n";
+    wlSetHeader+="#endif\n"; // close the include guard
+    virtualHeaderFiles[WAVELENGTH_SET_CONSTANTS_HEADER_FILENAME]=wlSetHeader;
 }
 
 QString makeDensitiesFunctions()
@@ -91,6 +76,7 @@ QString makeTransmittanceComputeFunctionsSrc(glm::vec4 const& wavelengths)
 #version 330
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "common-functions.h.glsl"
 )";
     const QString opticalDepthFunctionTemplate=R"(
@@ -147,16 +133,40 @@ QString makeScattererDensityFunctionsSrc()
 #version 330
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 )";
     return head+makeDensitiesFunctions();
 }
 
+// Fragment shader that evaluates the given number density function at altitudes altitudeStep*i, where i is the
+// index of the texel in the render target of width tableWidth, counting row by row.
+QString makeNumberDensityTabulationSrc(QString const& densityFunctionName)
+{
+    return 1+R"(
+#version 330
+#include "version.h.glsl"
+#include "const.h.glsl"
+#include "densities.h.glsl"
+
+uniform float altitudeStep;
+uniform int tableWidth;
+out vec4 density;
+
+void main()
+{
+    CONST int index=int(gl_FragCoord.y)*tableWidth+int(gl_FragCoord.x);
+    density=vec4()"+densityFunctionName+R"((index*altitudeStep));
+}
+)";
+}
+
 QString makePhaseFunctionsSrc()
 {
     QString src = 1+R"(
 #version 330
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 
 )";
     QString header;
@@ -179,6 +189,7 @@ QString makeTotalScatteringCoefSrc()
 #version 330
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "densities.h.glsl"
 #include "phase-functions.h.glsl"
 
@@ -198,6 +209,130 @@ vec4 totalScatteringCoefficient(float altitude, float dotViewInc)
     return src;
 }
 
+// Function that samples multiple scattering textures of all the wavelength sets and sums their contributions to the
+// luminance, so that a single draw call renders them all. Sampler arrays can't be indexed by a loop counter in GLSL
+// 3.30, so the loop is unrolled here.
+QString makeMultipleScatteringAllWavelengthSetsSrc()
+{
+    const auto wlSetCount=atmo.allWavelengths.size();
+    QString src = 1+R"(
+#version 330
+#include "version.h.glsl"
+#include "const.h.glsl"
+#include "texture-coordinates.h.glsl"
+
+uniform float scatteringTextureScales[)" + toString(int(wlSetCount)) + R"(];
+uniform float altitudeSliceMixes[)" + toString(int(wlSetCount)) + R"(];
+uniform vec4 solarIrradianceFixups[)" + toString(int(wlSetCount)) + R"(];
+)";
+    for(unsigned wlSetIndex=0; wlSetIndex<wlSetCount; ++wlSetIndex)
+    {
+        src += QString("uniform sampler3D scatteringTexture%1;\n"
+                       "uniform sampler3D scatteringTextureUpper%1;\n").arg(wlSetIndex);
+    }
+    src += R"(
+vec4 sampleMultipleScattering(const sampler3D lowerSlice, const sampler3D upperSlice, const float altitudeSliceMix,
+                              const float cosSunZenithAngle, const float cosViewZenithAngle, const float dotViewSun,
+                              const float altitude, const bool viewRayIntersectsGround)
+{
+    CONST vec4 lower = sample3DTexture(lowerSlice, cosSunZenithAngle, cosViewZenithAngle,
+                                       dotViewSun, altitude, viewRayIntersectsGround);
+    if(altitudeSliceMix==0)
+        return lower;
+    CONST vec4 upper = sample3DTexture(upperSlice, cosSunZenithAngle, cosViewZenithAngle,
+                                       dotViewSun, altitude, viewRayIntersectsGround);
+    return mix(lower, upper, altitudeSliceMix);
+}
+
+vec4 multipleScatteringLuminanceOfAllWavelengthSets(const float cosSunZenithAngle, const float cosViewZenithAngle,
+                                                    const float dotViewSun, const float altitude,
+                                                    const bool viewRayIntersectsGround)
+{
+    vec4 luminance=vec4(0);
+)";
+    for(unsigned wlSetIndex=0; wlSetIndex<wlSetCount; ++wlSetIndex)
+    {
+        src += QString("    luminance += %1 * (scatteringTextureScales[%2] * solarIrradianceFixups[%2] *\n"
+                       "                       sampleMultipleScattering(scatteringTexture%2, scatteringTextureUpper%2, altitudeSliceMixes[%2],\n"
+                       "                                                cosSunZenithAngle, cosViewZenithAngle, dotViewSun,\n"
+                       "                                                altitude, viewRayIntersectsGround));\n")
+                    .arg(toString(radianceToLuminance(wlSetIndex, atmo.allWavelengths))).arg(wlSetIndex);
+    }
+    src += "    return luminance;\n}\n";
+
+    virtualHeaderFiles[MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS_HEADER_FILENAME]=
+        "vec4 multipleScatteringLuminanceOfAllWavelengthSets(const float cosSunZenithAngle, const float cosViewZenithAngle,\n"
+        "                                                    const float dotViewSun, const float altitude,\n"
+        "                                                    const bool viewRayIntersectsGround);\n";
+    return src;
+}
+
+// Functions that compute luminance of the ground and of the Sun for all the wavelength sets, so that zero-order
+// scattering is rendered in a single draw call. The geometry is computed by the caller, only the values that depend on
+// the wavelength set are computed here. Like for multiple scattering, the loop over the sets is unrolled.
+QString makeZeroOrderScatteringAllWavelengthSetsSrc()
+{
+    const auto wlSetCount=atmo.allWavelengths.size();
+    QString src = 1+R"(
+#version 330
+#include "version.h.glsl"
+#include "const.h.glsl"
+#include "texture-sampling-functions.h.glsl"
+
+uniform vec4 solarIrradianceFixups[)" + toString(int(wlSetCount)) + R"(];
+)";
+    for(unsigned wlSetIndex=0; wlSetIndex<wlSetCount; ++wlSetIndex)
+    {
+        src += QString("uniform sampler2D transmittanceTexture%1;\n"
+                       "uniform sampler2D irradianceTexture%1;\n").arg(wlSetIndex);
+    }
+
+    // Only the calls are generated: the formulas are in texture-sampling-functions.frag, shared with the rendering of
+    // a single wavelength set
+    src += R"(
+vec4 groundLuminanceOfAllWavelengthSets(const float cosViewZenithAngle, const float altitude, const float distToGround,
+                                        const float cosSunZenithAngleAtGround, const float lightPollutionGroundLuminance)
+{
+    vec4 luminance=vec4(0);
+)";
+    for(unsigned wlSetIndex=0; wlSetIndex<wlSetCount; ++wlSetIndex)
+    {
+        // The same values as in wavelength-set-constants.h.glsl of the set
+        const auto constants=atmo.snippetConstants(atmo.allWavelengths[wlSetIndex]);
+        src += QString("    luminance += %1 * groundRadiance(transmittanceTexture%2, irradianceTexture%2,\n"
+                       "                                     cosViewZenithAngle, altitude, distToGround, cosSunZenithAngleAtGround,\n"
+                       "                                     %3, solarIrradianceFixups[%2],\n"
+                       "                                     lightPollutionGroundLuminance, %4);\n")
+                    .arg(toString(radianceToLuminance(wlSetIndex, atmo.allWavelengths)))
+                    .arg(wlSetIndex)
+                    .arg(toString(constants.at("groundAlbedo").value))
+                    .arg(toString(constants.at("lightPollutionRelativeRadiance").value));
+    }
+    src += R"(    return luminance;
+}
+
+vec4 sunLuminanceOfAllWavelengthSets(const float cosViewZenithAngle, const float altitude, const bool lookingIntoAtmosphere)
+{
+    vec4 luminance=vec4(0);
+)";
+    for(unsigned wlSetIndex=0; wlSetIndex<wlSetCount; ++wlSetIndex)
+    {
+        const auto constants=atmo.snippetConstants(atmo.allWavelengths[wlSetIndex]);
+        src += QString("    luminance += %1 * sunRadiance(transmittanceTexture%2, cosViewZenithAngle, altitude, lookingIntoAtmosphere,\n"
+                       "                                  %3, solarIrradianceFixups[%2]);\n")
+                    .arg(toString(radianceToLuminance(wlSetIndex, atmo.allWavelengths)))
+                    .arg(wlSetIndex)
+                    .arg(toString(constants.at("solarIrradianceAtTOA").value));
+    }
+    src += "    return luminance;\n}\n";
+
+    virtualHeaderFiles[ZERO_ORDER_SCATTERING_ALL_WAVELENGTH_SETS_HEADER_FILENAME]=
+        "vec4 groundLuminanceOfAllWavelengthSets(const float cosViewZenithAngle, const float altitude, const float distToGround,\n"
+        "                                        const float cosSunZenithAngleAtGround, const float lightPollutionGroundLuminance);\n"
+        "vec4 sunLuminanceOfAllWavelengthSets(const float cosViewZenithAngle, const float altitude, const bool lookingIntoAtmosphere);\n";
+    return src;
+}
+
 QString getShaderSrc(QString const& fileName, IgnoreCache ignoreCache)
 {
     if(!ignoreCache)
@@ -352,6 +487,8 @@ std::set<QString> getShaderFileNamesToLinkWith(QString const& filename, int recu
             continue;
         if(headerFileName == CONSTANTS_HEADER_FILENAME) // no companion source for constants header
             continue;
+        if(headerFileName == WAVELENGTH_SET_CONSTANTS_HEADER_FILENAME) // no companion source for wavelength set constants header
+            continue;
         if(headerFileName == RADIANCE_TO_LUMINANCE_HEADER_FILENAME) // no companion source for radiance-to-luminance conversion header
             continue;
         const auto shaderFileNameToLinkWith=includeFileBaseName+".frag";
@@ -15,7 +15,10 @@ std::unique_ptr<QOpenGLShaderProgram> compileShaderProgram(QString const& mainSr
                                                            std::vector<std::pair<QString, QString>>* sourcesToSave=nullptr);
 void initConstHeader(glm::vec4 const& wavelengths);
 QString makeScattererDensityFunctionsSrc();
+QString makeNumberDensityTabulationSrc(QString const& densityFunctionName);
 QString makeTransmittanceComputeFunctionsSrc(glm::vec4 const& wavelengths);
 QString makeTotalScatteringCoefSrc();
 QString makePhaseFunctionsSrc();
+QString makeMultipleScatteringAllWavelengthSetsSrc();
+QString makeZeroOrderScatteringAllWavelengthSetsSrc();
 #endif
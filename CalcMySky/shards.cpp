@@ -0,0 +1,180 @@
+#include "shards.hpp"
+
+#include <vector>
+#include <utility>
+#include <cassert>
+#include <iostream>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include "data.hpp"
+#include "util.hpp"
+
+namespace
+{
+
+constexpr char COMPLETION_MARKER_FILE_NAME[]="shard-complete";
+constexpr char COMPLETION_MARKER_HEADER[]="# CalcMySky shard completion marker. Don't edit.";
+constexpr char WAVELENGTH_SETS_KEY[]="wavelength-sets";
+
+// Indexed by texIndex
+std::vector<std::string> shardDirs;
+
+std::string completionMarkerPath(std::string const& dir)
+{
+    return dir+"/"+COMPLETION_MARKER_FILE_NAME;
+}
+
+// Returns the range of wavelength sets the shard has computed
+std::pair<unsigned,unsigned> readCompletionMarker(std::string const& dir)
+{
+    const auto path=completionMarkerPath(dir);
+    QFile file(QString::fromStdString(path));
+    if(!file.exists())
+    {
+        std::cerr << "Shard \"" << dir << "\" is incomplete\n";
+        throw MustQuit{};
+    }
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream in(&file);
+    for(int lineNumber=1; !in.atEnd(); ++lineNumber)
+    {
+        const auto line=in.readLine();
+        if(line.startsWith('#') || line.trimmed().isEmpty())
+            continue;
+        if(!line.startsWith(QString(WAVELENGTH_SETS_KEY)+":"))
+        {
+            std::cerr << path << ":" << lineNumber << ": bad line format\n";
+            throw MustQuit{};
+        }
+        const auto range=line.mid(sizeof WAVELENGTH_SETS_KEY).trimmed().split('-');
+        bool okFirst=false, okLast=false;
+        const auto first = range.size()==2 ? range[0].toUInt(&okFirst) : 0;
+        const auto last  = range.size()==2 ? range[1].toUInt(&okLast) : 0;
+        if(!okFirst || !okLast || first>last)
+        {
+            std::cerr << path << ":" << lineNumber << ": failed to parse range of wavelength sets\n";
+            throw MustQuit{};
+        }
+        if(last>=atmo.allWavelengths.size())
+        {
+            std::cerr << "Shard \"" << dir << "\" contains results for wavelength set " << last
+                      << ", but the atmosphere description only has " << atmo.allWavelengths.size() << "\n";
+            throw MustQuit{};
+        }
+        return {first, last};
+    }
+    std::cerr << path << ": range of wavelength sets not found\n";
+    throw MustQuit{};
+}
+
+void checkShardDescription(std::string const& dir)
+{
+    const auto path=dir+"/params.atmo";
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto text=QString::fromUtf8(file.readAll());
+    if(file.error())
+    {
+        std::cerr << "Failed to read \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    if(!text.contains(QString("\n%1\n").arg(AtmosphereParameters::ALL_TEXTURES_ARE_RADIANCES_DIRECTIVE)))
+    {
+        std::cerr << "Shard \"" << dir << "\" hasn't been computed in radiance mode\n";
+        throw MustQuit{};
+    }
+    // The original description is copied to the end of the output description
+    if(!text.endsWith(atmo.descriptionFileText))
+    {
+        std::cerr << "Shard \"" << dir << "\" has been computed for a different atmosphere description\n";
+        throw MustQuit{};
+    }
+}
+
+}
+
+void initShardMerging()
+{
+    if(!mergingShards()) return;
+
+    shardDirs.resize(atmo.allWavelengths.size());
+    for(const auto& dir : opts.shardsToMerge)
+    {
+        checkShardDescription(dir);
+        const auto [first, last]=readCompletionMarker(dir);
+        for(unsigned texIndex=first; texIndex<=last; ++texIndex)
+        {
+            if(!shardDirs[texIndex].empty())
+            {
+                std::cerr << "Both \"" << shardDirs[texIndex] << "\" and \"" << dir
+                          << "\" contain results for wavelength set " << texIndex << "\n";
+                throw MustQuit{};
+            }
+            shardDirs[texIndex]=dir;
+        }
+    }
+    for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
+    {
+        if(shardDirs[texIndex].empty())
+        {
+            std::cerr << "None of the shards contain results for wavelength set " << texIndex << "\n";
+            throw MustQuit{};
+        }
+    }
+}
+
+void initShardOutput()
+{
+    // Until the current computation is complete, the output directory isn't a complete shard
+    QFile::remove(QString::fromStdString(completionMarkerPath(atmo.textureOutputDir)));
+}
+
+void markShardComplete()
+{
+    if(!opts.saveResultAsRadiance || opts.dbgNoSaveTextures) return;
+
+    const auto path=completionMarkerPath(atmo.textureOutputDir);
+    std::cerr << "Marking the shard complete in \"" << path << "\"... ";
+    QSaveFile file(QString::fromStdString(path));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "failed to open file: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream out(&file);
+    out << COMPLETION_MARKER_HEADER << "\n";
+    out << WAVELENGTH_SETS_KEY << ": " << opts.firstWavelengthSet << "-" << opts.lastWavelengthSet << "\n";
+    out.flush();
+    if(!file.commit())
+    {
+        std::cerr << "failed to write file: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
+
+bool mergingShards()
+{
+    return !opts.shardsToMerge.empty();
+}
+
+std::string shardFilePath(const unsigned texIndex, std::string const& fileName)
+{
+    assert(texIndex < shardDirs.size());
+    return shardDirs[texIndex]+"/"+fileName;
+}
+
+void copyFileFromShard(const unsigned texIndex, std::string const& fileName)
+{
+    copyFile(shardFilePath(texIndex, fileName), atmo.textureOutputDir+"/"+fileName);
+}
@@ -0,0 +1,28 @@
+#ifndef INCLUDE_ONCE_4A0C7E2B_95D3_4F0E_B8A1_6C2D9E57F31A
+#define INCLUDE_ONCE_4A0C7E2B_95D3_4F0E_B8A1_6C2D9E57F31A
+
+#include <string>
+
+/* Sharding lets several calcmysky processes compute disjoint ranges of wavelength sets (see --wlsets option)
+ * in radiance mode. The shards are then merged by a separate run with --merge-shard options, which, instead
+ * of computing the textures, takes the radiance textures from the shards and accumulates them into the
+ * luminance textures, generating the rest of the luminance model as usual.
+ */
+
+/* A radiance mode run records the range of wavelength sets it has computed in a completion marker file in the
+ * output directory, once all its output has been saved. The marker, not the presence of the other output files,
+ * is what tells the merging run that the shard is complete and which wavelength sets to take from it.
+ */
+
+// Checks that the shards are complete and computed in radiance mode from the same atmosphere description
+void initShardMerging();
+// Removes the completion marker left in the output directory by a previous run
+void initShardOutput();
+// Writes the completion marker if the output is a radiance mode shard
+void markShardComplete();
+bool mergingShards();
+// Path to a file of the shard that contains results for the given wavelength set
+std::string shardFilePath(unsigned texIndex, std::string const& fileName);
+void copyFileFromShard(unsigned texIndex, std::string const& fileName);
+
+#endif
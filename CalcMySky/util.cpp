@@ -1,12 +1,17 @@
 #include "util.hpp"
 
+#include <cmath>
 #include <memory>
+#include <sstream>
+#include <cassert>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <filesystem>
 #include <QFile>
 
 #include "data.hpp"
+#include "../common/TextureFile.hpp"
 
 void createDirs(std::string const& path)
 {
@@ -19,6 +24,20 @@ void createDirs(std::string const& path)
     }
 }
 
+void copyFile(std::string const& source, std::string const& target)
+{
+    std::cerr << indentOutput() << "Copying \"" << source << "\" to \"" << target << "\"... ";
+    const auto targetQt=QString::fromStdString(target);
+    QFile::remove(targetQt);
+    QFile in(QString::fromStdString(source));
+    if(!in.copy(targetQt))
+    {
+        std::cerr << "failed: " << in.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
+
 void renderQuad()
 {
     OPENGL_DEBUG_CHECK_ERROR("FAILED on entry to renderQuad()");
@@ -56,6 +75,48 @@ void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString c
     }
 }
 
+namespace
+{
+
+// Compares the half-float data to the single-precision ones they were made from
+std::string halfFloatErrorReport(const GLfloat*const original, const uint16_t*const encoded, const size_t count, const float scale)
+{
+    const std::unique_ptr<GLfloat[]> decoded(new GLfloat[count]);
+    halfFloatsToFloats(encoded, count, scale, decoded.get());
+
+    // Below this magnitude half floats are denormalized, so the relative error grows
+    const double minNormal=std::ldexp(double(scale), -14);
+    double maxRelError=0, sumSqrRelError=0, maxAbsErrorOfSmall=0;
+    size_t normalCount=0, smallCount=0;
+    for(size_t n=0; n<count; ++n)
+    {
+        const double value=original[n], error=std::abs(decoded[n]-value);
+        if(value==0) continue;
+        if(std::abs(value) < minNormal)
+        {
+            ++smallCount;
+            maxAbsErrorOfSmall=std::max(maxAbsErrorOfSmall, error);
+            continue;
+        }
+        const auto relError=error/std::abs(value);
+        maxRelError=std::max(maxRelError, relError);
+        sumSqrRelError+=relError*relError;
+        ++normalCount;
+    }
+
+    std::ostringstream report;
+    report << "Error of half-float encoding relative to single precision: max " << maxRelError << ", RMS "
+           << (normalCount ? std::sqrt(sumSqrRelError/normalCount) : 0.) << " (value scale " << scale << ")";
+    if(smallCount)
+    {
+        report << "; " << smallCount << " of " << normalCount+smallCount << " nonzero values are smaller than "
+               << minNormal << " and have absolute error up to " << maxAbsErrorOfSmall;
+    }
+    return report.str();
+}
+
+}
+
 std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, const std::string_view name,
                                    const std::string_view path, std::vector<int> const& sizes,
                                    const ReturnTextureData returnTexData)
@@ -132,20 +193,30 @@ std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, co
         roundTexData(subpixels.get(), subpixelCount, opts.textureSavePrecision);
     }
 
-    QFile out(QByteArray::fromRawData(path.data(), path.size()));
-    if(!out.open(QFile::WriteOnly))
+    std::vector<uint64_t> fileSizes(sizes.begin(), sizes.end());
+    if(fileSizes.empty())
     {
-        std::cerr << "failed to open file: " << out.errorString().toStdString() << "\n";
-        throw MustQuit{};
+        fileSizes = target==GL_TEXTURE_3D ? std::vector<uint64_t>{uint64_t(w),uint64_t(h),uint64_t(d)} :
+                    target==GL_TEXTURE_2D ? std::vector<uint64_t>{uint64_t(w),uint64_t(h)} :
+                                            std::vector<uint64_t>{uint64_t(w)};
     }
-    for(const uint16_t s : sizes)
-        out.write(reinterpret_cast<const char*>(&s), sizeof s);
-    out.write(reinterpret_cast<const char*>(subpixels.get()), subpixelCount*sizeof subpixels[0]);
-    out.close();
-    if(out.error())
+    const auto filePath=QString::fromUtf8(path.data(), path.size());
+    std::string errorReport;
+    if(target==GL_TEXTURE_3D && opts.saveHalfFloatTextures)
     {
-        std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
-        throw MustQuit{};
+        const auto scale=halfFloatScale(subpixels.get(), subpixelCount);
+        const std::unique_ptr<uint16_t[]> halfSubpixels(new uint16_t[subpixelCount]);
+        floatsToHalfFloats(subpixels.get(), subpixelCount, scale, halfSubpixels.get());
+        TextureFileWriter out(filePath, TextureElementType::Float16, 4, fileSizes, scale);
+        out.write(halfSubpixels.get(), subpixelCount*sizeof halfSubpixels[0]);
+        out.finish();
+        errorReport=halfFloatErrorReport(subpixels.get(), halfSubpixels.get(), subpixelCount, scale);
+    }
+    else
+    {
+        TextureFileWriter out(filePath, TextureElementType::Float32, 4, fileSizes);
+        out.write(subpixels.get(), subpixelCount*sizeof subpixels[0]);
+        out.finish();
     }
     if(nanCount)
     {
@@ -154,10 +225,51 @@ std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, co
         throw MustQuit{};
     }
     std::cerr << "done\n";
+    if(!errorReport.empty())
+        std::cerr << indentOutput() << errorReport << "\n";
 
     return dataToReturn;
 }
 
+void loadTexture(const GLenum target, const GLuint texture, const std::string_view name, const std::string_view path,
+                 std::vector<int> const& sizes, const GLsizei width, const GLsizei height, const GLsizei depth)
+{
+    assert(target==GL_TEXTURE_2D || target==GL_TEXTURE_3D);
+
+    std::cerr << indentOutput() << "Loading " << name << " from \"" << path << "\"... ";
+    TextureFileReader in(QString::fromUtf8(path.data(), path.size()));
+    const bool halfFloat = target==GL_TEXTURE_3D && in.elementType()==TextureElementType::Float16;
+    in.checkFormat(halfFloat ? TextureElementType::Float16 : TextureElementType::Float32, 4,
+                   std::vector<uint64_t>(sizes.begin(), sizes.end()));
+    if(in.elementCount() != uint64_t(width)*height*depth)
+    {
+        std::cerr << "texture size in the file doesn't match the expected one\n";
+        throw MustQuit{};
+    }
+    auto data=in.readAll();
+    if(halfFloat)
+    {
+        // Computations are done in single precision, so unpack the data
+        QByteArray unpacked(in.elementCount()*sizeof(glm::vec4), Qt::Uninitialized);
+        halfFloatsToFloats(reinterpret_cast<const uint16_t*>(data.constData()), 4*in.elementCount(), in.valueScale(),
+                           reinterpret_cast<GLfloat*>(unpacked.data()));
+        data=unpacked;
+    }
+
+    gl.glBindTexture(target,texture);
+    if(target==GL_TEXTURE_3D)
+        gl.glTexImage3D(target,0,GL_RGBA32F,width,height,depth,0,GL_RGBA,GL_FLOAT,data.data());
+    else
+        gl.glTexImage2D(target,0,GL_RGBA32F,width,height,0,GL_RGBA,GL_FLOAT,data.data());
+    gl.glBindTexture(target,0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
+
 void setupTexture(TextureId id, const GLsizei width, const GLsizei height)
 {
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
@@ -55,7 +55,11 @@ void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString c
 DEFINE_EXPLICIT_BOOL(ReturnTextureData);
 std::vector<glm::vec4> saveTexture(GLenum target, GLuint texture, std::string_view name, std::string_view path,
                                    std::vector<int> const& sizes, ReturnTextureData=ReturnTextureData{false});
+// Loads a texture saved by saveTexture(). Physical dimensions may differ from the logical sizes saved in the file.
+void loadTexture(GLenum target, GLuint texture, std::string_view name, std::string_view path,
+                 std::vector<int> const& sizes, GLsizei width, GLsizei height, GLsizei depth=1);
 void createDirs(std::string const& path);
+void copyFile(std::string const& source, std::string const& target);
 
 class OutputIndentIncrease
 {
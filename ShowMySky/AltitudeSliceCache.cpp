@@ -0,0 +1,110 @@
+#include "AltitudeSliceCache.hpp"
+
+#include <new>
+#include "Texture4DSliceLoader.hpp"
+#include "../common/TextureFile.hpp"
+#include "../common/util.hpp"
+
+auto AltitudeSliceCache::load(TextureFileReader& file, const unsigned altIndex) -> Slice
+{
+    if(auto mapping=file.mapChunks(altIndex, 1))
+        return std::make_shared<const SliceData>(std::move(mapping));
+    std::vector<char> copy(file.chunkSize());
+    file.readChunks(altIndex, 1, copy.data());
+    return std::make_shared<const SliceData>(std::move(copy));
+}
+
+void AltitudeSliceCache::setMaxSize(const size_t maxSize)
+{
+    std::lock_guard lock(mutex);
+    maxSize_=maxSize;
+    evict();
+}
+
+size_t AltitudeSliceCache::maxSize() const
+{
+    std::lock_guard lock(mutex);
+    return maxSize_;
+}
+
+auto AltitudeSliceCache::find(QString const& path, const unsigned altIndex) -> Slice
+{
+    std::lock_guard lock(mutex);
+    const auto it=index.find({path, altIndex});
+    if(it==index.end()) return nullptr;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->slice;
+}
+
+bool AltitudeSliceCache::contains(QString const& path, const unsigned altIndex) const
+{
+    std::lock_guard lock(mutex);
+    return index.find({path, altIndex}) != index.end();
+}
+
+void AltitudeSliceCache::insert(QString const& path, const unsigned altIndex, Slice const& slice)
+{
+    std::lock_guard lock(mutex);
+    if(slice->size() > maxSize_) return;
+
+    Key key{path, altIndex};
+    if(const auto it=index.find(key); it!=index.end())
+    {
+        // Another thread has loaded the same slice, keep the existing copy
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+    entries.push_front({key, slice});
+    index.emplace(std::move(key), entries.begin());
+    size_+=slice->size();
+    evict();
+}
+
+void AltitudeSliceCache::clear()
+{
+    std::lock_guard lock(mutex);
+    entries.clear();
+    index.clear();
+    size_=0;
+}
+
+void AltitudeSliceCache::evict()
+{
+    while(size_ > maxSize_)
+    {
+        const auto& entry=entries.back();
+        size_-=entry.slice->size();
+        index.erase(entry.key);
+        entries.pop_back();
+    }
+}
+
+void AltitudeSliceCache::prefetch(QString const& path, const double altitudeCoord,
+                                  const unsigned countBelow, const unsigned countAbove)
+try
+{
+    // Verification of the checksums of the mapped slices makes the system read them into memory, so the loader gets
+    // them ready to use
+    TextureFileReader file(path);
+    if(file.sizes().empty() || file.sizes().back() < 2) return;
+    const unsigned numAltIntervals = file.sizes().back()-1;
+    const int floorAltIndex = Texture4DSliceLoader::altitudeSlicePosition(altitudeCoord, numAltIntervals).first;
+
+    std::vector<int> indices;
+    for(int n=1; n<=int(countBelow); ++n)
+        indices.push_back(floorAltIndex-n);
+    for(int n=1; n<=int(countAbove); ++n)
+        indices.push_back(floorAltIndex+1+n);
+    for(const int altIndex : indices)
+    {
+        if(altIndex<0 || altIndex>int(numAltIntervals) || contains(path, altIndex))
+            continue;
+        insert(path, altIndex, load(file, altIndex));
+    }
+}
+catch(DataLoadError const&)
+{
+}
+catch(std::bad_alloc const&)
+{
+}
@@ -0,0 +1,79 @@
+#ifndef INCLUDE_ONCE_8DF49662_034D_435E_8C45_66D8106A5CFF
+#define INCLUDE_ONCE_8DF49662_034D_435E_8C45_66D8106A5CFF
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <QString>
+#include "../common/TextureFile.hpp"
+
+/* Least-recently-used cache of altitude slices of 4D textures, as mapped or read (and checksum-verified) from the
+ * files. It lets the renderer switch between neighbouring altitude intervals without going to disk or verifying the
+ * checksums again, provided the slices have been prefetched. All the methods are thread-safe, so that the slices can
+ * be loaded and prefetched on worker threads.
+ */
+class AltitudeSliceCache
+{
+public:
+    /* Contents of an altitude slice: either a mapping of the slice alone, which is unmapped when the slice is evicted
+     * and doesn't keep the file open, or, if the file can't be mapped, a copy read from the file. Either way, the size
+     * counted against the budget is all the memory (or address space) the slice takes.
+     */
+    class SliceData
+    {
+        TextureFileMapping mapping_;
+        std::vector<char> copy_;
+        const char* data_;
+        size_t size_;
+    public:
+        explicit SliceData(TextureFileMapping mapping)
+            : mapping_(std::move(mapping)), data_(mapping_.data()), size_(mapping_.size()) {}
+        explicit SliceData(std::vector<char> copy)
+            : copy_(std::move(copy)), data_(copy_.data()), size_(copy_.size()) {}
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool mapped() const { return bool(mapping_); }
+    };
+    using Slice=std::shared_ptr<const SliceData>;
+
+    // Maps the slice from the file, or reads it if mapping fails. Throws DataLoadError.
+    static Slice load(TextureFileReader& file, unsigned altIndex);
+
+    explicit AltitudeSliceCache(size_t maxSize) : maxSize_(maxSize) {}
+    // Evicts the least recently used slices until the total size fits into maxSize (in bytes)
+    void setMaxSize(size_t maxSize);
+    size_t maxSize() const;
+    // Returns nullptr if the slice isn't in the cache
+    Slice find(QString const& path, unsigned altIndex);
+    bool contains(QString const& path, unsigned altIndex) const;
+    void insert(QString const& path, unsigned altIndex, Slice const& slice);
+    void clear();
+
+    /* Reads countBelow slices below and countAbove slices above the pair that Texture4DSliceLoader interpolates
+     * between for altitudeCoord, skipping the ones already cached. Unlike the other methods, this one does file I/O,
+     * so it's intended to be called on a worker thread. Errors are ignored: they will be reported when the slices are
+     * actually loaded.
+     */
+    void prefetch(QString const& path, double altitudeCoord, unsigned countBelow, unsigned countAbove);
+
+private:
+    using Key=std::pair<QString,unsigned>;
+    struct Entry
+    {
+        Key key;
+        Slice slice;
+    };
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries; //!< Most recently used first
+    std::map<Key,std::list<Entry>::iterator> index;
+    size_t size_=0;
+    size_t maxSize_;
+
+    void evict(); //!< Must be called with the mutex locked
+};
+
+#endif
@@ -8,15 +8,23 @@
 #include <cassert>
 #include <iterator>
 #include <iostream>
+#include <algorithm>
 #include <filesystem>
 #include <QFile>
+#include <QFileInfo>
 #include <QDebug>
+#include <QThread>
+#include <QRunnable>
+#include <QStandardPaths>
 #include <QRegularExpression>
 
 #include "util.hpp"
 #include "../common/const.hpp"
 #include "../common/util.hpp"
 #include "../common/EclipsedDoubleScatteringPrecomputer.hpp"
+#include "../common/EclipsedDoubleScatteringInterpolator.hpp"
+#include "../common/parallel.hpp"
+#include "../common/TextureFile.hpp"
 #include "api/ShowMySky/Settings.hpp"
 
 namespace fs=std::filesystem;
@@ -24,6 +32,42 @@ namespace fs=std::filesystem;
 namespace
 {
 
+// From GL_KHR_parallel_shader_compile, which may be missing from the headers
+constexpr GLenum COMPLETION_STATUS=0x91B1; // GL_COMPLETION_STATUS_KHR
+using MaxShaderCompilerThreadsFunc=void(QOPENGLF_APIENTRYP)(GLuint count);
+
+// Dynamic property of the programs built with the view direction shaders, holding the directory of their fragment
+// shaders, so that the programs made from cached binaries can be rebuilt when the view direction shaders change
+constexpr const char* FRAG_SHADERS_DIR_PROPERTY="fragShadersDir";
+
+// Changes of the eclipse geometry below these tolerances are ignored by the on-the-fly precomputations. They are far
+// finer than the precomputation textures can resolve: the Sun moves by this angle in about 0.15 s.
+constexpr double ECLIPSE_PRECOMPUTATION_ANGLE_TOLERANCE=1e-5; // rad
+constexpr double ECLIPSE_PRECOMPUTATION_ALTITUDE_TOLERANCE=1e-2; // m
+constexpr double ECLIPSE_PRECOMPUTATION_RELATIVE_DISTANCE_TOLERANCE=1e-6;
+// Estimates of the error of interpolation between eclipse keyframes above this are reported to the debug log
+constexpr double MAX_ECLIPSE_KEYFRAME_INTERPOLATION_ERROR=0.01;
+
+constexpr const char* precomputationProgramsVertShaderSrc=1+R"(
+#version 330
+in vec3 vertex;
+out vec3 position;
+void main()
+{
+    position=vertex;
+    gl_Position=vec4(position,1);
+}
+)";
+
+QString shaderInfoLog(QOpenGLFunctions_3_3_Core& gl, const GLuint shader)
+{
+    GLint length=0;
+    gl.glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    QByteArray log(std::max(length,1), '\0');
+    gl.glGetShaderInfoLog(shader, log.size(), nullptr, log.data());
+    return QString::fromUtf8(log.constData());
+}
+
 auto newTex(QOpenGLTexture::Target target)
 {
     return std::make_unique<QOpenGLTexture>(target);
@@ -65,84 +109,189 @@ public:
 # define OGL_TRACE()
 #endif
 
-}
-
-void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord)
+class FunctionRunnable : public QRunnable
 {
-    auto log=qDebug().nospace();
-
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error on entry to loadEclipsedDoubleScatteringTexture(\"%1\"): %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
-    }
-    log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
-
-    uint16_t numPointsPerSet;
+    std::function<void()> function;
+public:
+    FunctionRunnable(std::function<void()> const& function)
+        : function(function)
     {
-        const qint64 sizeToRead=sizeof numPointsPerSet;
-        if(file.read(reinterpret_cast<char*>(&numPointsPerSet), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
     }
-    const auto texSizeByViewAzimuth = params_.eclipsedDoubleScatteringTextureSize[0];
-    const auto texSizeByViewElevation = params_.eclipsedDoubleScatteringTextureSize[1];
-    const auto texSizeBySZA = params_.eclipsedDoubleScatteringTextureSize[2];
-    const auto texSizeByAltitude = params_.eclipsedDoubleScatteringTextureSize[3];
-    EclipsedDoubleScatteringPrecomputer precomputer(gl, params_, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA, 2);
-
-    const auto altTexIndex = altitudeCoord==1 ? numAltIntervalsIn4DTexture_-1 : altitudeCoord*numAltIntervalsIn4DTexture_;
-    const int floorAltIndex = std::floor(altTexIndex);
-    const auto fractAltIndex = altTexIndex-floorAltIndex;
-    const auto maxAltIndex = floorAltIndex+1;
+    void run() override { function(); }
+};
 
-    std::vector<glm::vec4> data(numPointsPerSet*texSizeBySZA*2);
+}
 
-    const auto sliceByteSize = numPointsPerSet*sizeof data[0];
-    const auto fileReadOffset = uint64_t(sliceByteSize)*texSizeBySZA*floorAltIndex;
-    const qint64 absoluteOffset=file.pos()+fileReadOffset;
-    log << "skipping to offset " << absoluteOffset << "... ";
-    if(!file.seek(absoluteOffset))
+GLuint AtmosphereRenderer::textureUploadBuffer(const unsigned index)
+{
+    while(textureUploadBuffers_.size() <= index)
     {
-        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
-            .arg(absoluteOffset).arg(path).arg(file.errorString())};
+        GLuint buffer=0;
+        gl.glGenBuffers(1, &buffer);
+        textureUploadBuffers_.push_back(buffer);
     }
+    return textureUploadBuffers_[index];
+}
 
-    const qint64 sizeToRead = data.size()*sizeof data[0];
-    if(file.read(reinterpret_cast<char*>(data.data()), sizeToRead) != sizeToRead)
-    {
-        throw DataLoadError{QObject::tr("Failed to read data from file \"%1\": %2")
-            .arg(path).arg(file.errorString())};
-    }
+auto AtmosphereRenderer::newTexture4D(const Texture4DSource::Slot slot) const -> TexturePtr
+{
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    auto texture = newTex(QOpenGLTexture::Target3D);
+    switch(slot)
+    {
+    case Texture4DSource::Slot::MultipleScattering:
+    case Texture4DSource::Slot::SingleScattering:
+        texture->setMinificationFilter(texFilter);
+        texture->setMagnificationFilter(texFilter);
+        texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+        break;
+    case Texture4DSource::Slot::SingleScatteringGuides01:
+    case Texture4DSource::Slot::SingleScatteringGuides02:
+        texture->setMinificationFilter(QOpenGLTexture::Linear);
+        texture->setMagnificationFilter(QOpenGLTexture::Linear);
+        texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+        break;
+    case Texture4DSource::Slot::EclipsedDoubleScattering:
+        texture->setMinificationFilter(texFilter);
+        texture->setMagnificationFilter(texFilter);
+        // relative azimuth
+        texture->setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
+        // VZA
+        texture->setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
+        // SZA
+        texture->setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
+        break;
+    }
+    return texture;
+}
 
-    size_t readOffset = 0;
-    for(int altIndex=floorAltIndex; altIndex<=maxAltIndex; ++altIndex)
+auto AtmosphereRenderer::texture4DSlot(Texture4DSource const& source) -> TexturePtr*
+{
+    // Textures may have been dropped after loading (e.g. inconsistent guides), so lookups must not create new entries
+    const auto findTextures = [&source](std::map<ScattererName,std::vector<TexturePtr>>& map) -> std::vector<TexturePtr>*
     {
-        for(int szaIndex=0; szaIndex<texSizeBySZA; ++szaIndex)
-        {
-            // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
-            const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*params_.lengthOfHorizRayFromGroundToBorderOfAtmo;
-            // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
-            // To avoid too many zeros that would make log interpolation problematic, we clamp the bottom value at 1 m. The same at the top.
-            const float cameraAltitude = std::clamp(float(sqrt(sqr(distToHorizon)+sqr(params_.earthRadius))-params_.earthRadius),
-                                                    1.f, params_.atmosphereHeight-1);
+        const auto it = map.find(source.scattererName);
+        return it==map.end() ? nullptr : &it->second;
+    };
+    std::vector<TexturePtr>* textures = nullptr;
+    switch(source.slot)
+    {
+    case Texture4DSource::Slot::MultipleScattering:
+        textures = &multipleScatteringTextures_;
+        break;
+    case Texture4DSource::Slot::SingleScattering:
+        textures = findTextures(singleScatteringTextures_);
+        break;
+    case Texture4DSource::Slot::SingleScatteringGuides01:
+        textures = findTextures(singleScatteringInterpolationGuidesTextures01_);
+        break;
+    case Texture4DSource::Slot::SingleScatteringGuides02:
+        textures = findTextures(singleScatteringInterpolationGuidesTextures02_);
+        break;
+    case Texture4DSource::Slot::EclipsedDoubleScattering:
+        textures = &eclipsedDoubleScatteringTextures_;
+        break;
+    }
+    if(!textures || source.index >= textures->size())
+        return nullptr;
+    return &(*textures)[source.index];
+}
 
-            precomputer.loadCoarseGridSamples(cameraAltitude, data.data()+readOffset, numPointsPerSet);
-            precomputer.generateTextureFromCoarseGridData(altIndex-floorAltIndex, szaIndex, cameraAltitude);
-            readOffset += numPointsPerSet;
-        }
-    }
+unsigned AtmosphereRenderer::numAltIntervals(Texture4DSource const& source) const
+{
+    if(source.slot == Texture4DSource::Slot::EclipsedDoubleScattering)
+        return params_.eclipsedDoubleScatteringTextureSize[3]-1;
+    return params_.scatteringTextureSize[3]-1;
+}
 
-    const size_t altSliceSize = texSizeByViewAzimuth * texSizeByViewElevation * texSizeBySZA;
-    auto texture = precomputer.texture();
-    assert(texture.size() == altSliceSize*2);
+float AtmosphereRenderer::bindUpperAltitudeSlice(QOpenGLShaderProgram& prog, const Texture4DSource::Slot slot,
+                                                 ScattererName const& scattererName, const unsigned index,
+                                                 const char*const samplerName, const int lowerSliceUnit, const int upperSliceUnit)
+{
+    // While the returned weight is zero, the shaders don't sample the upper slice, but the sampler must still refer
+    // to a unit with a 3D texture
+    prog.setUniformValue(samplerName, lowerSliceUnit);
+    if(!altitudeSlicesResident_)
+        return 0;
+
+    const auto source = std::find_if(texture4DSources_.begin(), texture4DSources_.end(),
+                                     [=](Texture4DSource const& candidate)
+                                     { return candidate.slot==slot && candidate.scattererName==scattererName &&
+                                              candidate.index==index; });
+    if(source == texture4DSources_.end())
+        return 0;
+    auto& upperSlice = upperAltitudeSliceTextures_[source-texture4DSources_.begin()];
+    if(!upperSlice)
+        return 0;
+
+    if(slot != Texture4DSource::Slot::SingleScatteringGuides01 && slot != Texture4DSource::Slot::SingleScatteringGuides02)
+    {
+        const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+        upperSlice->setMinificationFilter(texFilter);
+        upperSlice->setMagnificationFilter(texFilter);
+    }
+    upperSlice->bind(upperSliceUnit);
+    prog.setUniformValue(samplerName, upperSliceUnit);
+
+    // The altitude may have left the interval of the resident slices while the next pair is being loaded
+    const auto [floorAltIndex, fractAltIndex] = Texture4DSliceLoader::altitudeSlicePosition(altitudeUnitRangeTexCoord(),
+                                                                                           numAltIntervals(*source));
+    if(floorAltIndex == source->floorAltIndex)
+        return fractAltIndex;
+    return floorAltIndex < source->floorAltIndex ? 0 : 1;
+}
+
+std::vector<glm::vec4> AtmosphereRenderer::generateEclipsedDoubleScatteringTexture(Texture4DSliceLoader const& loader,
+                                                                                  const int maxThreads) const
+{
+    const auto texSizeByViewAzimuth = params_.eclipsedDoubleScatteringTextureSize[0];
+    const auto texSizeByViewElevation = params_.eclipsedDoubleScatteringTextureSize[1];
+    const auto texSizeBySZA = params_.eclipsedDoubleScatteringTextureSize[2];
+    const auto texSizeByAltitude = params_.eclipsedDoubleScatteringTextureSize[3];
 
-    for(size_t n = 0; n < altSliceSize; ++n)
+    const auto& sizes = loader.sizes();
+    if(sizes[1] != uint64_t(texSizeBySZA) || sizes[2] != uint64_t(texSizeByAltitude))
+    {
+        throw DataLoadError{QObject::tr("Unexpected size of texture in file \"%1\": %2×%3 instead of %4×%5")
+                            .arg(loader.path()).arg(sizes[1]).arg(sizes[2]).arg(texSizeBySZA).arg(texSizeByAltitude)};
+    }
+    const auto numPointsPerSet = sizes[0];
+    const int numSlices = loader.isSingleSlice() ? 1 : 2;
+    const int floorAltIndex = loader.floorAltIndex();
+    const auto fractAltIndex = loader.fractAltIndex();
+
+    // Each (altitude, SZA) slice is interpolated independently from its own samples, so the slices are distributed
+    // between threads, each with its own interpolator holding the intermediate data.
+    const int numSlicesToGenerate = numSlices*texSizeBySZA;
+    std::vector<std::unique_ptr<EclipsedDoubleScatteringInterpolator>> interpolators;
+    for(int n=0; n<parallelWorkerCount(numSlicesToGenerate, maxThreads); ++n)
+    {
+        interpolators.emplace_back(std::make_unique<EclipsedDoubleScatteringInterpolator>(
+                EclipsedDoubleScatteringPrecomputer::interpolationParameters(params_, texSizeByViewAzimuth,
+                                                                             texSizeByViewElevation)));
+    }
+    const size_t szaSliceSize = interpolators.front()->textureSliceSize();
+    const size_t altSliceSize = szaSliceSize * texSizeBySZA;
+    std::vector<glm::vec4> texture(altSliceSize*numSlices);
+    forEachInParallel(numSlicesToGenerate, [&](const int sliceIndex, const int worker)
+    {
+        const int sliceAltIndex = sliceIndex / texSizeBySZA;
+        const int szaIndex = sliceIndex % texSizeBySZA;
+        const int altIndex = floorAltIndex + sliceAltIndex;
+        // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
+        const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*params_.lengthOfHorizRayFromGroundToBorderOfAtmo;
+        // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
+        // To avoid too many zeros that would make log interpolation problematic, we clamp the bottom value at 1 m. The same at the top.
+        const float cameraAltitude = std::clamp(float(sqrt(sqr(distToHorizon)+sqr(params_.earthRadius))-params_.earthRadius),
+                                                1.f, params_.atmosphereHeight-1);
+
+        auto& interpolator = *interpolators[worker];
+        const auto data = loader.coarseGridSamples(sliceAltIndex);
+        interpolator.loadCoarseGridSamples(cameraAltitude, data+szaIndex*numPointsPerSet, numPointsPerSet);
+        interpolator.generateTextureSlice(cameraAltitude, &texture[sliceAltIndex*altSliceSize + szaIndex*szaSliceSize]);
+    }, maxThreads);
+
+    for(size_t n = 0; numSlices == 2 && n < altSliceSize; ++n)
     {
         const auto interpolated = texture[n] + fractAltIndex * (texture[n+altSliceSize] - texture[n]);
         if(std::isnan(interpolated.x))
@@ -151,9 +300,34 @@ void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path
         }
         texture[n] = interpolated;
     }
+    texture.resize(altSliceSize);
+    return texture;
+}
 
+void AtmosphereRenderer::uploadEclipsedDoubleScatteringTexture(std::vector<glm::vec4> const& texture)
+{
+    const auto texSizeByViewAzimuth = params_.eclipsedDoubleScatteringTextureSize[0];
+    const auto texSizeByViewElevation = params_.eclipsedDoubleScatteringTextureSize[1];
+    const auto texSizeBySZA = params_.eclipsedDoubleScatteringTextureSize[2];
+    assert(texture.size() == size_t(texSizeByViewAzimuth)*texSizeByViewElevation*texSizeBySZA);
     gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA,
                     0, GL_RGBA, GL_FLOAT, texture.data());
+}
+
+void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord)
+{
+    auto log=qDebug().nospace();
+
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        throw DataLoadError{QObject::tr("GL error on entry to loadEclipsedDoubleScatteringTexture(\"%1\"): %2")
+                            .arg(path).arg(openglErrorString(err).c_str())};
+    }
+    log << "Loading texture from " << path << "... ";
+    Texture4DSliceLoader loader(gl, path, altitudeCoord, Texture4DType::EclipsedDoubleScattering, 0, altitudeSliceCache());
+    log << "reading altitude slices " << loader.floorAltIndex() << " and " << loader.floorAltIndex()+1 << "... ";
+    loader.interpolate();
+    uploadEclipsedDoubleScatteringTexture(generateEclipsedDoubleScatteringTexture(loader, QThread::idealThreadCount()));
 
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
@@ -164,7 +338,7 @@ void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path
     log << "done";
 }
 
-void AtmosphereRenderer::loadTexture4D(QString const& path, const float altitudeCoord, Texture4DType texType)
+float AtmosphereRenderer::loadTexture4D(QString const& path, const float altitudeCoord, Texture4DType texType)
 {
     auto log=qDebug().nospace();
 
@@ -174,84 +348,12 @@ void AtmosphereRenderer::loadTexture4D(QString const& path, const float altitude
                             .arg(path).arg(openglErrorString(err).c_str())};
     }
     log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
-
-    uint16_t sizes[4];
-    {
-        const qint64 sizeToRead=sizeof sizes;
-        if(file.read(reinterpret_cast<char*>(sizes), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
-    }
+    Texture4DSliceLoader loader(gl, path, altitudeCoord, texType, textureUploadBuffer(0), altitudeSliceCache());
+    const auto& sizes = loader.sizes();
     log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "×" << sizes[2] << "×" << sizes[3] << "... ";
-
-    const size_t subpixelsPerPixel = texType==Texture4DType::InterpolationGuides ? 1 : 4;
-    const size_t subpixelSize = texType==Texture4DType::InterpolationGuides ? sizeof(GLshort) : sizeof(GLfloat);
-    const size_t pixelSize = subpixelsPerPixel*subpixelSize;
-    const qint64 expectedFileSize = file.pos() + pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
-    if(expectedFileSize != file.size())
-    {
-        throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4×%5×%6 from file header.\nThe expected size is %7 bytes.")
-                            .arg(path).arg(file.size()).arg(sizes[0]).arg(sizes[1]).arg(sizes[2]).arg(sizes[3]).arg(expectedFileSize)};
-    }
-
-    numAltIntervalsIn4DTexture_ = sizes[3]-1;
-    const auto altTexIndex = altitudeCoord==1 ? numAltIntervalsIn4DTexture_-1 : altitudeCoord*numAltIntervalsIn4DTexture_;
-    const auto floorAltIndex = std::floor(altTexIndex);
-    const auto fractAltIndex = altTexIndex-floorAltIndex;
-
-    const auto readOffset = pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*uint64_t(floorAltIndex);
-    sizes[3]=2;
-    const qint64 sizeToRead = pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
-
-    const std::unique_ptr<char[]> data(new char[sizeToRead]);
-
-    const qint64 absoluteOffset=file.pos()+readOffset;
-    log << "skipping to offset " << absoluteOffset << "... ";
-    if(!file.seek(absoluteOffset))
-    {
-        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
-                            .arg(absoluteOffset).arg(path).arg(file.errorString())};
-    }
-    const auto actuallyRead=file.read(data.get(), sizeToRead);
-    if(actuallyRead != sizeToRead)
-    {
-        const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
-                                            : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(sizeToRead).arg(actuallyRead);
-        throw DataLoadError{error};
-    }
-
-    const auto altSliceSize = size_t(sizes[0])*sizes[1]*sizes[2];
-    if(texType == Texture4DType::InterpolationGuides)
-    {
-        std::unique_ptr<int16_t[]> texData(new int16_t[altSliceSize]);
-        for(size_t n = 0; n < altSliceSize; ++n)
-        {
-            int16_t lower, upper;
-            assert(sizeof lower == pixelSize);
-            std::memcpy(&lower, data.get() + n * pixelSize, pixelSize);
-            std::memcpy(&upper, data.get() + (n+altSliceSize) * pixelSize, pixelSize);
-            texData[n] = lower + fractAltIndex*(upper-lower);
-        }
-        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_R16_SNORM, sizes[0], sizes[1], sizes[2], 0, GL_RED, GL_SHORT, texData.get());
-    }
-    else
-    {
-        std::unique_ptr<glm::vec4[]> texData(new glm::vec4[altSliceSize]);
-        for(size_t n = 0; n < altSliceSize; ++n)
-        {
-            glm::vec4 lower, upper;
-            assert(sizeof lower == pixelSize);
-            std::memcpy(&lower, data.get() + n * pixelSize, pixelSize);
-            std::memcpy(&upper, data.get() + (n+altSliceSize) * pixelSize, pixelSize);
-            texData[n] = lower + fractAltIndex*(upper-lower);
-        }
-        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, sizes[0], sizes[1], sizes[2], 0, GL_RGBA, GL_FLOAT, texData.get());
-    }
+    log << "reading altitude slices " << loader.floorAltIndex() << " and " << loader.floorAltIndex()+1 << "... ";
+    loader.interpolate();
+    loader.upload();
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
         throw DataLoadError{QObject::tr("GL error in loadTexture4D(\"%1\") after glTexImage3D() call: %2")
@@ -259,6 +361,7 @@ void AtmosphereRenderer::loadTexture4D(QString const& path, const float altitude
     }
 
     log << "done";
+    return loader.valueScale();
 }
 
 glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
@@ -271,41 +374,13 @@ glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
                             .arg(path).arg(openglErrorString(err).c_str())};
     }
     log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
-
-    uint16_t sizes[2];
-    {
-        const qint64 sizeToRead=sizeof sizes;
-        if(file.read(reinterpret_cast<char*>(sizes), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
-    }
-    const auto subpixelCount = 4*uint64_t(sizes[0])*sizes[1];
+    TextureFileReader file(path);
+    file.checkFormat(TextureElementType::Float32, 4, {0,0});
+    const glm::ivec2 sizes(file.sizes()[0], file.sizes()[1]);
     log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "... ";
 
-    if(const qint64 expectedFileSize = subpixelCount*sizeof(GLfloat)+file.pos();
-       expectedFileSize != file.size())
-    {
-        throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4 from file header.\nThe expected size is %5 bytes.")
-                            .arg(path).arg(file.size()).arg(sizes[0]).arg(sizes[1]).arg(expectedFileSize)};
-    }
-
-    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
-    {
-        const qint64 sizeToRead=subpixelCount*sizeof subpixels[0];
-        const auto actuallyRead=file.read(reinterpret_cast<char*>(subpixels.get()), sizeToRead);
-        if(actuallyRead != sizeToRead)
-        {
-            const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
-                                                : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(sizeToRead).arg(actuallyRead);
-            throw DataLoadError{error};
-        }
-    }
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,sizes[0],sizes[1],0,GL_RGBA,GL_FLOAT,subpixels.get());
+    const auto subpixels = file.readAll();
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,sizes[0],sizes[1],0,GL_RGBA,GL_FLOAT,subpixels.data());
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
         throw DataLoadError{QObject::tr("GL error in loadTexture2D(\"%1\") after glTexImage2D() call: %2")
@@ -376,8 +451,17 @@ double AtmosphereRenderer::altitudeUnitRangeTexCoord() const
 
 void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStepsOnly)
 {
+    using Slot=Texture4DSource::Slot;
     const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
     const auto altCoord = altCoordToLoad_;
+    const auto removeGuidesSources = [this]
+    {
+        texture4DSources_.erase(std::remove_if(texture4DSources_.begin(), texture4DSources_.end(),
+                                               [](Texture4DSource const& source)
+                                               { return source.slot==Slot::SingleScatteringGuides01 ||
+                                                        source.slot==Slot::SingleScatteringGuides02; }),
+                                texture4DSources_.end());
+    };
 
     if(countStepsOnly)
     {
@@ -385,7 +469,12 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
     }
     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
     {
+        texture4DSources_.clear();
+        // The initial load interpolates on CPU, the next reload switches to resident slices if needed
+        altitudeSlicesResident_ = false;
+        upperAltitudeSliceTextures_.clear();
         multipleScatteringTextures_.clear();
+        multipleScatteringTextureScales_.clear();
         ++loadingStepsDone_; return;
     }
     if(const auto filename=pathToData_+"/multiple-scattering-xyzw.f32"; QFile::exists(filename))
@@ -396,12 +485,9 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
         }
         else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
         {
-            auto& tex=*multipleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-            tex.setMinificationFilter(texFilter);
-            tex.setMagnificationFilter(texFilter);
-            tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-            tex.bind();
-            loadTexture4D(filename, altCoord);
+            multipleScatteringTextures_.emplace_back(newTexture4D(Slot::MultipleScattering))->bind();
+            multipleScatteringTextureScales_.push_back(loadTexture4D(filename, altCoord));
+            texture4DSources_.push_back({Slot::MultipleScattering, {}, 0, filename});
             ++loadingStepsDone_; return;
         }
     }
@@ -417,12 +503,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
             if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
                 continue;
 
-            auto& tex=*multipleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-            tex.setMinificationFilter(texFilter);
-            tex.setMagnificationFilter(texFilter);
-            tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-            tex.bind();
-            loadTexture4D(QString("%1/multiple-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex), altCoord);
+            const auto filename = QString("%1/multiple-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+            multipleScatteringTextures_.emplace_back(newTexture4D(Slot::MultipleScattering))->bind();
+            multipleScatteringTextureScales_.push_back(loadTexture4D(filename, altCoord));
+            texture4DSources_.push_back({Slot::MultipleScattering, {}, wlSetIndex, filename});
             ++loadingStepsDone_; return;
         }
     }
@@ -434,6 +518,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
     {
         singleScatteringTextures_.clear();
+        singleScatteringTextureScales_.clear();
         ++loadingStepsDone_; return;
     }
 
@@ -451,6 +536,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
     for(const auto& scatterer : params_.scatterers)
     {
         auto& texturesPerWLSet=singleScatteringTextures_[scatterer.name];
+        auto& textureScalesPerWLSet=singleScatteringTextureScales_[scatterer.name];
         switch(scatterer.phaseFunctionType)
         {
         case PhaseFunctionType::General:
@@ -465,12 +551,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
                     continue;
 
-                auto& texture=*texturesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                texture.setMinificationFilter(texFilter);
-                texture.setMagnificationFilter(texFilter);
-                texture.setWrapMode(QOpenGLTexture::ClampToEdge);
-                texture.bind();
-                loadTexture4D(QString("%1/single-scattering/%2/%3.f32").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name), altCoord);
+                const auto filename = QString("%1/single-scattering/%2/%3.f32").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name);
+                texturesPerWLSet.emplace_back(newTexture4D(Slot::SingleScattering))->bind();
+                textureScalesPerWLSet.push_back(loadTexture4D(filename, altCoord));
+                texture4DSources_.push_back({Slot::SingleScattering, scatterer.name, wlSetIndex, filename});
                 ++loadingStepsDone_; return;
             }
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
@@ -485,12 +569,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                     {
                         auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures01_[scatterer.name];
-                        auto& tex=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                        tex.setMinificationFilter(QOpenGLTexture::Linear);
-                        tex.setMagnificationFilter(QOpenGLTexture::Linear);
-                        tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-                        tex.bind();
+                        guidesPerWLSet.emplace_back(newTexture4D(Slot::SingleScatteringGuides01))->bind();
                         loadTexture4D(filename, altCoord, Texture4DType::InterpolationGuides);
+                        texture4DSources_.push_back({Slot::SingleScatteringGuides01, scatterer.name,
+                                                     unsigned(guidesPerWLSet.size()-1), filename});
                         ++loadingStepsDone_; return;
                     }
                 }
@@ -507,12 +589,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                     {
                         auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures02_[scatterer.name];
-                        auto& tex=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                        tex.setMinificationFilter(QOpenGLTexture::Linear);
-                        tex.setMagnificationFilter(QOpenGLTexture::Linear);
-                        tex.setWrapMode(QOpenGLTexture::ClampToEdge);
-                        tex.bind();
+                        guidesPerWLSet.emplace_back(newTexture4D(Slot::SingleScatteringGuides02))->bind();
                         loadTexture4D(filename, altCoord, Texture4DType::InterpolationGuides);
+                        texture4DSources_.push_back({Slot::SingleScatteringGuides02, scatterer.name,
+                                                     unsigned(guidesPerWLSet.size()-1), filename});
                         ++loadingStepsDone_; return;
                     }
                 }
@@ -530,6 +610,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                               << singleScatteringInterpolationGuidesTextures02_.size() << ". Ignoring the guides.\n";
                     singleScatteringInterpolationGuidesTextures01_.clear();
                     singleScatteringInterpolationGuidesTextures02_.clear();
+                    removeGuidesSources();
                 }
                 ++loadingStepsDone_; return;
             }
@@ -544,12 +625,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
             }
             else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
             {
-                auto& texture=*texturesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                texture.setMinificationFilter(texFilter);
-                texture.setMagnificationFilter(texFilter);
-                texture.setWrapMode(QOpenGLTexture::ClampToEdge);
-                texture.bind();
-                loadTexture4D(QString("%1/single-scattering/%2-xyzw.f32").arg(pathToData_).arg(scatterer.name), altCoord);
+                const auto filename = QString("%1/single-scattering/%2-xyzw.f32").arg(pathToData_).arg(scatterer.name);
+                texturesPerWLSet.emplace_back(newTexture4D(Slot::SingleScattering))->bind();
+                textureScalesPerWLSet.push_back(loadTexture4D(filename, altCoord));
+                texture4DSources_.push_back({Slot::SingleScattering, scatterer.name, 0, filename});
                 ++loadingStepsDone_; return;
             }
 
@@ -563,12 +642,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                 {
                     auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures01_[scatterer.name];
-                    auto& texture=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                    texture.setMinificationFilter(QOpenGLTexture::Linear);
-                    texture.setMagnificationFilter(QOpenGLTexture::Linear);
-                    texture.setWrapMode(QOpenGLTexture::ClampToEdge);
-                    texture.bind();
+                    guidesPerWLSet.emplace_back(newTexture4D(Slot::SingleScatteringGuides01))->bind();
                     loadTexture4D(guidesFilename01, altCoord, Texture4DType::InterpolationGuides);
+                    texture4DSources_.push_back({Slot::SingleScatteringGuides01, scatterer.name,
+                                                 unsigned(guidesPerWLSet.size()-1), guidesFilename01});
                     ++loadingStepsDone_; return;
                 }
             }
@@ -582,12 +659,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                 {
                     auto& guidesPerWLSet=singleScatteringInterpolationGuidesTextures02_[scatterer.name];
-                    auto& texture=*guidesPerWLSet.emplace_back(newTex(QOpenGLTexture::Target3D));
-                    texture.setMinificationFilter(QOpenGLTexture::Linear);
-                    texture.setMagnificationFilter(QOpenGLTexture::Linear);
-                    texture.setWrapMode(QOpenGLTexture::ClampToEdge);
-                    texture.bind();
+                    guidesPerWLSet.emplace_back(newTexture4D(Slot::SingleScatteringGuides02))->bind();
                     loadTexture4D(guidesFilename02, altCoord, Texture4DType::InterpolationGuides);
+                    texture4DSources_.push_back({Slot::SingleScatteringGuides02, scatterer.name,
+                                                 unsigned(guidesPerWLSet.size()-1), guidesFilename02});
                     ++loadingStepsDone_; return;
                 }
             }
@@ -606,6 +681,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                               << ". Ignoring the guides.\n";
                     singleScatteringInterpolationGuidesTextures01_.clear();
                     singleScatteringInterpolationGuidesTextures02_.clear();
+                    removeGuidesSources();
                 }
                 ++loadingStepsDone_; return;
             }
@@ -633,19 +709,9 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
             }
             else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
             {
-                auto& texture=*eclipsedDoubleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-                texture.setMinificationFilter(texFilter);
-                texture.setMagnificationFilter(texFilter);
-                // relative azimuth
-                texture.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
-                // VZA
-                texture.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
-                // SZA
-                texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
-
-                texture.bind();
-                loadEclipsedDoubleScatteringTexture(QString("%1/eclipsed-double-scattering-xyzw.f32")
-                                                     .arg(pathToData_), altCoord);
+                eclipsedDoubleScatteringTextures_.emplace_back(newTexture4D(Slot::EclipsedDoubleScattering))->bind();
+                loadEclipsedDoubleScatteringTexture(filename, altCoord);
+                texture4DSources_.push_back({Slot::EclipsedDoubleScattering, {}, 0, filename});
 
                 ++loadingStepsDone_; return;
             }
@@ -662,19 +728,10 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
                     continue;
 
-                auto& texture=*eclipsedDoubleScatteringTextures_.emplace_back(newTex(QOpenGLTexture::Target3D));
-                texture.setMinificationFilter(texFilter);
-                texture.setMagnificationFilter(texFilter);
-                // relative azimuth
-                texture.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
-                // VZA
-                texture.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
-                // SZA
-                texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
-
-                texture.bind();
-                loadEclipsedDoubleScatteringTexture(QString("%1/eclipsed-double-scattering-wlset%2.f32")
-                                                     .arg(pathToData_).arg(wlSetIndex), altCoord);
+                const auto filename = QString("%1/eclipsed-double-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
+                eclipsedDoubleScatteringTextures_.emplace_back(newTexture4D(Slot::EclipsedDoubleScattering))->bind();
+                loadEclipsedDoubleScatteringTexture(filename, altCoord);
+                texture4DSources_.push_back({Slot::EclipsedDoubleScattering, {}, wlSetIndex, filename});
 
                 ++loadingStepsDone_; return;
             }
@@ -758,6 +815,144 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
     }
 }
 
+QString AtmosphereRenderer::resolveShaderSourceReference(QString const& referencePath) const
+{
+    const auto name=QString::fromUtf8(readFullFile(referencePath)).trimmed();
+    // The reference may only name a file in the sources directory
+    if(name.isEmpty() || QFileInfo(name).fileName()!=name || name==".." || name==".")
+        throw DataLoadError{QObject::tr("Shader source reference \"%1\" contains invalid file name").arg(referencePath)};
+    return QString("%1/shaders/%2/%3").arg(pathToData_).arg(SHADER_SOURCES_DIR_NAME).arg(name);
+}
+
+void AtmosphereRenderer::buildProgram(QOpenGLShaderProgram& program, QString const& fragShadersDir,
+                                      const CommonShaders commonShaders, QString const& description)
+{
+    // Paths of the sources along with the descriptions for error messages
+    std::vector<std::pair<QString,QString>> fragShaderFiles;
+    for(const auto& shaderFile : fs::directory_iterator(fs::u8path(fragShadersDir.toStdString())))
+    {
+        const auto path=QString::fromStdString(shaderFile.path().u8string());
+        if(path.endsWith(SHADER_SOURCE_REFERENCE_SUFFIX))
+        {
+            const auto sourcePath=resolveShaderSourceReference(path);
+            fragShaderFiles.emplace_back(sourcePath, QObject::tr("shader file \"%1\" referenced by \"%2\"").arg(sourcePath).arg(path));
+        }
+        else
+        {
+            fragShaderFiles.emplace_back(path, QObject::tr("shader file \"%1\"").arg(path));
+        }
+    }
+    // Directory order is unspecified, so sort the files to get a stable key for the cache
+    std::sort(fragShaderFiles.begin(), fragShaderFiles.end());
+
+    std::vector<ProgramBinaryCache::Shader> shaders;
+    std::vector<FragShader*> fragShaders;
+    for(const auto& file : fragShaderFiles)
+    {
+        const auto& path=file.first;
+        auto it=fragShaders_.find(path);
+        if(it==fragShaders_.end())
+            it=fragShaders_.emplace(path, FragShader{readFullFile(path)}).first;
+        fragShaders.push_back(&it->second);
+        shaders.emplace_back(QOpenGLShader::Fragment, it->second.source);
+    }
+    ProgramBinaryCache::AttribLocations attribLocations;
+    if(commonShaders==CommonShaders::ViewDirection)
+    {
+        shaders.emplace_back(QOpenGLShader::Fragment, viewDirFragShaderSrc_);
+        shaders.emplace_back(QOpenGLShader::Vertex, viewDirVertShaderSrc_);
+        attribLocations=viewDirBindAttribLocations_;
+        program.setProperty(FRAG_SHADERS_DIR_PROPERTY, fragShadersDir);
+    }
+    else
+    {
+        shaders.emplace_back(QOpenGLShader::Vertex, precomputationProgramsVertShaderSrc);
+    }
+
+    const auto key=programBinaryCache_->key(shaders, attribLocations);
+    if(programBinaryCache_->load(program, key))
+        return;
+
+    // Compilation and linking are only started here, and their results are checked in finishPendingPrograms(), so
+    // that a driver supporting parallel shader compilation can build several programs at once
+    if(!program.create())
+        throw DataLoadError{QObject::tr("Failed to create %1").arg(description)};
+    PendingProgram pending{&program, description, {}, key};
+    for(unsigned n=0; n<fragShaderFiles.size(); ++n)
+    {
+        auto& fragShader=*fragShaders[n];
+        if(!fragShader.shader)
+        {
+            fragShader.shader=gl.glCreateShader(GL_FRAGMENT_SHADER);
+            const char*const sourceData=fragShader.source.constData();
+            const GLint sourceSize=fragShader.source.size();
+            gl.glShaderSource(fragShader.shader, 1, &sourceData, &sourceSize);
+            gl.glCompileShader(fragShader.shader);
+        }
+        gl.glAttachShader(program.programId(), fragShader.shader);
+        pending.shaders.emplace_back(fragShader.shader, fragShaderFiles[n].second);
+    }
+    if(commonShaders==CommonShaders::ViewDirection)
+    {
+        gl.glAttachShader(program.programId(), viewDirFragShader_->shaderId());
+        gl.glAttachShader(program.programId(), viewDirVertShader_->shaderId());
+        for(const auto& b : viewDirBindAttribLocations_)
+            program.bindAttributeLocation(b.first.c_str(), b.second);
+    }
+    else
+    {
+        gl.glAttachShader(program.programId(), precomputationProgramsVertShader_->shaderId());
+    }
+    programBinaryCache_->prepareForLinking(program);
+    gl.glLinkProgram(program.programId());
+    pendingPrograms_.push_back(std::move(pending));
+
+    finishPendingPrograms(maxPendingPrograms_);
+}
+
+void AtmosphereRenderer::finishPendingPrograms(const size_t maxToLeave)
+{
+    while(!pendingPrograms_.empty())
+    {
+        auto& pending=pendingPrograms_.front();
+        if(pendingPrograms_.size() <= maxToLeave)
+        {
+            // Don't wait for the driver, only collect what it has already finished
+            GLint completed=GL_FALSE;
+            gl.glGetProgramiv(pending.program->programId(), COMPLETION_STATUS, &completed);
+            if(!completed) return;
+        }
+
+        // Querying the statuses waits for the driver to complete the work
+        for(const auto& [shader, description] : pending.shaders)
+        {
+            GLint compiled=GL_FALSE;
+            gl.glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if(!compiled)
+                throw DataLoadError{QObject::tr("Failed to compile %1:\n%2").arg(description).arg(shaderInfoLog(gl, shader))};
+        }
+        // No shaders have been added via QOpenGLShaderProgram, so this only checks the link status
+        link(*pending.program, pending.description);
+        programBinaryCache_->save(*pending.program, pending.cacheKey);
+        pendingPrograms_.pop_front();
+    }
+}
+
+void AtmosphereRenderer::abandonPendingPrograms()
+{
+    pendingPrograms_.clear();
+    releaseFragShaders();
+}
+
+void AtmosphereRenderer::releaseFragShaders()
+{
+    // The shaders attached to programs are only flagged for deletion, and are deleted together with the programs
+    for(const auto& [path, fragShader] : fragShaders_)
+        if(fragShader.shader)
+            gl.glDeleteShader(fragShader.shader);
+    fragShaders_.clear();
+}
+
 void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
 {
     if(countStepsOnly)
@@ -766,6 +961,24 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
     }
     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
     {
+        if(!programBinaryCache_)
+        {
+            programBinaryCache_=std::make_unique<ProgramBinaryCache>(
+                QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)+"/ShowMySky/program-binaries");
+        }
+        abandonPendingPrograms();
+        maxPendingPrograms_=0;
+        if(const auto context=QOpenGLContext::currentContext();
+           context->hasExtension("GL_KHR_parallel_shader_compile") || context->hasExtension("GL_ARB_parallel_shader_compile"))
+        {
+            // Let the driver use as many threads as it wants, and keep enough programs in flight to occupy them
+            const auto maxShaderCompilerThreads=reinterpret_cast<MaxShaderCompilerThreadsFunc>(
+                context->getProcAddress(context->hasExtension("GL_KHR_parallel_shader_compile") ?
+                                            "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB"));
+            if(maxShaderCompilerThreads)
+                maxShaderCompilerThreads(0xFFFFFFFF);
+            maxPendingPrograms_=std::max(2, 2*QThread::idealThreadCount());
+        }
         viewDirVertShader_.reset(new QOpenGLShader(QOpenGLShader::Vertex));
         viewDirFragShader_.reset(new QOpenGLShader(QOpenGLShader::Fragment));
         if(!viewDirVertShader_->compileSourceCode(viewDirVertShaderSrc_))
@@ -818,15 +1031,8 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
                     qDebug().nospace() << "Loading shaders from " << scatDir << "...";
                     auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-                    for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                        addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-                    program.addShader(viewDirFragShader_.get());
-                    program.addShader(viewDirVertShader_.get());
-                    for(const auto& b : viewDirBindAttribLocations_)
-                        program.bindAttributeLocation(b.first.c_str(), b.second);
-
-                    link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
+                    buildProgram(program, scatDir, CommonShaders::ViewDirection,
+                                 QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
                     ++loadingStepsDone_; return;
                 }
             }
@@ -845,15 +1051,8 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
                                                                                 .arg(scatterer.name);
                 qDebug().nospace() << "Loading shaders from " << scatDir << "...";
                 auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
-                for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                    addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-                program.addShader(viewDirFragShader_.get());
-                program.addShader(viewDirVertShader_.get());
-                for(const auto& b : viewDirBindAttribLocations_)
-                    program.bindAttributeLocation(b.first.c_str(), b.second);
-
-                link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
+                buildProgram(program, scatDir, CommonShaders::ViewDirection,
+                             QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
                 ++loadingStepsDone_; return;
             }
         }
@@ -902,15 +1101,8 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
                     qDebug().nospace() << "Loading shaders from " << scatDir << "...";
                     auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-                    for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                        addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-                    program.addShader(viewDirFragShader_.get());
-                    program.addShader(viewDirVertShader_.get());
-                    for(const auto& b : viewDirBindAttribLocations_)
-                        program.bindAttributeLocation(b.first.c_str(), b.second);
-
-                    link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
+                    buildProgram(program, scatDir, CommonShaders::ViewDirection,
+                                 QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
                     ++loadingStepsDone_; return;
                 }
             }
@@ -930,15 +1122,8 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
                 qDebug().nospace() << "Loading shaders from " << scatDir << "...";
                 auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-                for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                    addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-                program.addShader(viewDirFragShader_.get());
-                program.addShader(viewDirVertShader_.get());
-                for(const auto& b : viewDirBindAttribLocations_)
-                    program.bindAttributeLocation(b.first.c_str(), b.second);
-
-                link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
+                buildProgram(program, scatDir, CommonShaders::ViewDirection,
+                             QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
                 ++loadingStepsDone_; return;
             }
         }
@@ -950,16 +1135,6 @@ void AtmosphereRenderer::loadShaders(const CountStepsOnly countStepsOnly)
     }
     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
     {
-        static constexpr const char* precomputationProgramsVertShaderSrc=1+R"(
-#version 330
-in vec3 vertex;
-out vec3 position;
-void main()
-{
-    position=vertex;
-    gl_Position=vec4(position,1);
-}
-)";
         precomputationProgramsVertShader_.reset(new QOpenGLShader(QOpenGLShader::Vertex));
         if(!precomputationProgramsVertShader_->compileSourceCode(precomputationProgramsVertShaderSrc))
             throw DataLoadError{QObject::tr("Failed to compile vertex shader for on-the-fly precomputation of eclipsed scattering:\n%2")
@@ -998,12 +1173,8 @@ void main()
             qDebug().nospace() << "Loading shaders from " << scatDir << "...";
             auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-            program.addShader(precomputationProgramsVertShader_.get());
-
-            link(program, QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
+            buildProgram(program, scatDir, CommonShaders::Precomputation,
+                         QObject::tr("shader program for scatterer \"%1\"").arg(scatterer.name));
             ++loadingStepsDone_; return;
         }
     }
@@ -1034,15 +1205,8 @@ void main()
             qDebug().nospace() << "Loading shaders from " << scatDir << "...";
             auto& program=*eclipsedDoubleScatteringPrecomputedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-
-            link(program, QObject::tr("precomputed eclipsed double scattering shader program"));
+            buildProgram(program, scatDir, CommonShaders::ViewDirection,
+                         QObject::tr("precomputed eclipsed double scattering shader program"));
             ++loadingStepsDone_; return;
         }
     }
@@ -1058,15 +1222,8 @@ void main()
             qDebug().nospace() << "Loading shaders from " << scatDir << "...";
             auto& program=*eclipsedDoubleScatteringPrecomputedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-
-            link(program, QObject::tr("precomputed eclipsed double scattering shader program"));
+            buildProgram(program, scatDir, CommonShaders::ViewDirection,
+                         QObject::tr("precomputed eclipsed double scattering shader program"));
             ++loadingStepsDone_; return;
         }
     }
@@ -1079,6 +1236,7 @@ void main()
     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
     {
         eclipsedDoubleScatteringPrecomputationPrograms_.clear();
+        eclipsedDoubleScatteringPrecomputers_.clear();
         ++loadingStepsDone_; return;
     }
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
@@ -1095,12 +1253,8 @@ void main()
         qDebug().nospace() << "Loading shaders from " << scatDir << "...";
         auto& program=*eclipsedDoubleScatteringPrecomputationPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
 
-        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
-            addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
-
-        program.addShader(precomputationProgramsVertShader_.get());
-
-        link(program, QObject::tr("on-the-fly eclipsed double scattering shader program"));
+        buildProgram(program, scatDir, CommonShaders::Precomputation,
+                     QObject::tr("on-the-fly eclipsed double scattering shader program"));
         ++loadingStepsDone_; return;
     }
 
@@ -1128,13 +1282,7 @@ void main()
             auto& program=*multipleScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
             const auto wlDir=QString("%1/shaders/multiple-scattering/%2").arg(pathToData_).arg(wlSetIndex);
             qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-            link(program, QObject::tr("multiple scattering shader program"));
+            buildProgram(program, wlDir, CommonShaders::ViewDirection, QObject::tr("multiple scattering shader program"));
             ++loadingStepsDone_; return;
         }
     }
@@ -1149,17 +1297,29 @@ void main()
             auto& program=*multipleScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
             const auto wlDir=pathToData_+"/shaders/multiple-scattering/";
             qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-            link(program, QObject::tr("multiple scattering shader program"));
+            buildProgram(program, wlDir, CommonShaders::ViewDirection, QObject::tr("multiple scattering shader program"));
             ++loadingStepsDone_; return;
         }
     }
 
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        allWavelengthSetsMultipleScatteringProgram_.reset();
+        const auto dir=QString("%1/shaders/multiple-scattering/%2").arg(pathToData_).arg(ALL_WAVELENGTH_SETS_SHADER_DIR_NAME);
+        if(QFile::exists(dir))
+        {
+            allWavelengthSetsMultipleScatteringProgram_=std::make_unique<QOpenGLShaderProgram>();
+            qDebug().nospace() << "Loading shaders from " << dir << "...";
+            buildProgram(*allWavelengthSetsMultipleScatteringProgram_, dir, CommonShaders::ViewDirection,
+                         QObject::tr("multiple scattering shader program for all wavelength sets"));
+        }
+        ++loadingStepsDone_; return;
+    }
+
     if(countStepsOnly)
     {
         ++totalLoadingStepsToDo_;
@@ -1182,13 +1342,25 @@ void main()
         auto& program=*zeroOrderScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
         const auto wlDir=QString("%1/shaders/zero-order-scattering/%2").arg(pathToData_).arg(wlSetIndex);
         qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-            addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-        program.addShader(viewDirFragShader_.get());
-        program.addShader(viewDirVertShader_.get());
-        for(const auto& b : viewDirBindAttribLocations_)
-            program.bindAttributeLocation(b.first.c_str(), b.second);
-        link(program, QObject::tr("zero-order scattering shader program"));
+        buildProgram(program, wlDir, CommonShaders::ViewDirection, QObject::tr("zero-order scattering shader program"));
+        ++loadingStepsDone_; return;
+    }
+
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        allWavelengthSetsZeroOrderScatteringProgram_.reset();
+        const auto dir=QString("%1/shaders/zero-order-scattering/%2").arg(pathToData_).arg(ALL_WAVELENGTH_SETS_SHADER_DIR_NAME);
+        if(QFile::exists(dir))
+        {
+            allWavelengthSetsZeroOrderScatteringProgram_=std::make_unique<QOpenGLShaderProgram>();
+            qDebug().nospace() << "Loading shaders from " << dir << "...";
+            buildProgram(*allWavelengthSetsZeroOrderScatteringProgram_, dir, CommonShaders::ViewDirection,
+                         QObject::tr("zero-order scattering shader program for all wavelength sets"));
+        }
         ++loadingStepsDone_; return;
     }
 
@@ -1214,13 +1386,8 @@ void main()
         auto& program=*eclipsedZeroOrderScatteringPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
         const auto wlDir=QString("%1/shaders/eclipsed-zero-order-scattering/%2").arg(pathToData_).arg(wlSetIndex);
         qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-        for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-            addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-        program.addShader(viewDirFragShader_.get());
-        program.addShader(viewDirVertShader_.get());
-        for(const auto& b : viewDirBindAttribLocations_)
-            program.bindAttributeLocation(b.first.c_str(), b.second);
-        link(program, QObject::tr("eclipsed zero-order scattering shader program"));
+        buildProgram(program, wlDir, CommonShaders::ViewDirection,
+                     QObject::tr("eclipsed zero-order scattering shader program"));
         ++loadingStepsDone_; return;
     }
 
@@ -1276,13 +1443,7 @@ void main()
             auto& program=*lightPollutionPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
             const auto wlDir=QString("%1/shaders/light-pollution/%2").arg(pathToData_).arg(wlSetIndex);
             qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-            link(program, QObject::tr("light pollution shader program"));
+            buildProgram(program, wlDir, CommonShaders::ViewDirection, QObject::tr("light pollution shader program"));
             ++loadingStepsDone_; return;
         }
     }
@@ -1297,16 +1458,21 @@ void main()
             auto& program=*lightPollutionPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
             const auto wlDir=pathToData_+"/shaders/light-pollution/";
             qDebug().nospace() << "Loading shaders from " << wlDir << "...";
-            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(wlDir.toStdString())))
-                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
-            program.addShader(viewDirFragShader_.get());
-            program.addShader(viewDirVertShader_.get());
-            for(const auto& b : viewDirBindAttribLocations_)
-                program.bindAttributeLocation(b.first.c_str(), b.second);
-            link(program, QObject::tr("light pollution shader program"));
+            buildProgram(program, wlDir, CommonShaders::ViewDirection, QObject::tr("light pollution shader program"));
             ++loadingStepsDone_; return;
         }
     }
+
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        finishPendingPrograms(0);
+        releaseFragShaders();
+        ++loadingStepsDone_; return;
+    }
 }
 
 void AtmosphereRenderer::setupBuffers()
@@ -1441,6 +1607,37 @@ void AtmosphereRenderer::resetSolarSpectrum()
     std::fill(solarIrradianceFixup_.begin(), solarIrradianceFixup_.end(), QVector4D(1,1,1,1));
 }
 
+bool AtmosphereRenderer::EclipsePrecomputationKey::closeTo(EclipsePrecomputationKey const& other) const
+{
+    const auto anglesClose=[](const double a, const double b)
+    {
+        // Azimuths may differ by whole turns
+        return std::abs(std::remainder(a-b, 2*M_PI)) <= ECLIPSE_PRECOMPUTATION_ANGLE_TOLERANCE;
+    };
+    return luminance==other.luminance &&
+           solarIrradianceFixup==other.solarIrradianceFixup &&
+           std::abs(altitude-other.altitude) <= ECLIPSE_PRECOMPUTATION_ALTITUDE_TOLERANCE &&
+           std::abs(earthMoonDistance-other.earthMoonDistance) <= ECLIPSE_PRECOMPUTATION_RELATIVE_DISTANCE_TOLERANCE*earthMoonDistance &&
+           anglesClose(sunZenithAngle, other.sunZenithAngle) &&
+           anglesClose(moonZenithAngle, other.moonZenithAngle) &&
+           anglesClose(moonAzimuthRelativeToSun, other.moonAzimuthRelativeToSun) &&
+           anglesClose(sunAngularRadius, other.sunAngularRadius);
+}
+
+auto AtmosphereRenderer::eclipsePrecomputationKey(const bool luminance) const -> EclipsePrecomputationKey
+{
+    return {tools_->altitude(), tools_->sunZenithAngle(), tools_->moonZenithAngle(),
+            tools_->moonAzimuth() - tools_->sunAzimuth(), tools_->earthMoonDistance(),
+            tools_->sunAngularRadius(), solarIrradianceFixup_, luminance};
+}
+
+void AtmosphereRenderer::invalidateEclipsePrecomputations()
+{
+    eclipsedSingleScatteringPrecomputationKey_.reset();
+    eclipsedDoubleScatteringPrecomputationKey_.reset();
+    eclipseKeyframes_.clear();
+}
+
 auto AtmosphereRenderer::getViewDirection(QPoint const& pixelPos) -> Direction
 {
     viewDirectionGetterProgram_->bind();
@@ -1489,6 +1686,12 @@ bool AtmosphereRenderer::canRenderPrecomputedEclipsedDoubleScattering() const
 void AtmosphereRenderer::renderZeroOrderScattering()
 {
     OGL_TRACE();
+    // The eclipsed version samples the eclipsed direct irradiance computed on the fly per wavelength set, so it isn't batched
+    if(allWavelengthSetsZeroOrderScatteringProgram_ && radianceRenderBuffers_.empty() && !tools_->usingEclipseShader())
+    {
+        renderZeroOrderScatteringOfAllWavelengthSets();
+        return;
+    }
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
         if(!radianceRenderBuffers_.empty())
@@ -1534,8 +1737,11 @@ void AtmosphereRenderer::precomputeEclipsedSingleScattering()
 {
     OGL_TRACE();
 
+    auto key=eclipsePrecomputationKey(false);
+    if(eclipsedSingleScatteringPrecomputationKey_ && eclipsedSingleScatteringPrecomputationKey_->closeTo(key))
+        return;
+
     gl.glBindVertexArray(vao_);
-    // TODO: avoid redoing it if Sun elevation and Moon elevation and relative azimuth haven't changed
     for(const auto& scatterer : params_.scatterers)
     {
         auto& textures=eclipsedSingleScatteringPrecomputationTextures_[scatterer.name];
@@ -1568,11 +1774,43 @@ void AtmosphereRenderer::precomputeEclipsedSingleScattering()
     gl.glBindVertexArray(0);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,luminanceRadianceFBO_);
     gl.glEnablei(GL_BLEND, 0);
+    eclipsedSingleScatteringPrecomputationKey_=std::move(key);
+}
+
+void AtmosphereRenderer::renderZeroOrderScatteringOfAllWavelengthSets()
+{
+    OGL_TRACE();
+
+    auto& prog=*allWavelengthSetsZeroOrderScatteringProgram_;
+    prog.bind();
+    prog.setUniformValue("cameraPosition", toQVector(cameraPosition()));
+    prog.setUniformValue("sunDirection", toQVector(sunDirection()));
+    prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+    prog.setUniformValue("lightPollutionGroundLuminance", float(tools_->lightPollutionGroundLuminance()));
+    prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
+
+    // Each wavelength set takes two texture units: for transmittance and irradiance
+    std::vector<QVector4D> solarIrradianceFixups;
+    for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
+    {
+        const int transmittanceUnit = 2*wlSetIndex, irradianceUnit = transmittanceUnit+1;
+        transmittanceTextures_[wlSetIndex]->bind(transmittanceUnit);
+        prog.setUniformValue(QString("transmittanceTexture%1").arg(wlSetIndex).toLatin1().constData(), transmittanceUnit);
+        irradianceTextures_[wlSetIndex]->bind(irradianceUnit);
+        prog.setUniformValue(QString("irradianceTexture%1").arg(wlSetIndex).toLatin1().constData(), irradianceUnit);
+        solarIrradianceFixups.push_back(solarIrradianceFixup_.empty() ? QVector4D(1,1,1,1) : solarIrradianceFixup_[wlSetIndex]);
+    }
+    prog.setUniformValueArray("solarIrradianceFixups", solarIrradianceFixups.data(), int(solarIrradianceFixups.size()));
+    drawSurface(prog);
 }
 
 void AtmosphereRenderer::renderSingleScattering()
 {
     OGL_TRACE();
+    // Unlike zero-order and multiple scattering, this is drawn per wavelength set: the phase functions are generated
+    // for each set from the atmosphere description, and a set can need up to six 3D textures per scatterer (two
+    // altitude slices, each with two interpolation guides), which wouldn't fit into the guaranteed texture units.
+    // There are no arrays of 3D textures to pack them into.
 
     if(tools_->usingEclipseShader())
         precomputeEclipsedSingleScattering();
@@ -1676,6 +1914,10 @@ void AtmosphereRenderer::renderSingleScattering()
                         tex.setMagnificationFilter(texFilter);
                         tex.bind(0);
                         prog.setUniformValue("scatteringTexture", 0);
+                        prog.setUniformValue("scatteringTextureScale", singleScatteringTextureScales_.at(scatterer.name)[wlSetIndex]);
+                        prog.setUniformValue("altitudeSliceMix",
+                                             bindUpperAltitudeSlice(prog, Texture4DSource::Slot::SingleScattering, scatterer.name,
+                                                                    wlSetIndex, "scatteringTextureUpper", 0, 3));
                     }
 
                     bool guides01Loaded = false, guides02Loaded = false;
@@ -1686,6 +1928,8 @@ void AtmosphereRenderer::renderSingleScattering()
                             auto& tex=guidesPerWLSetIt->second[wlSetIndex];
                             tex->bind(1);
                             prog.setUniformValue("scatteringTextureInterpolationGuides01", 1);
+                            bindUpperAltitudeSlice(prog, Texture4DSource::Slot::SingleScatteringGuides01, scatterer.name,
+                                                   wlSetIndex, "scatteringTextureInterpolationGuides01Upper", 1, 4);
                             guides01Loaded = true;
                         }
                     }
@@ -1696,6 +1940,8 @@ void AtmosphereRenderer::renderSingleScattering()
                             auto& tex=guidesPerWLSetIt->second[wlSetIndex];
                             tex->bind(2);
                             prog.setUniformValue("scatteringTextureInterpolationGuides02", 2);
+                            bindUpperAltitudeSlice(prog, Texture4DSource::Slot::SingleScatteringGuides02, scatterer.name,
+                                                   wlSetIndex, "scatteringTextureInterpolationGuides02Upper", 2, 5);
                             guides02Loaded = true;
                         }
                     }
@@ -1723,6 +1969,10 @@ void AtmosphereRenderer::renderSingleScattering()
                 tex.bind(0);
             }
             prog.setUniformValue("scatteringTexture", 0);
+            prog.setUniformValue("scatteringTextureScale", singleScatteringTextureScales_.at(scatterer.name).front());
+            prog.setUniformValue("altitudeSliceMix",
+                                 bindUpperAltitudeSlice(prog, Texture4DSource::Slot::SingleScattering, scatterer.name,
+                                                        0, "scatteringTextureUpper", 0, 3));
             prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
 
             bool guides01Loaded = false, guides02Loaded = false;
@@ -1733,6 +1983,8 @@ void AtmosphereRenderer::renderSingleScattering()
                     auto& tex=guidesPerWLSetIt->second.front();
                     tex->bind(1);
                     prog.setUniformValue("scatteringTextureInterpolationGuides01", 1);
+                    bindUpperAltitudeSlice(prog, Texture4DSource::Slot::SingleScatteringGuides01, scatterer.name,
+                                           0, "scatteringTextureInterpolationGuides01Upper", 1, 4);
                     guides01Loaded = true;
                 }
             }
@@ -1743,6 +1995,8 @@ void AtmosphereRenderer::renderSingleScattering()
                     auto& tex=guidesPerWLSetIt->second.front();
                     tex->bind(2);
                     prog.setUniformValue("scatteringTextureInterpolationGuides02", 2);
+                    bindUpperAltitudeSlice(prog, Texture4DSource::Slot::SingleScatteringGuides02, scatterer.name,
+                                           0, "scatteringTextureInterpolationGuides02Upper", 2, 5);
                     guides02Loaded = true;
                 }
             }
@@ -1771,15 +2025,22 @@ void AtmosphereRenderer::renderSingleScattering()
     }
 }
 
-void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
+std::vector<glm::vec4> AtmosphereRenderer::computeEclipsedDoubleScatteringCoarseGrid(const double sunZenithAngle,
+                                                                                 const double moonZenithAngle,
+                                                                                 const double moonAzimuthRelativeToSun,
+                                                                                 const bool luminance)
 {
-    // TODO: avoid redoing it if Sun elevation and Moon elevation and relative azimuth haven't changed
+    // The precomputers are kept between the calls, so that their interpolators with their Fourier transform plans
+    // aren't made anew for each keyframe
+    while(eclipsedDoubleScatteringPrecomputers_.size() < params_.allWavelengths.size())
+    {
+        eclipsedDoubleScatteringPrecomputers_.emplace_back(std::make_unique<EclipsedDoubleScatteringPrecomputer>(gl,
+                                                        params_,
+                                                        params_.eclipsedDoubleScatteringTextureSize[0],
+                                                        params_.eclipsedDoubleScatteringTextureSize[1], 1));
+    }
 
-    gl.glBindFramebuffer(GL_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
-    gl.glDisablei(GL_BLEND, 0);
-    gl.glBindVertexArray(vao_);
-    const bool renderingNeedsLuminance = !canGrabRadiance();
-    std::unique_ptr<EclipsedDoubleScatteringPrecomputer> precompAccumulator;
+    std::vector<glm::vec4> samples;
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
         auto& prog=*eclipsedDoubleScatteringPrecomputationPrograms_[wlSetIndex];
@@ -1791,41 +2052,149 @@ void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
             prog.setUniformValue("solarIrradianceFixup", solarIrradianceFixup_[wlSetIndex]);
         prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
 
-        auto precomputer = std::make_unique<EclipsedDoubleScatteringPrecomputer>(gl,
-                                                        params_,
-                                                        params_.eclipsedDoubleScatteringTextureSize[0],
-                                                        params_.eclipsedDoubleScatteringTextureSize[1], 1, 1);
-        precomputer->computeRadianceOnCoarseGrid(prog, eclipsedDoubleScatteringPrecomputationScratchTexture_->textureId(),
-                                                 unusedTextureUnitNum, tools_->altitude(), tools_->sunZenithAngle(),
-                                                 tools_->moonZenithAngle(), tools_->moonAzimuth() - tools_->sunAzimuth(),
-                                                 tools_->earthMoonDistance());
-        if(renderingNeedsLuminance)
+        auto& precomputer=*eclipsedDoubleScatteringPrecomputers_[wlSetIndex];
+        precomputer.computeRadianceOnCoarseGrid(prog, *eclipsedDoubleScatteringLayerSummer_,
+                                                unusedTextureUnitNum, tools_->altitude(), sunZenithAngle,
+                                                moonZenithAngle, moonAzimuthRelativeToSun, tools_->earthMoonDistance());
+        if(luminance)
         {
+            // The interpolator of the first wavelength set accumulates the luminance. It's overwritten by the
+            // next computation anyway.
             const auto rad2lum = radianceToLuminance(wlSetIndex, params_.allWavelengths);
+            auto& accumulator=eclipsedDoubleScatteringPrecomputers_[0]->interpolator();
             if(wlSetIndex==0)
-            {
-                precompAccumulator = std::move(precomputer);
-                precompAccumulator->convertRadianceToLuminance(rad2lum);
-            }
+                accumulator.convertRadianceToLuminance(rad2lum);
             else
-            {
-                precompAccumulator->accumulateLuminance(*precomputer, rad2lum);
-            }
+                accumulator.accumulateLuminance(precomputer.interpolator(), rad2lum);
+        }
+        else
+        {
+            precomputer.interpolator().appendCoarseGridSamplesTo(samples);
         }
+    }
+    if(luminance)
+        eclipsedDoubleScatteringPrecomputers_[0]->interpolator().appendCoarseGridSamplesTo(samples);
+    return samples;
+}
+
+std::optional<std::vector<glm::vec4>> AtmosphereRenderer::eclipsedDoubleScatteringCoarseGridFromKeyframes(const double spacing,
+                                                                                                         const bool luminance)
+{
+    const auto sunZenithAngle=tools_->sunZenithAngle();
+    const auto moonZenithAngle=tools_->moonZenithAngle();
+    const auto moonAzimuthRelativeToSun=tools_->moonAzimuth() - tools_->sunAzimuth();
+    const auto [separation, positionAngle]=EclipseKeyframes::moonSeparationAndPositionAngle(sunZenithAngle,
+                                                                                           moonZenithAngle,
+                                                                                           moonAzimuthRelativeToSun);
+    std::vector<glm::vec4> fixup;
+    for(const auto& f : solarIrradianceFixup_)
+        fixup.emplace_back(f.x(), f.y(), f.z(), f.w());
+    const bool keyframesKept=eclipseKeyframes_.setup(spacing, {tools_->altitude(), positionAngle, tools_->earthMoonDistance(),
+                                                               tools_->sunAngularRadius(), std::move(fixup), luminance},
+                                                     separation);
+
+    // The keyframes are computed here, on the render thread, because the integration is done by the GL programs in
+    // the renderer's context. To keep the frames smooth, at most one integration is done per frame.
+    const auto computeKeyframe=[&, positionAngle=positionAngle](EclipseKeyframes::Index const& index)
+    {
+        const auto keyframeSunZenithAngle=eclipseKeyframes_.sunZenithAngle(index);
+        const auto [keyframeMoonZenithAngle, keyframeMoonAzimuthRelativeToSun] =
+            EclipseKeyframes::moonZenithAngleAndRelativeAzimuth(keyframeSunZenithAngle, eclipseKeyframes_.separation(index),
+                                                                positionAngle);
+        eclipseKeyframes_.insert(index, computeEclipsedDoubleScatteringCoarseGrid(keyframeSunZenithAngle, keyframeMoonZenithAngle,
+                                                                                  keyframeMoonAzimuthRelativeToSun, luminance));
+    };
+
+    const auto lowerIndex=eclipseKeyframes_.lowerIndex(separation, sunZenithAngle);
+    std::optional<EclipseKeyframes::Index> missingIndex;
+    for(const auto& index : {lowerIndex,
+                             EclipseKeyframes::Index{lowerIndex.bySeparation+1, lowerIndex.bySunZenithAngle},
+                             EclipseKeyframes::Index{lowerIndex.bySeparation, lowerIndex.bySunZenithAngle+1},
+                             EclipseKeyframes::Index{lowerIndex.bySeparation+1, lowerIndex.bySunZenithAngle+1}})
+    {
+        if(eclipseKeyframes_.contains(index)) continue;
+        if(missingIndex)
+        {
+            // More keyframes are missing than the frame can afford. While the first of them is computed, the
+            // previous result is close enough to keep showing, unless the context has changed or there's no
+            // previous result. In the latter case integrating for the current geometry directly costs the same
+            // as one keyframe.
+            if(!keyframesKept || !eclipsedDoubleScatteringPrecomputationKey_)
+                return computeEclipsedDoubleScatteringCoarseGrid(sunZenithAngle, moonZenithAngle,
+                                                                 moonAzimuthRelativeToSun, luminance);
+            computeKeyframe(*missingIndex);
+            return std::nullopt;
+        }
+        missingIndex=index;
+    }
+
+    // Spread the cost of the keyframes over the frames: at most one is computed in advance per frame, and only if the
+    // current frame hasn't already paid for one
+    const auto indexToPrefetch=eclipseKeyframes_.indexToPrefetch(separation, sunZenithAngle);
+    if(missingIndex)
+        computeKeyframe(*missingIndex);
+    else if(indexToPrefetch)
+        computeKeyframe(*indexToPrefetch);
 
-        if(!renderingNeedsLuminance || wlSetIndex+1 == params_.allWavelengths.size())
+    if(missingIndex || indexToPrefetch)
+    {
+        const auto error=eclipseKeyframes_.interpolationErrorEstimate(lowerIndex);
+        if(error > MAX_ECLIPSE_KEYFRAME_INTERPOLATION_ERROR)
         {
-            auto& generator = renderingNeedsLuminance ? *precompAccumulator : *precomputer;
-            generator.generateTextureFromCoarseGridData(0, 0, tools_->altitude());
-            eclipsedDoubleScatteringPrecomputationTargetTextures_[renderingNeedsLuminance ? 0 : wlSetIndex]->bind();
-            gl.glTexImage3D(GL_TEXTURE_3D,0,GL_RGBA32F,
-                            params_.eclipsedDoubleScatteringTextureSize[0], params_.eclipsedDoubleScatteringTextureSize[1], 1,
-                            0,GL_RGBA,GL_FLOAT,generator.texture().data());
+            qDebug().nospace() << "Estimated relative error of eclipsed double scattering interpolation between keyframes at "
+                               << "separations " << eclipseKeyframes_.separation(lowerIndex)*180/M_PI << "-"
+                               << (eclipseKeyframes_.separation(lowerIndex)+spacing)*180/M_PI << " deg and Sun zenith angles "
+                               << eclipseKeyframes_.sunZenithAngle(lowerIndex)*180/M_PI << "-"
+                               << (eclipseKeyframes_.sunZenithAngle(lowerIndex)+spacing)*180/M_PI << " deg is " << error
+                               << ", consider reducing keyframe spacing";
         }
     }
+    return eclipseKeyframes_.interpolate(separation, sunZenithAngle);
+}
+
+void AtmosphereRenderer::generateEclipsedDoubleScatteringPrecomputationTextures(std::vector<glm::vec4> const& coarseGridSamples,
+                                                                               const bool luminance)
+{
+    EclipsedDoubleScatteringInterpolator generator(EclipsedDoubleScatteringPrecomputer::interpolationParameters(params_,
+                                                       params_.eclipsedDoubleScatteringTextureSize[0],
+                                                       params_.eclipsedDoubleScatteringTextureSize[1]));
+    std::vector<glm::vec4> texture(generator.textureSliceSize());
+    const unsigned numOutputs = luminance ? 1 : params_.allWavelengths.size();
+    const auto samplesPerOutput = coarseGridSamples.size()/numOutputs;
+    for(unsigned n=0; n<numOutputs; ++n)
+    {
+        generator.loadCoarseGridSamples(tools_->altitude(), &coarseGridSamples[n*samplesPerOutput], samplesPerOutput);
+        generator.generateTextureSlice(tools_->altitude(), texture.data());
+        eclipsedDoubleScatteringPrecomputationTargetTextures_[n]->bind();
+        gl.glTexImage3D(GL_TEXTURE_3D,0,GL_RGBA32F,
+                        params_.eclipsedDoubleScatteringTextureSize[0], params_.eclipsedDoubleScatteringTextureSize[1], 1,
+                        0,GL_RGBA,GL_FLOAT,texture.data());
+    }
+}
+
+void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
+{
+    const bool renderingNeedsLuminance = !canGrabRadiance();
+    auto key=eclipsePrecomputationKey(renderingNeedsLuminance);
+    if(eclipsedDoubleScatteringPrecomputationKey_ && eclipsedDoubleScatteringPrecomputationKey_->closeTo(key))
+        return;
+
+    gl.glBindFramebuffer(GL_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
+    gl.glDisablei(GL_BLEND, 0);
+    gl.glBindVertexArray(vao_);
+    const auto keyframeSpacing=tools_->eclipseKeyframeSpacing();
+    const auto coarseGridSamples = keyframeSpacing>0 ?
+        eclipsedDoubleScatteringCoarseGridFromKeyframes(keyframeSpacing, renderingNeedsLuminance) :
+        computeEclipsedDoubleScatteringCoarseGrid(tools_->sunZenithAngle(), tools_->moonZenithAngle(),
+                                                  tools_->moonAzimuth() - tools_->sunAzimuth(), renderingNeedsLuminance);
+    // Without the samples the textures of the previous frame are kept, and the next frame tries again
+    if(coarseGridSamples)
+        generateEclipsedDoubleScatteringPrecomputationTextures(*coarseGridSamples, renderingNeedsLuminance);
     gl.glBindVertexArray(0);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,luminanceRadianceFBO_);
     gl.glEnablei(GL_BLEND, 0);
+    if(coarseGridSamples)
+        eclipsedDoubleScatteringPrecomputationKey_=std::move(key);
 }
 
 void AtmosphereRenderer::renderMultipleScattering()
@@ -1859,6 +2228,8 @@ void AtmosphereRenderer::renderMultipleScattering()
                 tex.setMagnificationFilter(texFilter);
                 tex.bind(0);
                 prog.setUniformValue("eclipsedDoubleScatteringTexture", 0);
+                prog.setUniformValue("eclipsedDoubleScatteringTextureUpper", 0);
+                prog.setUniformValue("altitudeSliceMix", 0.f);
                 prog.setUniformValue("eclipsedDoubleScatteringTextureSize", QVector3D(params_.eclipsedDoubleScatteringTextureSize[0],
                                                                                       params_.eclipsedDoubleScatteringTextureSize[1], 1));
             }
@@ -1871,12 +2242,19 @@ void AtmosphereRenderer::renderMultipleScattering()
                 texture.setMagnificationFilter(texFilter);
                 texture.bind(0);
                 prog.setUniformValue("eclipsedDoubleScatteringTexture", 0);
+                prog.setUniformValue("altitudeSliceMix",
+                                     bindUpperAltitudeSlice(prog, Texture4DSource::Slot::EclipsedDoubleScattering, {},
+                                                            wlSetIndex, "eclipsedDoubleScatteringTextureUpper", 0, 1));
 
                 prog.setUniformValue("eclipsedDoubleScatteringTextureSize", toQVector(glm::vec3(params_.eclipsedDoubleScatteringTextureSize)));
             }
             drawSurface(prog);
         }
     }
+    else if(allWavelengthSetsMultipleScatteringProgram_ && radianceRenderBuffers_.empty())
+    {
+        renderMultipleScatteringOfAllWavelengthSets();
+    }
     else
     {
         for(unsigned wlSetIndex = 0; wlSetIndex < multipleScatteringTextures_.size(); ++wlSetIndex)
@@ -1898,11 +2276,50 @@ void AtmosphereRenderer::renderMultipleScattering()
             tex.setMagnificationFilter(texFilter);
             tex.bind(0);
             prog.setUniformValue("scatteringTexture", 0);
+            prog.setUniformValue("scatteringTextureScale", multipleScatteringTextureScales_[wlSetIndex]);
+            prog.setUniformValue("altitudeSliceMix",
+                                 bindUpperAltitudeSlice(prog, Texture4DSource::Slot::MultipleScattering, {},
+                                                        wlSetIndex, "scatteringTextureUpper", 0, 3));
             drawSurface(prog);
         }
     }
 }
 
+void AtmosphereRenderer::renderMultipleScatteringOfAllWavelengthSets()
+{
+    OGL_TRACE();
+
+    auto& prog=*allWavelengthSetsMultipleScatteringProgram_;
+    prog.bind();
+    prog.setUniformValue("cameraPosition", toQVector(cameraPosition()));
+    prog.setUniformValue("sunDirection", toQVector(sunDirection()));
+    prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+    prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
+
+    // Each wavelength set takes two texture units: for the lower and upper altitude slices
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    std::vector<GLfloat> altitudeSliceMixes;
+    std::vector<QVector4D> solarIrradianceFixups;
+    for(unsigned wlSetIndex = 0; wlSetIndex < multipleScatteringTextures_.size(); ++wlSetIndex)
+    {
+        const int lowerSliceUnit = 2*wlSetIndex, upperSliceUnit = lowerSliceUnit+1;
+        auto& tex=*multipleScatteringTextures_[wlSetIndex];
+        tex.setMinificationFilter(texFilter);
+        tex.setMagnificationFilter(texFilter);
+        tex.bind(lowerSliceUnit);
+        prog.setUniformValue(QString("scatteringTexture%1").arg(wlSetIndex).toLatin1().constData(), lowerSliceUnit);
+        altitudeSliceMixes.push_back(bindUpperAltitudeSlice(prog, Texture4DSource::Slot::MultipleScattering, {}, wlSetIndex,
+                                                            QString("scatteringTextureUpper%1").arg(wlSetIndex).toLatin1().constData(),
+                                                            lowerSliceUnit, upperSliceUnit));
+        solarIrradianceFixups.push_back(solarIrradianceFixup_.empty() ? QVector4D(1,1,1,1) : solarIrradianceFixup_[wlSetIndex]);
+    }
+    prog.setUniformValueArray("scatteringTextureScales", multipleScatteringTextureScales_.data(),
+                              int(multipleScatteringTextureScales_.size()), 1);
+    prog.setUniformValueArray("altitudeSliceMixes", altitudeSliceMixes.data(), int(altitudeSliceMixes.size()), 1);
+    prog.setUniformValueArray("solarIrradianceFixups", solarIrradianceFixups.data(), int(solarIrradianceFixups.size()));
+    drawSurface(prog);
+}
+
 void AtmosphereRenderer::renderLightPollution()
 {
     OGL_TRACE();
@@ -1933,25 +2350,257 @@ void AtmosphereRenderer::renderLightPollution()
     }
 }
 
+AltitudeSliceCache* AtmosphereRenderer::altitudeSliceCache()
+{
+    altitudeSliceCache_.setMaxSize(size_t(tools_->altitudeSliceCacheSizeInMiB())*1024*1024);
+    return altitudeSliceCache_.maxSize() ? &altitudeSliceCache_ : nullptr;
+}
+
+void AtmosphereRenderer::prefetchAltitudeSlices()
+{
+    if(!altitudeSliceCache()) return;
+
+    // Neighbours on both sides, and a bit more in the direction the altitude is changing
+    const unsigned countBelow = altCoordChangeDirection_<0 ? 2 : 1;
+    const unsigned countAbove = altCoordChangeDirection_>0 ? 2 : 1;
+    for(const auto& source : texture4DSources_)
+    {
+        // Prefetching must not delay loading of the slices that are needed right now
+        constexpr int priority = -1;
+        textureLoadingThreadPool_.start(new FunctionRunnable([cache = &altitudeSliceCache_, path = source.path,
+                                                              altCoord = altCoordToLoad_, countBelow, countAbove]
+                                                             { cache->prefetch(path, altCoord, countBelow, countAbove); }),
+                                        priority);
+    }
+}
+
+bool AtmosphereRenderer::textureReloadNeeded(const double altCoord) const
+{
+    if(!tools_->gpuAltitudeInterpolationEnabled())
+        return altitudeSlicesResident_ || altCoord != altCoordToLoad_;
+    if(!altitudeSlicesResident_)
+        return true;
+    // The shaders interpolate within the current pair of slices, so only moving to another pair needs a reload
+    for(const auto& source : texture4DSources_)
+    {
+        if(Texture4DSliceLoader::altitudeSlicePosition(altCoord, numAltIntervals(source)).first != source.floorAltIndex)
+            return true;
+    }
+    return false;
+}
+
+void AtmosphereRenderer::startTextureReload(const double altCoord)
+{
+    [[maybe_unused]] OGLTrace t("starting reload of textures");
+
+    using Role=AsyncTextureReload::Job::Role;
+    const bool residentSlices = tools_->gpuAltitudeInterpolationEnabled();
+    if(texture4DSources_.empty())
+    {
+        altCoordToLoad_ = altCoord;
+        altitudeSlicesResident_ = residentSlices;
+        return;
+    }
+
+    auto reload = std::make_unique<AsyncTextureReload>();
+    reload->altCoord = altCoord;
+    reload->residentSlices = residentSlices;
+    // Headers are read and upload buffers are mapped here, in the thread that owns the OpenGL context, while
+    // reading and interpolation of the altitude slices go to the worker threads
+    const auto addJob = [this, &reload, altCoord](const unsigned sourceIndex, const Role role, const unsigned altIndex)
+    {
+        const auto& source = texture4DSources_[sourceIndex];
+        const auto uploadBuffer = textureUploadBuffer(reload->jobs.size());
+        auto& job = *reload->jobs.emplace_back(std::make_unique<AsyncTextureReload::Job>());
+        job.role = role;
+        job.sourceIndex = sourceIndex;
+        job.eclipsedDoubleScattering = source.slot==Texture4DSource::Slot::EclipsedDoubleScattering;
+        const auto type = source.slot==Texture4DSource::Slot::EclipsedDoubleScattering ? Texture4DType::EclipsedDoubleScattering :
+                          source.slot==Texture4DSource::Slot::SingleScatteringGuides01 ||
+                          source.slot==Texture4DSource::Slot::SingleScatteringGuides02 ? Texture4DType::InterpolationGuides :
+                                                                                          Texture4DType::ScatteringTexture;
+        if(role == Role::Interpolated)
+        {
+            job.loader = std::make_unique<Texture4DSliceLoader>(gl, source.path, altCoord, type, uploadBuffer,
+                                                                altitudeSliceCache());
+            return;
+        }
+        job.loader = std::make_unique<Texture4DSliceLoader>(gl, source.path, Texture4DSliceLoader::SingleSlice{altIndex},
+                                                            type, uploadBuffer, altitudeSliceCache());
+        if(job.loader->numAltIntervals() != numAltIntervals(source))
+        {
+            throw DataLoadError{QObject::tr("Unexpected number of altitude slices in texture from file \"%1\": %2 instead of %3")
+                                .arg(source.path).arg(job.loader->numAltIntervals()+1).arg(numAltIntervals(source)+1)};
+        }
+    };
+    for(unsigned n = 0; n < texture4DSources_.size(); ++n)
+    {
+        const auto& source = texture4DSources_[n];
+        if(!residentSlices)
+        {
+            addJob(n, Role::Interpolated, 0);
+            continue;
+        }
+
+        const auto floorAltIndex = Texture4DSliceLoader::altitudeSlicePosition(altCoord, numAltIntervals(source)).first;
+        reload->floorAltIndices.push_back(floorAltIndex);
+        if(altitudeSlicesResident_ && floorAltIndex == source.floorAltIndex)
+            continue;
+        // When moving to an adjacent interval, one of the slices is already on GPU
+        const bool movingUp   = altitudeSlicesResident_ && floorAltIndex == source.floorAltIndex+1;
+        const bool movingDown = altitudeSlicesResident_ && floorAltIndex+1 == source.floorAltIndex;
+        if(!movingUp)
+            addJob(n, Role::LowerSlice, floorAltIndex);
+        if(!movingDown)
+            addJob(n, Role::UpperSlice, floorAltIndex+1);
+    }
+
+    textureReload_ = std::move(reload);
+    // The jobs already run in parallel on the pool's threads, so each of them only gets its share of the threads for
+    // the texture generation
+    const int threadsPerJob = std::max(1, textureLoadingThreadPool_.maxThreadCount() /
+                                              std::max(1, int(textureReload_->jobs.size())));
+    for(auto& job : textureReload_->jobs)
+    {
+        textureLoadingThreadPool_.start(new FunctionRunnable([this, &job = *job, threadsPerJob]
+        {
+            try
+            {
+                job.loader->interpolate();
+                // The texture is generated from the coarse grid samples here too, so that the render thread only
+                // has to upload it
+                if(job.eclipsedDoubleScattering)
+                    job.eclipsedDoubleScatteringTexture = generateEclipsedDoubleScatteringTexture(*job.loader, threadsPerJob);
+            }
+            catch(...)
+            {
+                job.error = std::current_exception();
+            }
+            job.done = true;
+        }));
+    }
+
+    currentActivity_=QObject::tr("Reloading textures due to altitude change...");
+    loadingStepsDone_=0;
+    totalLoadingStepsToDo_=textureReload_->jobs.size();
+}
+
+void AtmosphereRenderer::pollTextureReload()
+{
+    using Role=AsyncTextureReload::Job::Role;
+    auto& reload = *textureReload_;
+
+    gl.glActiveTexture(GL_TEXTURE0);
+    for(auto& jobPtr : reload.jobs)
+    {
+        auto& job = *jobPtr;
+        if(job.texture || !job.done) continue;
+        const auto& source = texture4DSources_[job.sourceIndex];
+        if(job.error)
+        {
+            const auto error = job.error;
+            cancelTextureReload();
+            std::rethrow_exception(error);
+        }
+
+        while(gl.glGetError()!=GL_NO_ERROR);
+        auto texture = newTexture4D(source.slot);
+        texture->bind();
+        if(job.eclipsedDoubleScattering)
+            uploadEclipsedDoubleScatteringTexture(job.eclipsedDoubleScatteringTexture);
+        else
+            job.loader->upload();
+        if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+        {
+            const auto path = source.path;
+            cancelTextureReload();
+            throw DataLoadError{QObject::tr("GL error while reloading texture from \"%1\": %2")
+                                .arg(path).arg(openglErrorString(err).c_str())};
+        }
+        job.valueScale = job.loader->valueScale();
+        job.loader.reset();
+        job.eclipsedDoubleScatteringTexture = {};
+        job.texture = std::move(texture);
+        ++loadingStepsDone_;
+    }
+    if(loadingStepsDone_ < totalLoadingStepsToDo_)
+        return;
+
+    // All the textures are ready, replace the old ones at once so that no frame mixes different altitudes
+    if(reload.residentSlices)
+    {
+        upperAltitudeSliceTextures_.resize(texture4DSources_.size());
+        for(unsigned n = 0; n < texture4DSources_.size(); ++n)
+        {
+            auto& source = texture4DSources_[n];
+            const auto floorAltIndex = reload.floorAltIndices[n];
+            const auto lowerSlice = texture4DSlot(source);
+            auto& upperSlice = upperAltitudeSliceTextures_[n];
+            if(lowerSlice && altitudeSlicesResident_ && floorAltIndex == source.floorAltIndex+1)
+                *lowerSlice = std::move(upperSlice);
+            else if(lowerSlice && altitudeSlicesResident_ && floorAltIndex+1 == source.floorAltIndex)
+                upperSlice = std::move(*lowerSlice);
+            source.floorAltIndex = floorAltIndex;
+        }
+    }
+    else
+    {
+        upperAltitudeSliceTextures_.clear();
+    }
+    for(auto& job : reload.jobs)
+    {
+        const auto& source = texture4DSources_[job->sourceIndex];
+        if(job->role == Role::UpperSlice)
+            upperAltitudeSliceTextures_[job->sourceIndex] = std::move(job->texture);
+        else if(const auto slot = texture4DSlot(source))
+            *slot = std::move(job->texture);
+        if(source.slot == Texture4DSource::Slot::MultipleScattering)
+            multipleScatteringTextureScales_[source.index] = job->valueScale;
+        else if(source.slot == Texture4DSource::Slot::SingleScattering)
+            singleScatteringTextureScales_[source.scattererName][source.index] = job->valueScale;
+    }
+    altitudeSlicesResident_ = reload.residentSlices;
+    if(reload.altCoord != altCoordToLoad_)
+        altCoordChangeDirection_ = reload.altCoord > altCoordToLoad_ ? 1 : -1;
+    altCoordToLoad_ = reload.altCoord;
+    textureReload_.reset();
+    finalizeLoading();
+    prefetchAltitudeSlices();
+}
+
+void AtmosphereRenderer::cancelTextureReload()
+{
+    if(!textureReload_) return;
+    // The jobs reference the reload state, so we can't destroy it while they are running
+    textureLoadingThreadPool_.waitForDone();
+    textureReload_.reset();
+}
+
 int AtmosphereRenderer::initPreparationToDraw()
 {
     OGL_TRACE();
 
-    if(state_ == State::ReloadingTextures)
-        return totalLoadingStepsToDo_;
     if(state_ != State::ReadyToRender) return -1;
 
-    const auto altCoord=altitudeUnitRangeTexCoord();
-    if(altCoord != altCoordToLoad_)
+    try
     {
-        [[maybe_unused]] OGLTrace t("reloading textures");
+        if(textureReload_)
+        {
+            pollTextureReload();
+            if(textureReload_)
+                return totalLoadingStepsToDo_;
+        }
 
-        altCoordToLoad_ = altCoord;
-        state_ = State::ReloadingTextures;
-        currentActivity_=QObject::tr("Reloading textures due to altitude change...");
-        loadingStepsDone_=0;
-        totalLoadingStepsToDo_=0;
-        reloadScatteringTextures(CountStepsOnly{true});
+        const auto altCoord=altitudeUnitRangeTexCoord();
+        if(textureReloadNeeded(altCoord))
+            startTextureReload(altCoord);
+    }
+    catch(...)
+    {
+        cancelTextureReload();
+        finalizeLoading();
+        state_ = State::NotReady;
+        throw;
     }
 
     return totalLoadingStepsToDo_;
@@ -1961,24 +2610,25 @@ auto AtmosphereRenderer::stepPreparationToDraw() -> LoadingStatus
 {
     OGL_TRACE();
 
-    if(state_ != State::ReloadingTextures)
+    if(state_ != State::ReadyToRender || !textureReload_)
         return {0, -1};
 
-    const auto altCoord=altitudeUnitRangeTexCoord();
-    if(altCoord != altCoordToLoad_)
+    // Only the textures whose jobs are done are uploaded, the rest are checked again in the next step. Waiting for
+    // the jobs here would block the render thread, which keeps drawing with the old textures meanwhile.
+    const auto totalSteps = totalLoadingStepsToDo_;
+    try
     {
-        std::cerr << "While we were reloading textures, the requested altitude changed again "
-                     "(loaded coordinate: " << altCoordToLoad_ << ", requested: " << altCoord
-                  << "). Restarting the reloading process\n";
-        finalizeLoading();
-        initPreparationToDraw();
+        pollTextureReload();
     }
-
-    currentLoadingIterationStepCounter_=0;
-    reloadScatteringTextures(CountStepsOnly{false});
-
-    if(loadingStepsDone_ == totalLoadingStepsToDo_)
+    catch(...)
+    {
+        cancelTextureReload();
         finalizeLoading();
+        state_ = State::NotReady;
+        throw;
+    }
+    if(!textureReload_)
+        return {totalSteps, totalSteps};
 
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
@@ -1987,12 +2637,8 @@ void AtmosphereRenderer::draw(const double brightness, const bool clear)
 {
     OGL_TRACE();
 
-    if(const int preparationSteps = initPreparationToDraw(); preparationSteps>0)
-    {
-        qWarning() << "Calling code hasn't properly prepared the renderer. Doing the preparation synchronously.";
-        for(LoadingStatus status = stepPreparationToDraw(); status.stepsDone < status.stepsToDo; )
-            status = stepPreparationToDraw();
-    }
+    // Reloading of textures for a new altitude proceeds in the background, while we keep rendering the old ones
+    initPreparationToDraw();
 
     if(state_ != State::ReadyToRender) return;
 
@@ -2085,14 +2731,11 @@ void AtmosphereRenderer::setupRenderTarget()
     }
 
     gl.glGenFramebuffers(1,&eclipseDoubleScatteringPrecomputationFBO_);
-    eclipsedDoubleScatteringPrecomputationScratchTexture_=newTex(QOpenGLTexture::Target2D);
-    eclipsedDoubleScatteringPrecomputationScratchTexture_->create();
-    eclipsedDoubleScatteringPrecomputationScratchTexture_->bind();
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,
-                    params_.eclipseAngularIntegrationPoints, params_.radialIntegrationPoints,
-                    0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    eclipsedDoubleScatteringLayerSummer_=std::make_unique<TextureLayerSumComputer>(gl,
+                                            params_.eclipseAngularIntegrationPoints, params_.radialIntegrationPoints,
+                                            EclipsedDoubleScatteringPrecomputer::coarseGridSampleCount(params_));
     gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
-    gl.glFramebufferTexture(GL_DRAW_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,eclipsedDoubleScatteringPrecomputationScratchTexture_->textureId(),0);
+    eclipsedDoubleScatteringLayerSummer_->attachLayer(0);
     checkFramebufferStatus(gl, "Eclipsed double scattering precomputation FBO");
     gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, origFBO);
 
@@ -2150,56 +2793,63 @@ int AtmosphereRenderer::initDataLoading(QByteArray viewDirVertShaderSrc, QByteAr
 void AtmosphereRenderer::setViewDirShaders(QByteArray viewDirVertShaderSrc, QByteArray viewDirFragShaderSrc,
                                            std::vector<std::pair<std::string,GLuint>> viewDirBindAttribLocations)
 {
-    viewDirVertShaderSrc_ = viewDirVertShaderSrc;
-    viewDirFragShaderSrc_ = viewDirFragShaderSrc;
-
     std::unique_ptr<QOpenGLShader> newVertShader(new QOpenGLShader(QOpenGLShader::Vertex));
     std::unique_ptr<QOpenGLShader> newFragShader(new QOpenGLShader(QOpenGLShader::Fragment));
 
-    if(!newVertShader->compileSourceCode(viewDirVertShaderSrc_))
-        throw DataLoadError{QObject::tr("Failed to compile view direction vertex shader:\n%2").arg(viewDirVertShader_->log())};
-    if(!newFragShader->compileSourceCode(viewDirFragShaderSrc_))
-        throw DataLoadError{QObject::tr("Failed to compile view direction fragment shader:\n%2").arg(viewDirFragShader_->log())};
-
-    const auto replaceShaders = [oldVert=viewDirVertShader_.get(),
-                                 oldFrag=viewDirFragShader_.get(),
-                                 newVert=newVertShader.get(),
-                                 newFrag=newFragShader.get()](QOpenGLShaderProgram& prog, QString const& name)
-                                {
-                                    prog.removeShader(oldVert);
-                                    prog.removeShader(oldFrag);
-                                    prog.addShader(newVert);
-                                    prog.addShader(newFrag);
-                                    link(prog, name);
-                                };
+    if(!newVertShader->compileSourceCode(viewDirVertShaderSrc))
+        throw DataLoadError{QObject::tr("Failed to compile view direction vertex shader:\n%2").arg(newVertShader->log())};
+    if(!newFragShader->compileSourceCode(viewDirFragShaderSrc))
+        throw DataLoadError{QObject::tr("Failed to compile view direction fragment shader:\n%2").arg(newFragShader->log())};
+
+    // The programs made from cached binaries are rebuilt by buildProgram(), which takes the new shaders from the members
+    const auto oldVertShader = std::move(viewDirVertShader_);
+    const auto oldFragShader = std::move(viewDirFragShader_);
+    viewDirVertShader_ = std::move(newVertShader);
+    viewDirFragShader_ = std::move(newFragShader);
+    viewDirVertShaderSrc_ = std::move(viewDirVertShaderSrc);
+    viewDirFragShaderSrc_ = std::move(viewDirFragShaderSrc);
+    viewDirBindAttribLocations_ = std::move(viewDirBindAttribLocations);
+
+    const auto replaceViewDirShaders = [this, oldShaders=std::vector{oldVertShader.get(), oldFragShader.get()},
+                                        newShaders=std::vector{viewDirVertShader_.get(), viewDirFragShader_.get()}]
+                                       (QOpenGLShaderProgram& prog, QString const& name)
+                                       {
+                                           replaceShaders(prog, oldShaders, newShaders, viewDirBindAttribLocations_, name,
+                                                          [&]{ buildProgram(prog, prog.property(FRAG_SHADERS_DIR_PROPERTY).toString(),
+                                                                            CommonShaders::ViewDirection, name); });
+                                       };
 
     for(const auto& map : singleScatteringPrograms_)
         for(auto& item : *map)
             for(auto& prog : item.second)
-                replaceShaders(*prog, QObject::tr("single scattering shader program"));
+                replaceViewDirShaders(*prog, QObject::tr("single scattering shader program"));
 
     for(const auto& map : eclipsedSingleScatteringPrograms_)
         for(auto& item : *map)
             for(auto& prog : item.second)
-                replaceShaders(*prog, QObject::tr("eclipsed single scattering shader program"));
+                replaceViewDirShaders(*prog, QObject::tr("eclipsed single scattering shader program"));
 
     for(const auto& prog : eclipsedDoubleScatteringPrecomputedPrograms_)
-        replaceShaders(*prog, QObject::tr("eclipsed double scattering shader program"));
+        replaceViewDirShaders(*prog, QObject::tr("eclipsed double scattering shader program"));
     for(const auto& prog : lightPollutionPrograms_)
-        replaceShaders(*prog, QObject::tr("light pollution shader program"));
+        replaceViewDirShaders(*prog, QObject::tr("light pollution shader program"));
     for(const auto& prog : zeroOrderScatteringPrograms_)
-        replaceShaders(*prog, QObject::tr("zero-order scattering shader program"));
+        replaceViewDirShaders(*prog, QObject::tr("zero-order scattering shader program"));
+    if(allWavelengthSetsZeroOrderScatteringProgram_)
+        replaceViewDirShaders(*allWavelengthSetsZeroOrderScatteringProgram_, QObject::tr("zero-order scattering shader program for all wavelength sets"));
     for(const auto& prog : eclipsedZeroOrderScatteringPrograms_)
-        replaceShaders(*prog, QObject::tr("eclipsed zero-order scattering shader program"));
+        replaceViewDirShaders(*prog, QObject::tr("eclipsed zero-order scattering shader program"));
     for(const auto& prog : multipleScatteringPrograms_)
-        replaceShaders(*prog, QObject::tr("multiple scattering shader program"));
+        replaceViewDirShaders(*prog, QObject::tr("multiple scattering shader program"));
+    if(allWavelengthSetsMultipleScatteringProgram_)
+        replaceViewDirShaders(*allWavelengthSetsMultipleScatteringProgram_, QObject::tr("multiple scattering shader program for all wavelength sets"));
 
-    replaceShaders(*viewDirectionGetterProgram_, QObject::tr("view direction getter shader program"));
-
-    viewDirVertShader_ = std::move(newVertShader);
-    viewDirFragShader_ = std::move(newFragShader);
-    viewDirBindAttribLocations_ = std::move(viewDirBindAttribLocations);
+    replaceViewDirShaders(*viewDirectionGetterProgram_, QObject::tr("view direction getter shader program"));
 
+    finishPendingPrograms(0);
+    // While loading, the fragment shaders are still needed by the programs yet to be built
+    if(state_!=State::LoadingData)
+        releaseFragShaders();
 }
 
 auto AtmosphereRenderer::stepDataLoading() -> LoadingStatus
@@ -2237,6 +2887,7 @@ auto AtmosphereRenderer::stepDataLoading() -> LoadingStatus
     }
 
     finalizeLoading();
+    prefetchAltitudeSlices();
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
 
@@ -2246,6 +2897,8 @@ void AtmosphereRenderer::finalizeLoading()
     totalLoadingStepsToDo_=0;
     loadingStepsDone_=0;
     state_ = State::ReadyToRender;
+    // The programs or textures of the precomputations may have been replaced
+    invalidateEclipsePrecomputations();
 }
 
 AtmosphereRenderer::~AtmosphereRenderer()
@@ -2260,6 +2913,20 @@ void AtmosphereRenderer::clearResources()
         gl.glDeleteBuffers(1, &vbo_);
         vbo_=0;
     }
+    abandonPendingPrograms();
+    invalidateEclipsePrecomputations();
+    eclipsedDoubleScatteringLayerSummer_.reset();
+    eclipsedDoubleScatteringPrecomputers_.clear();
+    // Loaders of the pending reload keep the upload buffers mapped, so they must go first
+    cancelTextureReload();
+    // The data may be about to change, so the cached slices can't be reused
+    textureLoadingThreadPool_.waitForDone();
+    altitudeSliceCache_.clear();
+    if(!textureUploadBuffers_.empty())
+    {
+        gl.glDeleteBuffers(textureUploadBuffers_.size(), textureUploadBuffers_.data());
+        textureUploadBuffers_.clear();
+    }
     if(vao_)
     {
         gl.glDeleteVertexArrays(1, &vao_);
@@ -2338,6 +3005,8 @@ int AtmosphereRenderer::initShaderReloading()
     if(state_ != State::NotReady && state_ != State::ReadyToRender)
         return -1;
 
+    // Reloading of textures uses the same progress counters, so it has to be restarted after the shaders are reloaded
+    cancelTextureReload();
     state_ = State::ReloadingShaders;
     currentActivity_=QObject::tr("Reloading shaders...");
     loadingStepsDone_=0;
@@ -4,14 +4,24 @@
 #include <cmath>
 #include <array>
 #include <deque>
+#include <atomic>
 #include <memory>
+#include <optional>
+#include <exception>
 #include <glm/glm.hpp>
 #include <QObject>
+#include <QThreadPool>
 #include <QOpenGLTexture>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFunctions_3_3_Core>
 #include "../common/types.hpp"
 #include "../common/AtmosphereParameters.hpp"
+#include "../common/TextureLayerSumComputer.hpp"
+#include "../common/EclipsedDoubleScatteringPrecomputer.hpp"
+#include "Texture4DSliceLoader.hpp"
+#include "AltitudeSliceCache.hpp"
+#include "EclipseKeyframes.hpp"
+#include "ProgramBinaryCache.hpp"
 #include "api/ShowMySky/AtmosphereRenderer.hpp"
 
 class AtmosphereRenderer : public ShowMySky::AtmosphereRenderer
@@ -89,9 +99,11 @@ private: // variables
     GLuint vao_=0, vbo_=0, luminanceRadianceFBO_=0, viewDirectionFBO_=0;
     GLuint eclipseSingleScatteringPrecomputationFBO_=0;
     GLuint eclipseDoubleScatteringPrecomputationFBO_=0;
+    std::vector<GLuint> textureUploadBuffers_; //!< Pixel unpack buffers for the interpolated altitude slices of 4D textures
     // Lower and upper altitude slices from the 4D texture
     std::vector<TexturePtr> eclipsedDoubleScatteringTextures_;
     std::vector<TexturePtr> multipleScatteringTextures_;
+    std::vector<float> multipleScatteringTextureScales_;
     std::vector<TexturePtr> transmittanceTextures_;
     std::vector<TexturePtr> irradianceTextures_;
     std::vector<TexturePtr> lightPollutionTextures_;
@@ -101,17 +113,24 @@ private: // variables
     GLuint viewDirectionRenderBuffer_=0;
     // Indexed as singleScatteringTextures_[scattererName][wavelengthSetIndex]
     std::map<ScattererName,std::vector<TexturePtr>> singleScatteringTextures_;
+    std::map<ScattererName,std::vector<float>> singleScatteringTextureScales_;
     std::map<ScattererName,std::vector<TexturePtr>> eclipsedSingleScatteringPrecomputationTextures_;
-    TexturePtr eclipsedDoubleScatteringPrecomputationScratchTexture_;
+    std::unique_ptr<TextureLayerSumComputer> eclipsedDoubleScatteringLayerSummer_;
+    std::vector<std::unique_ptr<EclipsedDoubleScatteringPrecomputer>> eclipsedDoubleScatteringPrecomputers_;
     std::vector<TexturePtr> eclipsedDoubleScatteringPrecomputationTargetTextures_;
     QOpenGLTexture luminanceRenderTargetTexture_;
     QSize viewportSize_;
     double altCoordToLoad_=0; //!< Used to load textures for a single altitude slice, even if input altitude changes during the load
+    int altCoordChangeDirection_=0; //!< Sign of the last change of altCoordToLoad_, to prefetch altitude slices ahead
 
     std::vector<ShaderProgPtr> lightPollutionPrograms_;
     std::vector<ShaderProgPtr> zeroOrderScatteringPrograms_;
+    //! Renders luminance of non-eclipsed zero-order scattering for all the wavelength sets in one pass, if the data provide it
+    ShaderProgPtr allWavelengthSetsZeroOrderScatteringProgram_;
     std::vector<ShaderProgPtr> eclipsedZeroOrderScatteringPrograms_;
     std::vector<ShaderProgPtr> multipleScatteringPrograms_;
+    //! Renders luminance of multiple scattering for all the wavelength sets in one pass, if the data provide it
+    ShaderProgPtr allWavelengthSetsMultipleScatteringProgram_;
     // Indexed as singleScatteringPrograms_[renderMode][scattererName][wavelengthSetIndex]
     using ScatteringProgramsMap=std::map<ScattererName,std::vector<ShaderProgPtr>>;
     std::vector<std::unique_ptr<ScatteringProgramsMap>> singleScatteringPrograms_;
@@ -122,19 +141,108 @@ private: // variables
     std::unique_ptr<ScatteringProgramsMap> eclipsedSingleScatteringPrecomputationPrograms_;
     std::unique_ptr<QOpenGLShader> precomputationProgramsVertShader_;
     std::unique_ptr<QOpenGLShader> viewDirVertShader_, viewDirFragShader_;
+    std::unique_ptr<ProgramBinaryCache> programBinaryCache_;
+    // Programs whose compilation and linking the driver may still be doing in the background
+    struct PendingProgram
+    {
+        QOpenGLShaderProgram* program;
+        QString description;
+        std::vector<std::pair<GLuint,QString>> shaders; //!< Fragment shaders attached to the program, with their descriptions
+        QByteArray cacheKey;
+    };
+    std::deque<PendingProgram> pendingPrograms_;
+    // Fragment shaders of the programs being loaded, keyed by the path of the source file. CalcMySky stores each
+    // distinct source once, so a source shared by many programs is read and compiled only once.
+    struct FragShader
+    {
+        QByteArray source;
+        GLuint shader=0; //!< Zero until some program not found in the binary cache needs it
+    };
+    std::map<QString,FragShader> fragShaders_;
+    size_t maxPendingPrograms_=0; //!< Zero if the driver can't compile shaders in parallel
     ShaderProgPtr viewDirectionGetterProgram_;
     std::map<ScattererName,bool> scatterersEnabledStates_;
 
     std::vector<QVector4D> solarIrradianceFixup_;
 
-    int numAltIntervalsIn4DTexture_;
+    // Parameters that the on-the-fly precomputations of eclipsed scattering depend on. While they stay within small
+    // tolerances of those of the last precomputation, its results are reused instead of being computed anew each frame.
+    struct EclipsePrecomputationKey
+    {
+        double altitude;
+        double sunZenithAngle;
+        double moonZenithAngle;
+        double moonAzimuthRelativeToSun;
+        double earthMoonDistance;
+        double sunAngularRadius;
+        std::vector<QVector4D> solarIrradianceFixup;
+        bool luminance; //!< Whether the results are converted to luminance rather than kept per wavelength set
+
+        bool closeTo(EclipsePrecomputationKey const& other) const;
+    };
+    std::optional<EclipsePrecomputationKey> eclipsedSingleScatteringPrecomputationKey_;
+    std::optional<EclipsePrecomputationKey> eclipsedDoubleScatteringPrecomputationKey_;
+    EclipseKeyframes eclipseKeyframes_;
+
+    // Where each altitude-dependent texture came from, so that it can be reloaded for another altitude
+    struct Texture4DSource
+    {
+        enum class Slot
+        {
+            MultipleScattering,
+            SingleScattering,
+            SingleScatteringGuides01,
+            SingleScatteringGuides02,
+            EclipsedDoubleScattering,
+        } slot;
+        ScattererName scattererName; //!< Empty for the slots not related to a particular scatterer
+        unsigned index; //!< Index in the vector of textures of the slot
+        QString path;
+        unsigned floorAltIndex=0; //!< Lower of the altitude slices resident on GPU, if altitudeSlicesResident_
+    };
+    std::vector<Texture4DSource> texture4DSources_;
+    /* If true, the textures of texture4DSources_ contain the lower altitude slices as is, the upper ones are in
+     * upperAltitudeSliceTextures_ (indexed as texture4DSources_), and the shaders interpolate between them. Otherwise
+     * the textures contain the slices interpolated on CPU, and upperAltitudeSliceTextures_ is empty.
+     */
+    bool altitudeSlicesResident_=false;
+    std::vector<TexturePtr> upperAltitudeSliceTextures_;
+    // Reloading of altitude-dependent textures after an altitude change. It's done in the background, while the
+    // textures for the previous altitude are still used for rendering, and the new ones replace them all at once.
+    struct AsyncTextureReload
+    {
+        struct Job
+        {
+            enum class Role
+            {
+                Interpolated, //!< Slice interpolated on CPU
+                LowerSlice,   //!< Lower slice to keep resident on GPU
+                UpperSlice,   //!< Upper slice to keep resident on GPU
+            } role;
+            unsigned sourceIndex; //!< Index in texture4DSources_
+            bool eclipsedDoubleScattering; //!< Whether the texture is generated from the loaded coarse grid samples
+            std::unique_ptr<Texture4DSliceLoader> loader;
+            std::vector<glm::vec4> eclipsedDoubleScatteringTexture; //!< Generated by the worker thread
+            std::atomic<bool> done{false}; //!< Set by the worker thread when it's finished with the loader
+            std::exception_ptr error; //!< Exception thrown in the worker thread
+            TexturePtr texture; //!< Non-null after upload
+            float valueScale=1;
+        };
+        double altCoord;
+        bool residentSlices; //!< Whether the jobs load the slices to keep resident on GPU
+        std::vector<unsigned> floorAltIndices; //!< New Texture4DSource::floorAltIndex values if residentSlices
+        std::vector<std::unique_ptr<Job>> jobs;
+    };
+    std::unique_ptr<AsyncTextureReload> textureReload_;
+    AltitudeSliceCache altitudeSliceCache_{0};
+    // Must be destroyed before the cache, since its threads may be prefetching into it
+    QThreadPool textureLoadingThreadPool_;
 
     enum class State
     {
         NotReady,           //!< Just constructed or failed to load data
         LoadingData,        //!< After initDataLoading() and until loading completes
         ReloadingShaders,   //!< After initShaderReloading() and until shaders reloading completes
-        ReloadingTextures,  //!< After initPreparationToDraw() and until textures reloading completes
         ReadyToRender,
     } state_ = State::NotReady;
 
@@ -144,8 +252,28 @@ private: // methods
     void reloadScatteringTextures(CountStepsOnly countStepsOnly);
     void setupRenderTarget();
     void loadShaders(CountStepsOnly countStepsOnly);
+    enum class CommonShaders
+    {
+        ViewDirection,  //!< The view direction shaders supplied by the application
+        Precomputation, //!< The vertex shader for on-the-fly precomputation
+    };
+    // Starts building the program from the fragment shaders in fragShadersDir and the common shaders, unless it's
+    // found in the program binary cache
+    void buildProgram(QOpenGLShaderProgram& program, QString const& fragShadersDir, CommonShaders commonShaders,
+                      QString const& description);
+    // Checks the results of building the pending programs, waiting for the driver until at most maxToLeave remain
+    void finishPendingPrograms(size_t maxToLeave);
+    void abandonPendingPrograms();
+    void releaseFragShaders();
+    QString resolveShaderSourceReference(QString const& referencePath) const;
     void setupBuffers();
     void clearResources();
+    bool textureReloadNeeded(double altCoord) const;
+    void startTextureReload(double altCoord);
+    void pollTextureReload();
+    void cancelTextureReload();
+    AltitudeSliceCache* altitudeSliceCache();
+    void prefetchAltitudeSlices();
     void finalizeLoading();
     void drawSurface(QOpenGLShaderProgram& prog);
 
@@ -156,19 +284,39 @@ private: // methods
     glm::dvec3 moonPositionRelativeToSunAzimuth() const;
     glm::dvec3 cameraPosition() const;
     glm::ivec2 loadTexture2D(QString const& path);
-    enum class Texture4DType
-    {
-        ScatteringTexture,
-        InterpolationGuides,
-    };
-    void loadTexture4D(QString const& path, float altitudeCoord, Texture4DType texType = Texture4DType::ScatteringTexture);
+    using Texture4DType=Texture4DSliceLoader::Type;
+    GLuint textureUploadBuffer(unsigned index);
+    TexturePtr newTexture4D(Texture4DSource::Slot slot) const;
+    TexturePtr* texture4DSlot(Texture4DSource const& source);
+    unsigned numAltIntervals(Texture4DSource const& source) const;
+    // Binds the upper altitude slice paired with the given texture, if the slices are resident, and returns the weight
+    // of this slice for the shaders to interpolate with (zero if the texture is already interpolated)
+    float bindUpperAltitudeSlice(QOpenGLShaderProgram& prog, Texture4DSource::Slot slot, ScattererName const& scattererName,
+                                 unsigned index, const char* samplerName, int lowerSliceUnit, int upperSliceUnit);
+    // Returns the factor to multiply the texel values by when sampling the texture
+    float loadTexture4D(QString const& path, float altitudeCoord, Texture4DType texType = Texture4DType::ScatteringTexture);
     void loadEclipsedDoubleScatteringTexture(QString const& path, float altitudeCoord);
+    // Doesn't call OpenGL, so that it can be run on a worker thread. Throws DataLoadError.
+    // Uses at most maxThreads threads, including the calling one
+    std::vector<glm::vec4> generateEclipsedDoubleScatteringTexture(Texture4DSliceLoader const& loader, int maxThreads) const;
+    // Uploads into the texture bound to GL_TEXTURE_3D
+    void uploadEclipsedDoubleScatteringTexture(std::vector<glm::vec4> const& texture);
 
+    EclipsePrecomputationKey eclipsePrecomputationKey(bool luminance) const;
+    void invalidateEclipsePrecomputations();
     void precomputeEclipsedSingleScattering();
+    // Returns the coarse grid samples of luminance or of radiance of all the wavelength sets, concatenated
+    std::vector<glm::vec4> computeEclipsedDoubleScatteringCoarseGrid(double sunZenithAngle, double moonZenithAngle,
+                                                                     double moonAzimuthRelativeToSun, bool luminance);
+    // Returns nothing if the textures of the previous frame should be kept while the keyframes are computed
+    std::optional<std::vector<glm::vec4>> eclipsedDoubleScatteringCoarseGridFromKeyframes(double spacing, bool luminance);
+    void generateEclipsedDoubleScatteringPrecomputationTextures(std::vector<glm::vec4> const& coarseGridSamples, bool luminance);
     void precomputeEclipsedDoubleScattering();
     void renderZeroOrderScattering();
+    void renderZeroOrderScatteringOfAllWavelengthSets();
     void renderSingleScattering();
     void renderMultipleScattering();
+    void renderMultipleScatteringOfAllWavelengthSets();
     void renderLightPollution();
     void prepareRadianceFrames(bool clear);
 };
@@ -0,0 +1,204 @@
+#include "EclipseKeyframes.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <iterator>
+#include <algorithm>
+
+namespace
+{
+
+// The keyframes stay valid while the Moon, due to the change of its position angle, moves by less than this many
+// keyframe spacings. This keeps the resulting error below that of the interpolation between the keyframes.
+constexpr double POSITION_ANGLE_TOLERANCE_IN_SPACINGS=0.5;
+constexpr double ALTITUDE_TOLERANCE=1; // m
+constexpr double RELATIVE_SIZE_TOLERANCE=1e-3; // for the Earth-Moon distance and the Sun angular radius
+// Enough for the four corners of the current grid cell, the keyframes prefetched for the next cells along both axes,
+// and the ones left behind, which are still needed if the motion turns back
+constexpr unsigned MAX_KEYFRAMES=16;
+
+double angleDifference(const double a, const double b)
+{
+    return std::abs(std::remainder(a-b, 2*M_PI));
+}
+
+int distance(EclipseKeyframes::Index const& a, EclipseKeyframes::Index const& b)
+{
+    return std::max(std::abs(a.bySeparation-b.bySeparation), std::abs(a.bySunZenithAngle-b.bySunZenithAngle));
+}
+
+}
+
+std::pair<double,double> EclipseKeyframes::moonSeparationAndPositionAngle(const double sunZenithAngle,
+                                                                          const double moonZenithAngle,
+                                                                          const double moonAzimuthRelativeToSun)
+{
+    using namespace glm;
+    const dvec3 sunDir(std::sin(sunZenithAngle), 0, std::cos(sunZenithAngle));
+    const dvec3 moonDir(std::cos(moonAzimuthRelativeToSun)*std::sin(moonZenithAngle),
+                        std::sin(moonAzimuthRelativeToSun)*std::sin(moonZenithAngle),
+                        std::cos(moonZenithAngle));
+    // Basis of the plane tangent to the sky at the Sun
+    const dvec3 towardsLargerZenithAngle(std::cos(sunZenithAngle), 0, -std::sin(sunZenithAngle));
+    const dvec3 towardsLargerAzimuth(0,1,0);
+    const auto separation=std::acos(std::clamp(dot(sunDir,moonDir), -1., 1.));
+    const auto positionAngle=std::atan2(dot(moonDir,towardsLargerAzimuth), dot(moonDir,towardsLargerZenithAngle));
+    return {separation, positionAngle};
+}
+
+std::pair<double,double> EclipseKeyframes::moonZenithAngleAndRelativeAzimuth(const double sunZenithAngle,
+                                                                             const double separation,
+                                                                             const double positionAngle)
+{
+    using namespace glm;
+    const dvec3 sunDir(std::sin(sunZenithAngle), 0, std::cos(sunZenithAngle));
+    const dvec3 towardsLargerZenithAngle(std::cos(sunZenithAngle), 0, -std::sin(sunZenithAngle));
+    const dvec3 towardsLargerAzimuth(0,1,0);
+    const auto moonDir=std::cos(separation)*sunDir +
+                       std::sin(separation)*(std::cos(positionAngle)*towardsLargerZenithAngle +
+                                             std::sin(positionAngle)*towardsLargerAzimuth);
+    return {std::acos(std::clamp(moonDir.z, -1., 1.)), std::atan2(moonDir.y, moonDir.x)};
+}
+
+bool EclipseKeyframes::contextMatches(Context const& context, const double separation) const
+{
+    return context.luminance==context_.luminance &&
+           context.solarIrradianceFixup==context_.solarIrradianceFixup &&
+           std::abs(context.altitude-context_.altitude) <= ALTITUDE_TOLERANCE &&
+           std::abs(context.earthMoonDistance-context_.earthMoonDistance) <= RELATIVE_SIZE_TOLERANCE*context_.earthMoonDistance &&
+           std::abs(context.sunAngularRadius-context_.sunAngularRadius) <= RELATIVE_SIZE_TOLERANCE*context_.sunAngularRadius &&
+           // Near the Sun, the position angle may change a lot while the Moon barely moves
+           separation*angleDifference(context.moonPositionAngle, context_.moonPositionAngle) <=
+               POSITION_ANGLE_TOLERANCE_IN_SPACINGS*spacing_;
+}
+
+bool EclipseKeyframes::setup(const double spacing, Context const& context, const double separation)
+{
+    if(spacing==spacing_ && contextMatches(context, separation))
+        return true;
+    clear();
+    spacing_=spacing;
+    context_=context;
+    return false;
+}
+
+void EclipseKeyframes::clear()
+{
+    keyframes_.clear();
+    lastSeparation_=-1;
+    lastSunZenithAngle_=-1;
+}
+
+auto EclipseKeyframes::lowerIndex(const double separation, const double sunZenithAngle) const -> Index
+{
+    assert(spacing_>0);
+    return {int(std::floor(separation/spacing_)), int(std::floor(sunZenithAngle/spacing_))};
+}
+
+void EclipseKeyframes::insert(Index const& index, Samples samples)
+{
+    keyframes_[index]=std::move(samples);
+    while(keyframes_.size() > MAX_KEYFRAMES)
+    {
+        const auto farthest=std::max_element(keyframes_.begin(), keyframes_.end(),
+                                             [&index](auto const& a, auto const& b)
+                                             { return distance(a.first, index) < distance(b.first, index); });
+        keyframes_.erase(farthest);
+    }
+}
+
+auto EclipseKeyframes::indexToPrefetch(const double separation, const double sunZenithAngle) -> std::optional<Index>
+{
+    const auto lastSeparation=lastSeparation_;
+    const auto lastSunZenithAngle=lastSunZenithAngle_;
+    lastSeparation_=separation;
+    lastSunZenithAngle_=sunZenithAngle;
+    if(lastSeparation<0)
+        return {};
+    // The keyframes for the current cell are supposed to be present already, so look one cell ahead along each axis
+    // the motion goes in
+    const auto lower=lowerIndex(separation, sunZenithAngle);
+    std::vector<Index> candidates;
+    if(separation!=lastSeparation)
+    {
+        const auto next = separation>lastSeparation ? lower.bySeparation+2 : lower.bySeparation-1;
+        candidates.push_back({next, lower.bySunZenithAngle});
+        candidates.push_back({next, lower.bySunZenithAngle+1});
+    }
+    if(sunZenithAngle!=lastSunZenithAngle)
+    {
+        const auto next = sunZenithAngle>lastSunZenithAngle ? lower.bySunZenithAngle+2 : lower.bySunZenithAngle-1;
+        candidates.push_back({lower.bySeparation, next});
+        candidates.push_back({lower.bySeparation+1, next});
+    }
+    for(const auto& index : candidates)
+    {
+        if(index.bySeparation<0 || index.bySunZenithAngle<0 || contains(index))
+            continue;
+        return index;
+    }
+    return {};
+}
+
+auto EclipseKeyframes::interpolate(const double separation, const double sunZenithAngle) const -> Samples
+{
+    const auto index=lowerIndex(separation, sunZenithAngle);
+    const auto& lowerLower=keyframes_.at(index);
+    const auto& upperLower=keyframes_.at({index.bySeparation+1, index.bySunZenithAngle});
+    const auto& lowerUpper=keyframes_.at({index.bySeparation, index.bySunZenithAngle+1});
+    const auto& upperUpper=keyframes_.at({index.bySeparation+1, index.bySunZenithAngle+1});
+    assert(lowerLower.size()==upperLower.size());
+    assert(lowerLower.size()==lowerUpper.size());
+    assert(lowerLower.size()==upperUpper.size());
+    const float alphaSep=separation/spacing_-index.bySeparation;
+    const float alphaSZA=sunZenithAngle/spacing_-index.bySunZenithAngle;
+    Samples samples(lowerLower.size());
+    for(size_t n=0; n<samples.size(); ++n)
+    {
+        const auto lower=lowerLower[n]+alphaSep*(upperLower[n]-lowerLower[n]);
+        const auto upper=lowerUpper[n]+alphaSep*(upperUpper[n]-lowerUpper[n]);
+        samples[n]=lower+alphaSZA*(upper-lower);
+    }
+    return samples;
+}
+
+double EclipseKeyframes::interpolationErrorEstimate(Index const& index) const
+{
+    // The error of linear interpolation is bounded by max|f''|*h^2/8, and the second difference approximates f''*h^2.
+    // For bilinear interpolation the bounds for the two axes add up.
+    double maxSecondDifference[2]={-1,-1}, maxSample=0;
+    for(const auto& center : {index, Index{index.bySeparation+1, index.bySunZenithAngle},
+                              Index{index.bySeparation, index.bySunZenithAngle+1},
+                              Index{index.bySeparation+1, index.bySunZenithAngle+1}})
+    {
+        const auto curr=keyframes_.find(center);
+        if(curr==keyframes_.end())
+            continue;
+        for(int axis=0; axis<2; ++axis)
+        {
+            const Index prevIndex = axis==0 ? Index{center.bySeparation-1, center.bySunZenithAngle}
+                                            : Index{center.bySeparation, center.bySunZenithAngle-1};
+            const Index nextIndex = axis==0 ? Index{center.bySeparation+1, center.bySunZenithAngle}
+                                            : Index{center.bySeparation, center.bySunZenithAngle+1};
+            const auto prev=keyframes_.find(prevIndex), next=keyframes_.find(nextIndex);
+            if(prev==keyframes_.end() || next==keyframes_.end())
+                continue;
+            maxSecondDifference[axis]=std::max(maxSecondDifference[axis], 0.);
+            for(size_t n=0; n<curr->second.size(); ++n)
+            {
+                const auto secondDifference=glm::abs(prev->second[n] - 2.f*curr->second[n] + next->second[n]);
+                const auto sample=glm::abs(curr->second[n]);
+                for(int i=0; i<4; ++i)
+                {
+                    maxSecondDifference[axis]=std::max(maxSecondDifference[axis], double(secondDifference[i]));
+                    maxSample=std::max(maxSample, double(sample[i]));
+                }
+            }
+        }
+    }
+    if(maxSecondDifference[0]<0 || maxSecondDifference[1]<0)
+        return -1;
+    if(maxSample==0)
+        return 0;
+    return (maxSecondDifference[0]+maxSecondDifference[1])/8/maxSample;
+}
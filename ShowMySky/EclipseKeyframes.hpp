@@ -0,0 +1,88 @@
+#ifndef INCLUDE_ONCE_C50EC987_4FB7_45F7_A7D4_26744BFBD183
+#define INCLUDE_ONCE_C50EC987_4FB7_45F7_A7D4_26744BFBD183
+
+#include <map>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <optional>
+#include <glm/glm.hpp>
+
+/* Coarse grid samples of eclipsed double scattering computed at keyframes, for animations where the Moon moves every
+ * frame. The keyframes form a grid evenly spaced in the angular separation between the Moon and the Sun and in the
+ * Sun zenith angle, since during an eclipse the Sun moves in zenith angle much faster than the Moon moves relative to
+ * it. The samples between the keyframes are interpolated bilinearly, which is much cheaper than integrating anew. The
+ * other parameters of the geometry are only required to stay close to those the keyframes were started with: the
+ * eclipsed sky changes with them much slower, or they don't change during an animation.
+ */
+class EclipseKeyframes
+{
+public:
+    //! Coarse grid samples of all the outputs of the precomputation, concatenated
+    using Samples=std::vector<glm::vec4>;
+    //! Parameters of the precomputation other than the Moon-Sun separation and the Sun zenith angle
+    struct Context
+    {
+        double altitude=0;
+        double moonPositionAngle=0;
+        double earthMoonDistance=0;
+        double sunAngularRadius=0;
+        std::vector<glm::vec4> solarIrradianceFixup;
+        bool luminance=false;
+    };
+    //! Position of a keyframe in the grid
+    struct Index
+    {
+        int bySeparation;
+        int bySunZenithAngle;
+
+        bool operator==(Index const& other) const
+        { return bySeparation==other.bySeparation && bySunZenithAngle==other.bySunZenithAngle; }
+        bool operator<(Index const& other) const
+        { return std::tie(bySeparation,bySunZenithAngle) < std::tie(other.bySeparation,other.bySunZenithAngle); }
+    };
+
+    // Angular separation of the Moon from the Sun and its position angle, i.e. the direction from the Sun to the Moon,
+    // counted from the direction of increasing zenith angle towards increasing azimuth
+    static std::pair<double,double> moonSeparationAndPositionAngle(double sunZenithAngle, double moonZenithAngle,
+                                                                   double moonAzimuthRelativeToSun);
+    // Inverse of moonSeparationAndPositionAngle(): returns Moon zenith angle and its azimuth relative to the Sun
+    static std::pair<double,double> moonZenithAngleAndRelativeAzimuth(double sunZenithAngle, double separation,
+                                                                      double positionAngle);
+
+    // Drops all the keyframes unless the spacing and the context match those they were computed for. Returns whether
+    // the keyframes were kept.
+    bool setup(double spacing, Context const& context, double separation);
+    void clear();
+    double spacing() const { return spacing_; }
+    // Index of the keyframe at or below the separation and the Sun zenith angle. The interpolation uses this keyframe
+    // and the next ones along each axis.
+    Index lowerIndex(double separation, double sunZenithAngle) const;
+    double separation(Index const& index) const { return index.bySeparation*spacing_; }
+    double sunZenithAngle(Index const& index) const { return index.bySunZenithAngle*spacing_; }
+    bool contains(Index const& index) const { return keyframes_.count(index); }
+    // Evicts the keyframes farthest from this one if there are too many of them
+    void insert(Index const& index, Samples samples);
+    /* Keyframe worth computing in advance for the frames to come, judging by the direction of the motion since the
+     * previous call. Returns nothing if there's nothing to prefetch.
+     */
+    std::optional<Index> indexToPrefetch(double separation, double sunZenithAngle);
+    // Requires the keyframes at the corners of the grid cell starting at lowerIndex(separation, sunZenithAngle)
+    Samples interpolate(double separation, double sunZenithAngle) const;
+    /* Estimate of the maximum error of the interpolation in the grid cell starting at index, relative to the largest
+     * sample, made from the second differences of the keyframes around its corners along both axes. Negative if there
+     * aren't enough keyframes to estimate it.
+     */
+    double interpolationErrorEstimate(Index const& index) const;
+
+private:
+    double spacing_=0;
+    Context context_;
+    std::map<Index,Samples> keyframes_;
+    double lastSeparation_=-1;
+    double lastSunZenithAngle_=-1;
+
+    bool contextMatches(Context const& context, double separation) const;
+};
+
+#endif
@@ -536,6 +536,9 @@ void GLWidget::stepDataLoading()
 
 void GLWidget::stepPreparationToDraw(const bool emitProgressStatus)
 {
+    // The steps don't wait for the background reload, so the chain only polls it now and then instead of spinning
+    constexpr int pollIntervalMS=5;
+    preparingToDraw_=false;
     try
     {
         makeCurrent();
@@ -546,9 +549,14 @@ void GLWidget::stepPreparationToDraw(const bool emitProgressStatus)
             emit loadProgress(renderer->currentActivity(), status.stepsDone, status.stepsToDo);
 
         if(status.stepsDone < status.stepsToDo)
-            QTimer::singleShot(0, this, [this]{stepPreparationToDraw(true);});
+        {
+            preparingToDraw_=true;
+            QTimer::singleShot(pollIntervalMS, this, [this]{stepPreparationToDraw(true);});
+        }
         else
+        {
             QTimer::singleShot(0, this, qOverload<>(&GLWidget::update));
+        }
     }
     catch(ShowMySky::Error const& ex)
     {
@@ -567,7 +575,8 @@ void GLWidget::paintGL()
     if(!isVisible()) return;
 
     const int preparationSteps = renderer->initPreparationToDraw();
-    if(preparationSteps > 0)
+    // The frames drawn during the preparation must not start more step chains than the one already running
+    if(preparationSteps > 0 && !preparingToDraw_)
         stepPreparationToDraw(false);
 
     if(!renderer->isReadyToRender()) return;
@@ -52,6 +52,7 @@ private:
         Camera,
     } dragMode_=DragMode::None;
     int prevMouseX_, prevMouseY_;
+    bool preparingToDraw_=false; //!< Whether the stepPreparationToDraw() chain is scheduled
 
 public:
     enum class DitheringMode
@@ -0,0 +1,169 @@
+#include "ProgramBinaryCache.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QOpenGLContext>
+#include <QCryptographicHash>
+#include <QOpenGLExtraFunctions>
+
+namespace
+{
+
+// Prepended to the binary in the cache file, so that the format doesn't need to be guessed when loading it
+using BinaryFormat=uint32_t;
+
+}
+
+ProgramBinaryCache::ProgramBinaryCache(QString const& dirPath, const qint64 maxTotalSize)
+    : dirPath(dirPath)
+    , maxTotalSize(maxTotalSize)
+{
+    const auto context=QOpenGLContext::currentContext();
+    if(dirPath.isEmpty() || !context)
+        return;
+    // Program binaries are core since OpenGL 4.1
+    if(context->format().version() < qMakePair(4,1) && !context->hasExtension("GL_ARB_get_program_binary"))
+    {
+        qDebug() << "Program binaries aren't supported, shader programs won't be cached";
+        return;
+    }
+    const auto functions=context->extraFunctions();
+    GLint numFormats=0;
+    functions->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if(numFormats<=0)
+    {
+        qDebug() << "OpenGL implementation has no program binary formats, shader programs won't be cached";
+        return;
+    }
+    if(!QDir().mkpath(dirPath))
+    {
+        qDebug().nospace() << "Failed to create directory for program binary cache " << dirPath;
+        return;
+    }
+
+    for(const auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
+    {
+        if(const auto string=functions->glGetString(name))
+            implementationId += reinterpret_cast<const char*>(string);
+        implementationId += '\n';
+    }
+    gl=functions;
+    trim();
+}
+
+QByteArray ProgramBinaryCache::key(std::vector<Shader> const& shaders, AttribLocations const& attribLocations) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(implementationId);
+    // Prefixing each item with its kind and size avoids ambiguity of concatenation
+    for(const auto& [type, source] : shaders)
+    {
+        hash.addData(QString("\nshader %1 %2: ").arg(int(type)).arg(source.size()).toUtf8());
+        hash.addData(source);
+    }
+    for(const auto& [name, location] : attribLocations)
+        hash.addData(QString("\nattribute %1: %2").arg(location).arg(name.c_str()).toUtf8());
+    return hash.result().toHex();
+}
+
+QString ProgramBinaryCache::filePath(QByteArray const& key) const
+{
+    return dirPath+"/"+QString::fromLatin1(key)+".bin";
+}
+
+bool ProgramBinaryCache::load(QOpenGLShaderProgram& program, QByteArray const& key)
+{
+    if(!gl) return false;
+
+    QFile file(filePath(key));
+    if(!file.open(QFile::ReadOnly))
+        return false;
+    const auto data=file.readAll();
+    // The modification time serves as the time of last use for trim()
+    file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+    file.close();
+    if(size_t(data.size()) <= sizeof(BinaryFormat))
+    {
+        file.remove();
+        return false;
+    }
+
+    BinaryFormat format;
+    std::memcpy(&format, data.data(), sizeof format);
+    if(!program.create())
+        return false;
+    gl->glProgramBinary(program.programId(), format, data.data()+sizeof format, data.size()-sizeof format);
+    // Without any shaders added, link() only checks the link status of the program
+    if(!program.link())
+    {
+        while(gl->glGetError()!=GL_NO_ERROR);
+        qDebug().nospace() << "Program binary " << file.fileName() << " was rejected by OpenGL implementation, removing it";
+        file.remove();
+        return false;
+    }
+    program.setProperty(LOADED_FROM_BINARY_PROPERTY, true);
+    return true;
+}
+
+void ProgramBinaryCache::prepareForLinking(QOpenGLShaderProgram& program)
+{
+    // The program may have been made from a binary before, and is now being rebuilt from the sources
+    program.setProperty(LOADED_FROM_BINARY_PROPERTY, false);
+    if(!gl) return;
+    if(program.create())
+        gl->glProgramParameteri(program.programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramBinaryCache::save(QOpenGLShaderProgram& program, QByteArray const& key)
+{
+    if(!gl) return;
+
+    GLint length=0;
+    gl->glGetProgramiv(program.programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length<=0) return;
+
+    QByteArray data(sizeof(BinaryFormat)+length, 0);
+    GLenum format=0;
+    GLsizei lengthReturned=0;
+    gl->glGetProgramBinary(program.programId(), length, &lengthReturned, &format, data.data()+sizeof(BinaryFormat));
+    if(lengthReturned<=0) return;
+    data.resize(sizeof(BinaryFormat)+lengthReturned);
+    const BinaryFormat formatToSave=format;
+    std::memcpy(data.data(), &formatToSave, sizeof formatToSave);
+
+    QSaveFile file(filePath(key));
+    if(!file.open(QFile::WriteOnly) || file.write(data)!=data.size() || !file.commit())
+    {
+        qDebug().nospace() << "Failed to save program binary to " << file.fileName() << ": " << file.errorString();
+        return;
+    }
+    totalSize += data.size();
+    if(totalSize > maxTotalSize)
+        trim();
+}
+
+void ProgramBinaryCache::trim()
+{
+    // Most recently modified first
+    const auto files=QDir(dirPath).entryInfoList({"*.bin"}, QDir::Files, QDir::Time);
+    totalSize=0;
+    for(const auto& info : files)
+    {
+        if(totalSize+info.size() <= maxTotalSize)
+        {
+            totalSize += info.size();
+            continue;
+        }
+        if(!QFile::remove(info.filePath()))
+        {
+            qDebug().nospace() << "Failed to remove program binary " << info.filePath() << " from the cache";
+            totalSize += info.size();
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef INCLUDE_ONCE_3B1E7F0A_54C2_4D3E_9F6B_2A8C71D05E94
+#define INCLUDE_ONCE_3B1E7F0A_54C2_4D3E_9F6B_2A8C71D05E94
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <QString>
+#include <QVariant>
+#include <QByteArray>
+#include <QOpenGLShader>
+#include <QOpenGLShaderProgram>
+
+class QOpenGLExtraFunctions;
+
+/* On-disk cache of linked shader programs in the form of program binaries. A program is keyed by a hash of the
+ * sources of its shaders and of its attribute bindings, as well as of the strings identifying the OpenGL
+ * implementation, so that any change of the sources or an update of the driver simply results in a miss. Binaries
+ * that the driver rejects are removed from the cache. The binaries left behind by such changes are never requested
+ * again, so when the total size of the cache exceeds its limit, the least recently used binaries are removed.
+ *
+ * All the methods must be called in the thread where the OpenGL context is current.
+ */
+class ProgramBinaryCache
+{
+public:
+    using Shader=std::pair<QOpenGLShader::ShaderType, QByteArray>;
+    using AttribLocations=std::vector<std::pair<std::string,GLuint>>;
+
+    static constexpr qint64 DEFAULT_MAX_TOTAL_SIZE=256*1024*1024;
+
+    // Disables itself if the current OpenGL context doesn't support program binaries or dirPath is empty
+    explicit ProgramBinaryCache(QString const& dirPath, qint64 maxTotalSize=DEFAULT_MAX_TOTAL_SIZE);
+    bool enabled() const { return gl; }
+    QByteArray key(std::vector<Shader> const& shaders, AttribLocations const& attribLocations) const;
+    // Makes the program from the cached binary. Returns false if there's no usable binary for this key.
+    bool load(QOpenGLShaderProgram& program, QByteArray const& key);
+    /* Whether the program was made from a cached binary by load(). Such a program has no shaders attached, so it
+     * can't be relinked with some of its shaders replaced: it has to be built anew from the sources.
+     */
+    static bool loadedFromBinary(QOpenGLShaderProgram const& program)
+    { return program.property(LOADED_FROM_BINARY_PROPERTY).toBool(); }
+    // Must be called before linking, to let the driver know that the binary will be retrieved
+    void prepareForLinking(QOpenGLShaderProgram& program);
+    // Failures to save are only reported to the debug log: the programs will simply be compiled next time
+    void save(QOpenGLShaderProgram& program, QByteArray const& key);
+
+private:
+    // Dynamic property of the programs that marks the ones made from cached binaries
+    static constexpr const char* LOADED_FROM_BINARY_PROPERTY="loadedFromBinary";
+
+    QOpenGLExtraFunctions* gl=nullptr;
+    QString dirPath;
+    QByteArray implementationId;
+    qint64 maxTotalSize;
+    qint64 totalSize=0; //!< Total size of the binaries in the cache, as of the last scan plus the ones saved since
+
+    QString filePath(QByteArray const& key) const;
+    // Removes the least recently used binaries until the total size is within the limit
+    void trim();
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "Texture4DSliceLoader.hpp"
+
+#include <cmath>
+#include <tuple>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <glm/gtc/packing.hpp>
+#include <QObject>
+#include "../common/util.hpp"
+
+std::pair<unsigned,float> Texture4DSliceLoader::altitudeSlicePosition(const double altitudeCoord, const unsigned numAltIntervals)
+{
+    const auto altTexIndex = altitudeCoord==1 ? numAltIntervals-1 : altitudeCoord*numAltIntervals;
+    const unsigned floorAltIndex = std::floor(altTexIndex);
+    return {floorAltIndex, altTexIndex-floorAltIndex};
+}
+
+Texture4DSliceLoader::Texture4DSliceLoader(QOpenGLFunctions_3_3_Core& gl, QString const& path, const Type type,
+                                           const GLuint uploadBuffer, AltitudeSliceCache*const cache)
+    : gl(gl)
+    , file(std::make_unique<TextureFileReader>(path))
+    , path_(path)
+    , type(type)
+    , halfFloat(type==Type::ScatteringTexture && file->elementType()==TextureElementType::Float16)
+    , uploadBuffer(uploadBuffer)
+    , cache(cache)
+{
+    switch(type)
+    {
+    case Type::InterpolationGuides:
+        file->checkFormat(TextureElementType::SNorm16, 1, {0,0,0,0});
+        break;
+    case Type::ScatteringTexture:
+        file->checkFormat(halfFloat ? TextureElementType::Float16 : TextureElementType::Float32, 4, {0,0,0,0});
+        break;
+    case Type::EclipsedDoubleScattering:
+        file->checkFormat(TextureElementType::Float32, 4, {0,0,0});
+        break;
+    }
+    if(file->sizes().back() < 2)
+        throw DataLoadError{QObject::tr("Texture in file \"%1\" has less than 2 altitude slices").arg(path)};
+}
+
+Texture4DSliceLoader::Texture4DSliceLoader(QOpenGLFunctions_3_3_Core& gl, QString const& path, const double altitudeCoord,
+                                           const Type type, const GLuint uploadBuffer, AltitudeSliceCache*const cache)
+    : Texture4DSliceLoader(gl, path, type, uploadBuffer, cache)
+{
+    std::tie(floorAltIndex_, fractAltIndex_) = altitudeSlicePosition(altitudeCoord, numAltIntervals());
+    mapUploadBuffer();
+}
+
+Texture4DSliceLoader::Texture4DSliceLoader(QOpenGLFunctions_3_3_Core& gl, QString const& path, const SingleSlice slice,
+                                           const Type type, const GLuint uploadBuffer, AltitudeSliceCache*const cache)
+    : Texture4DSliceLoader(gl, path, type, uploadBuffer, cache)
+{
+    if(slice.altIndex > numAltIntervals())
+    {
+        throw DataLoadError{QObject::tr("Altitude slice %1 requested from texture in file \"%2\" that only has %3 slices")
+                            .arg(slice.altIndex).arg(path).arg(numAltIntervals()+1)};
+    }
+    floorAltIndex_ = slice.altIndex;
+    singleSlice = true;
+    mapUploadBuffer();
+}
+
+void Texture4DSliceLoader::mapUploadBuffer()
+{
+    if(type==Type::EclipsedDoubleScattering)
+        return;
+
+    // The result of interpolation goes directly into a pixel unpack buffer, so that the driver can transfer it
+    // to the texture asynchronously
+    const auto sliceByteSize = file->chunkSize();
+    gl.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+    gl.glBufferData(GL_PIXEL_UNPACK_BUFFER, sliceByteSize, nullptr, GL_STREAM_DRAW);
+    uploadBufferData = gl.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, sliceByteSize,
+                                           GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+    const auto err = gl.glGetError();
+    gl.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if(!uploadBufferData)
+    {
+        throw DataLoadError{QObject::tr("Failed to map pixel unpack buffer to load texture from \"%1\": %2")
+                            .arg(path_).arg(openglErrorString(err).c_str())};
+    }
+}
+
+Texture4DSliceLoader::~Texture4DSliceLoader()
+{
+    if(uploadBufferData)
+        unmapUploadBuffer();
+}
+
+bool Texture4DSliceLoader::unmapUploadBuffer()
+{
+    gl.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+    const bool unmapped = gl.glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    gl.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    uploadBufferData = nullptr;
+    return unmapped;
+}
+
+const char* Texture4DSliceLoader::readSlice(const unsigned altIndex, const unsigned slot)
+{
+    auto slice = cache ? cache->find(path_, altIndex) : nullptr;
+    if(!slice)
+    {
+        slice = AltitudeSliceCache::load(*file, altIndex);
+        if(cache)
+            cache->insert(path_, altIndex, slice);
+    }
+    slices[slot] = std::move(slice);
+    return slices[slot]->data();
+}
+
+void Texture4DSliceLoader::interpolate()
+{
+    const auto sliceByteSize = file->chunkSize();
+    lowerSlice = readSlice(floorAltIndex_, 0);
+    if(!singleSlice)
+        upperSlice = readSlice(floorAltIndex_+1, 1);
+    if(type==Type::EclipsedDoubleScattering)
+        return;
+    if(singleSlice)
+    {
+        std::memcpy(uploadBufferData, lowerSlice, sliceByteSize);
+        return;
+    }
+
+    const auto& sizes = file->sizes();
+    const auto altSliceSize = size_t(sizes[0])*sizes[1]*sizes[2];
+    if(type == Type::InterpolationGuides)
+    {
+        const auto lower = reinterpret_cast<const int16_t*>(lowerSlice);
+        const auto upper = reinterpret_cast<const int16_t*>(upperSlice);
+        const auto out = static_cast<int16_t*>(uploadBufferData);
+        for(size_t n = 0; n < altSliceSize; ++n)
+            out[n] = lower[n] + fractAltIndex_*(upper[n]-lower[n]);
+    }
+    else if(halfFloat)
+    {
+        // The values stay divided by valueScale, so that they fit into the half-float range; the shader multiplies them back
+        const auto lower = reinterpret_cast<const uint16_t*>(lowerSlice);
+        const auto upper = reinterpret_cast<const uint16_t*>(upperSlice);
+        const auto out = static_cast<uint16_t*>(uploadBufferData);
+        for(size_t n = 0; n < 4*altSliceSize; ++n)
+        {
+            const auto lowerValue = glm::unpackHalf1x16(lower[n]), upperValue = glm::unpackHalf1x16(upper[n]);
+            out[n] = glm::packHalf1x16(lowerValue + fractAltIndex_*(upperValue-lowerValue));
+        }
+    }
+    else
+    {
+        const auto lower = reinterpret_cast<const glm::vec4*>(lowerSlice);
+        const auto upper = reinterpret_cast<const glm::vec4*>(upperSlice);
+        const auto out = static_cast<glm::vec4*>(uploadBufferData);
+        for(size_t n = 0; n < altSliceSize; ++n)
+            out[n] = lower[n] + fractAltIndex_*(upper[n]-lower[n]);
+    }
+}
+
+void Texture4DSliceLoader::upload()
+{
+    assert(type != Type::EclipsedDoubleScattering);
+    assert(lowerSlice);
+
+    if(!unmapUploadBuffer())
+        throw DataLoadError{QObject::tr("Contents of pixel unpack buffer got corrupted while loading texture from \"%1\"").arg(path_)};
+
+    // With a pixel unpack buffer bound, the data pointer is an offset into the buffer
+    const auto& sizes = file->sizes();
+    gl.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+    if(type == Type::InterpolationGuides)
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_R16_SNORM, sizes[0], sizes[1], sizes[2], 0, GL_RED, GL_SHORT, nullptr);
+    else if(halfFloat)
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, sizes[0], sizes[1], sizes[2], 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    else
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, sizes[0], sizes[1], sizes[2], 0, GL_RGBA, GL_FLOAT, nullptr);
+    gl.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
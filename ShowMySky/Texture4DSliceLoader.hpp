@@ -0,0 +1,93 @@
+#ifndef INCLUDE_ONCE_0CF420AA_FC4C_4FFD_A270_27F3FC2D21D7
+#define INCLUDE_ONCE_0CF420AA_FC4C_4FFD_A270_27F3FC2D21D7
+
+#include <memory>
+#include <utility>
+#include <glm/glm.hpp>
+#include <QString>
+#include <QOpenGLFunctions_3_3_Core>
+#include "../common/TextureFile.hpp"
+#include "AltitudeSliceCache.hpp"
+
+/* Loads the slice of a 4D texture for a given altitude, interpolating between the two nearest altitude slices stored
+ * in the file. The work is split into stages so that the expensive one, interpolate(), can be run on a worker thread:
+ * it neither calls OpenGL nor touches anything but this object. The constructor and upload() must be called in the
+ * thread where the OpenGL context is current, as well as the destructor.
+ */
+class Texture4DSliceLoader
+{
+public:
+    enum class Type
+    {
+        ScatteringTexture,
+        InterpolationGuides,
+        //! Coarse grid samples of eclipsed double scattering. They are interpolated by altitude only after the texture
+        //! is generated from them on GPU, so interpolate() simply reads both altitude slices, and upload() isn't used.
+        EclipsedDoubleScattering,
+    };
+
+    //! Selects loading of a single altitude slice as is, e.g. to let the shaders interpolate between slices
+    struct SingleSlice
+    {
+        unsigned altIndex;
+    };
+
+    /* Reads the header of the file and, for the types other than EclipsedDoubleScattering, maps uploadBuffer to
+     * receive the interpolated data. If cache is not null, the altitude slices are taken from it when available, and
+     * put into it otherwise. Either way the slices are mapped from the file if possible, so that they aren't copied.
+     * Throws DataLoadError.
+     */
+    Texture4DSliceLoader(QOpenGLFunctions_3_3_Core& gl, QString const& path, double altitudeCoord, Type type,
+                         GLuint uploadBuffer, AltitudeSliceCache* cache = nullptr);
+    Texture4DSliceLoader(QOpenGLFunctions_3_3_Core& gl, QString const& path, SingleSlice slice, Type type,
+                         GLuint uploadBuffer, AltitudeSliceCache* cache = nullptr);
+    Texture4DSliceLoader(Texture4DSliceLoader const&)=delete;
+    ~Texture4DSliceLoader();
+
+    // Index of the lower of the two altitude slices to interpolate between, and the interpolation weight of the upper one
+    static std::pair<unsigned,float> altitudeSlicePosition(double altitudeCoord, unsigned numAltIntervals);
+
+    // Maps or reads the altitude slices, verifying their checksums, and interpolates them (or, in the SingleSlice mode,
+    // copies the slice). Throws DataLoadError.
+    void interpolate();
+    // Uploads the result into the texture bound to GL_TEXTURE_3D. Throws DataLoadError.
+    void upload();
+
+    QString const& path() const { return path_; }
+    //! Factor to multiply the texel values by when sampling the texture
+    float valueScale() const { return halfFloat ? file->valueScale() : 1.f; }
+    unsigned numAltIntervals() const { return file->sizes().back()-1; }
+    unsigned floorAltIndex() const { return floorAltIndex_; }
+    bool isSingleSlice() const { return singleSlice; }
+    float fractAltIndex() const { return fractAltIndex_; }
+    std::vector<uint64_t> const& sizes() const { return file->sizes(); }
+    //! Lower (0) or upper (1) altitude slice, available after interpolate() for EclipsedDoubleScattering type.
+    //! In the SingleSlice mode, there's only the lower one.
+    const glm::vec4* coarseGridSamples(unsigned slice) const
+    { return reinterpret_cast<const glm::vec4*>(slice ? upperSlice : lowerSlice); }
+
+private:
+    QOpenGLFunctions_3_3_Core& gl;
+    std::unique_ptr<TextureFileReader> file; //!< Closed when the loader is destroyed, the mapped slices don't need it
+    QString path_;
+    Type type;
+    bool halfFloat;
+    unsigned floorAltIndex_=0;
+    float fractAltIndex_=0;
+    bool singleSlice=false;
+    GLuint uploadBuffer;
+    void* uploadBufferData=nullptr; //!< Non-null while the upload buffer is mapped
+    AltitudeSliceCache* cache;
+    const char* lowerSlice=nullptr;
+    const char* upperSlice=nullptr;
+    AltitudeSliceCache::Slice slices[2]; //!< Keep the slices alive even if the cache evicts them
+
+    // Reads the header and checks the format
+    Texture4DSliceLoader(QOpenGLFunctions_3_3_Core& gl, QString const& path, Type type, GLuint uploadBuffer,
+                         AltitudeSliceCache* cache);
+    void mapUploadBuffer();
+    bool unmapUploadBuffer(); //!< Returns false if the buffer contents got corrupted
+    const char* readSlice(unsigned altIndex, unsigned slot);
+};
+
+#endif
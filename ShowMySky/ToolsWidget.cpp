@@ -189,8 +189,12 @@ ToolsWidget::ToolsWidget(QWidget*const parent)
     }
 
     textureFilteringEnabled_=addCheckBox(layout, this, tr("&Texture filtering"), true);
+    gpuAltitudeInterpolationEnabled_=addCheckBox(layout, this, tr("Interpolate &between altitude slices on GPU"), false);
     onTheFlySingleScatteringEnabled_=addCheckBox(layout, this, tr("Compute single scattering on the &fly"), false);
     onTheFlyPrecompDoubleScatteringEnabled_=addCheckBox(layout, this, tr("Precompute double(-only) scattering on the fly"), true);
+    eclipseKeyframeSpacing_=addManipulator(layout, this, tr("Eclipse keyframe spacing (0 = off)"), 0, 1, 0, 3, QChar(0x00b0));
+    connect(onTheFlyPrecompDoubleScatteringEnabled_, &QCheckBox::stateChanged, eclipseKeyframeSpacing_,
+            [this](const int state){ eclipseKeyframeSpacing_->setEnabled(state==Qt::Checked); });
 
     usingEclipseShader_=addCheckBox(layout, this, tr("Use e&clipse-mode shaders"), false);
     connect(usingEclipseShader_, &QCheckBox::stateChanged, this, [this](const int state)
@@ -38,12 +38,14 @@ class ToolsWidget : public QDockWidget, public ShowMySky::Settings
     Manipulator* cameraPitch_=nullptr;
     Manipulator* cameraYaw_=nullptr;
     Manipulator* lightPollutionGroundLuminance_=nullptr;
+    Manipulator* eclipseKeyframeSpacing_=nullptr;
     QCheckBox* onTheFlySingleScatteringEnabled_=nullptr;
     QCheckBox* onTheFlyPrecompDoubleScatteringEnabled_=nullptr;
     QCheckBox* zeroOrderScatteringEnabled_=nullptr;
     QCheckBox* singleScatteringEnabled_=nullptr;
     QCheckBox* multipleScatteringEnabled_=nullptr;
     QCheckBox* textureFilteringEnabled_=nullptr;
+    QCheckBox* gpuAltitudeInterpolationEnabled_=nullptr;
     QCheckBox* usingEclipseShader_=nullptr;
     QCheckBox* pseudoMirrorEnabled_=nullptr;
     QCheckBox* gradualClippingEnabled_=nullptr;
@@ -73,6 +75,8 @@ public:
     bool singleScatteringEnabled() override { return singleScatteringEnabled_->isChecked(); }
     bool multipleScatteringEnabled() override { return multipleScatteringEnabled_->isChecked(); }
     bool textureFilteringEnabled() override { return textureFilteringEnabled_->isChecked(); }
+    bool gpuAltitudeInterpolationEnabled() override { return gpuAltitudeInterpolationEnabled_->isChecked(); }
+    double eclipseKeyframeSpacing() override { return degree*eclipseKeyframeSpacing_->value(); }
     bool usingEclipseShader() override { return usingEclipseShader_->isChecked(); }
     bool pseudoMirrorEnabled() override { return pseudoMirrorEnabled_->isChecked(); }
     bool gradualClippingEnabled() const { return gradualClippingEnabled_->isChecked(); }
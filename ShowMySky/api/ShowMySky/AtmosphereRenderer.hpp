@@ -123,6 +123,8 @@ public:
      *
      * If there's no need for progress indication, this function (and #stepPreparationToDraw) can be ignored. Otherwise, use this method to initialize the process of reloading data.
      *
+     * The reloading itself runs in background threads, and until it completes, #draw keeps rendering with the previously loaded data. The new data replace the old ones all at once when this method or #stepPreparationToDraw finds all of them ready. Thus, if the application doesn't need progress indication, it's enough to keep calling #draw.
+     *
      * This method can also be called during the preparation to render to find out the number of steps to do.
      *
      * \return Total number of loading steps to complete the preparation.
@@ -131,7 +133,7 @@ public:
     /**
      * \brief Perform a single step of preparation to draw.
      *
-     * This method performs a single step of preparation to draw started by #initPreparationToDraw.
+     * This method performs a single step of preparation to draw started by #initPreparationToDraw. It doesn't wait for the background reloading, so the application should call it again after some time, rather than in a busy loop, until it reports completion.
      * \return Status of preparation process: progress, error indication.
      */
     virtual LoadingStatus stepPreparationToDraw() = 0;
@@ -299,7 +301,7 @@ SHOWMYSKY_DLL_PUBLIC ShowMySky::AtmosphereRenderer*
  *
  * If the value of the symbol doesn't match the value of this constant, the library loaded is incompatible with the header against which the binary was compiled. Mixing incompatible header and library leads to undefined behavior.
  */
-#define ShowMySky_ABI_version 15
+#define ShowMySky_ABI_version 16
 
 /**
  * \brief Name of library to be dlopen()-ed
@@ -115,6 +115,33 @@ public:
      */
     virtual bool textureFilteringEnabled() { return true; }
 
+    /**
+     * \brief Memory budget for cached altitude slices of the textures.
+     *
+     * The renderer keeps the recently used altitude slices of the 4D textures in memory, and prefetches the neighbouring ones in the background, so that changes of altitude (e.g. animation of an ascent) don't have to wait for disk reads. Zero disables the cache, as well as prefetching.
+     *
+     * \returns Maximum total size of the cached slices, in MiB.
+     */
+    virtual unsigned altitudeSliceCacheSizeInMiB() { return 512; }
+
+    /**
+     * \brief Whether to interpolate the textures between altitude slices in the shaders.
+     *
+     * If this is enabled, the renderer keeps the two altitude slices nearest to the camera altitude on GPU and lets the shaders interpolate between them, so that altitude changes only require reloading of textures when the camera leaves the interval between the slices, and moving to an adjacent interval only loads one new slice. This costs twice the GPU memory and texture fetches. Otherwise, the slices are interpolated on CPU and reloaded on every altitude change.
+     *
+     * \returns \c true if the altitude slices should be interpolated on GPU, \c false otherwise.
+     */
+    virtual bool gpuAltitudeInterpolationEnabled() { return false; }
+
+    /**
+     * \brief Spacing of keyframes of on-the-fly eclipsed double scattering precomputation.
+     *
+     * If this is positive, and double scattering is precomputed on the fly (see #onTheFlyPrecompDoubleScatteringEnabled), the expensive part of the precomputation is done only at keyframes evenly spaced in angular separation between the Moon and the Sun and in zenith angle of the Sun, and the results between the keyframes are interpolated. The keyframes are computed in advance as the Sun and the Moon move, and at most one integration is done per frame: when the animation jumps to where more than one keyframe is missing, the previous result is shown until they are computed. This is intended for animations of eclipses, trading exactness for much shorter frame times. Zero disables keyframes, so that the precomputation is done anew whenever the Moon moves.
+     *
+     * \returns Keyframe spacing in radians.
+     */
+    virtual double eclipseKeyframeSpacing() { return 0; }
+
     /**
      * \brief Whether to use shader designed to render eclipse atmosphere.
      *
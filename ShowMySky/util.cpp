@@ -1,4 +1,5 @@
 #include "util.hpp"
+#include "ProgramBinaryCache.hpp"
 #include "../common/util.hpp"
 #include <QFile>
 
@@ -25,3 +26,22 @@ void link(QOpenGLShaderProgram& program, QString const& description)
     if(!program.link())
         throw DataLoadError{QObject::tr("Failed to link %1:\n%2").arg(description).arg(program.log())};
 }
+
+void replaceShaders(QOpenGLShaderProgram& program, std::vector<QOpenGLShader*> const& oldShaders,
+                    std::vector<QOpenGLShader*> const& newShaders,
+                    std::vector<std::pair<std::string,GLuint>> const& attribLocations,
+                    QString const& description, std::function<void()> const& rebuild)
+{
+    if(ProgramBinaryCache::loadedFromBinary(program))
+    {
+        rebuild();
+        return;
+    }
+    for(const auto shader : oldShaders)
+        program.removeShader(shader);
+    for(const auto shader : newShaders)
+        program.addShader(shader);
+    for(const auto& [name, location] : attribLocations)
+        program.bindAttributeLocation(name.c_str(), location);
+    link(program, description);
+}
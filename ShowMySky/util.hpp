@@ -1,6 +1,10 @@
 #ifndef INCLUDE_ONCE_BCBE8DB3_A1E2_40C1_8E09_1DA9FE40B65D
 #define INCLUDE_ONCE_BCBE8DB3_A1E2_40C1_8E09_1DA9FE40B65D
 
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
 #include <filesystem>
 #include <QOpenGLShaderProgram>
 #include <QString>
@@ -13,5 +17,12 @@ inline void addShaderFile(QOpenGLShaderProgram& program, QOpenGLShader::ShaderTy
 inline void addShaderFile(QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, std::filesystem::path const& filename)
 { addShaderFile(program, type, QString::fromStdString(filename.u8string())); }
 void link(QOpenGLShaderProgram& program, QString const& description);
+/* Replaces oldShaders in the program with newShaders and relinks it. A program made from a cached binary has no shaders
+ * to replace, so rebuild is called instead to build it anew from the sources.
+ */
+void replaceShaders(QOpenGLShaderProgram& program, std::vector<QOpenGLShader*> const& oldShaders,
+                    std::vector<QOpenGLShader*> const& newShaders,
+                    std::vector<std::pair<std::string,GLuint>> const& attribLocations,
+                    QString const& description, std::function<void()> const& rebuild);
 
 #endif
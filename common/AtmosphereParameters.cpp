@@ -8,6 +8,40 @@
 namespace
 {
 
+using GLSLConstant=AtmosphereParameters::GLSLConstant;
+
+QString glslNumber(const float x) { return QString::number(x, 'g', 9); }
+
+GLSLConstant floatConstant(std::string const& name, const float value)
+{
+    return {name, QString("const float %1=%2;").arg(name.c_str()).arg(glslNumber(value)),
+            {GLSLSnippet::Type::Float, glm::vec4(value)}};
+}
+
+GLSLConstant intConstant(std::string const& name, const int value)
+{
+    return {name, QString("const int %1=%2;").arg(name.c_str()).arg(value), {GLSLSnippet::Type::Int, glm::vec4(value)}};
+}
+
+GLSLConstant vec4Constant(std::string const& name, glm::vec4 const& v)
+{
+    return {name, QString("const vec4 %1=vec4(%2,%3,%4,%5);").arg(name.c_str()).arg(glslNumber(v.x))
+                                                               .arg(glslNumber(v.y)).arg(glslNumber(v.z)).arg(glslNumber(v.w)),
+            {GLSLSnippet::Type::Vec4, v}};
+}
+
+// The types GLSLSnippet doesn't support
+GLSLConstant unsupportedConstant(std::string const& name, QString const& declaration)
+{
+    return {name, declaration, {GLSLSnippet::Type::Unsupported, {}}};
+}
+
+GLSLConstant vec2Constant(std::string const& name, glm::vec2 const& v)
+{
+    return unsupportedConstant(name, QString("const vec2 %1=vec2(%2,%3);").arg(name.c_str())
+                                                                         .arg(glslNumber(v.x)).arg(glslNumber(v.y)));
+}
+
 unsigned long long getUInt(QString const& value, const unsigned long long min, const unsigned long long max,
                            QString const& filename, int lineNumber)
 {
@@ -170,6 +204,23 @@ QString readGLSLFunctionBody(QTextStream& stream, const QString filename, int& l
     return function;
 }
 
+/* Checks the function body for errors that can be found without compiling it as a part of a shader. The bodies
+ * that use GLSL features GLSLSnippet doesn't support are accepted here: the GLSL compiler will check them.
+ */
+void checkGLSLFunctionBody(QString const& body, const GLSLSnippet::Type returnType, std::string const& argumentName,
+                           GLSLSnippet::Constants const& constants, QString const& filename, const int firstLine)
+{
+    try
+    {
+        GLSLSnippet(body.toStdString(), returnType, argumentName, constants);
+    }
+    catch(GLSLSnippet::Error const& error)
+    {
+        if(!error.unsupported)
+            throw ParsingError{filename, firstLine+error.lineNumber-1, QString::fromStdString(error.message)};
+    }
+}
+
 void getSpectrum(std::vector<glm::vec4> const& allWavelengths, QString const& line, const GLfloat min, const GLfloat max,
                  QString const& filename, const int lineNumber, std::vector<glm::vec4>& output)
 {
@@ -356,9 +407,15 @@ AtmosphereParameters::Scatterer parseScatterer(AtmosphereParameters const& atmo,
                 getSpectrum(atmo.allWavelengths,value,0,1,filename,lineNumber, description.singleScatteringAlbedo);
         }
         else if(key=="number density")
+        {
+            description.numberDensityLine=lineNumber+2;
             description.numberDensity=readGLSLFunctionBody(stream,filename,++lineNumber);
+        }
         else if(key=="phase function")
+        {
+            description.phaseFunctionLine=lineNumber+2;
             description.phaseFunction=readGLSLFunctionBody(stream,filename,++lineNumber);
+        }
         else if(key=="phase function type")
             description.phaseFunctionType=parsePhaseFunctionType(value,filename,lineNumber);
 
@@ -406,7 +463,10 @@ AtmosphereParameters::Absorber parseAbsorber(AtmosphereParameters const& atmo, c
         const auto value=keyValue[1].trimmed();
 
         if(key=="number density")
+        {
+            description.numberDensityLine=lineNumber+2;
             description.numberDensity=readGLSLFunctionBody(stream,filename,++lineNumber);
+        }
         else if(key=="cross section")
         {
             if(!skipSpectrum)
@@ -636,6 +696,78 @@ void AtmosphereParameters::parse(QString const& atmoDescrFileName, const ForceNo
     }
 }
 
+void AtmosphereParameters::checkGLSLFunctionBodies(QString const& atmoDescrFileName) const
+{
+    // The bodies can refer to constants related to any scatterer, so they can only be checked after all are parsed
+    const auto constants=snippetConstants(allWavelengths.front());
+    for(const auto& scatterer : scatterers)
+    {
+        checkGLSLFunctionBody(scatterer.numberDensity, GLSLSnippet::Type::Float, "altitude", constants,
+                              atmoDescrFileName, scatterer.numberDensityLine);
+        checkGLSLFunctionBody(scatterer.phaseFunction, GLSLSnippet::Type::Vec4, "dotViewSun", constants,
+                              atmoDescrFileName, scatterer.phaseFunctionLine);
+    }
+    for(const auto& absorber : absorbers)
+    {
+        checkGLSLFunctionBody(absorber.numberDensity, GLSLSnippet::Type::Float, "altitude", constants,
+                              atmoDescrFileName, absorber.numberDensityLine);
+    }
+}
+
+auto AtmosphereParameters::glslConstants() const -> std::vector<GLSLConstant>
+{
+    return {
+        floatConstant("earthRadius", earthRadius), // must be in meters
+        floatConstant("atmosphereHeight", atmosphereHeight), // must be in meters
+        unsupportedConstant("earthCenter", "const vec3 earthCenter=vec3(0,0,-earthRadius);"),
+        floatConstant("dobsonUnit", 2.687e20), // molecules/m^2
+        floatConstant("PI", M_PI),
+        floatConstant("km", 1000),
+        // A uniform rather than a constant, since the renderer can change it, so snippets can't be evaluated with it
+        unsupportedConstant("sunAngularRadius", "uniform float sunAngularRadius="+glslNumber(sunAngularRadius)+";"),
+        floatConstant("moonRadius", moonRadius),
+        vec4Constant("scatteringTextureSize", glm::vec4(scatteringTextureSize)),
+        vec2Constant("irradianceTextureSize", glm::vec2(irradianceTexW, irradianceTexH)),
+        vec2Constant("transmittanceTextureSize", glm::vec2(transmittanceTexW, transmittanceTexH)),
+        vec2Constant("eclipsedSingleScatteringTextureSize", glm::vec2(eclipsedSingleScatteringTextureSize)),
+        vec2Constant("lightPollutionTextureSize", glm::vec2(lightPollutionTextureSize)),
+        intConstant("radialIntegrationPoints", radialIntegrationPoints),
+        intConstant("angularIntegrationPoints", angularIntegrationPoints),
+        intConstant("lightPollutionAngularIntegrationPoints", lightPollutionAngularIntegrationPoints),
+        intConstant("eclipseAngularIntegrationPoints", eclipseAngularIntegrationPoints),
+        intConstant("numTransmittanceIntegrationPoints", numTransmittanceIntegrationPoints),
+    };
+}
+
+auto AtmosphereParameters::wavelengthSetGLSLConstants(glm::vec4 const& wavelengths) const -> std::vector<GLSLConstant>
+{
+    const auto wlI=wavelengthsIndex(wavelengths);
+    const auto spectrumValue=[wlI](std::vector<glm::vec4> const& spectrum)
+                             { return wlI<spectrum.size() ? spectrum[wlI] : glm::vec4(0); };
+    std::vector<GLSLConstant> constants;
+    for(const auto& scatterer : scatterers)
+    {
+        constants.push_back(vec4Constant("scatteringCrossSection_"+scatterer.name.toStdString(),
+                                         spectrumValue(scatterer.scatteringCrossSection_)));
+    }
+    constants.push_back(vec4Constant("groundAlbedo", spectrumValue(groundAlbedo)));
+    constants.push_back(vec4Constant("solarIrradianceAtTOA", spectrumValue(solarIrradianceAtTOA)));
+    constants.push_back(vec4Constant("lightPollutionRelativeRadiance", spectrumValue(lightPollutionRelativeRadiance)));
+    constants.push_back(vec4Constant("wavelengths", wavelengths));
+    constants.push_back(intConstant("wlSetIndex", wlI));
+    return constants;
+}
+
+GLSLSnippet::Constants AtmosphereParameters::snippetConstants(glm::vec4 const& wavelengths) const
+{
+    GLSLSnippet::Constants constants;
+    for(const auto& constant : glslConstants())
+        constants[constant.name]=constant.value;
+    for(const auto& constant : wavelengthSetGLSLConstants(wavelengths))
+        constants[constant.name]=constant.value;
+    return constants;
+}
+
 QString AtmosphereParameters::spectrumToString(std::vector<glm::vec4> const& spectrum)
 {
     QString out;
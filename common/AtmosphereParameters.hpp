@@ -6,6 +6,7 @@
 #include <QtGui>
 #include "types.hpp"
 #include "util.hpp"
+#include "GLSLSnippet.hpp"
 
 struct AtmosphereParameters
 {
@@ -25,6 +26,7 @@ struct AtmosphereParameters
         std::vector<glm::vec4> scatteringCrossSection_;
         QString numberDensity;
         QString phaseFunction;
+        int numberDensityLine=0, phaseFunctionLine=0; // first lines of the function bodies, for error messages
         PhaseFunctionType phaseFunctionType=PhaseFunctionType::General;
         bool needsInterpolationGuides = false;
 
@@ -56,6 +58,7 @@ struct AtmosphereParameters
     struct Absorber
     {
         QString numberDensity;
+        int numberDensityLine=0; // first line of the function body, for error messages
         QString name;
         std::vector<glm::vec4> absorptionCrossSection;
 
@@ -130,6 +133,25 @@ struct AtmosphereParameters
         return it-allWavelengths.begin();
     }
     static QString spectrumToString(std::vector<glm::vec4> const& spectrum);
+
+    struct GLSLConstant
+    {
+        std::string name;
+        QString declaration; // GLSL code that declares the constant
+        GLSLSnippet::Constant value; // the type is Unsupported for what GLSLSnippet can't use
+    };
+    // The contents of const.h.glsl, which is generated from this list, so that the values GLSL snippets are evaluated
+    // with on CPU are the same as on GPU
+    std::vector<GLSLConstant> glslConstants() const;
+    // The contents of wavelength-set-constants.h.glsl. Spectra that weren't loaded are replaced with zeros.
+    std::vector<GLSLConstant> wavelengthSetGLSLConstants(glm::vec4 const& wavelengths) const;
+    // The constants of both headers, for the given wavelength set
+    GLSLSnippet::Constants snippetConstants(glm::vec4 const& wavelengths) const;
+    /* Checks the GLSL function bodies for the errors that can be found without a GLSL compiler. The bodies that use
+     * GLSL features GLSLSnippet doesn't support are accepted here: the GLSL compiler will check them.
+     * Throws ParsingError.
+     */
+    void checkGLSLFunctionBodies(QString const& atmoDescrFileName) const;
 };
 
 #endif
@@ -0,0 +1,357 @@
+#include "EclipsedDoubleScatteringInterpolator.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "fourier-interpolation.hpp"
+#include "spline-interpolation.hpp"
+
+using namespace glm;
+using std::asin;
+using std::exp;
+using std::log;
+
+namespace
+{
+template<typename T> auto sqr(T const& x) { return x*x; }
+// XXX: keep in sync with the same function in util.hpp
+float clampCosine(const float x) { return std::clamp(x, -1.f, 1.f); }
+}
+
+float EclipsedDoubleScatteringInterpolator::cosZenithAngleOfHorizon(const float altitude) const
+{
+    const float R=params.earthRadius;
+    const float h=altitude;
+    return -std::sqrt(2*h*R+sqr(h))/(R+h);
+}
+
+void EclipsedDoubleScatteringInterpolator::generateElevations(const float cameraAltitude)
+{
+    const auto trueHorizonToZenith = acos(cosZenithAngleOfHorizon(cameraAltitude));
+    const auto trueHorizonToNadir = M_PI - trueHorizonToZenith;
+    const auto elevationOfHorizon = M_PI/2-trueHorizonToZenith;
+    constexpr auto mathHorizonToZenith = M_PI/2;
+    constexpr auto mathHorizonToNadir  = M_PI/2;
+    std::vector<float> baseElevations;
+    const auto kMax = params.numberOfElevationPairsToSample;
+    for(unsigned k=0; k<kMax; ++k)
+    {
+        constexpr double nMin=0;
+        constexpr double nMax=9.14247130714592;
+        const double n=nMin+nMax*(k+0.5)/kMax;
+        baseElevations.push_back(exp(-5.373792168754 + 0.876897748729422*n - 0.0262205343007567*n*n));
+    }
+    assert(!baseElevations.empty());
+    const double firstBaseElev=0.001*M_PI/180; // resolve the possible almost-jump in the vicinity of the horizon
+    if(baseElevations[0] > firstBaseElev)
+        baseElevations[0] = firstBaseElev;
+
+    elevationsBelowHorizon_.clear();
+    // Elevations from horizon to nadir in backward direction, [-PI, -PI/2] at alt==0
+    for(const auto baseElev : baseElevations)
+        elevationsBelowHorizon_.push_back(-M_PI - elevationOfHorizon + baseElev/mathHorizonToNadir*trueHorizonToNadir);
+    // Elevations from nadir to horizon in forward direction, [-PI/2, 0] at alt==0
+    for(unsigned i=baseElevations.size(); i-->0;)
+        elevationsBelowHorizon_.push_back(elevationOfHorizon - baseElevations[i]/mathHorizonToNadir*trueHorizonToNadir);
+
+    elevationsAboveHorizon_.clear();
+    // Elevations from horizon to zenith in forward direction, [0, PI/2] at alt==0
+    for(const auto baseElev : baseElevations)
+        elevationsAboveHorizon_.push_back(elevationOfHorizon + baseElev/mathHorizonToZenith*trueHorizonToZenith);
+    // Elevations from zenith to horizon in backward direction, [PI/2, PI] at alt==0
+    for(unsigned i=baseElevations.size(); i-->0;)
+        elevationsAboveHorizon_.push_back(M_PI-(elevationOfHorizon + baseElevations[i]/mathHorizonToZenith*trueHorizonToZenith));
+}
+
+// XXX: keep in sync with the GLSL version in texture-coordinates.{frag,h.glsl}
+std::pair<float,bool> EclipsedDoubleScatteringInterpolator::eclipseTexCoordsToTexVars_cosVZA_VRIG(const float vzaTexCoordInUnitRange,
+                                                                                                  const float altitude) const
+{
+    using namespace std;
+
+    const float distToHorizon = sqrt(sqr(altitude)+2*altitude*params.earthRadius);
+
+    const bool viewRayIntersectsGround = vzaTexCoordInUnitRange<0.5;
+    if(viewRayIntersectsGround)
+    {
+        // Bring the [0 .. 4.9xx] range to exact [0 .. 1]
+        const float vzaTexCoordInDoubleRange = vzaTexCoordInUnitRange * (params.texSizeByViewElevation-1)/(params.texSizeByViewElevation/2-1);
+        const float cosVZACoord = 1 - vzaTexCoordInDoubleRange;
+
+        const float distMin=altitude;
+        const float distMax=distToHorizon;
+        const float distToGround=cosVZACoord*(distMax-distMin)+distMin;
+        return {distToGround==0 ? -1 :
+            clampCosine(-(sqr(distToHorizon)+sqr(distToGround)) / (2*distToGround*(altitude+params.earthRadius))),
+                viewRayIntersectsGround};
+    }
+    else
+    {
+        // [0.50xx .. 1] --reverse--> [0.49xx .. 0]
+        const float vzaTexCoordInUnitRangeReversed = 1 - vzaTexCoordInUnitRange;
+        // [0.49xx .. 0] -> [1 .. 0]
+        const float vzaTexCoordInDoubleRange = vzaTexCoordInUnitRangeReversed * (params.texSizeByViewElevation-1)/(params.texSizeByViewElevation/2-1);
+        // [1 .. 0] --reverse--> [0 .. 1]
+        const float cosVZACoord = 1 - vzaTexCoordInDoubleRange;
+
+        const float distMin=params.atmosphereHeight-altitude;
+        const float distMax=distToHorizon+params.lengthOfHorizRayFromGroundToBorderOfAtmo;
+        const float distToTopAtmoBorder=cosVZACoord*(distMax-distMin)+distMin;
+        return {distToTopAtmoBorder==0 ? 1 :
+            clampCosine((sqr(params.lengthOfHorizRayFromGroundToBorderOfAtmo)-sqr(distToHorizon)-sqr(distToTopAtmoBorder)) /
+                        (2*distToTopAtmoBorder*(altitude+params.earthRadius))),
+                viewRayIntersectsGround};
+    }
+}
+
+EclipsedDoubleScatteringInterpolator::EclipsedDoubleScatteringInterpolator(EclipsedDoubleScatteringInterpolationParameters const& params)
+    : params(params)
+    , fourierInterpolator(std::make_unique<FourierInterpolator>(2*params.numberOfAzimuthPairsToSample,
+                                                                params.texSizeByViewAzimuth))
+{
+    const auto nAzimuthPairsToSample=params.numberOfAzimuthPairsToSample;
+    const auto nElevationPairsToSample=params.numberOfElevationPairsToSample;
+    for(auto& s : samplesAboveHorizon)
+        s.resize(2*nElevationPairsToSample*nAzimuthPairsToSample);
+    for(auto& s : samplesBelowHorizon)
+        s.resize(2*nElevationPairsToSample*nAzimuthPairsToSample);
+
+    for(auto& r : radianceInterpolatedOverElevations)
+        r.resize(params.texSizeByViewElevation*2*nAzimuthPairsToSample);
+}
+
+EclipsedDoubleScatteringInterpolator::~EclipsedDoubleScatteringInterpolator() = default;
+
+void EclipsedDoubleScatteringInterpolator::setSample(const bool aboveHorizon, const unsigned azimIndex,
+                                                     const unsigned elevIndex, glm::vec4 const& radiance)
+{
+    const auto elevCount=elevationsAboveHorizon_.size();
+    const auto elev = (aboveHorizon ? elevationsAboveHorizon_ : elevationsBelowHorizon_)[elevIndex];
+    auto*const samples = aboveHorizon ? samplesAboveHorizon : samplesBelowHorizon;
+    for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+        samples[i][azimIndex*elevCount+elevIndex]=vec2(elev, radiance[i]);
+}
+
+void EclipsedDoubleScatteringInterpolator::generateTextureSlice(const double cameraAltitude, glm::vec4*const output)
+{
+    // 1. The samples on the coarse grid must have been set or loaded before we get here.
+
+    const auto nAzimuthPairsToSample=params.numberOfAzimuthPairsToSample;
+    const auto elevCount=elevationsAboveHorizon_.size(); // for each direction: above and below horizon
+
+    // 2. Apply log to all samples: interpolation works much better in logarithmic scale.
+    for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
+    {
+        for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+        {
+            const auto pos = azimIndex*elevCount+elevIndex;
+            static constexpr float ALMOST_LOG_ZERO = -70;
+
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+            {
+                auto& sample = samplesAboveHorizon[i][pos].y;
+                sample = sample==0 ? ALMOST_LOG_ZERO : log(sample);
+            }
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+            {
+                auto& sample = samplesBelowHorizon[i][pos].y;
+                sample = sample==0 ? ALMOST_LOG_ZERO : log(sample);
+            }
+        }
+    }
+
+    // 3. Interpolate the samples over the circles of elevations using second order spline interpolation
+
+    // The elevations of the texels don't depend on azimuth, so they are computed once for all azimuths, grouped by the
+    // set of spline functions they are sampled from, and sorted, so that each group is sampled in one monotonic pass.
+    struct ElevationToSample
+    {
+        float elevation;
+        unsigned index; // in radianceInterpolatedOverElevations, without the azimuth index
+    };
+    std::vector<ElevationToSample> elevsToSampleAboveHorizon, elevsToSampleBelowHorizon;
+    for(unsigned texElevIndex=0; texElevIndex<params.texSizeByViewElevation; ++texElevIndex)
+    {
+        const auto [cosVZA, viewRayIntersectsGround]=
+            eclipseTexCoordsToTexVars_cosVZA_VRIG(float(texElevIndex)/(params.texSizeByViewElevation-1), cameraAltitude);
+        auto& elevsToSample = viewRayIntersectsGround ? elevsToSampleBelowHorizon : elevsToSampleAboveHorizon;
+        const double elevMin = (viewRayIntersectsGround ? elevationsBelowHorizon_ : elevationsAboveHorizon_).front();
+        const double elevMax = (viewRayIntersectsGround ? elevationsBelowHorizon_ : elevationsAboveHorizon_).back();
+        for(const bool oppositeAzimuth : {false, true})
+        {
+            auto elevation = oppositeAzimuth ? M_PI-asin(cosVZA) : asin(cosVZA);
+            if(viewRayIntersectsGround && elevation > 0)
+                elevation -= 2*M_PI; // bring it to the negative range to match that of intFuncsBelowHorizon
+            // We've not sampled too close to horizon to avoid rounding errors, so let's clamp to the edges of available range
+            elevation = std::clamp(elevation, elevMin, elevMax);
+
+            const auto index = texElevIndex*2*nAzimuthPairsToSample + (oppositeAzimuth ? nAzimuthPairsToSample : 0);
+            elevsToSample.push_back({float(elevation), index});
+        }
+    }
+    std::vector<float> elevationsToSample[2], sampledValues;
+    for(const bool aboveHorizon : {false, true})
+    {
+        auto& elevsToSample = aboveHorizon ? elevsToSampleAboveHorizon : elevsToSampleBelowHorizon;
+        std::sort(elevsToSample.begin(), elevsToSample.end(),
+                  [](auto const& a, auto const& b){ return a.elevation < b.elevation; });
+        for(const auto& e : elevsToSample)
+            elevationsToSample[aboveHorizon].push_back(e.elevation);
+    }
+    sampledValues.resize(std::max(elevsToSampleAboveHorizon.size(), elevsToSampleBelowHorizon.size()));
+
+    for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
+    {
+        for(const bool aboveHorizon : {false, true})
+        {
+            auto*const samples = aboveHorizon ? samplesAboveHorizon : samplesBelowHorizon;
+            const auto& elevsToSample = aboveHorizon ? elevsToSampleAboveHorizon : elevsToSampleBelowHorizon;
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+            {
+                const auto intFunc=splineInterpolationOrder2(&samples[i][azimIndex*elevCount], elevCount);
+                intFunc.sampleSorted(elevationsToSample[aboveHorizon].data(), elevsToSample.size(), sampledValues.data());
+                for(unsigned k=0; k<elevsToSample.size(); ++k)
+                    radianceInterpolatedOverElevations[i][elevsToSample[k].index + azimIndex] = sampledValues[k];
+            }
+        }
+    }
+
+    // 4. Interpolate the resulting interpolations over azimuths using Fourier interpolation and save into the output
+    float const* rowsToInterpolate[VEC_ELEM_COUNT];
+    for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+        rowsToInterpolate[i]=radianceInterpolatedOverElevations[i].data();
+    fourierInterpolator->interpolate(rowsToInterpolate, VEC_ELEM_COUNT, params.texSizeByViewElevation, &output[0][0]);
+}
+
+void EclipsedDoubleScatteringInterpolator::convertRadianceToLuminance(glm::mat4 const& radianceToLuminance)
+{
+    const auto nAzimuthPairsToSample=params.numberOfAzimuthPairsToSample;
+    const auto elevCount=elevationsAboveHorizon_.size(); // for each direction: above and below horizon
+
+    for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
+    {
+        for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+        {
+            const auto pos = azimIndex*elevCount+elevIndex;
+            const auto v = vec4(samplesAboveHorizon[0][pos].y,
+                                samplesAboveHorizon[1][pos].y,
+                                samplesAboveHorizon[2][pos].y,
+                                samplesAboveHorizon[3][pos].y);
+            const auto transformed = radianceToLuminance * v;
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+                samplesAboveHorizon[i][pos].y = transformed[i];
+        }
+        for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+        {
+            const auto pos = azimIndex*elevCount+elevIndex;
+            const auto v = vec4(samplesBelowHorizon[0][pos].y,
+                                samplesBelowHorizon[1][pos].y,
+                                samplesBelowHorizon[2][pos].y,
+                                samplesBelowHorizon[3][pos].y);
+            const auto transformed = radianceToLuminance * v;
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+                samplesBelowHorizon[i][pos].y = transformed[i];
+        }
+    }
+}
+
+void EclipsedDoubleScatteringInterpolator::accumulateLuminance(EclipsedDoubleScatteringInterpolator const& source,
+                                                               glm::mat4 const& sourceRadianceToLuminance)
+{
+    const auto nAzimuthPairsToSample=params.numberOfAzimuthPairsToSample;
+    const auto elevCount=elevationsAboveHorizon_.size(); // for each direction: above and below horizon
+
+    for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
+    {
+        for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+        {
+            const auto pos = azimIndex*elevCount+elevIndex;
+            const auto v = vec4(source.samplesAboveHorizon[0][pos].y,
+                                source.samplesAboveHorizon[1][pos].y,
+                                source.samplesAboveHorizon[2][pos].y,
+                                source.samplesAboveHorizon[3][pos].y);
+            const auto transformed = sourceRadianceToLuminance * v;
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+                samplesAboveHorizon[i][pos].y += transformed[i];
+        }
+        for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+        {
+            const auto pos = azimIndex*elevCount+elevIndex;
+            const auto v = vec4(source.samplesBelowHorizon[0][pos].y,
+                                source.samplesBelowHorizon[1][pos].y,
+                                source.samplesBelowHorizon[2][pos].y,
+                                source.samplesBelowHorizon[3][pos].y);
+            const auto transformed = sourceRadianceToLuminance * v;
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+                samplesBelowHorizon[i][pos].y += transformed[i];
+        }
+    }
+}
+
+// The only data that's really expensive to compute is radiance. As we want to
+// keep storage use as small as possible, we intend the other data like the list
+// of elevations to be restored on loading by the renderer.
+size_t EclipsedDoubleScatteringInterpolator::appendCoarseGridSamplesTo(std::vector<glm::vec4>& data) const
+{
+    const auto initialSize = data.size();
+    for(unsigned n=0; n<samplesAboveHorizon[0].size(); ++n)
+    {
+        data.emplace_back(samplesAboveHorizon[0][n].y,
+                          samplesAboveHorizon[1][n].y,
+                          samplesAboveHorizon[2][n].y,
+                          samplesAboveHorizon[3][n].y);
+    }
+    for(unsigned n=0; n<samplesBelowHorizon[0].size(); ++n)
+    {
+        data.emplace_back(samplesBelowHorizon[0][n].y,
+                          samplesBelowHorizon[1][n].y,
+                          samplesBelowHorizon[2][n].y,
+                          samplesBelowHorizon[3][n].y);
+    }
+    const auto numElementsWritten = data.size() - initialSize;
+    return numElementsWritten;
+}
+
+void EclipsedDoubleScatteringInterpolator::loadCoarseGridSamples(const double cameraAltitude,
+                                                                 glm::vec4 const* data, const size_t numElements)
+{
+    generateElevations(cameraAltitude);
+
+    const auto numPointsPerElevSet = numElements/2;
+    unsigned dataOffset = 0;
+
+    for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+        samplesAboveHorizon[i].resize(numPointsPerElevSet);
+    for(unsigned n = 0, elevIndex = 0; n<numPointsPerElevSet; ++n)
+    {
+        const auto elev = elevationsAboveHorizon_[elevIndex];
+        samplesAboveHorizon[0][n] = vec2(elev, data[dataOffset][0]);
+        samplesAboveHorizon[1][n] = vec2(elev, data[dataOffset][1]);
+        samplesAboveHorizon[2][n] = vec2(elev, data[dataOffset][2]);
+        samplesAboveHorizon[3][n] = vec2(elev, data[dataOffset][3]);
+        ++dataOffset;
+
+        if(elevIndex+1 < elevationsAboveHorizon_.size())
+            ++elevIndex;
+        else
+            elevIndex=0;
+    }
+
+    for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+        samplesBelowHorizon[i].resize(numPointsPerElevSet);
+    for(unsigned n = 0, elevIndex = 0; n<numPointsPerElevSet; ++n)
+    {
+        const auto elev = elevationsBelowHorizon_[elevIndex];
+        samplesBelowHorizon[0][n] = vec2(elev, data[dataOffset][0]);
+        samplesBelowHorizon[1][n] = vec2(elev, data[dataOffset][1]);
+        samplesBelowHorizon[2][n] = vec2(elev, data[dataOffset][2]);
+        samplesBelowHorizon[3][n] = vec2(elev, data[dataOffset][3]);
+        ++dataOffset;
+
+        if(elevIndex+1 < elevationsBelowHorizon_.size())
+            ++elevIndex;
+        else
+            elevIndex=0;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef INCLUDE_ONCE_A0B0E843_4679_4D0E_8E3E_0C46F319F5F9
+#define INCLUDE_ONCE_A0B0E843_4679_4D0E_8E3E_0C46F319F5F9
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+class FourierInterpolator;
+
+// The subset of AtmosphereParameters that the interpolation depends on
+struct EclipsedDoubleScatteringInterpolationParameters
+{
+    float earthRadius;
+    float atmosphereHeight;
+    float lengthOfHorizRayFromGroundToBorderOfAtmo;
+    unsigned numberOfAzimuthPairsToSample;
+    unsigned numberOfElevationPairsToSample;
+    unsigned texSizeByViewAzimuth;
+    unsigned texSizeByViewElevation;
+};
+
+/* The CPU part of the eclipsed double scattering precomputation: it holds the radiance sampled on a coarse grid of view
+ * directions for one camera altitude and Sun zenith angle, and interpolates it into a slice of the 4D texture.
+ *
+ * The code here deliberately doesn't depend on OpenGL or Qt, so that it can be tested and benchmarked separately, and
+ * different instances can be used concurrently from different threads. The sampling on GPU is done by
+ * EclipsedDoubleScatteringPrecomputer, which stores the results here.
+ */
+class EclipsedDoubleScatteringInterpolator
+{
+    const EclipsedDoubleScatteringInterpolationParameters params;
+
+    std::unique_ptr<FourierInterpolator> fourierInterpolator; // from the samples over azimuths to the texels
+    std::vector<float> elevationsAboveHorizon_, elevationsBelowHorizon_;
+
+    static constexpr unsigned VEC_ELEM_COUNT=4; // number of components in the partial radiance vector
+    // The samples of radiance, one container per vec4 component. These containers are re-used for different altitudes and Sun elevations.
+    // The separation into above-horizon and below-horizon parts is because at some altitudes there's a jump (or simply rapid change) in
+    // radiance at the horizon, so spline interpolation would misbehave near this point if done without separation.
+    std::vector<glm::vec2> samplesAboveHorizon[VEC_ELEM_COUNT];
+    std::vector<glm::vec2> samplesBelowHorizon[VEC_ELEM_COUNT];
+    // The samples of radiance interpolated over view elevations but not yet over view azimuths, one container per vec4 component.
+    // These containers are re-used for different altitudes and Sun elevations.
+    std::vector<float> radianceInterpolatedOverElevations[VEC_ELEM_COUNT];
+
+    float cosZenithAngleOfHorizon(float altitude) const;
+    std::pair<float,bool> eclipseTexCoordsToTexVars_cosVZA_VRIG(float vzaTexCoordInUnitRange, float altitude) const;
+public:
+    explicit EclipsedDoubleScatteringInterpolator(EclipsedDoubleScatteringInterpolationParameters const& params);
+    ~EclipsedDoubleScatteringInterpolator();
+
+    // Number of the samples on the coarse grid, i.e. the number of elements appendCoarseGridSamplesTo() appends
+    size_t coarseGridSampleCount() const
+    { return 2 * 2*size_t(params.numberOfElevationPairsToSample)*params.numberOfAzimuthPairsToSample; }
+    // Number of texels in the output of generateTextureSlice()
+    size_t textureSliceSize() const { return size_t(params.texSizeByViewAzimuth)*params.texSizeByViewElevation; }
+
+    // Generates the elevations of the coarse grid for the given altitude. The samples must be set for them afterwards.
+    void generateElevations(float cameraAltitude);
+    // These elevations span from forward horizon to backward horizon
+    std::vector<float> const& elevationsAboveHorizon() const { return elevationsAboveHorizon_; }
+    std::vector<float> const& elevationsBelowHorizon() const { return elevationsBelowHorizon_; }
+    void setSample(bool aboveHorizon, unsigned azimIndex, unsigned elevIndex, glm::vec4 const& radiance);
+
+    void convertRadianceToLuminance(glm::mat4 const& radianceToLuminance);
+    void accumulateLuminance(EclipsedDoubleScatteringInterpolator const& source, glm::mat4 const& sourceRadianceToLuminance);
+    // Writes textureSliceSize() texels into output. The samples are modified in the process, so they must be set
+    // again before the next call.
+    void generateTextureSlice(double cameraAltitude, glm::vec4* output);
+
+    size_t appendCoarseGridSamplesTo(std::vector<glm::vec4>& data) const;
+    void loadCoarseGridSamples(double cameraAltitude, glm::vec4 const* data, size_t numElements);
+};
+
+#endif
@@ -2,11 +2,12 @@
 #define INCLUDE_ONCE_9100E17F_B7DD_4CC0_8D2F_9DBB66C7D23D
 
 #include <vector>
-#include <utility>
-#include <complex>
 #include <glm/glm.hpp>
 #include <QtOpenGL>
 #include "AtmosphereParameters.hpp"
+#include "EclipsedDoubleScatteringInterpolator.hpp"
+
+class TextureLayerSumComputer;
 
 class EclipsedDoubleScatteringPrecomputer
 {
@@ -17,50 +18,62 @@ class EclipsedDoubleScatteringPrecomputer
     const unsigned texSizeBySZA;
 
     const double texW, texH; // size of the intermediate texture we are rendering to
-    std::vector<glm::vec4> texture_; // output 4D texture data
-    std::vector<std::complex<float>> fourierIntermediate;
-    std::vector<float> elevationsAboveHorizon, elevationsBelowHorizon;
-
-    static constexpr unsigned VEC_ELEM_COUNT=4; // number of components in the partial radiance vector
-    // The samples of radiance, one container per vec4 component. These containers are re-used for different altitudes and Sun elevations.
-    // The separation into above-horizon and below-horizon parts is because at some altitudes there's a jump (or simply rapid change) in
-    // radiance at the horizon, so spline interpolation would misbehave near this point if done without separation.
-    std::vector<glm::vec2> samplesAboveHorizon[VEC_ELEM_COUNT];
-    std::vector<glm::vec2> samplesBelowHorizon[VEC_ELEM_COUNT];
-    // The samples of radiance interpolated over view elevations but not yet over view azimuths, one container per vec4 component.
-    // These containers are re-used for different altitudes and Sun elevations.
-    std::vector<float> radianceInterpolatedOverElevations[VEC_ELEM_COUNT];
+    EclipsedDoubleScatteringInterpolator interpolator_;
 
-    GLint origViewportWidth, origViewportHeight;
+    // The directions of the coarse grid samples whose computation has been started but not finished
+    struct CoarseGridSample
+    {
+        unsigned azimIndex;
+        unsigned elevIndex;
+        bool aboveHorizon;
+        glm::vec3 viewDir;
+    };
+    std::vector<CoarseGridSample> coarseGridSamplesToCompute;
+    unsigned pendingBatchStart=0;
 
-    float cosZenithAngleOfHorizon(const float altitude) const;
-    std::pair<float,bool> eclipseTexCoordsToTexVars_cosVZA_VRIG(float vzaTexCoordInUnitRange, float altitude) const;
-    void generateElevationsForEclipsedDoubleScattering(float cameraAltitude);
+    void storeCoarseGridIntegrals(unsigned firstSample, std::vector<glm::vec4> const& integrals);
 public:
+    // The GPU is only used by the computations, so that the precomputer can be created without changing any GL state
+    EclipsedDoubleScatteringPrecomputer(QOpenGLFunctions_3_3_Core& gl,
+                                        AtmosphereParameters const& atmo,
+                                        unsigned texSizeByViewAzimuth, unsigned texSizeByViewElevation,
+                                        unsigned texSizeBySZA);
+
+    // Number of the samples computed by computeRadianceOnCoarseGrid(), i.e. the number of layers layerSummer needs
+    // to compute them all in one batch
+    static unsigned coarseGridSampleCount(AtmosphereParameters const& atmo);
+    static EclipsedDoubleScatteringInterpolationParameters interpolationParameters(AtmosphereParameters const& atmo,
+                                                                                   unsigned texSizeByViewAzimuth,
+                                                                                   unsigned texSizeByViewElevation);
     /* Preconditions:
-     *   * Rendering FBO is bound, and the target texture is attached to it
+     *   * Rendering FBO is bound
      *   * program is bound
      *   * Transmittance texture uniform is set for program
      *   * VAO for a quad is bound
+     *
+     * The integrals for the samples are rendered into the layers of layerSummer, which must have the size of
+     * eclipseAngularIntegrationPoints x radialIntegrationPoints, and summed in batches of layerSummer.layerCount().
+     * Layers are attached to the currently bound draw framebuffer. The viewport is restored before returning.
+     * The results are stored in interpolator().
      */
-    EclipsedDoubleScatteringPrecomputer(QOpenGLFunctions_3_3_Core& gl,
-                                        AtmosphereParameters const& atmo,
-                                        unsigned texSizeByViewAzimuth, unsigned texSizeByViewElevation,
-                                        unsigned texSizeBySZA, unsigned texSizeByAltitude);
-    ~EclipsedDoubleScatteringPrecomputer();
-
     void computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
-                                     GLuint intermediateTextureName, GLuint intermediateTextureTexUnitNum,
+                                     TextureLayerSumComputer& layerSummer, GLuint unusedTextureUnitNum,
                                      double cameraAltitude, double sunZenithAngle, double moonZenithAngle,
                                      double moonAzimuthRelativeToSun, double earthMoonDistance);
-    void convertRadianceToLuminance(glm::mat4 const& radianceToLuminance);
-    void accumulateLuminance(EclipsedDoubleScatteringPrecomputer const& source, glm::mat4 const& sourceRadianceToLuminance);
-    void generateTextureFromCoarseGridData(unsigned altIndex, unsigned szaIndex, double cameraAltitude);
-
-    size_t appendCoarseGridSamplesTo(std::vector<glm::vec4>& data) const;
-    void loadCoarseGridSamples(double cameraAltitude, glm::vec4 const* data, size_t numElements);
+    /* Split version of computeRadianceOnCoarseGrid(). The start doesn't wait for the GPU to finish the last batch of
+     * integrals, so that the caller can meanwhile start the computation for another point in another precomputer. The
+     * computations must be finished in the order they were started, with at most
+     * TextureLayerSumComputer::MAX_PENDING_SUMMATIONS of them pending at a time.
+     */
+    void startComputingRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
+                                            TextureLayerSumComputer& layerSummer, GLuint unusedTextureUnitNum,
+                                            double cameraAltitude, double sunZenithAngle, double moonZenithAngle,
+                                            double moonAzimuthRelativeToSun, double earthMoonDistance);
+    void finishComputingRadianceOnCoarseGrid(TextureLayerSumComputer& layerSummer);
 
-    std::vector<glm::vec4> const& texture() const { return texture_; }
+    // The CPU part, which holds the samples on the coarse grid
+    EclipsedDoubleScatteringInterpolator& interpolator() { return interpolator_; }
+    EclipsedDoubleScatteringInterpolator const& interpolator() const { return interpolator_; }
 };
 
 #endif
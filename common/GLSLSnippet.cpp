@@ -0,0 +1,1092 @@
+#include "GLSLSnippet.hpp"
+#include <set>
+#include <cmath>
+#include <array>
+#include <cctype>
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+
+using Type=GLSLSnippet::Type;
+using Error=GLSLSnippet::Error;
+
+enum class GLSLSnippet::Op : uint8_t
+{
+    // Pure operations: dst = f(a, b, c, d)
+    Move,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    IntDiv,
+    Neg,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+    And,
+    Or,
+    Not,
+    Select,       //!< a ? b : c
+    MakeVec4,     //!< vec4(a, b, c, d)
+    ExtractX,
+    ExtractY,
+    ExtractZ,
+    ExtractW,
+    Trunc,
+    Exp,
+    Log,
+    Exp2,
+    Log2,
+    Sqrt,
+    InverseSqrt,
+    Abs,
+    Sign,
+    Floor,
+    Ceil,
+    Fract,
+    Sin,
+    Cos,
+    Tan,
+    Asin,
+    Acos,
+    Atan,
+    Sinh,
+    Cosh,
+    Tanh,
+    Radians,
+    Degrees,
+    Pow,
+    Atan2,
+    Mod,
+    Min,
+    Max,
+    Step,
+    Clamp,
+    Mix,
+    Smoothstep,
+
+    // Control flow
+    Jump,         //!< to dst
+    JumpIfFalse,  //!< to dst if a is false
+    Return,       //!< a
+};
+
+namespace
+{
+
+using Op=GLSLSnippet::Op;
+
+/* Scalar values are kept replicated in all the components of a vec4, and booleans are represented by 1 and 0.
+ * This way all the arithmetic can be done component-wise regardless of the types of the operands, e.g.
+ * float*vec4 needs no special handling. Integers are kept as floats, which is exact for the values that
+ * the snippets could reasonably use.
+ */
+
+template<typename F>
+glm::vec4 map(glm::vec4 const& a, F const& f)
+{
+    return glm::vec4(f(a[0]), f(a[1]), f(a[2]), f(a[3]));
+}
+template<typename F>
+glm::vec4 map(glm::vec4 const& a, glm::vec4 const& b, F const& f)
+{
+    return glm::vec4(f(a[0],b[0]), f(a[1],b[1]), f(a[2],b[2]), f(a[3],b[3]));
+}
+template<typename F>
+glm::vec4 map(glm::vec4 const& a, glm::vec4 const& b, glm::vec4 const& c, F const& f)
+{
+    return glm::vec4(f(a[0],b[0],c[0]), f(a[1],b[1],c[1]), f(a[2],b[2],c[2]), f(a[3],b[3],c[3]));
+}
+
+glm::vec4 boolean(const bool x) { return glm::vec4(x ? 1.f : 0.f); }
+
+constexpr float PI=3.1415926535897932;
+
+inline glm::vec4 applyOp(const Op op, glm::vec4 const& a, glm::vec4 const& b, glm::vec4 const& c, glm::vec4 const& d)
+{
+    switch(op)
+    {
+    case Op::Move:         return a;
+    case Op::Add:          return map(a,b,[](float x, float y){ return x+y; });
+    case Op::Sub:          return map(a,b,[](float x, float y){ return x-y; });
+    case Op::Mul:          return map(a,b,[](float x, float y){ return x*y; });
+    case Op::Div:          return map(a,b,[](float x, float y){ return x/y; });
+    case Op::IntDiv:       return map(a,b,[](float x, float y){ return std::trunc(x/y); });
+    case Op::Neg:          return map(a,[](float x){ return -x; });
+    case Op::Less:         return boolean(a[0] <  b[0]);
+    case Op::LessEqual:    return boolean(a[0] <= b[0]);
+    case Op::Greater:      return boolean(a[0] >  b[0]);
+    case Op::GreaterEqual: return boolean(a[0] >= b[0]);
+    case Op::Equal:        return boolean(a==b);
+    case Op::NotEqual:     return boolean(a!=b);
+    case Op::And:          return boolean(a[0]!=0 && b[0]!=0);
+    case Op::Or:           return boolean(a[0]!=0 || b[0]!=0);
+    case Op::Not:          return boolean(a[0]==0);
+    case Op::Select:       return a[0]!=0 ? b : c;
+    case Op::MakeVec4:     return glm::vec4(a[0], b[0], c[0], d[0]);
+    case Op::ExtractX:     return glm::vec4(a[0]);
+    case Op::ExtractY:     return glm::vec4(a[1]);
+    case Op::ExtractZ:     return glm::vec4(a[2]);
+    case Op::ExtractW:     return glm::vec4(a[3]);
+    case Op::Trunc:        return map(a,[](float x){ return std::trunc(x); });
+    case Op::Exp:          return map(a,[](float x){ return std::exp(x); });
+    case Op::Log:          return map(a,[](float x){ return std::log(x); });
+    case Op::Exp2:         return map(a,[](float x){ return std::exp2(x); });
+    case Op::Log2:         return map(a,[](float x){ return std::log2(x); });
+    case Op::Sqrt:         return map(a,[](float x){ return std::sqrt(x); });
+    case Op::InverseSqrt:  return map(a,[](float x){ return 1/std::sqrt(x); });
+    case Op::Abs:          return map(a,[](float x){ return std::abs(x); });
+    case Op::Sign:         return map(a,[](float x){ return x>0 ? 1.f : x<0 ? -1.f : 0.f; });
+    case Op::Floor:        return map(a,[](float x){ return std::floor(x); });
+    case Op::Ceil:         return map(a,[](float x){ return std::ceil(x); });
+    case Op::Fract:        return map(a,[](float x){ return x-std::floor(x); });
+    case Op::Sin:          return map(a,[](float x){ return std::sin(x); });
+    case Op::Cos:          return map(a,[](float x){ return std::cos(x); });
+    case Op::Tan:          return map(a,[](float x){ return std::tan(x); });
+    case Op::Asin:         return map(a,[](float x){ return std::asin(x); });
+    case Op::Acos:         return map(a,[](float x){ return std::acos(x); });
+    case Op::Atan:         return map(a,[](float x){ return std::atan(x); });
+    case Op::Sinh:         return map(a,[](float x){ return std::sinh(x); });
+    case Op::Cosh:         return map(a,[](float x){ return std::cosh(x); });
+    case Op::Tanh:         return map(a,[](float x){ return std::tanh(x); });
+    case Op::Radians:      return map(a,[](float x){ return x*(PI/180); });
+    case Op::Degrees:      return map(a,[](float x){ return x*(180/PI); });
+    case Op::Pow:          return map(a,b,[](float x, float y){ return std::pow(x,y); });
+    case Op::Atan2:        return map(a,b,[](float y, float x){ return std::atan2(y,x); });
+    case Op::Mod:          return map(a,b,[](float x, float y){ return x-y*std::floor(x/y); });
+    case Op::Min:          return map(a,b,[](float x, float y){ return std::min(x,y); });
+    case Op::Max:          return map(a,b,[](float x, float y){ return std::max(x,y); });
+    case Op::Step:         return map(a,b,[](float edge, float x){ return x<edge ? 0.f : 1.f; });
+    case Op::Clamp:        return map(a,b,c,[](float x, float lo, float hi){ return std::min(std::max(x,lo),hi); });
+    case Op::Mix:          return map(a,b,c,[](float x, float y, float t){ return x*(1-t)+y*t; });
+    case Op::Smoothstep:   return map(a,b,c,[](float e0, float e1, float x)
+                                         {
+                                             const float t=std::min(std::max((x-e0)/(e1-e0), 0.f), 1.f);
+                                             return t*t*(3-2*t);
+                                         });
+    case Op::Jump:
+    case Op::JumpIfFalse:
+    case Op::Return:
+        break;
+    }
+    return glm::vec4(0);
+}
+
+struct Token
+{
+    enum Kind
+    {
+        End,
+        Number,
+        Identifier,
+        Punctuator,
+    } kind;
+    std::string text;
+    int line;
+    bool isInt=false;
+    float value=0;
+};
+
+bool isIdentifierStart(const char c) { return std::isalpha(static_cast<unsigned char>(c)) || c=='_'; }
+bool isIdentifierChar(const char c) { return std::isalnum(static_cast<unsigned char>(c)) || c=='_'; }
+bool isDigit(const char c) { return std::isdigit(static_cast<unsigned char>(c)); }
+
+std::vector<Token> tokenize(std::string_view src)
+{
+    std::vector<Token> tokens;
+    int line=1;
+    bool lineStart=true;
+    for(size_t i=0; i<src.size();)
+    {
+        const char c=src[i];
+        if(c=='\n')
+        {
+            ++line;
+            ++i;
+            lineStart=true;
+            continue;
+        }
+        if(std::isspace(static_cast<unsigned char>(c)))
+        {
+            ++i;
+            continue;
+        }
+        if(src.substr(i,2)=="//")
+        {
+            while(i<src.size() && src[i]!='\n')
+                ++i;
+            continue;
+        }
+        if(src.substr(i,2)=="/*")
+        {
+            const auto end=src.find("*/", i+2);
+            if(end==src.npos)
+                throw Error{line, "unterminated comment", false};
+            line+=std::count(src.begin()+i, src.begin()+end, '\n');
+            i=end+2;
+            continue;
+        }
+        if(c=='#' && lineStart)
+            throw Error{line, "preprocessor directives are not supported", true};
+        lineStart=false;
+
+        Token token{Token::End, "", line};
+        const auto start=i;
+        if(isIdentifierStart(c))
+        {
+            while(i<src.size() && isIdentifierChar(src[i]))
+                ++i;
+            token.kind=Token::Identifier;
+        }
+        else if(isDigit(c) || (c=='.' && i+1<src.size() && isDigit(src[i+1])))
+        {
+            token.kind=Token::Number;
+            token.isInt=true;
+            if(src.substr(i,2)=="0x" || src.substr(i,2)=="0X")
+                throw Error{line, "hexadecimal literals are not supported", true};
+            while(i<src.size() && isDigit(src[i]))
+                ++i;
+            if(i<src.size() && src[i]=='.')
+            {
+                token.isInt=false;
+                ++i;
+                while(i<src.size() && isDigit(src[i]))
+                    ++i;
+            }
+            if(i<src.size() && (src[i]=='e' || src[i]=='E'))
+            {
+                token.isInt=false;
+                ++i;
+                if(i<src.size() && (src[i]=='+' || src[i]=='-'))
+                    ++i;
+                if(i==src.size() || !isDigit(src[i]))
+                    throw Error{line, "bad exponent in a floating-point literal", false};
+                while(i<src.size() && isDigit(src[i]))
+                    ++i;
+            }
+            const std::string number(src.substr(start, i-start));
+            token.value=std::strtof(number.c_str(), nullptr);
+            if(i<src.size() && (src[i]=='f' || src[i]=='F') && !token.isInt)
+                ++i;
+            if(i<src.size() && isIdentifierChar(src[i]))
+                throw Error{line, "unsupported suffix of a numeric literal", true};
+        }
+        else
+        {
+            static const char*const twoCharPunctuators[]={"<=",">=","==","!=","&&","||","^^","+=","-=","*=","/=",
+                                                          "%=","++","--","<<",">>"};
+            token.kind=Token::Punctuator;
+            i+=std::any_of(std::begin(twoCharPunctuators), std::end(twoCharPunctuators),
+                           [&](const char* p){ return src.substr(i,2)==p; }) ? 2 : 1;
+            if(i-start==1 && std::string_view("+-*/%<>=!?:;,(){}[].&|^~").find(c)==std::string_view::npos)
+                throw Error{line, std::string("unexpected character '")+c+"'", false};
+        }
+        token.text=src.substr(start, i-start);
+        tokens.push_back(token);
+    }
+    tokens.push_back({Token::End, "", line});
+    return tokens;
+}
+
+const char* typeName(const Type type)
+{
+    switch(type)
+    {
+    case Type::Float: return "float";
+    case Type::Int: return "int";
+    case Type::Bool: return "bool";
+    case Type::Vec4: return "vec4";
+    case Type::Unsupported: break;
+    }
+    return "(unsupported type)";
+}
+
+bool isScalarNumber(const Type type) { return type==Type::Float || type==Type::Int; }
+bool isNumber(const Type type) { return isScalarNumber(type) || type==Type::Vec4; }
+
+// Whether a value of the given type can be assigned to a variable of the target type, with implicit conversion if needed
+bool isAssignable(const Type target, const Type source)
+{
+    return target==source || (target==Type::Float && source==Type::Int);
+}
+
+}
+
+class GLSLSnippet::Compiler
+{
+    static constexpr uint16_t CONST_FLAG=0x8000;
+
+    struct Value
+    {
+        Type type;
+        uint16_t reg;
+    };
+    struct Variable
+    {
+        Value value;
+        bool readOnly;
+    };
+
+    std::vector<Token> tokens;
+    size_t pos=0;
+    Constants const& externalConstants;
+    std::map<std::string, uint16_t> usedExternalConstants;
+    std::vector<std::map<std::string, Variable>> scopes;
+    unsigned nextRegister=0;
+    const Type returnType;
+
+public:
+    std::vector<glm::vec4> constants;
+    std::vector<Instruction> code;
+    unsigned numWorkRegisters=0;
+
+private:
+    Token const& token() const { return tokens[pos]; }
+    bool isPunct(const char* p) const { return token().kind==Token::Punctuator && token().text==p; }
+    bool isIdentifier(const char* name) const { return token().kind==Token::Identifier && token().text==name; }
+    bool accept(const char* p)
+    {
+        if(!isPunct(p)) return false;
+        ++pos;
+        return true;
+    }
+    void expect(const char* p)
+    {
+        if(!accept(p))
+            error(std::string("expected '")+p+"' before "+describeToken());
+    }
+    std::string describeToken() const
+    {
+        return token().kind==Token::End ? "end of function body" : "'"+token().text+"'";
+    }
+
+    [[noreturn]] void error(std::string const& message) const { throw Error{token().line, message, false}; }
+    [[noreturn]] void unsupported(std::string const& message) const { throw Error{token().line, message, true}; }
+
+    uint16_t addConstant(glm::vec4 const& value)
+    {
+        const auto it=std::find(constants.begin(), constants.end(), value);
+        if(it!=constants.end())
+            return CONST_FLAG | uint16_t(it-constants.begin());
+        if(constants.size() >= CONST_FLAG)
+            unsupported("too many constants");
+        constants.push_back(value);
+        return CONST_FLAG | uint16_t(constants.size()-1);
+    }
+    static bool isConstant(const Value v) { return v.reg & CONST_FLAG; }
+    glm::vec4 const& constantValue(const Value v) const { return constants[v.reg & ~CONST_FLAG]; }
+
+    uint16_t allocateRegister()
+    {
+        if(nextRegister >= maxRegisters)
+            unsupported("function body is too complex");
+        numWorkRegisters=std::max(numWorkRegisters, nextRegister+1);
+        return nextRegister++;
+    }
+
+    size_t emitInstruction(const Op op, const uint16_t dst, const uint16_t a=0, const uint16_t b=0,
+                           const uint16_t c=0, const uint16_t d=0)
+    {
+        if(code.size() >= 0xffff)
+            unsupported("function body is too long");
+        code.push_back({op, dst, a, b, c, d});
+        return code.size()-1;
+    }
+
+    // Emits a pure operation, folding it if all the operands are constant
+    Value emit(const Type resultType, const Op op, std::initializer_list<Value> args)
+    {
+        assert(args.size()<=4);
+        std::array<uint16_t,4> regs{};
+        std::transform(args.begin(), args.end(), regs.begin(), [](Value v){ return v.reg; });
+        // Unused operands must be constant too for folding to be possible
+        for(auto it=regs.begin()+args.size(); it!=regs.end(); ++it)
+            *it=CONST_FLAG;
+        if(std::all_of(args.begin(), args.end(), isConstant))
+        {
+            std::array<glm::vec4,4> values;
+            std::transform(args.begin(), args.end(), values.begin(), [this](Value v){ return constantValue(v); });
+            return {resultType, addConstant(applyOp(op, values[0], values[1], values[2], values[3]))};
+        }
+        const auto dst=allocateRegister();
+        emitInstruction(op, dst, regs[0], regs[1], regs[2], regs[3]);
+        return {resultType, dst};
+    }
+
+    void patchJumpTarget(const size_t jumpInstruction)
+    {
+        code[jumpInstruction].dst=uint16_t(code.size());
+    }
+
+    Variable const* findVariable(std::string const& name) const
+    {
+        for(auto scope=scopes.rbegin(); scope!=scopes.rend(); ++scope)
+        {
+            if(const auto it=scope->find(name); it!=scope->end())
+                return &it->second;
+        }
+        return nullptr;
+    }
+
+    static bool isTypeName(std::string const& name)
+    {
+        return name=="float" || name=="int" || name=="bool" || name=="vec4";
+    }
+    static bool isUnsupportedTypeName(std::string const& name)
+    {
+        static const std::set<std::string> names{"void","uint","double","vec2","vec3","ivec2","ivec3","ivec4",
+                                                 "uvec2","uvec3","uvec4","bvec2","bvec3","bvec4","dvec2","dvec3","dvec4",
+                                                 "mat2","mat3","mat4","mat2x2","mat2x3","mat2x4","mat3x2","mat3x3",
+                                                 "mat3x4","mat4x2","mat4x3","mat4x4","struct"};
+        return names.count(name);
+    }
+    static Type typeFromName(std::string const& name)
+    {
+        if(name=="float") return Type::Float;
+        if(name=="int") return Type::Int;
+        if(name=="bool") return Type::Bool;
+        assert(name=="vec4");
+        return Type::Vec4;
+    }
+
+    // ---------------------------------- Expressions ----------------------------------
+
+    Type arithmeticResultType(const Value a, const Value b, std::string const& op) const
+    {
+        if(!isNumber(a.type) || !isNumber(b.type))
+        {
+            error("no operation '"+op+"' exists that takes operands of types "+
+                  typeName(a.type)+" and "+typeName(b.type));
+        }
+        if(a.type==Type::Vec4 || b.type==Type::Vec4)
+            return Type::Vec4;
+        if(a.type==Type::Int && b.type==Type::Int)
+            return Type::Int;
+        return Type::Float;
+    }
+
+    Value arithmetic(std::string const& op, const Value a, const Value b)
+    {
+        const auto type=arithmeticResultType(a, b, op);
+        if(op=="+") return emit(type, Op::Add, {a,b});
+        if(op=="-") return emit(type, Op::Sub, {a,b});
+        if(op=="*") return emit(type, Op::Mul, {a,b});
+        assert(op=="/");
+        return emit(type, type==Type::Int ? Op::IntDiv : Op::Div, {a,b});
+    }
+
+    Value primary()
+    {
+        const auto tok=token();
+        if(tok.kind==Token::Number)
+        {
+            ++pos;
+            return {tok.isInt ? Type::Int : Type::Float, addConstant(glm::vec4(tok.value))};
+        }
+        if(accept("("))
+        {
+            const auto value=expression();
+            expect(")");
+            return value;
+        }
+        if(tok.kind!=Token::Identifier)
+            error("syntax error: unexpected "+describeToken());
+
+        ++pos;
+        const auto& name=tok.text;
+        if(isPunct("("))
+            return call(name);
+        if(name=="true" || name=="false")
+            return {Type::Bool, addConstant(boolean(name=="true"))};
+        if(const auto var=findVariable(name))
+            return var->value;
+        if(const auto it=externalConstants.find(name); it!=externalConstants.end())
+        {
+            if(it->second.type==Type::Unsupported)
+                unsupported("the type of '"+name+"' is not supported");
+            auto& reg=usedExternalConstants[name];
+            if(!reg)
+                reg=addConstant(it->second.value);
+            return {it->second.type, reg};
+        }
+        if(isTypeName(name) || isUnsupportedTypeName(name))
+            unsupported("unexpected use of type name '"+name+"'");
+        if(name.substr(0,3)=="gl_")
+            unsupported("built-in variable '"+name+"' is not supported");
+        error("'"+name+"': undeclared identifier");
+    }
+
+    std::vector<Value> arguments()
+    {
+        std::vector<Value> args;
+        expect("(");
+        if(accept(")"))
+            return args;
+        do args.push_back(ternary());
+        while(accept(","));
+        expect(")");
+        return args;
+    }
+
+    Value constructor(std::string const& typeName, std::vector<Value> const& args)
+    {
+        if(typeName=="vec4" && args.size()!=1 &&
+           std::any_of(args.begin(), args.end(), [](Value v){ return v.type==Type::Vec4; }))
+            unsupported("construction of vec4 from vectors is not supported");
+        if(typeName=="vec4")
+        {
+            if(args.size()==1)
+                return {Type::Vec4, args[0].reg}; // scalars are already replicated into all components
+            if(args.size()!=4)
+                error("wrong number of arguments to vec4 constructor");
+            return emit(Type::Vec4, Op::MakeVec4, {args[0], args[1], args[2], args[3]});
+        }
+        if(args.size()!=1)
+            error("wrong number of arguments to "+typeName+" constructor");
+        const auto arg=args[0];
+        const auto scalar = arg.type==Type::Vec4 ? emit(Type::Float, Op::ExtractX, {arg}) : arg;
+        if(typeName=="float")
+            return {Type::Float, scalar.reg};
+        if(typeName=="int")
+            return scalar.type==Type::Float ? emit(Type::Int, Op::Trunc, {scalar}) : Value{Type::Int, scalar.reg};
+        assert(typeName=="bool");
+        if(scalar.type==Type::Bool)
+            return scalar;
+        return emit(Type::Bool, Op::NotEqual, {scalar, {Type::Float, addConstant(glm::vec4(0))}});
+    }
+
+    Value call(std::string const& name)
+    {
+        const auto line=token().line;
+        const auto args=arguments();
+
+        if(isTypeName(name))
+            return constructor(name, args);
+        if(isUnsupportedTypeName(name))
+            unsupported("type '"+name+"' is not supported");
+
+        if(name=="sqr") // macro defined in const.h.glsl
+        {
+            if(args.size()!=1)
+                error("macro 'sqr' requires 1 argument");
+            return emit(arithmeticResultType(args[0], args[0], "*"), Op::Mul, {args[0], args[0]});
+        }
+
+        struct Function
+        {
+            const char* name;
+            unsigned numArgs;
+            Op op;
+            unsigned scalarArgsMask; //!< Arguments that can be float even if the others are vec4
+        };
+        static constexpr Function functions[]={
+            {"exp",1,Op::Exp,0}, {"log",1,Op::Log,0}, {"exp2",1,Op::Exp2,0}, {"log2",1,Op::Log2,0},
+            {"sqrt",1,Op::Sqrt,0}, {"inversesqrt",1,Op::InverseSqrt,0}, {"abs",1,Op::Abs,0}, {"sign",1,Op::Sign,0},
+            {"floor",1,Op::Floor,0}, {"ceil",1,Op::Ceil,0}, {"fract",1,Op::Fract,0}, {"trunc",1,Op::Trunc,0},
+            {"sin",1,Op::Sin,0}, {"cos",1,Op::Cos,0}, {"tan",1,Op::Tan,0}, {"asin",1,Op::Asin,0}, {"acos",1,Op::Acos,0},
+            {"atan",1,Op::Atan,0}, {"atan",2,Op::Atan2,0}, {"sinh",1,Op::Sinh,0}, {"cosh",1,Op::Cosh,0},
+            {"tanh",1,Op::Tanh,0}, {"radians",1,Op::Radians,0}, {"degrees",1,Op::Degrees,0},
+            {"pow",2,Op::Pow,0}, {"mod",2,Op::Mod,0b10}, {"min",2,Op::Min,0b10}, {"max",2,Op::Max,0b10},
+            {"step",2,Op::Step,0b01}, {"clamp",3,Op::Clamp,0b110}, {"mix",3,Op::Mix,0b100},
+            {"smoothstep",3,Op::Smoothstep,0b011},
+        };
+        bool nameFound=false;
+        for(const auto& func : functions)
+        {
+            if(name!=func.name) continue;
+            nameFound=true;
+            if(args.size()!=func.numArgs) continue;
+
+            const bool isVector=std::any_of(args.begin(), args.end(), [](Value v){ return v.type==Type::Vec4; });
+            bool matches=true;
+            for(unsigned i=0; i<args.size(); ++i)
+            {
+                const auto type=args[i].type;
+                const bool scalarAllowed = !isVector || (func.scalarArgsMask & (1u<<i));
+                if(!(type==Type::Vec4 || (scalarAllowed && isScalarNumber(type))))
+                    matches=false;
+            }
+            if(!matches)
+                break;
+            switch(args.size())
+            {
+            case 1: return emit(isVector ? Type::Vec4 : Type::Float, func.op, {args[0]});
+            case 2: return emit(isVector ? Type::Vec4 : Type::Float, func.op, {args[0], args[1]});
+            case 3: return emit(isVector ? Type::Vec4 : Type::Float, func.op, {args[0], args[1], args[2]});
+            }
+        }
+        if(nameFound)
+        {
+            std::string types;
+            for(const auto& arg : args)
+                types += std::string(types.empty() ? "" : ", ")+typeName(arg.type);
+            throw Error{line, "no matching overloaded function found: "+name+"("+types+")", false};
+        }
+        throw Error{line, "call of function '"+name+"' is not supported", true};
+    }
+
+    Value postfix()
+    {
+        auto value=primary();
+        for(;;)
+        {
+            if(accept("."))
+            {
+                if(token().kind!=Token::Identifier)
+                    error("expected field selection after '.'");
+                const auto field=token().text;
+                if(value.type!=Type::Vec4 || field.size()!=1)
+                    unsupported("swizzle '."+field+"' is not supported");
+                static const std::string_view components[]={"xrs", "ygt", "zbp", "waq"};
+                static constexpr Op ops[]={Op::ExtractX, Op::ExtractY, Op::ExtractZ, Op::ExtractW};
+                const auto it=std::find_if(std::begin(components), std::end(components),
+                                           [&](std::string_view c){ return c.find(field[0])!=c.npos; });
+                if(it==std::end(components))
+                    error("illegal vector field selection '"+field+"'");
+                ++pos;
+                value=emit(Type::Float, ops[it-std::begin(components)], {value});
+            }
+            else if(isPunct("[") || isPunct("++") || isPunct("--"))
+            {
+                unsupported("operator '"+token().text+"' is not supported");
+            }
+            else
+            {
+                return value;
+            }
+        }
+    }
+
+    Value unary()
+    {
+        if(accept("-"))
+        {
+            const auto value=unary();
+            if(!isNumber(value.type))
+                error(std::string("no operation '-' exists that takes an operand of type ")+typeName(value.type));
+            return emit(value.type, Op::Neg, {value});
+        }
+        if(accept("+"))
+        {
+            const auto value=unary();
+            if(!isNumber(value.type))
+                error(std::string("no operation '+' exists that takes an operand of type ")+typeName(value.type));
+            return value;
+        }
+        if(accept("!"))
+        {
+            const auto value=unary();
+            if(value.type!=Type::Bool)
+                error(std::string("no operation '!' exists that takes an operand of type ")+typeName(value.type));
+            return emit(Type::Bool, Op::Not, {value});
+        }
+        if(isPunct("++") || isPunct("--") || isPunct("~"))
+            unsupported("operator '"+token().text+"' is not supported");
+        return postfix();
+    }
+
+    Value multiplicative()
+    {
+        auto value=unary();
+        for(;;)
+        {
+            if(isPunct("*") || isPunct("/"))
+            {
+                const auto op=token().text;
+                ++pos;
+                value=arithmetic(op, value, unary());
+            }
+            else if(isPunct("%"))
+                unsupported("operator '%' is not supported");
+            else
+                return value;
+        }
+    }
+
+    Value additive()
+    {
+        auto value=multiplicative();
+        while(isPunct("+") || isPunct("-"))
+        {
+            const auto op=token().text;
+            ++pos;
+            value=arithmetic(op, value, multiplicative());
+        }
+        return value;
+    }
+
+    Value relational()
+    {
+        auto value=additive();
+        for(;;)
+        {
+            Op op;
+            if(isPunct("<")) op=Op::Less;
+            else if(isPunct("<=")) op=Op::LessEqual;
+            else if(isPunct(">")) op=Op::Greater;
+            else if(isPunct(">=")) op=Op::GreaterEqual;
+            else return value;
+            const auto opText=token().text;
+            ++pos;
+            const auto rhs=additive();
+            if(!isScalarNumber(value.type) || !isScalarNumber(rhs.type))
+            {
+                error("no operation '"+opText+"' exists that takes operands of types "+
+                      typeName(value.type)+" and "+typeName(rhs.type));
+            }
+            value=emit(Type::Bool, op, {value, rhs});
+        }
+    }
+
+    Value equality()
+    {
+        auto value=relational();
+        while(isPunct("==") || isPunct("!="))
+        {
+            const auto opText=token().text;
+            ++pos;
+            const auto rhs=relational();
+            if(!isAssignable(value.type, rhs.type) && !isAssignable(rhs.type, value.type))
+            {
+                error("no operation '"+opText+"' exists that takes operands of types "+
+                      typeName(value.type)+" and "+typeName(rhs.type));
+            }
+            value=emit(Type::Bool, opText=="==" ? Op::Equal : Op::NotEqual, {value, rhs});
+        }
+        return value;
+    }
+
+    Value logical(const char* opText, const Op op, Value (Compiler::*operand)())
+    {
+        auto value=(this->*operand)();
+        while(accept(opText))
+        {
+            const auto rhs=(this->*operand)();
+            if(value.type!=Type::Bool || rhs.type!=Type::Bool)
+            {
+                error(std::string("no operation '")+opText+"' exists that takes operands of types "+
+                      typeName(value.type)+" and "+typeName(rhs.type));
+            }
+            value=emit(Type::Bool, op, {value, rhs});
+        }
+        return value;
+    }
+    Value logicalAnd() { return logical("&&", Op::And, &Compiler::equality); }
+    Value logicalOr() { return logical("||", Op::Or, &Compiler::logicalAnd); }
+
+    Value ternary()
+    {
+        const auto condition=logicalOr();
+        if(!accept("?"))
+            return condition;
+        if(condition.type!=Type::Bool)
+            error("boolean expression expected before '?'");
+        const auto ifTrue=expression();
+        expect(":");
+        const auto ifFalse=ternary();
+        Type type;
+        if(isAssignable(ifTrue.type, ifFalse.type))
+            type=ifTrue.type;
+        else if(isAssignable(ifFalse.type, ifTrue.type))
+            type=ifFalse.type;
+        else
+            error("the second and third operands of '?:' must have the same type");
+        return emit(type, Op::Select, {condition, ifTrue, ifFalse});
+    }
+
+    Value expression()
+    {
+        const auto value=ternary();
+        if(isPunct(","))
+            unsupported("comma operator is not supported");
+        return value;
+    }
+
+    // ---------------------------------- Statements ----------------------------------
+
+    void moveTo(const uint16_t dst, const Value value)
+    {
+        if(dst!=value.reg)
+            emitInstruction(Op::Move, dst, value.reg);
+    }
+
+    void declaration(const bool readOnly)
+    {
+        if(isUnsupportedTypeName(token().text))
+            unsupported("type '"+token().text+"' is not supported");
+        if(token().kind!=Token::Identifier || !isTypeName(token().text))
+            error("type name expected before "+describeToken());
+        const auto type=typeFromName(token().text);
+        ++pos;
+        do
+        {
+            if(token().kind!=Token::Identifier)
+                error("variable name expected before "+describeToken());
+            const auto name=token().text;
+            if(isTypeName(name) || isUnsupportedTypeName(name))
+                error("'"+name+"' is a type name");
+            if(scopes.back().count(name))
+                error("'"+name+"': redefinition");
+            ++pos;
+            if(isPunct("["))
+                unsupported("arrays are not supported");
+
+            const auto reg=nextRegister;
+            Variable var{{type, 0}, readOnly};
+            if(accept("="))
+            {
+                const auto init=ternary();
+                if(!isAssignable(type, init.type))
+                {
+                    error(std::string("cannot convert from ")+typeName(init.type)+" to "+typeName(type)+
+                          " in initialization of '"+name+"'");
+                }
+                if(readOnly && isConstant(init))
+                {
+                    // No need for a register, the variable is an alias of the constant
+                    var.value.reg=init.reg;
+                    nextRegister=reg;
+                }
+                else
+                {
+                    nextRegister=reg;
+                    var.value.reg=allocateRegister();
+                    moveTo(var.value.reg, init);
+                }
+            }
+            else
+            {
+                if(readOnly)
+                    error("'"+name+"': constant variable must be initialized");
+                var.value.reg=allocateRegister();
+                // Uninitialized variables are undefined in GLSL, but let them be zero for determinism
+                moveTo(var.value.reg, {type, addConstant(glm::vec4(0))});
+            }
+            scopes.back()[name]=var;
+        }
+        while(accept(","));
+        expect(";");
+    }
+
+    void assignment()
+    {
+        const auto name=token().text;
+        const auto var=findVariable(name);
+        if(!var)
+        {
+            if(externalConstants.count(name))
+                error("'"+name+"': assignment to a read-only variable");
+            error("'"+name+"': undeclared identifier");
+        }
+        if(var->readOnly)
+            error("'"+name+"': assignment to a read-only variable");
+        ++pos;
+
+        const auto opText=token().text;
+        ++pos;
+        auto value=expression();
+        if(opText!="=")
+            value=arithmetic(opText.substr(0,1), var->value, value);
+        if(!isAssignable(var->value.type, value.type))
+        {
+            error(std::string("cannot convert from ")+typeName(value.type)+" to "+typeName(var->value.type)+
+                  " in assignment to '"+name+"'");
+        }
+        moveTo(var->value.reg, value);
+        expect(";");
+    }
+
+    void ifStatement()
+    {
+        expect("(");
+        const auto condition=expression();
+        if(condition.type!=Type::Bool)
+            error("boolean expression expected as the condition of 'if'");
+        expect(")");
+        const auto jumpOverThen=emitInstruction(Op::JumpIfFalse, 0, condition.reg);
+        statement();
+        if(isIdentifier("else"))
+        {
+            ++pos;
+            const auto jumpOverElse=emitInstruction(Op::Jump, 0);
+            patchJumpTarget(jumpOverThen);
+            statement();
+            patchJumpTarget(jumpOverElse);
+        }
+        else
+        {
+            patchJumpTarget(jumpOverThen);
+        }
+    }
+
+    void returnStatement()
+    {
+        const auto value=expression();
+        if(!isAssignable(returnType, value.type))
+        {
+            error(std::string("function return is not matching type: returning ")+typeName(value.type)+
+                  " from a function returning "+typeName(returnType));
+        }
+        emitInstruction(Op::Return, 0, value.reg);
+        expect(";");
+    }
+
+    void statement()
+    {
+        const auto firstTempRegister=nextRegister;
+        if(token().kind==Token::End)
+            error("statement expected before end of function body");
+        if(accept("{"))
+        {
+            scopes.emplace_back();
+            while(!accept("}"))
+            {
+                if(token().kind==Token::End)
+                    error("expected '}' before end of function body");
+                statement();
+            }
+            scopes.pop_back();
+        }
+        else if(accept(";"))
+        {
+        }
+        else if(token().kind==Token::Identifier)
+        {
+            const auto& word=token().text;
+            if(word=="if")
+            {
+                ++pos;
+                ifStatement();
+            }
+            else if(word=="return")
+            {
+                ++pos;
+                returnStatement();
+            }
+            else if(word=="const" || word=="CONST")
+            {
+                ++pos;
+                declaration(true);
+                return; // keep the registers of the variables
+            }
+            else if(isTypeName(word) || isUnsupportedTypeName(word))
+            {
+                declaration(false);
+                return; // keep the registers of the variables
+            }
+            else if(word=="for" || word=="while" || word=="do" || word=="switch" || word=="break" ||
+                    word=="continue" || word=="discard" || word=="in" || word=="out" || word=="inout" ||
+                    word=="uniform" || word=="highp" || word=="mediump" || word=="lowp" || word=="precise")
+            {
+                unsupported("'"+word+"' is not supported");
+            }
+            else if(word=="else")
+            {
+                error("'else' without a previous 'if'");
+            }
+            else if(tokens[pos+1].kind==Token::Punctuator &&
+                    (tokens[pos+1].text=="=" || tokens[pos+1].text=="+=" || tokens[pos+1].text=="-=" ||
+                     tokens[pos+1].text=="*=" || tokens[pos+1].text=="/="))
+            {
+                assignment();
+            }
+            else
+            {
+                // Expressions have no side effects here, but they are still valid statements
+                const auto firstToken=pos;
+                expression();
+                if(isPunct("++") || isPunct("--"))
+                    unsupported("operator '"+token().text+"' is not supported");
+                if(isPunct("=") || isPunct("%=") || isPunct("+=") || isPunct("-=") || isPunct("*=") || isPunct("/="))
+                {
+                    std::string target;
+                    for(auto n=firstToken; n<pos; ++n)
+                        target+=tokens[n].text;
+                    unsupported("assignment to '"+target+"' is not supported");
+                }
+                expect(";");
+            }
+        }
+        else
+        {
+            expression();
+            expect(";");
+        }
+        nextRegister=firstTempRegister;
+    }
+
+public:
+    Compiler(std::string_view body, const Type returnType, std::string const& argumentName, Constants const& constants)
+        : tokens(tokenize(body))
+        , externalConstants(constants)
+        , returnType(returnType)
+    {
+        scopes.emplace_back();
+        scopes.back()[argumentName]=Variable{{Type::Float, allocateRegister()}, false};
+        // Function body has the same scope as the argument
+        while(token().kind!=Token::End)
+            statement();
+        // Reaching the end of a non-void function gives an undefined result in GLSL. Let it be zero.
+        emitInstruction(Op::Return, 0, addConstant(glm::vec4(0)));
+    }
+};
+
+GLSLSnippet::GLSLSnippet(std::string_view body, const Type returnType, std::string const& argumentName, Constants const& constants)
+    : returnType(returnType)
+{
+    assert(returnType==Type::Float || returnType==Type::Vec4);
+    Compiler compiler(body, returnType, argumentName, constants);
+    this->constants=std::move(compiler.constants);
+    code=std::move(compiler.code);
+
+    // Put the constants in the beginning of the register file, followed by the working registers
+    const auto numConstants=this->constants.size();
+    numRegisters=numConstants+compiler.numWorkRegisters;
+    if(numRegisters > maxRegisters)
+        throw Error{1, "function body is too complex", true};
+    const auto relocate=[numConstants](uint16_t& reg)
+    {
+        reg = reg & 0x8000 ? reg & 0x7fff : reg+numConstants;
+    };
+    for(auto& instr : code)
+    {
+        if(instr.op!=Op::Jump && instr.op!=Op::JumpIfFalse)
+            relocate(instr.dst);
+        relocate(instr.a);
+        relocate(instr.b);
+        relocate(instr.c);
+        relocate(instr.d);
+    }
+    argumentRegister=numConstants; // the argument was the first working register allocated
+}
+
+glm::vec4 GLSLSnippet::evaluate(const float argument) const
+{
+    std::array<glm::vec4, maxRegisters> registers;
+    const auto regEnd=std::copy(constants.begin(), constants.end(), registers.begin());
+    std::fill(regEnd, registers.begin()+numRegisters, glm::vec4(0));
+    registers[argumentRegister]=glm::vec4(argument);
+    for(size_t pc=0;;)
+    {
+        const auto& instr=code[pc++];
+        switch(instr.op)
+        {
+        case Op::Jump:
+            pc=instr.dst;
+            break;
+        case Op::JumpIfFalse:
+            if(registers[instr.a][0]==0)
+                pc=instr.dst;
+            break;
+        case Op::Return:
+            return registers[instr.a];
+        default:
+            registers[instr.dst]=applyOp(instr.op, registers[instr.a], registers[instr.b],
+                                         registers[instr.c], registers[instr.d]);
+            break;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef INCLUDE_ONCE_93C1E5A8_47B2_4D6F_A0E3_5F8B2D7C64E1
+#define INCLUDE_ONCE_93C1E5A8_47B2_4D6F_A0E3_5F8B2D7C64E1
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include <glm/glm.hpp>
+
+/* Compiler and evaluator of the GLSL function bodies used in atmosphere descriptions (number density and phase
+ * functions), so that they can be evaluated on CPU.
+ *
+ * Only the subset of GLSL these snippets need is supported: local variables of types float, int, bool and vec4
+ * (optionally declared CONST or const), assignments including the compound ones, if/else, return, the arithmetic,
+ * relational, logical and ternary operators, the common built-in math functions, single-component swizzles, and
+ * the constants of the generated const.h.glsl and wavelength-set-constants.h.glsl headers like PI, km or wavelengths.
+ * The snippet is compiled into bytecode of a simple register machine, with constant subexpressions folded at compile
+ * time.
+ *
+ * Snippets that use anything else (loops, vectors other than vec4, calls of other functions etc.) are rejected
+ * with an Error marked as unsupported. These may still be valid GLSL, so the callers should fall back to
+ * evaluation on GPU in this case, rather than treat it as an error in the snippet.
+ */
+class GLSLSnippet
+{
+public:
+    enum class Type
+    {
+        Float,
+        Int,
+        Bool,
+        Vec4,
+        Unsupported, //!< For constants of types that exist in GLSL but aren't supported here, e.g. vec3
+    };
+    struct Constant
+    {
+        Type type;
+        glm::vec4 value;
+    };
+    using Constants = std::map<std::string, Constant>;
+
+    struct Error
+    {
+        int lineNumber; //!< Counted from 1 at the first line of the snippet
+        std::string message;
+        bool unsupported; //!< Whether the snippet uses a feature beyond the supported subset of GLSL
+    };
+
+    enum class Op : uint8_t;
+    struct Instruction
+    {
+        Op op;
+        uint16_t dst, a, b, c, d;
+    };
+
+private:
+    std::vector<glm::vec4> constants;
+    std::vector<Instruction> code;
+    unsigned numRegisters=0;
+    uint16_t argumentRegister=0;
+    Type returnType;
+
+    class Compiler;
+
+public:
+    /* Compiles the body of the function
+     *     returnType name(float argumentName) { body }
+     * Throws Error if the body can't be compiled.
+     */
+    GLSLSnippet(std::string_view body, Type returnType, std::string const& argumentName, Constants const& constants);
+    // Float results are returned in all the components of the vector
+    glm::vec4 evaluate(float argument) const;
+
+    static constexpr unsigned maxRegisters=256;
+};
+
+#endif
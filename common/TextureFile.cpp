@@ -0,0 +1,456 @@
+#include "TextureFile.hpp"
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <glm/gtc/packing.hpp>
+#include <QObject>
+#include <QDataStream>
+#include <QStringList>
+#include "util.hpp"
+
+unsigned textureElementSize(const TextureElementType type)
+{
+    switch(type)
+    {
+    case TextureElementType::Float32: return 4;
+    case TextureElementType::Float16: return 2;
+    case TextureElementType::SNorm16: return 2;
+    }
+    assert(!"Unknown element type");
+    return 0;
+}
+
+QString toString(const TextureElementType type)
+{
+    switch(type)
+    {
+    case TextureElementType::Float32: return "float32";
+    case TextureElementType::Float16: return "float16";
+    case TextureElementType::SNorm16: return "snorm16";
+    }
+    return QString("bad type %1").arg(static_cast<uint32_t>(type));
+}
+
+uint32_t crc32(const void*const data, const size_t size, uint32_t crc)
+{
+    // Slicing-by-8: tables[k][b] is the CRC of byte b followed by k zero bytes, which lets the loop consume 8 bytes
+    // per iteration with independent lookups instead of 8 dependent ones
+    static const auto tables=[]
+    {
+        std::array<std::array<uint32_t,256>,8> tables;
+        for(uint32_t n=0; n<256; ++n)
+        {
+            uint32_t c=n;
+            for(int k=0; k<8; ++k)
+                c = c&1 ? 0xedb88320u^(c>>1) : c>>1;
+            tables[0][n]=c;
+        }
+        for(uint32_t n=0; n<256; ++n)
+            for(unsigned k=1; k<tables.size(); ++k)
+                tables[k][n]=tables[0][tables[k-1][n]&0xff]^(tables[k-1][n]>>8);
+        return tables;
+    }();
+
+    auto bytes=static_cast<const unsigned char*>(data);
+    auto remaining=size;
+    crc=~crc;
+    for(; remaining>=8; remaining-=8, bytes+=8)
+    {
+        // Assembled byte by byte to be independent of endianness and alignment; compilers turn this into plain loads
+        const uint32_t lo = crc ^ (uint32_t(bytes[0]) | uint32_t(bytes[1])<<8 | uint32_t(bytes[2])<<16 | uint32_t(bytes[3])<<24);
+        const uint32_t hi = uint32_t(bytes[4]) | uint32_t(bytes[5])<<8 | uint32_t(bytes[6])<<16 | uint32_t(bytes[7])<<24;
+        crc = tables[7][lo&0xff] ^ tables[6][(lo>>8)&0xff] ^ tables[5][(lo>>16)&0xff] ^ tables[4][lo>>24] ^
+              tables[3][hi&0xff] ^ tables[2][(hi>>8)&0xff] ^ tables[1][(hi>>16)&0xff] ^ tables[0][hi>>24];
+    }
+    for(; remaining; --remaining, ++bytes)
+        crc=tables[0][(crc^*bytes)&0xff]^(crc>>8);
+    return ~crc;
+}
+
+float halfFloatScale(const float*const data, const size_t count)
+{
+    float maxMagnitude=0;
+    for(size_t n=0; n<count; ++n)
+        maxMagnitude=std::max(maxMagnitude, std::abs(data[n]));
+    if(!std::isfinite(maxMagnitude) || maxMagnitude==0)
+        return 1;
+    // Largest half-float is 65504, so after the division the maximum will be in [2^14, 2^15)
+    int exponent;
+    std::frexp(maxMagnitude, &exponent);
+    return std::ldexp(1.f, exponent-15);
+}
+
+void floatsToHalfFloats(const float*const src, const size_t count, const float scale, uint16_t*const dest)
+{
+    for(size_t n=0; n<count; ++n)
+        dest[n]=glm::packHalf1x16(src[n]/scale);
+}
+
+void halfFloatsToFloats(const uint16_t*const src, const size_t count, const float scale, float*const dest)
+{
+    for(size_t n=0; n<count; ++n)
+        dest[n]=glm::unpackHalf1x16(src[n])*scale;
+}
+
+TextureFileWriter::TextureFileWriter(QString const& path, const TextureElementType elementType, const unsigned componentCount,
+                                     std::vector<uint64_t> const& sizes, const float valueScale)
+    : file(path)
+{
+    assert(!sizes.empty());
+    assert(std::find(sizes.begin(), sizes.end(), 0u)==sizes.end());
+    assert(valueScale>0);
+
+    chunkCount=sizes.back();
+    chunkSize=uint64_t(textureElementSize(elementType))*componentCount;
+    for(size_t n=0; n+1<sizes.size(); ++n)
+        chunkSize*=sizes[n];
+
+    if(!file.open(QFile::WriteOnly))
+    {
+        throw DataSaveError{QObject::tr("Failed to open file \"%1\" for writing: %2")
+                            .arg(path).arg(file.errorString())};
+    }
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(TextureFileFormat::MAGIC, sizeof TextureFileFormat::MAGIC);
+    quint32 valueScaleBits;
+    static_assert(sizeof valueScaleBits==sizeof valueScale);
+    std::memcpy(&valueScaleBits, &valueScale, sizeof valueScale);
+    out << quint32(TextureFileFormat::VERSION) << quint32(elementType) << quint32(componentCount)
+        << quint32(TextureFileFormat::COMPRESSION_NONE) << quint32(sizes.size()) << valueScaleBits;
+    for(const auto size : sizes)
+        out << quint64(size);
+    out << quint64(chunkCount);
+
+    // The chunk table is filled in by finish(), when the checksums are known
+    chunkTableOffset=file.pos();
+    const QByteArray placeholder(chunkCount*sizeof(TextureFileFormat::ChunkEntry), 0);
+    out.writeRawData(placeholder.data(), placeholder.size());
+    payloadOffset=file.pos();
+
+    if(out.status()!=QDataStream::Ok)
+        throw DataSaveError{QObject::tr("Failed to write header to file \"%1\": %2").arg(path).arg(file.errorString())};
+    chunks.reserve(chunkCount);
+}
+
+void TextureFileWriter::write(const void*const data, uint64_t size)
+{
+    auto bytes=static_cast<const char*>(data);
+    while(size)
+    {
+        if(chunks.size()==chunkCount)
+        {
+            throw DataSaveError{QObject::tr("Attempted to write more data than fits in the texture to file \"%1\"")
+                                .arg(file.fileName())};
+        }
+        const auto sizeToWrite=std::min(size, chunkSize-bytesInCurrentChunk);
+        if(file.write(bytes, sizeToWrite) != qint64(sizeToWrite))
+        {
+            throw DataSaveError{QObject::tr("Failed to write to file \"%1\": %2")
+                                .arg(file.fileName()).arg(file.errorString())};
+        }
+        currentChunkCRC=crc32(bytes, sizeToWrite, currentChunkCRC);
+        bytesInCurrentChunk+=sizeToWrite;
+        bytes+=sizeToWrite;
+        size-=sizeToWrite;
+
+        if(bytesInCurrentChunk==chunkSize)
+        {
+            chunks.push_back({payloadOffset+chunks.size()*chunkSize, chunkSize, currentChunkCRC, 0});
+            bytesInCurrentChunk=0;
+            currentChunkCRC=0;
+        }
+    }
+}
+
+void TextureFileWriter::finish()
+{
+    if(chunks.size()!=chunkCount)
+    {
+        throw DataSaveError{QObject::tr("Texture data written to file \"%1\" are incomplete: %2 of %3 chunks written")
+                            .arg(file.fileName()).arg(chunks.size()).arg(chunkCount)};
+    }
+    if(!file.seek(chunkTableOffset))
+    {
+        throw DataSaveError{QObject::tr("Failed to seek to chunk table in file \"%1\": %2")
+                            .arg(file.fileName()).arg(file.errorString())};
+    }
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    for(const auto& chunk : chunks)
+        out << quint64(chunk.offset) << quint64(chunk.storedSize) << quint32(chunk.crc32) << quint32(chunk.reserved);
+    file.close();
+    if(out.status()!=QDataStream::Ok || file.error())
+    {
+        throw DataSaveError{QObject::tr("Failed to write file \"%1\": %2")
+                            .arg(file.fileName()).arg(file.errorString())};
+    }
+}
+
+TextureFileMapping::TextureFileMapping(std::shared_ptr<TextureFileHandle> handle, uchar*const data, const uint64_t size)
+    : handle(std::move(handle))
+    , data_(data)
+    , size_(size)
+{
+}
+
+TextureFileMapping::TextureFileMapping(TextureFileMapping&& other) noexcept
+    : handle(std::move(other.handle))
+    , data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+{
+}
+
+TextureFileMapping& TextureFileMapping::operator=(TextureFileMapping&& other) noexcept
+{
+    if(this!=&other)
+    {
+        unmap();
+        handle=std::move(other.handle);
+        data_=std::exchange(other.data_, nullptr);
+        size_=std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void TextureFileMapping::unmap()
+{
+    if(!data_) return;
+    {
+        // QFile can unmap the memory after the file has been closed
+        std::lock_guard lock(handle->mutex);
+        handle->file.unmap(data_);
+    }
+    handle.reset();
+    data_=nullptr;
+    size_=0;
+}
+
+TextureFileReader::TextureFileReader(QString const& path)
+    : handle(std::make_shared<TextureFileHandle>(path))
+    , file(handle->file)
+    , path(path)
+{
+    if(!file.open(QFile::ReadOnly))
+        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
+
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof TextureFileFormat::MAGIC];
+    if(in.readRawData(magic, sizeof magic)!=sizeof magic ||
+       !std::equal(std::begin(magic), std::end(magic), std::begin(TextureFileFormat::MAGIC)))
+    {
+        throw DataLoadError{QObject::tr("File \"%1\" is not a texture file of CalcMySky. If it was generated by an older "
+                                        "version of CalcMySky, please regenerate the model.").arg(path)};
+    }
+
+    quint32 version=0, elementType=0, componentCount=0, compression=0, dimensionCount=0, valueScaleBits=0;
+    in >> version >> elementType >> componentCount >> compression >> dimensionCount >> valueScaleBits;
+    if(in.status()!=QDataStream::Ok)
+        throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2").arg(path).arg(file.errorString())};
+    if(version<1 || version>TextureFileFormat::VERSION)
+    {
+        throw DataLoadError{QObject::tr("Texture file \"%1\" has unsupported format version %2, the newest supported one is %3")
+                            .arg(path).arg(version).arg(TextureFileFormat::VERSION)};
+    }
+    switch(static_cast<TextureElementType>(elementType))
+    {
+    case TextureElementType::Float32:
+    case TextureElementType::Float16:
+    case TextureElementType::SNorm16:
+        elementType_=static_cast<TextureElementType>(elementType);
+        break;
+    default:
+        throw DataLoadError{QObject::tr("Texture file \"%1\" has unknown element type %2").arg(path).arg(elementType)};
+    }
+    if(componentCount<1 || componentCount>4)
+        throw DataLoadError{QObject::tr("Texture file \"%1\" has bad component count %2").arg(path).arg(componentCount)};
+    componentCount_=componentCount;
+    if(compression!=TextureFileFormat::COMPRESSION_NONE)
+        throw DataLoadError{QObject::tr("Texture file \"%1\" uses unsupported compression %2").arg(path).arg(compression)};
+    if(version>=2)
+    {
+        std::memcpy(&valueScale_, &valueScaleBits, sizeof valueScale_);
+        if(!std::isfinite(valueScale_) || valueScale_<=0)
+            throw DataLoadError{QObject::tr("Texture file \"%1\" has bad value scale %2").arg(path).arg(valueScale_)};
+    }
+    if(dimensionCount<1 || dimensionCount>8)
+        throw DataLoadError{QObject::tr("Texture file \"%1\" has bad dimension count %2").arg(path).arg(dimensionCount)};
+
+    for(unsigned n=0; n<dimensionCount; ++n)
+    {
+        quint64 size=0;
+        in >> size;
+        if(size==0)
+            throw DataLoadError{QObject::tr("Texture file \"%1\" has zero size of dimension %2").arg(path).arg(n)};
+        sizes_.push_back(size);
+    }
+    quint64 chunkCount=0;
+    in >> chunkCount;
+    if(in.status()!=QDataStream::Ok)
+        throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2").arg(path).arg(file.errorString())};
+    if(chunkCount!=sizes_.back())
+    {
+        throw DataLoadError{QObject::tr("Texture file \"%1\" has %2 chunks, while the size of its last dimension is %3")
+                            .arg(path).arg(chunkCount).arg(sizes_.back())};
+    }
+
+    // Check the sizes before multiplying them to avoid overflow
+    const auto fileSize=uint64_t(file.size());
+    chunkSize_=uint64_t(textureElementSize(elementType_))*componentCount_;
+    for(size_t n=0; n+1<sizes_.size(); ++n)
+    {
+        if(sizes_[n] > fileSize || chunkSize_*sizes_[n] > fileSize)
+            throw DataLoadError{QObject::tr("Texture dimensions in file \"%1\" exceed the file size").arg(path)};
+        chunkSize_*=sizes_[n];
+    }
+    if(chunkCount > fileSize/sizeof(TextureFileFormat::ChunkEntry))
+        throw DataLoadError{QObject::tr("Texture dimensions in file \"%1\" exceed the file size").arg(path)};
+
+    chunks.resize(chunkCount);
+    for(auto& chunk : chunks)
+    {
+        quint64 offset=0, storedSize=0;
+        quint32 crc=0, reserved=0;
+        in >> offset >> storedSize >> crc >> reserved;
+        chunk={offset, storedSize, crc, reserved};
+        if(in.status()!=QDataStream::Ok)
+            throw DataLoadError{QObject::tr("Failed to read chunk table from file \"%1\": %2").arg(path).arg(file.errorString())};
+        if(storedSize!=chunkSize_ || offset > fileSize || storedSize > fileSize-offset)
+            throw DataLoadError{QObject::tr("Bad chunk table in file \"%1\": the file may be truncated").arg(path)};
+    }
+    chunkVerified.assign(chunkCount, false);
+}
+
+TextureFileReader::~TextureFileReader()
+{
+    std::lock_guard lock(handle->mutex);
+    file.close();
+}
+
+uint64_t TextureFileReader::elementCount() const
+{
+    uint64_t count=1;
+    for(const auto size : sizes_)
+        count*=size;
+    return count;
+}
+
+void TextureFileReader::checkFormat(const TextureElementType expectedType, const unsigned expectedComponentCount,
+                                    std::vector<uint64_t> const& expectedSizes) const
+{
+    if(elementType_!=expectedType || componentCount_!=expectedComponentCount)
+    {
+        throw DataLoadError{QObject::tr("Texture file \"%1\" has %2 components of type %3 per texel, "
+                                        "while %4 components of type %5 were expected")
+                            .arg(path).arg(componentCount_).arg(toString(elementType_))
+                            .arg(expectedComponentCount).arg(toString(expectedType))};
+    }
+    const auto formatSizes=[](std::vector<uint64_t> const& sizes)
+    {
+        QStringList list;
+        for(const auto size : sizes)
+            list << (size ? QString::number(size) : "*");
+        return list.join(QChar(0x00d7));
+    };
+    bool sizesMatch = sizes_.size()==expectedSizes.size();
+    for(size_t n=0; sizesMatch && n<sizes_.size(); ++n)
+        sizesMatch = expectedSizes[n]==0 || expectedSizes[n]==sizes_[n];
+    if(!sizesMatch)
+    {
+        throw DataLoadError{QObject::tr("Texture in file \"%1\" has dimensions %2, while %3 were expected")
+                            .arg(path).arg(formatSizes(sizes_)).arg(formatSizes(expectedSizes))};
+    }
+}
+
+void TextureFileReader::checkChunkRange(const uint64_t firstChunk, const uint64_t count) const
+{
+    if(firstChunk > chunks.size() || count > chunks.size()-firstChunk)
+    {
+        throw DataLoadError{QObject::tr("Attempted to read chunks %1..%2 from file \"%3\" that only has %4 chunks")
+                            .arg(firstChunk).arg(firstChunk+count-1).arg(path).arg(chunks.size())};
+    }
+}
+
+void TextureFileReader::checkChunkCRC(const uint64_t chunkIndex, const char*const data)
+{
+    // The file is opened read-only, so the contents of a chunk that passed the check once don't need checking again
+    if(chunkVerified[chunkIndex]) return;
+    const auto& chunk=chunks[chunkIndex];
+    if(crc32(data, chunk.storedSize)!=chunk.crc32)
+    {
+        throw DataLoadError{QObject::tr("Checksum mismatch in chunk %1 of file \"%2\": the file is corrupt")
+                            .arg(chunkIndex).arg(path)};
+    }
+    chunkVerified[chunkIndex]=true;
+}
+
+TextureFileMapping TextureFileReader::mapChunks(const uint64_t firstChunk, const uint64_t count)
+{
+    checkChunkRange(firstChunk, count);
+    if(count==0) return {};
+    const auto offset=chunks[firstChunk].offset;
+    for(uint64_t n=1; n<count; ++n)
+        if(chunks[firstChunk+n].offset != offset+n*chunkSize_)
+            return {};
+
+    uchar* data;
+    {
+        std::lock_guard lock(handle->mutex);
+        data=file.map(offset, count*chunkSize_);
+    }
+    if(!data) return {};
+    // If a check fails, the mapping gets released while the exception propagates
+    TextureFileMapping mapping(handle, data, count*chunkSize_);
+    for(uint64_t n=0; n<count; ++n)
+        checkChunkCRC(firstChunk+n, mapping.data()+n*chunkSize_);
+    return mapping;
+}
+
+void TextureFileReader::readChunks(const uint64_t firstChunk, const uint64_t count, char*const dest)
+{
+    checkChunkRange(firstChunk, count);
+    std::lock_guard lock(handle->mutex);
+    for(uint64_t n=0; n<count; ++n)
+    {
+        const auto& chunk=chunks[firstChunk+n];
+        if(!file.seek(chunk.offset))
+        {
+            throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
+                                .arg(chunk.offset).arg(path).arg(file.errorString())};
+        }
+        const auto chunkDest=dest+n*chunkSize_;
+        const auto actuallyRead=file.read(chunkDest, chunk.storedSize);
+        if(actuallyRead != qint64(chunk.storedSize))
+        {
+            const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
+                                                : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(chunk.storedSize).arg(actuallyRead);
+            throw DataLoadError{error};
+        }
+        checkChunkCRC(firstChunk+n, chunkDest);
+    }
+}
+
+QByteArray TextureFileReader::readAll()
+{
+#if QT_VERSION < QT_VERSION_CHECK(6,0,0)
+    // The size of a QByteArray is an int, and the header of the array is allocated in the same block
+    constexpr uint64_t maxSize=std::numeric_limits<int>::max()-sizeof(QByteArrayData)-1;
+#else
+    constexpr uint64_t maxSize=std::numeric_limits<qsizetype>::max();
+#endif
+    if(!chunks.empty() && chunkSize_ > maxSize/chunks.size())
+    {
+        throw DataLoadError{QObject::tr("Texture in file \"%1\" is too large to be read at once: %2 bytes")
+                            .arg(path).arg(chunkSize_*chunks.size())};
+    }
+    QByteArray data(chunkSize_*chunks.size(), Qt::Uninitialized);
+    readChunks(0, chunks.size(), data.data());
+    return data;
+}
@@ -0,0 +1,170 @@
+#ifndef INCLUDE_ONCE_A5FA2DE3_EAC5_45D0_8E68_9C945F07E533
+#define INCLUDE_ONCE_A5FA2DE3_EAC5_45D0_8E68_9C945F07E533
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+
+/* Container for the textures saved by CalcMySky and loaded by ShowMySky.
+ *
+ * File layout (all numbers are little-endian):
+ *
+ *     char     magic[8]            "CMSKYTEX"
+ *     uint32   formatVersion
+ *     uint32   elementType         TextureElementType
+ *     uint32   componentCount      components per texel, e.g. 4 for RGBA
+ *     uint32   compression         0: none
+ *     uint32   dimensionCount
+ *     float32  valueScale          factor to multiply the stored values by, 1 unless the payload is scaled
+ *     uint64   sizes[dimensionCount]   the first dimension varies fastest
+ *     uint64   chunkCount
+ *     struct { uint64 offset; uint64 storedSize; uint32 crc32; uint32 reserved; } chunks[chunkCount]
+ *     payload
+ *
+ * The payload is split into chunks along the last (slowest-varying) dimension, one slice per chunk, so that e.g.
+ * a couple of altitude slices of a 4D scattering texture can be read without touching the rest of the file. The
+ * offsets are counted from the beginning of the file, and CRC-32 is computed over the stored bytes of each chunk.
+ *
+ * Version 1 had a zero reserved field in place of valueScale.
+ */
+
+enum class TextureElementType : uint32_t
+{
+    Float32 = 1,
+    Float16 = 2,
+    SNorm16 = 3,
+};
+unsigned textureElementSize(TextureElementType type);
+QString toString(TextureElementType type);
+
+struct TextureFileFormat
+{
+    static constexpr char MAGIC[8]={'C','M','S','K','Y','T','E','X'};
+    static constexpr uint32_t VERSION=2;
+    static constexpr uint32_t COMPRESSION_NONE=0;
+
+    struct ChunkEntry
+    {
+        uint64_t offset;
+        uint64_t storedSize;
+        uint32_t crc32;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(ChunkEntry)==24);
+};
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc=0);
+
+/* Half-float payloads are divided by a power of two chosen so that the largest magnitude lands near the top of the
+ * half-float range. This keeps the full 11-bit relative precision for the values down to 2^-28 of the largest one,
+ * instead of losing everything below 6e-5 or overflowing above 65504. The returned factor is the valueScale to
+ * store in the file.
+ */
+float halfFloatScale(const float* data, size_t count);
+void floatsToHalfFloats(const float* src, size_t count, float scale, uint16_t* dest);
+void halfFloatsToFloats(const uint16_t* src, size_t count, float scale, float* dest);
+
+/* Writes the payload sequentially. The data can be passed in pieces of any size, chunk boundaries are tracked
+ * automatically. Throws DataSaveError on failure.
+ */
+class TextureFileWriter
+{
+    QFile file;
+    std::vector<TextureFileFormat::ChunkEntry> chunks; //!< Complete chunks written so far
+    uint64_t chunkCount;
+    uint64_t chunkSize; //!< In bytes
+    qint64 chunkTableOffset=0;
+    qint64 payloadOffset=0;
+    uint64_t bytesInCurrentChunk=0;
+    uint32_t currentChunkCRC=0;
+
+public:
+    TextureFileWriter(QString const& path, TextureElementType elementType, unsigned componentCount,
+                      std::vector<uint64_t> const& sizes, float valueScale=1);
+    void write(const void* data, uint64_t size);
+    // Writes the chunk table and closes the file. All the payload must have been written at this point.
+    void finish();
+};
+
+// File shared by a reader and the mappings made from it. The mappings may be released in other threads than the one
+// using the reader, so all the accesses to the file are done with the mutex locked.
+struct TextureFileHandle
+{
+    QFile file;
+    std::mutex mutex;
+    explicit TextureFileHandle(QString const& path) : file(path) {}
+};
+
+/* Memory mapping of a range of chunks made by TextureFileReader::mapChunks(). The memory is unmapped when the object
+ * is destroyed. Neither the reader nor the open file descriptor are needed to keep the mapping valid.
+ */
+class TextureFileMapping
+{
+    std::shared_ptr<TextureFileHandle> handle;
+    uchar* data_=nullptr;
+    uint64_t size_=0;
+public:
+    TextureFileMapping()=default;
+    TextureFileMapping(std::shared_ptr<TextureFileHandle> handle, uchar* data, uint64_t size);
+    TextureFileMapping(TextureFileMapping&& other) noexcept;
+    TextureFileMapping& operator=(TextureFileMapping&& other) noexcept;
+    ~TextureFileMapping() { unmap(); }
+    void unmap();
+    const char* data() const { return reinterpret_cast<const char*>(data_); }
+    uint64_t size() const { return size_; } //!< In bytes
+    explicit operator bool() const { return data_!=nullptr; }
+};
+
+// Throws DataLoadError on failure.
+class TextureFileReader
+{
+    std::shared_ptr<TextureFileHandle> handle;
+    QFile& file;
+    QString path;
+    TextureElementType elementType_;
+    unsigned componentCount_;
+    float valueScale_=1;
+    std::vector<uint64_t> sizes_;
+    std::vector<TextureFileFormat::ChunkEntry> chunks;
+    std::vector<bool> chunkVerified; //!< Whether the checksum of the chunk has already been checked
+    uint64_t chunkSize_;
+
+    void checkChunkRange(uint64_t firstChunk, uint64_t count) const;
+    void checkChunkCRC(uint64_t chunkIndex, const char* data);
+
+public:
+    explicit TextureFileReader(QString const& path);
+    TextureFileReader(TextureFileReader const&)=delete;
+    // Closes the file. The mappings made by this reader stay valid.
+    ~TextureFileReader();
+    TextureElementType elementType() const { return elementType_; }
+    unsigned componentCount() const { return componentCount_; }
+    float valueScale() const { return valueScale_; }
+    std::vector<uint64_t> const& sizes() const { return sizes_; }
+    uint64_t chunkCount() const { return chunks.size(); }
+    uint64_t chunkSize() const { return chunkSize_; } //!< In bytes
+    uint64_t elementCount() const; //!< In texels
+
+    /* Throws DataLoadError with a descriptive message if the file doesn't have the expected layout. The number of
+     * dimensions must match the size of expectedSizes; zero elements of expectedSizes match any size.
+     */
+    void checkFormat(TextureElementType expectedType, unsigned expectedComponentCount,
+                     std::vector<uint64_t> const& expectedSizes) const;
+
+    // Reads count chunks starting from firstChunk into dest, which must have room for count*chunkSize() bytes
+    void readChunks(uint64_t firstChunk, uint64_t count, char* dest);
+    /* Maps count chunks starting from firstChunk into memory and verifies their checksums, unless this reader has
+     * already verified them. The result holds count*chunkSize() bytes and stays valid until it's destroyed or unmapped,
+     * even if the reader is destroyed earlier. Returns an empty mapping if the chunks can't be mapped, e.g. if they
+     * aren't contiguous in the file or the file system doesn't support mapping; use readChunks() then.
+     */
+    TextureFileMapping mapChunks(uint64_t firstChunk, uint64_t count);
+    // Throws DataLoadError if the texture is too large to fit into a QByteArray
+    QByteArray readAll();
+};
+
+#endif
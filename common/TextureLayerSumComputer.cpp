@@ -0,0 +1,288 @@
+#include "TextureLayerSumComputer.hpp"
+#include "util.hpp"
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <QOpenGLFunctions_3_3_Core>
+
+namespace
+{
+
+// Sum of the 2x2 block of texels starting at pos, with the ones beyond sourceSize taken as zeros
+constexpr char blockSumSrc[]=R"(
+uniform sampler2DArray source;
+uniform ivec2 sourceSize;
+vec4 texel(const ivec2 pos, const int layer)
+{
+    return all(lessThan(pos, sourceSize)) ? texelFetch(source, ivec3(pos,layer), 0) : vec4(0);
+}
+vec4 blockSum(const ivec2 pos, const int layer)
+{
+    return (texel(pos,layer) + texel(pos+ivec2(1,0),layer)) + (texel(pos+ivec2(0,1),layer) + texel(pos+ivec2(1,1),layer));
+}
+)";
+
+int halved(const int size)
+{
+    return (size+1)/2;
+}
+
+void setupTextureArray(QOpenGLFunctions_3_3_Core& gl, const GLuint texture, const int width, const int height, const int layers)
+{
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    gl.glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA32F,width,height,layers,0,GL_RGBA,GL_FLOAT,nullptr);
+}
+
+}
+
+TextureLayerSumComputer::TextureLayerSumComputer(QOpenGLFunctions_3_3_Core& gl, const int width, const int height,
+                                                 const int layerCount)
+    : gl(gl)
+    , width(width)
+    , height(height)
+{
+    GLint maxLayers=0;
+    gl.glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    layerCount_=std::min(layerCount, int(maxLayers));
+
+    GLint oldVAO=-1;
+    gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &oldVAO);
+
+    gl.glGenTextures(1, &layersTexture);
+    setupTextureArray(gl, layersTexture, width, height, layerCount_);
+    // Odd passes render into the first texture, even ones into the second
+    gl.glGenTextures(2, pingPongTextures);
+    setupTextureArray(gl, pingPongTextures[0], halved(width), halved(height), layerCount_);
+    setupTextureArray(gl, pingPongTextures[1], halved(halved(width)), halved(halved(height)), layerCount_);
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // The final pass writes the sum of each layer into the texel of this texture at x=layer
+    gl.glGenTextures(1, &sumsTexture);
+    gl.glBindTexture(GL_TEXTURE_2D, sumsTexture);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,layerCount_,1,0,GL_RGBA,GL_FLOAT,nullptr);
+    gl.glBindTexture(GL_TEXTURE_2D, 0);
+    gl.glGenFramebuffers(1, &fbo);
+
+    gl.glGenBuffers(MAX_PENDING_SUMMATIONS, readbackBuffers);
+    for(const auto buffer : readbackBuffers)
+    {
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        gl.glBufferData(GL_PIXEL_PACK_BUFFER, layerCount_*sizeof(glm::vec4), nullptr, GL_STREAM_READ);
+    }
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    gl.glGenVertexArrays(1, &vao);
+    gl.glBindVertexArray(vao);
+    gl.glGenBuffers(1, &vbo);
+    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    const GLfloat vertices[]=
+    {
+        -1, -1,
+         1, -1,
+        -1,  1,
+         1,  1,
+    };
+    gl.glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices, GL_STATIC_DRAW);
+    constexpr GLuint attribIndex=0;
+    constexpr int coordsPerVertex=2;
+    gl.glVertexAttribPointer(attribIndex, coordsPerVertex, GL_FLOAT, false, 0, 0);
+    gl.glEnableVertexAttribArray(attribIndex);
+    gl.glBindVertexArray(oldVAO);
+
+    // Each instance of the quad is routed to its own layer, so that one draw call reduces all the layers
+    halvingProgram.reset(new QOpenGLShaderProgram);
+    halvingProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, 1+R"(
+#version 330
+layout(location=0) in vec4 vertex;
+flat out int vertexLayer;
+void main()
+{
+    gl_Position = vertex;
+    vertexLayer = gl_InstanceID;
+}
+)");
+    halvingProgram->addShaderFromSourceCode(QOpenGLShader::Geometry, 1+R"(
+#version 330
+layout(triangles) in;
+layout(triangle_strip, max_vertices=3) out;
+flat in int vertexLayer[];
+flat out int layer;
+void main()
+{
+    for(int i=0; i<3; ++i)
+    {
+        gl_Position = gl_in[i].gl_Position;
+        gl_Layer = vertexLayer[0];
+        layer = vertexLayer[0];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+)");
+    halvingProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, QByteArray(1+R"(
+#version 330
+)") + blockSumSrc + R"(
+flat in int layer;
+out vec4 sum;
+void main()
+{
+    sum = blockSum(2*ivec2(gl_FragCoord.xy), layer);
+}
+)");
+    if(!halvingProgram->link())
+        throw OpenGLError(QObject::tr("Failed to link texture layer halving program: %1").arg(halvingProgram->log()));
+
+    finalProgram.reset(new QOpenGLShaderProgram);
+    finalProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, 1+R"(
+#version 330
+layout(location=0) in vec4 vertex;
+void main()
+{
+    gl_Position = vertex;
+}
+)");
+    finalProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, QByteArray(1+R"(
+#version 330
+)") + blockSumSrc + R"(
+out vec4 sum;
+void main()
+{
+    sum = blockSum(ivec2(0), int(gl_FragCoord.x));
+}
+)");
+    if(!finalProgram->link())
+        throw OpenGLError(QObject::tr("Failed to link texture layer summation program: %1").arg(finalProgram->log()));
+}
+
+void TextureLayerSumComputer::attachLayer(const int layer)
+{
+    assert(layer < layerCount_);
+    gl.glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, layersTexture, 0, layer);
+}
+
+template<typename ReadSums>
+void TextureLayerSumComputer::reduceLayers(const int layersToSum, const GLuint unusedTextureUnitNum, ReadSums readSums)
+{
+    assert(layersToSum <= layerCount_);
+
+    GLint oldVAO=-1;
+    gl.glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &oldVAO);
+    GLint oldProgram=-1;
+    gl.glGetIntegerv(GL_CURRENT_PROGRAM, &oldProgram);
+    GLint oldViewport[4];
+    gl.glGetIntegerv(GL_VIEWPORT, oldViewport);
+    GLint oldDrawFBO=-1, oldReadFBO=-1;
+    gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDrawFBO);
+    gl.glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldReadFBO);
+    const bool blendWasEnabled=gl.glIsEnabledi(GL_BLEND, 0);
+
+    gl.glActiveTexture(GL_TEXTURE0 + unusedTextureUnitNum);
+    gl.glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    gl.glDisablei(GL_BLEND, 0);
+    gl.glBindVertexArray(vao);
+
+    // Halve the layers until they are small enough for the final pass to sum each of them by a single 2x2 block
+    GLuint source=layersTexture;
+    int sourceWidth=width, sourceHeight=height;
+    halvingProgram->bind();
+    halvingProgram->setUniformValue("source", unusedTextureUnitNum);
+    for(unsigned pass=0; sourceWidth>2 || sourceHeight>2; ++pass)
+    {
+        const auto target=pingPongTextures[pass%2];
+        const int targetWidth=halved(sourceWidth), targetHeight=halved(sourceHeight);
+        gl.glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, 0);
+        gl.glBindTexture(GL_TEXTURE_2D_ARRAY, source);
+        halvingProgram->setUniformValue("sourceSize", sourceWidth, sourceHeight);
+        gl.glViewport(0,0,targetWidth,targetHeight);
+        gl.glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layersToSum);
+
+        source=target;
+        sourceWidth=targetWidth;
+        sourceHeight=targetHeight;
+    }
+
+    finalProgram->bind();
+    finalProgram->setUniformValue("source", unusedTextureUnitNum);
+    finalProgram->setUniformValue("sourceSize", sourceWidth, sourceHeight);
+    gl.glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sumsTexture, 0);
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, source);
+    gl.glViewport(0,0,layersToSum,1);
+    gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    gl.glReadBuffer(GL_COLOR_ATTACHMENT0);
+    readSums();
+
+    if(blendWasEnabled)
+        gl.glEnablei(GL_BLEND, 0);
+    gl.glBindVertexArray(oldVAO);
+    gl.glViewport(oldViewport[0], oldViewport[1], oldViewport[2], oldViewport[3]);
+    gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDrawFBO);
+    gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, oldReadFBO);
+    gl.glUseProgram(oldProgram);
+}
+
+std::vector<glm::vec4> TextureLayerSumComputer::sumLayers(const int layersToSum, const GLuint unusedTextureUnitNum)
+{
+    std::vector<glm::vec4> sums(layersToSum);
+    reduceLayers(layersToSum, unusedTextureUnitNum, [&]
+    {
+        // Reading into client memory waits for the GPU. Pending summations have already copied the sums texture
+        // into their buffers, so their results aren't affected.
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        gl.glReadPixels(0,0,layersToSum,1,GL_RGBA,GL_FLOAT,sums.data());
+    });
+    return sums;
+}
+
+void TextureLayerSumComputer::startSumming(const int layersToSum, const GLuint unusedTextureUnitNum)
+{
+    assert(pendingSummationCount_ < MAX_PENDING_SUMMATIONS);
+    const auto bufferIndex=nextReadbackBuffer;
+    reduceLayers(layersToSum, unusedTextureUnitNum, [&]
+    {
+        // Reading into a pixel buffer only enqueues the copy
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[bufferIndex]);
+        gl.glReadPixels(0,0,layersToSum,1,GL_RGBA,GL_FLOAT,nullptr);
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    });
+    pendingLayerCounts[bufferIndex]=layersToSum;
+    nextReadbackBuffer=(nextReadbackBuffer+1)%MAX_PENDING_SUMMATIONS;
+    ++pendingSummationCount_;
+}
+
+std::vector<glm::vec4> TextureLayerSumComputer::finishSumming()
+{
+    assert(pendingSummationCount_ > 0);
+    const auto bufferIndex=(nextReadbackBuffer-pendingSummationCount_+MAX_PENDING_SUMMATIONS)%MAX_PENDING_SUMMATIONS;
+    --pendingSummationCount_;
+
+    std::vector<glm::vec4> sums(pendingLayerCounts[bufferIndex]);
+    const auto size=sums.size()*sizeof sums[0];
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[bufferIndex]);
+    // This is where the CPU waits for the GPU
+    const auto data=gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if(!data)
+    {
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        throw OpenGLError(QObject::tr("Failed to map readback buffer of texture layer sums"));
+    }
+    std::memcpy(sums.data(), data, size);
+    gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return sums;
+}
+
+TextureLayerSumComputer::~TextureLayerSumComputer()
+{
+    gl.glDeleteTextures(1, &layersTexture);
+    gl.glDeleteTextures(2, pingPongTextures);
+    gl.glDeleteTextures(1, &sumsTexture);
+    gl.glDeleteFramebuffers(1, &fbo);
+    gl.glDeleteVertexArrays(1, &vao);
+    gl.glDeleteBuffers(1, &vbo);
+    gl.glDeleteBuffers(MAX_PENDING_SUMMATIONS, readbackBuffers);
+}
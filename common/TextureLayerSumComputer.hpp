@@ -0,0 +1,69 @@
+#ifndef INCLUDE_ONCE_39F9C2E5_4ED4_4BCC_B0EC_37A8508E74B4
+#define INCLUDE_ONCE_39F9C2E5_4ED4_4BCC_B0EC_37A8508E74B4
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <QOpenGLShaderProgram>
+
+class QOpenGLFunctions_3_3_Core;
+
+/* Sums the texels of each layer of a 2D array texture that it owns. The terms of many sums, e.g. of the integrals over
+ * a coarse grid of directions, are rendered each into its own layer, and then all the sums are computed on GPU and
+ * read back at once, so that the pipeline doesn't stall after every draw.
+ *
+ * The reduction is done by fragment shader passes, each of which halves the width and height of all the layers at
+ * once, adding each 2x2 block of texels pairwise. Texels beyond the edges of odd-sized layers are taken as zeros, so
+ * the result is the exact sum for any size, and as a whole this is pairwise summation, whose rounding error only
+ * grows as the logarithm of the number of texels. Nothing here depends on how the driver generates mipmaps.
+ *
+ * The sums can also be read back asynchronously, via pixel buffers, so that the caller can render the terms of the next
+ * sums while the GPU is still busy with the previous ones.
+ */
+class TextureLayerSumComputer
+{
+public:
+    static constexpr int MAX_PENDING_SUMMATIONS=2;
+private:
+    QOpenGLFunctions_3_3_Core& gl;
+    std::unique_ptr<QOpenGLShaderProgram> halvingProgram;
+    std::unique_ptr<QOpenGLShaderProgram> finalProgram;
+    GLuint layersTexture = 0;
+    GLuint pingPongTextures[2] = {};
+    GLuint sumsTexture = 0;
+    GLuint fbo = 0;
+    GLuint vbo = 0, vao = 0;
+    int width, height;
+    int layerCount_;
+    GLuint readbackBuffers[MAX_PENDING_SUMMATIONS] = {};
+    int pendingLayerCounts[MAX_PENDING_SUMMATIONS] = {};
+    int pendingSummationCount_ = 0;
+    int nextReadbackBuffer = 0;
+
+    // Leaves the sums in the texels of the currently bound read framebuffer for readSums() to read them
+    template<typename ReadSums>
+    void reduceLayers(int layersToSum, GLuint unusedTextureUnitNum, ReadSums readSums);
+public:
+    // The number of layers is limited by GL_MAX_ARRAY_TEXTURE_LAYERS, so layerCount() may be less than requested.
+    // Clobbers: GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_2D, GL_ARRAY_BUFFER_BINDING, GL_PIXEL_PACK_BUFFER_BINDING
+    TextureLayerSumComputer(QOpenGLFunctions_3_3_Core&, int width, int height, int layerCount);
+    ~TextureLayerSumComputer();
+    int layerCount() const { return layerCount_; }
+    // Attaches the layer to GL_COLOR_ATTACHMENT0 of the currently bound draw framebuffer
+    void attachLayer(int layer);
+    // Returns the sums of all texels of layers [0, layersToSum). Doesn't interfere with pending summations.
+    // Clobbers: GL_ACTIVE_TEXTURE, GL_TEXTURE_BINDING_2D_ARRAY
+    std::vector<glm::vec4> sumLayers(int layersToSum, GLuint unusedTextureUnitNum);
+    /* Starts summing layers [0, layersToSum) without waiting for the result, which is then returned by
+     * finishSumming(). The layers may be rendered into right after this call. At most MAX_PENDING_SUMMATIONS may be
+     * pending at a time.
+     * Clobbers: GL_ACTIVE_TEXTURE, GL_TEXTURE_BINDING_2D_ARRAY, GL_PIXEL_PACK_BUFFER_BINDING
+     */
+    void startSumming(int layersToSum, GLuint unusedTextureUnitNum);
+    int pendingSummationCount() const { return pendingSummationCount_; }
+    // Waits for the earliest pending summation to complete and returns its sums
+    // Clobbers: GL_PIXEL_PACK_BUFFER_BINDING
+    std::vector<glm::vec4> finishSumming();
+};
+
+#endif
@@ -7,4 +7,13 @@ constexpr double AU=astronomicalUnit;
 constexpr double sunRadius=696350e3; /* m */
 constexpr auto moonRadius=1737.1e3; /* m */
 
+/* Sources of the shaders saved by CalcMySky are stored once per distinct contents in this subdirectory of the
+ * shaders directory, under names made of the hashes of the contents. The directory of each shader program only
+ * gets small files named after the sources with the suffix below, which contain the names of the stored sources.
+ */
+constexpr char SHADER_SOURCES_DIR_NAME[]="sources";
+constexpr char SHADER_SOURCE_REFERENCE_SUFFIX[]=".ref";
+// Subdirectory of the multiple scattering shaders with the program that renders all the wavelength sets in one pass
+constexpr char ALL_WAVELENGTH_SETS_SHADER_DIR_NAME[]="all-wavelength-sets";
+
 #endif
@@ -1,45 +1,139 @@
 #ifndef INCLUDE_ONCE_3A48838B_2D1A_4326_9585_2E19F9D300D1
 #define INCLUDE_ONCE_3A48838B_2D1A_4326_9585_2E19F9D300D1
 
+#include <cmath>
+#include <vector>
+#include <cassert>
 #include <algorithm>
 #include <unsupported/Eigen/FFT>
 
-void fourierInterpolate(float const*const points, const std::size_t inPointCount,
-                        std::complex<float>*const intermediate /* must fit interpolationPointCount elements */,
-                        float*const interpolated, std::size_t const interpolationPointCount)
+/* Fourier interpolation of periodic real sequences of a fixed length to a fixed, not smaller, length. The FFT object,
+ * which caches the plans and twiddle factors for the lengths it has seen, and the buffers are kept between the calls,
+ * so a single interpolator is meant to be used for all the rows of the same length.
+ *
+ * Eigen only has a fast real inverse FFT for lengths that are multiples of 4. For other output lengths it does a
+ * complex transform of the full length, which for lengths with large prime factors (e.g. 255=3*5*17) is slower than
+ * computing each output point directly from the input. In this case the interpolation is done as multiplication by a
+ * precomputed outPointCount x inPointCount matrix.
+ */
+class FourierInterpolator
 {
-    if(inPointCount==interpolationPointCount)
+    using FFT=Eigen::FFT<float>;
+
+    FFT fft;
+    std::vector<std::complex<float>> spectrum;
+    std::vector<float> row;
+    std::vector<float> interpolationMatrix; // row-major, empty if the FFT is used
+    std::size_t inPointCount_, outPointCount_;
+
+    void computeInterpolationMatrix()
     {
-        std::copy_n(points, inPointCount, interpolated);
-        return;
+        // Each output point is the sum of the preserved harmonics of the input, with the same scaling and treatment of
+        // the Nyquist frequency as in the FFT path. For input point j the sum of the harmonics is the Dirichlet kernel
+        // of the phase difference between the output and input points.
+        const bool evenInput = inPointCount_ % 2 == 0;
+        const double N=inPointCount_;
+        interpolationMatrix.resize(outPointCount_*inPointCount_);
+        for(std::size_t n=0; n<outPointCount_; ++n)
+        {
+            for(std::size_t j=0; j<inPointCount_; ++j)
+            {
+                const double phase = 2*M_PI*(double(n)/outPointCount_ - j/N);
+                const double sinHalfPhase=std::sin(phase/2);
+                double kernel;
+                if(std::abs(sinHalfPhase) < 1e-9)
+                    kernel = N; // the limit at zero phase difference
+                else if(evenInput)
+                    kernel = std::sin((N-1)*phase/2)/sinHalfPhase + std::cos(N*phase/2);
+                else
+                    kernel = std::sin(N*phase/2)/sinHalfPhase;
+                interpolationMatrix[n*inPointCount_+j] = kernel/N;
+            }
+        }
     }
 
-    assert(interpolationPointCount > inPointCount);
+public:
+    FourierInterpolator(const std::size_t inPointCount, const std::size_t outPointCount)
+        // Only the lower half of the spectrum of a real sequence is needed, and the inverse transform is left unscaled
+        // because the scaling is folded into the spectrum
+        : fft(FFT::impl_type(), FFT::Flag(FFT::HalfSpectrum | FFT::Unscaled))
+        , spectrum(outPointCount/2+1)
+        , row(outPointCount)
+        , inPointCount_(inPointCount)
+        , outPointCount_(outPointCount)
+    {
+        assert(outPointCount >= inPointCount);
+        if(outPointCount!=inPointCount && outPointCount%4!=0)
+            computeInterpolationMatrix();
+    }
+    std::size_t inPointCount() const { return inPointCount_; }
+    std::size_t outPointCount() const { return outPointCount_; }
 
-    Eigen::FFT<float> fft;
-    fft.fwd(intermediate, points, inPointCount);
-    if(inPointCount % 2)
+    void interpolate(float const*const points, float*const interpolated)
     {
-        const auto fftHalfCount=(inPointCount+1)/2;
-        // Clear upper half of the spectrum. Since Eigen inverse FFT ignores upper half when output
-        // type is real, don't bother preserving it in extended spectrum.
-        std::fill_n(intermediate+fftHalfCount, interpolationPointCount-fftHalfCount, 0);
+        if(inPointCount_==outPointCount_)
+        {
+            std::copy_n(points, inPointCount_, interpolated);
+            return;
+        }
+        if(!interpolationMatrix.empty())
+        {
+            for(std::size_t n=0; n<outPointCount_; ++n)
+            {
+                float const*const weights = &interpolationMatrix[n*inPointCount_];
+                float sum=0;
+                for(std::size_t j=0; j<inPointCount_; ++j)
+                    sum += weights[j]*points[j];
+                interpolated[n]=sum;
+            }
+            return;
+        }
+
+        fft.fwd(spectrum.data(), points, inPointCount_);
+        const bool evenInput = inPointCount_ % 2 == 0;
+        // For even input, the Nyquist frequency component is preserved too
+        const auto numPreservedElems = evenInput ? inPointCount_/2+1 : (inPointCount_+1)/2;
+        // The forward transform is not normalized, and the inverse one is unscaled, so the spectrum must be divided by
+        // inPointCount. Doing this here touches only the preserved components instead of all the output points.
+        const float scale=1.f/inPointCount_;
+        for(std::size_t i=0; i<numPreservedElems; ++i)
+            spectrum[i] *= scale;
+        if(evenInput)
+        {
+            // Nyquist frequency gets split into two half-amplitude components in the two sides of the spectrum.
+            // Since Eigen inverse FFT only uses lower half of the spectrum when output type is real, only the lower
+            // instance needs to be kept, divided by 2.
+            spectrum[inPointCount_/2] /= 2;
+        }
+        // Clear upper part of the lower half of the extended spectrum
+        std::fill(spectrum.begin()+numPreservedElems, spectrum.end(), 0);
+        fft.inv(interpolated, spectrum.data(), outPointCount_);
     }
-    else
+
+    /* Interpolates rowCount rows in each of channelCount channels. Row r of channel c is read from
+     * points[c]+r*inPointCount(). The output is interleaved by channel like texture data: point k of row r in channel c
+     * goes to interpolated[(r*outPointCount()+k)*channelCount+c].
+     */
+    void interpolate(float const*const*const points, const std::size_t channelCount, const std::size_t rowCount,
+                     float*const interpolated)
     {
-        const auto fftHalfCount=inPointCount/2;
-        // Nyquist frequency gets split into two half-amplitude components in the two sides of the spectrum.
-        // So we need to 1) avoid zeroing this spectral component out, and 2) divide both its instances by 2.
-        // In practice, since Eigen ignores upper half of the spectrum when output type of inverse transform
-        // is real, we don't bother saving/moving/dividing the upper entries, and just zero them out too.
-        // So only the lower instance of Nyquist frequency amplitude remains to be divided.
-        const auto numPreservedElems=fftHalfCount+1;
-        std::fill_n(intermediate+numPreservedElems, interpolationPointCount-numPreservedElems, 0);
-        intermediate[fftHalfCount] /= 2;
+        for(std::size_t r=0; r<rowCount; ++r)
+        {
+            float*const outRow = interpolated + r*outPointCount_*channelCount;
+            for(std::size_t c=0; c<channelCount; ++c)
+            {
+                interpolate(points[c]+r*inPointCount_, row.data());
+                for(std::size_t k=0; k<outPointCount_; ++k)
+                    outRow[k*channelCount+c] = row[k];
+            }
+        }
     }
-    fft.inv(interpolated, intermediate, interpolationPointCount);
-    for(std::size_t i=0; i<interpolationPointCount; ++i)
-        interpolated[i] *= float(interpolationPointCount)/inPointCount;
+};
+
+inline void fourierInterpolate(float const*const points, const std::size_t inPointCount,
+                               float*const interpolated, std::size_t const interpolationPointCount)
+{
+    FourierInterpolator(inPointCount, interpolationPointCount).interpolate(points, interpolated);
 }
 
 #endif
@@ -0,0 +1,57 @@
+#ifndef INCLUDE_ONCE_AA71EBBD_7BAB_417A_A2CD_118BF4735D33
+#define INCLUDE_ONCE_AA71EBBD_7BAB_417A_A2CD_118BF4735D33
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+// Number of threads forEachInParallel() uses to process numItems items, including the calling thread
+inline int parallelWorkerCount(const int numItems, const int maxThreads=int(std::thread::hardware_concurrency()))
+{
+    return std::clamp(maxThreads, 1, std::max(numItems, 1));
+}
+
+/* Calls process(item, worker) for each item in [0,numItems), distributing the items between at most maxThreads threads,
+ * by default all the available hardware threads. Callers that already run in parallel with others should pass their
+ * share of the hardware threads to avoid oversubscription. The worker index is in
+ * [0,parallelWorkerCount(numItems,maxThreads)), and no two calls with the same worker index run concurrently, so it
+ * can be used to select per-thread scratch state. If any call throws, the remaining items are skipped, and the first
+ * exception is rethrown in the calling thread after all the workers have finished.
+ */
+template<typename ItemProcessor>
+void forEachInParallel(const int numItems, ItemProcessor const& process,
+                       const int maxThreads=int(std::thread::hardware_concurrency()))
+{
+    const int numThreads=parallelWorkerCount(numItems, maxThreads);
+    std::atomic<int> nextItem{0};
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+    const auto worker=[&](const int workerIndex)
+    {
+        try
+        {
+            for(int item=nextItem++; item<numItems; item=nextItem++)
+                process(item, workerIndex);
+        }
+        catch(...)
+        {
+            nextItem=numItems;
+            const std::lock_guard lock(errorMutex);
+            if(!firstError)
+                firstError=std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int n=1; n<numThreads; ++n)
+        threads.emplace_back(worker, n);
+    worker(0);
+    for(auto& thread : threads)
+        thread.join();
+    if(firstError)
+        std::rethrow_exception(firstError);
+}
+
+#endif
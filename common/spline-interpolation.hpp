@@ -2,8 +2,11 @@
 #define INCLUDE_ONCE_F820C110_1DC9_40B4_8442_EDD0227CB7E8
 
 #include <Eigen/Dense>
+#include <algorithm>
 #include <cassert>
 #include <vector>
+#include <array>
+#include <stdexcept>
 
 template<typename Number, typename Vec2>
 class SplineOrder2InterpolationFunction
@@ -24,27 +27,217 @@ public:
     {
         assert(!chunks.empty());
 
-        std::size_t chunkIndex;
-        for(chunkIndex=0; chunkIndex<chunks.size() && x > chunks[chunkIndex].xMax; ++chunkIndex);
-
-        if(chunkIndex==chunks.size())
+        const auto chunk=std::lower_bound(chunks.begin(), chunks.end(), x,
+                                          [](Chunk const& chunk, Number const x){ return chunk.xMax < x; });
+        if(chunk==chunks.end())
             throw std::out_of_range("SplineOrder2InterpolationFunction::sample: too large x");
 
-        const auto a = chunks[chunkIndex].a;
-        const auto b = chunks[chunkIndex].b;
-        const auto c = chunks[chunkIndex].c;
+        const auto a = chunk->a;
+        const auto b = chunk->b;
+        const auto c = chunk->c;
         return a*x*x + b*x + c;
     }
+    /* Same as calling sample() for each of xs, which must be sorted in nondecreasing order. The chunks are walked once
+     * for all the xs, and each run of xs falling into the same chunk is evaluated by a loop simple enough for the
+     * compiler to vectorize.
+     */
+    void sampleSorted(Number const*const xs, const std::size_t n, Number*const out) const
+    {
+        assert(!chunks.empty());
+        assert(std::is_sorted(xs, xs+n));
+
+        std::size_t runBegin=0;
+        for(const auto& chunk : chunks)
+        {
+            if(runBegin==n) return;
+            std::size_t runEnd=runBegin;
+            while(runEnd<n && xs[runEnd] <= chunk.xMax)
+                ++runEnd;
+
+            const auto a = chunk.a;
+            const auto b = chunk.b;
+            const auto c = chunk.c;
+            for(std::size_t k=runBegin; k<runEnd; ++k)
+            {
+                const auto x=xs[k];
+                out[k] = a*x*x + b*x + c;
+            }
+            runBegin=runEnd;
+        }
+        if(runBegin!=n)
+            throw std::out_of_range("SplineOrder2InterpolationFunction::sampleSorted: too large x");
+    }
 private:
     std::vector<Chunk> chunks;
 };
 
+namespace detail
+{
+
+/* Linear system with KL subdiagonals and KU superdiagonals, solved by Gaussian elimination with partial pivoting in
+ * O(N) time. Each row keeps only a window of KL+KU+1 coefficients: initially it starts at column row-KL, and while the
+ * elimination goes on, the rows it works with are shifted to start at the current column, the ones to the left of it
+ * being zero already. Pivoting makes the superdiagonal fill grow to at most KL+KU, so nothing falls out of the window.
+ */
+template<typename Number, int KL, int KU>
+class BandedLinearSystem
+{
+    static constexpr int WIDTH=KL+KU+1;
+    struct Row
+    {
+        int firstCol;
+        std::array<Number,WIDTH> coefs{};
+        Number rhs=0;
+    };
+    std::vector<Row> rows;
+
+    static void shiftWindow(Row& row, const int firstCol)
+    {
+        const int shift=firstCol-row.firstCol;
+        assert(shift>=0);
+        if(shift==0) return;
+        for(int j=0; j<WIDTH; ++j)
+        {
+            assert(j>=shift || row.coefs[j]==0);
+            row.coefs[j] = j+shift<WIDTH ? row.coefs[j+shift] : 0;
+        }
+        row.firstCol=firstCol;
+    }
+public:
+    explicit BandedLinearSystem(const int size)
+        : rows(size)
+    {
+        for(int r=0; r<size; ++r)
+            rows[r].firstCol=r-KL;
+    }
+    Number& coef(const int row, const int col)
+    {
+        assert(col-rows[row].firstCol>=0 && col-rows[row].firstCol<WIDTH);
+        return rows[row].coefs[col-rows[row].firstCol];
+    }
+    Number& rhs(const int row) { return rows[row].rhs; }
+
+    // Destroys the matrix
+    std::vector<Number> solve()
+    {
+        using std::abs;
+        const int N=rows.size();
+        for(int k=0; k<N; ++k)
+        {
+            const int lastRow=std::min(N-1, k+KL);
+            int pivotRow=k;
+            for(int r=k; r<=lastRow; ++r)
+            {
+                shiftWindow(rows[r], k);
+                if(abs(rows[r].coefs[0]) > abs(rows[pivotRow].coefs[0]))
+                    pivotRow=r;
+            }
+            std::swap(rows[k], rows[pivotRow]);
+
+            const auto& pivot=rows[k];
+            for(int r=k+1; r<=lastRow; ++r)
+            {
+                const auto factor=rows[r].coefs[0]/pivot.coefs[0];
+                if(factor==0) continue;
+                rows[r].coefs[0]=0;
+                for(int j=1; j<WIDTH; ++j)
+                    rows[r].coefs[j] -= factor*pivot.coefs[j];
+                rows[r].rhs -= factor*pivot.rhs;
+            }
+        }
+
+        std::vector<Number> x(N);
+        for(int k=N-1; k>=0; --k)
+        {
+            auto sum=rows[k].rhs;
+            for(int j=1; j<WIDTH && k+j<N; ++j)
+                sum -= rows[k].coefs[j]*x[k+j];
+            x[k]=sum/rows[k].coefs[0];
+        }
+        return x;
+    }
+};
+
+}
+
+/* Piecewise-quadratic interpolation with one chunk per internal point, the chunks joining at the midpoints between the
+ * points with continuous value and derivative.
+ *
+ * Each chunk i is written in terms of the offset from its point, y[i+1] + d[i] (x-x[i+1]) + a[i] (x-x[i+1])^2, which
+ * satisfies interpolation of that point by construction. With the unknowns ordered as d[0], a[0], d[1], a[1], ..., and
+ * the equations ordered so that those for the joint between chunks i and i+1 come between the rows of these chunks,
+ * the system has two subdiagonals and two superdiagonals, and is solved in O(n) time.
+ */
 template<typename Vec2, typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
 SplineOrder2InterpolationFunction<Number,Vec2> splineInterpolationOrder2(Vec2 const*const points, const std::size_t pointCount)
 {
     assert(pointCount>=3);
     assert(std::is_sorted(points,points+pointCount,[](Vec2 const& a, Vec2 const& b){return a.x<b.x;}));
 
+    enum { D=0, A=1 };
+    const int n=pointCount;
+    const int chunkCount=n-2;
+
+    detail::BandedLinearSystem<Number,2,2> system(2*chunkCount);
+
+    // The first chunk must pass through the first point
+    {
+        const Number h=points[0].x-points[1].x;
+        system.coef(0, 2*0+D)=h;
+        system.coef(0, 2*0+A)=h*h;
+        system.rhs(0)=points[0].y-points[1].y;
+    }
+
+    // Value and derivative of chunks i and i+1 must agree at the midpoint between points i+1 and i+2, which is at the
+    // offset h/2 from the point of chunk i and -h/2 from that of chunk i+1
+    for(int i=0; i<chunkCount-1; ++i)
+    {
+        const Number h=points[i+2].x-points[i+1].x;
+        const int valueRow=2*i+1, derivRow=2*i+2;
+        system.coef(valueRow, 2*i+D)     =  h/2;
+        system.coef(valueRow, 2*i+A)     =  h*h/4;
+        system.coef(valueRow, 2*(i+1)+D) =  h/2;
+        system.coef(valueRow, 2*(i+1)+A) = -h*h/4;
+        system.rhs(valueRow)=points[i+2].y-points[i+1].y;
+
+        system.coef(derivRow, 2*i+D)     =  1;
+        system.coef(derivRow, 2*i+A)     =  h;
+        system.coef(derivRow, 2*(i+1)+D) = -1;
+        system.coef(derivRow, 2*(i+1)+A) =  h;
+    }
+
+    // The last chunk must pass through the last point
+    {
+        const int row=2*chunkCount-1;
+        const Number h=points[n-1].x-points[n-2].x;
+        system.coef(row, 2*(chunkCount-1)+D)=h;
+        system.coef(row, 2*(chunkCount-1)+A)=h*h;
+        system.rhs(row)=points[n-1].y-points[n-2].y;
+    }
+
+    const auto DAs=system.solve();
+
+    std::vector<typename SplineOrder2InterpolationFunction<Number,Vec2>::Chunk> coefs;
+    coefs.reserve(chunkCount);
+    for(int i=0; i<chunkCount; ++i)
+    {
+        const auto xMax = i==chunkCount-1 ? points[n-1].x : (points[i+1].x+points[i+2].x)/2;
+        const Number x0=points[i+1].x, y0=points[i+1].y;
+        const auto d=DAs[2*i+D], a=DAs[2*i+A];
+        coefs.emplace_back(xMax, a, d-2*a*x0, y0-d*x0+a*x0*x0);
+    }
+    return coefs;
+}
+
+/* Reference implementation of splineInterpolationOrder2(), which builds the dense system for the global coefficients of
+ * the chunks and solves it in O(n^3) time. Only used to check the results of the fast version.
+ */
+template<typename Vec2, typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
+SplineOrder2InterpolationFunction<Number,Vec2> splineInterpolationOrder2Dense(Vec2 const*const points, const std::size_t pointCount)
+{
+    assert(pointCount>=3);
+    assert(std::is_sorted(points,points+pointCount,[](Vec2 const& a, Vec2 const& b){return a.x<b.x;}));
+
     const auto sqr=[](Number x){ return x*x; };
     enum { A=0, B=1, C=2 };
 
@@ -1,3 +1,4 @@
+// Keep in sync with dependenciesOf() in CalcMySky/dependencies.cpp
 digraph calculation
 {
     overlap=false;
@@ -4,6 +4,7 @@
 
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "texture-coordinates.h.glsl"
 #include "radiance-to-luminance.h.glsl"
 #include "single-scattering-eclipsed.h.glsl"
@@ -1,6 +1,7 @@
 #version 330
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "texture-sampling-functions.h.glsl"
 
 vec4 computeDirectGroundIrradiance(const float cosSunZenithAngle, const float altitude)
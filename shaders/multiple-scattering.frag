@@ -1,6 +1,7 @@
 #version 330
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "common-functions.h.glsl"
 #include "texture-coordinates.h.glsl"
 #include "texture-sampling-functions.h.glsl"
@@ -1,9 +1,10 @@
 #version 330
 
-#definitions (RENDERING_ANY_ECLIPSED_SINGLE_SCATTERING, RENDERING_ANY_LIGHT_POLLUTION, RENDERING_ANY_NORMAL_SINGLE_SCATTERING, RENDERING_ANY_SINGLE_SCATTERING, RENDERING_ANY_ZERO_SCATTERING, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_ZERO_SCATTERING, RENDERING_LIGHT_POLLUTION_LUMINANCE, RENDERING_LIGHT_POLLUTION_RADIANCE, RENDERING_MULTIPLE_SCATTERING_LUMINANCE, RENDERING_MULTIPLE_SCATTERING_RADIANCE, RENDERING_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ZERO_SCATTERING)
+#definitions (RENDERING_ANY_ECLIPSED_SINGLE_SCATTERING, RENDERING_ANY_LIGHT_POLLUTION, RENDERING_ANY_NORMAL_SINGLE_SCATTERING, RENDERING_ANY_SINGLE_SCATTERING, RENDERING_ANY_ZERO_SCATTERING, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_ZERO_SCATTERING, RENDERING_LIGHT_POLLUTION_LUMINANCE, RENDERING_LIGHT_POLLUTION_RADIANCE, RENDERING_MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS, RENDERING_MULTIPLE_SCATTERING_LUMINANCE, RENDERING_MULTIPLE_SCATTERING_RADIANCE, RENDERING_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ZERO_SCATTERING, RENDERING_ZERO_SCATTERING_ALL_WAVELENGTH_SETS)
 
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "calc-view-dir.h.glsl"
 #include "common-functions.h.glsl"
 #include_if(RENDERING_ANY_SINGLE_SCATTERING) "phase-functions.h.glsl"
@@ -14,12 +15,22 @@
 #include_if(RENDERING_ANY_ZERO_SCATTERING) "texture-sampling-functions.h.glsl"
 #include_if(RENDERING_ECLIPSED_ZERO_SCATTERING) "eclipsed-direct-irradiance.h.glsl"
 #include_if(RENDERING_ANY_LIGHT_POLLUTION) "texture-sampling-functions.h.glsl"
+#include_if(RENDERING_MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS) "multiple-scattering-all-wavelength-sets.h.glsl"
+#include_if(RENDERING_ZERO_SCATTERING_ALL_WAVELENGTH_SETS) "zero-order-scattering-all-wavelength-sets.h.glsl"
 
 uniform sampler3D scatteringTextureInterpolationGuides01;
 uniform sampler3D scatteringTextureInterpolationGuides02;
 uniform sampler3D scatteringTexture;
+uniform float scatteringTextureScale=1; // Factor the texels of scatteringTexture are multiplied by, e.g. to restore range of half-float data
 uniform sampler2D eclipsedScatteringTexture;
 uniform sampler3D eclipsedDoubleScatteringTexture;
+// Upper altitude slices of the textures above. They are only sampled if altitudeSliceMix is nonzero, i.e. when the
+// textures aren't interpolated by altitude on CPU, but are kept resident as pairs of slices.
+uniform sampler3D scatteringTextureInterpolationGuides01Upper;
+uniform sampler3D scatteringTextureInterpolationGuides02Upper;
+uniform sampler3D scatteringTextureUpper;
+uniform sampler3D eclipsedDoubleScatteringTextureUpper;
+uniform float altitudeSliceMix=0; // Weight of the upper altitude slice
 uniform vec3 cameraPosition;
 uniform vec3 sunDirection;
 uniform vec3 moonPosition;
@@ -31,10 +42,65 @@ in vec3 position;
 layout(location=0) out vec4 luminance;
 layout(location=1) out vec4 radianceOutput;
 
-vec4 solarRadiance()
+#if RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE || RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE
+vec4 sampleSingleScatteringSlice(const sampler3D tex, const sampler3D guides01, const sampler3D guides02,
+                                 const float cosSunZenithAngle, const float cosViewZenithAngle, const float dotViewSun,
+                                 const float altitude, const bool viewRayIntersectsGround)
 {
-    return solarIrradianceAtTOA*solarIrradianceFixup/(PI*sqr(sunAngularRadius));
+    if(useInterpolationGuides)
+    {
+        return sample3DTextureGuided(tex, guides01, guides02, cosSunZenithAngle,
+                                     cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
+    }
+    return sample3DTexture(tex, cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
+}
+
+vec4 sampleSingleScattering(const float cosSunZenithAngle, const float cosViewZenithAngle, const float dotViewSun,
+                            const float altitude, const bool viewRayIntersectsGround)
+{
+    CONST vec4 lower = sampleSingleScatteringSlice(scatteringTexture, scatteringTextureInterpolationGuides01,
+                                                   scatteringTextureInterpolationGuides02, cosSunZenithAngle,
+                                                   cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
+    if(altitudeSliceMix==0)
+        return lower;
+    CONST vec4 upper = sampleSingleScatteringSlice(scatteringTextureUpper, scatteringTextureInterpolationGuides01Upper,
+                                                   scatteringTextureInterpolationGuides02Upper, cosSunZenithAngle,
+                                                   cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
+    return mix(lower, upper, altitudeSliceMix);
 }
+#endif
+
+#if RENDERING_MULTIPLE_SCATTERING_LUMINANCE || RENDERING_MULTIPLE_SCATTERING_RADIANCE
+vec4 sampleMultipleScattering(const float cosSunZenithAngle, const float cosViewZenithAngle, const float dotViewSun,
+                              const float altitude, const bool viewRayIntersectsGround)
+{
+    CONST vec4 lower = sample3DTexture(scatteringTexture, cosSunZenithAngle, cosViewZenithAngle,
+                                       dotViewSun, altitude, viewRayIntersectsGround);
+    if(altitudeSliceMix==0)
+        return lower;
+    CONST vec4 upper = sample3DTexture(scatteringTextureUpper, cosSunZenithAngle, cosViewZenithAngle,
+                                       dotViewSun, altitude, viewRayIntersectsGround);
+    return mix(lower, upper, altitudeSliceMix);
+}
+#endif
+
+#if RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE || RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE
+// Returns the logarithm of the radiance, which is what's interpolated on CPU too
+vec4 sampleEclipsedDoubleScatteringLog(const float cosSunZenithAngle, const float cosViewZenithAngle,
+                                       const float azimuthRelativeToSun, const float altitude,
+                                       const bool viewRayIntersectsGround)
+{
+    CONST vec4 lower = sampleEclipseDoubleScattering3DTexture(eclipsedDoubleScatteringTexture,
+                                                              cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
+                                                              altitude, viewRayIntersectsGround);
+    if(altitudeSliceMix==0)
+        return lower;
+    CONST vec4 upper = sampleEclipseDoubleScattering3DTexture(eclipsedDoubleScatteringTextureUpper,
+                                                              cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
+                                                              altitude, viewRayIntersectsGround);
+    return mix(lower, upper, altitudeSliceMix);
+}
+#endif
 
 void main()
 {
@@ -151,23 +217,15 @@ void main()
     vec4 radiance;
     if(viewRayIntersectsGround)
     {
-        // XXX: keep in sync with the same code in computeScatteringDensity(), but don't forget about
-        //      the difference in the usage of viewDir vs incDir.
         CONST float distToGround = distanceToGround(cosViewZenithAngle, altitude);
-        CONST vec4 transmittanceToGround=transmittance(cosViewZenithAngle, altitude, distToGround, viewRayIntersectsGround);
         CONST vec3 groundNormal = normalize(zenith*(earthRadius+altitude)+viewDir*distToGround);
-        CONST vec4 groundIrradiance = irradiance(dot(groundNormal, sunDirection), 0);
-        // Radiation scattered by the ground
-        CONST float groundBRDF = 1/PI; // Assuming Lambertian BRDF, which is constant
-        radiance = transmittanceToGround*groundAlbedo*groundIrradiance*solarIrradianceFixup*groundBRDF
-                 + lightPollutionGroundLuminance*lightPollutionRelativeRadiance;
+        radiance = groundRadiance(cosViewZenithAngle, altitude, distToGround, dot(groundNormal, sunDirection),
+                                  groundAlbedo, solarIrradianceFixup,
+                                  lightPollutionGroundLuminance, lightPollutionRelativeRadiance);
     }
     else if(dotViewSun>cos(sunAngularRadius))
     {
-        if(lookingIntoAtmosphere)
-            radiance=transmittanceToAtmosphereBorder(cosViewZenithAngle, altitude)*solarRadiance();
-        else
-            radiance=solarRadiance();
+        radiance=sunRadiance(cosViewZenithAngle, altitude, lookingIntoAtmosphere, solarIrradianceAtTOA, solarIrradianceFixup);
     }
     else
     {
@@ -175,12 +233,29 @@ void main()
     }
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
+#elif RENDERING_ZERO_SCATTERING_ALL_WAVELENGTH_SETS
+    // Only luminance is rendered, like for multiple scattering of all wavelength sets. The functions called here sum
+    // the same functions as above over the wavelength sets.
+    if(viewRayIntersectsGround)
+    {
+        CONST float distToGround = distanceToGround(cosViewZenithAngle, altitude);
+        CONST vec3 groundNormal = normalize(zenith*(earthRadius+altitude)+viewDir*distToGround);
+        luminance=groundLuminanceOfAllWavelengthSets(cosViewZenithAngle, altitude, distToGround,
+                                                     dot(groundNormal, sunDirection), lightPollutionGroundLuminance);
+    }
+    else if(dotViewSun>cos(sunAngularRadius))
+    {
+        luminance=sunLuminanceOfAllWavelengthSets(cosViewZenithAngle, altitude, lookingIntoAtmosphere);
+    }
+    else
+    {
+        discard;
+    }
 #elif RENDERING_ECLIPSED_ZERO_SCATTERING
     vec4 radiance;
     CONST float dotViewMoon=dot(viewDir,normalize(moonPosition-cameraPosition));
     if(viewRayIntersectsGround)
     {
-        // XXX: keep in sync with the similar code in non-eclipsed zero scattering rendering.
         CONST float distToGround = distanceToGround(cosViewZenithAngle, altitude);
         CONST vec4 transmittanceToGround=transmittance(cosViewZenithAngle, altitude, distToGround, viewRayIntersectsGround);
         CONST vec3 pointOnGround = cameraPosition+viewDir*distToGround;
@@ -189,17 +264,12 @@ void main()
         // conditions: when limited to 2 orders). This should be calculated at the same time when second order
         // is: all the infrastructure is already there.
         CONST vec4 groundIrradiance = directGroundIrradiance;
-        // Radiation scattered by the ground
-        CONST float groundBRDF = 1/PI; // Assuming Lambertian BRDF, which is constant
-        radiance = transmittanceToGround*groundAlbedo*groundIrradiance*solarIrradianceFixup*groundBRDF
-                 + lightPollutionGroundLuminance*lightPollutionRelativeRadiance;
+        radiance = groundRadiance(transmittanceToGround, groundIrradiance, groundAlbedo, solarIrradianceFixup,
+                                  lightPollutionGroundLuminance, lightPollutionRelativeRadiance);
     }
     else if(dotViewSun>cos(sunAngularRadius) && dotViewMoon<cos(moonAngularRadius(cameraPosition,moonPosition)))
     {
-        if(lookingIntoAtmosphere)
-            radiance=transmittanceToAtmosphereBorder(cosViewZenithAngle, altitude)*solarRadiance();
-        else
-            radiance=solarRadiance();
+        radiance=sunRadiance(cosViewZenithAngle, altitude, lookingIntoAtmosphere, solarIrradianceAtTOA, solarIrradianceFixup);
     }
     else
     {
@@ -236,16 +306,14 @@ void main()
     CONST vec4 scattering = textureLod(eclipsedScatteringTexture, texCoords, 0);
     luminance=scattering*phaseFuncValue;
 #elif RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE
-    vec4 radiance=exp(sampleEclipseDoubleScattering3DTexture(eclipsedDoubleScatteringTexture,
-                                                             cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
-                                                             altitude, viewRayIntersectsGround));
+    vec4 radiance=exp(sampleEclipsedDoubleScatteringLog(cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
+                                                        altitude, viewRayIntersectsGround));
     radiance*=solarIrradianceFixup;
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
 #elif RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE
-    luminance=exp(sampleEclipseDoubleScattering3DTexture(eclipsedDoubleScatteringTexture,
-                                                         cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
-                                                         altitude, viewRayIntersectsGround));
+    luminance=exp(sampleEclipsedDoubleScatteringLog(cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
+                                                    altitude, viewRayIntersectsGround));
 #elif RENDERING_SINGLE_SCATTERING_ON_THE_FLY
     CONST vec4 scattering=computeSingleScattering(cosSunZenithAngle,cosViewZenithAngle,dotViewSun,
                                                   altitude,viewRayIntersectsGround);
@@ -254,43 +322,27 @@ void main()
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
 #elif RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE
-    vec4 scattering;
-    if(useInterpolationGuides)
-    {
-        scattering = sample3DTextureGuided(scatteringTexture, scatteringTextureInterpolationGuides01,
-                                           scatteringTextureInterpolationGuides02, cosSunZenithAngle,
-                                           cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
-    }
-    else
-    {
-        scattering = sample3DTexture(scatteringTexture, cosSunZenithAngle, cosViewZenithAngle,
-                                     dotViewSun, altitude, viewRayIntersectsGround);
-    }
+    CONST vec4 scattering = scatteringTextureScale*sampleSingleScattering(cosSunZenithAngle, cosViewZenithAngle, dotViewSun,
+                                                                          altitude, viewRayIntersectsGround);
     vec4 radiance=scattering*phaseFuncValue;
     radiance*=solarIrradianceFixup;
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
 #elif RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE
-    vec4 scattering;
-    if(useInterpolationGuides)
-    {
-        scattering = sample3DTextureGuided(scatteringTexture, scatteringTextureInterpolationGuides01,
-                                           scatteringTextureInterpolationGuides02, cosSunZenithAngle,
-                                           cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
-    }
-    else
-    {
-        scattering = sample3DTexture(scatteringTexture, cosSunZenithAngle, cosViewZenithAngle,
-                                     dotViewSun, altitude, viewRayIntersectsGround);
-    }
+    CONST vec4 scattering = scatteringTextureScale*sampleSingleScattering(cosSunZenithAngle, cosViewZenithAngle, dotViewSun,
+                                                                          altitude, viewRayIntersectsGround);
     luminance=scattering * (bool(PHASE_FUNCTION_IS_EMBEDDED) ? vec4(1) : phaseFuncValue);
 #elif RENDERING_MULTIPLE_SCATTERING_LUMINANCE
-    luminance=sample3DTexture(scatteringTexture, cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
+    luminance=scatteringTextureScale*sampleMultipleScattering(cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
 #elif RENDERING_MULTIPLE_SCATTERING_RADIANCE
-    vec4 radiance=sample3DTexture(scatteringTexture, cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
+    vec4 radiance=scatteringTextureScale*sampleMultipleScattering(cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround);
     radiance*=solarIrradianceFixup;
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
+#elif RENDERING_MULTIPLE_SCATTERING_ALL_WAVELENGTH_SETS
+    // Only luminance is rendered: the radiances of separate wavelength sets would need too many render targets
+    luminance=multipleScatteringLuminanceOfAllWavelengthSets(cosSunZenithAngle, cosViewZenithAngle, dotViewSun,
+                                                             altitude, viewRayIntersectsGround);
 #elif RENDERING_LIGHT_POLLUTION_RADIANCE
     vec4 radiance=lightPollutionGroundLuminance*lightPollutionScattering(altitude, cosViewZenithAngle, viewRayIntersectsGround);
     luminance=radianceToLuminance*radiance;
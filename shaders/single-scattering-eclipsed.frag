@@ -4,6 +4,7 @@
 
 #include "version.h.glsl"
 #include "const.h.glsl"
+#include "wavelength-set-constants.h.glsl"
 #include "densities.h.glsl"
 #include "common-functions.h.glsl"
 #include "texture-sampling-functions.h.glsl"
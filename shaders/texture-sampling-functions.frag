@@ -13,13 +13,21 @@ uniform sampler3D multipleScatteringTexture;
 
 uniform sampler2D lightPollutionScatteringTexture;
 
-vec4 irradiance(const float cosSunZenithAngle, const float altitude)
+// The versions of the functions below that take the textures as arguments let a shader sample the textures of
+// several wavelength sets
+
+vec4 irradiance(const sampler2D irradianceTex, const float cosSunZenithAngle, const float altitude)
 {
     CONST vec2 texCoords=irradianceTexVarsToTexCoord(cosSunZenithAngle, altitude);
-    return texture(irradianceTexture, texCoords);
+    return texture(irradianceTex, texCoords);
 }
 
-vec4 opticalDepthToAtmosphereBorder(const float cosViewZenithAngle, const float altitude)
+vec4 irradiance(const float cosSunZenithAngle, const float altitude)
+{
+    return irradiance(irradianceTexture, cosSunZenithAngle, altitude);
+}
+
+vec4 opticalDepthToAtmosphereBorder(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude)
 {
     CONST vec2 texCoords=transmittanceTexVarsToTexCoord(cosViewZenithAngle, altitude);
     // We don't use mip mapping here, but for some reason, on my NVidia GTX 750 Ti with Linux-x86 driver 390.116 I get
@@ -27,17 +35,22 @@ vec4 opticalDepthToAtmosphereBorder(const float cosViewZenithAngle, const float
     // transmittance texture for altitude being 4096). This happens when I simply call texture(eclipsedScatteringTexture,
     // texCoords) without specifying LOD.
     // Apparently, the driver uses the derivative for some reason, even though it shouldn't.
-    return textureLod(transmittanceTexture, texCoords, 0);
+    return textureLod(transmittanceTex, texCoords, 0);
+}
+
+vec4 transmittanceToAtmosphereBorder(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude)
+{
+    return exp(-opticalDepthToAtmosphereBorder(transmittanceTex, cosViewZenithAngle,altitude));
 }
 
 vec4 transmittanceToAtmosphereBorder(const float cosViewZenithAngle, const float altitude)
 {
-    return exp(-opticalDepthToAtmosphereBorder(cosViewZenithAngle,altitude));
+    return transmittanceToAtmosphereBorder(transmittanceTexture, cosViewZenithAngle, altitude);
 }
 
 // Assumes that the endpoint of view ray doesn't intentionally exit atmosphere.
-vec4 transmittance(const float cosViewZenithAngle, const float altitude, const float dist,
-                   const bool viewRayIntersectsGround)
+vec4 transmittance(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude,
+                   const float dist, const bool viewRayIntersectsGround)
 {
     CONST float r=earthRadius+altitude;
     // Clamping only guards against rounding errors here, we don't try to handle view ray endpoint
@@ -48,17 +61,82 @@ vec4 transmittance(const float cosViewZenithAngle, const float altitude, const f
     vec4 depth;
     if(viewRayIntersectsGround)
     {
-        depth=opticalDepthToAtmosphereBorder(-cosViewZenithAngleAtDist, altAtDist) -
-              opticalDepthToAtmosphereBorder(-cosViewZenithAngle, altitude);
+        depth=opticalDepthToAtmosphereBorder(transmittanceTex, -cosViewZenithAngleAtDist, altAtDist) -
+              opticalDepthToAtmosphereBorder(transmittanceTex, -cosViewZenithAngle, altitude);
     }
     else
     {
-        depth=opticalDepthToAtmosphereBorder(cosViewZenithAngle, altitude) -
-              opticalDepthToAtmosphereBorder(cosViewZenithAngleAtDist, altAtDist);
+        depth=opticalDepthToAtmosphereBorder(transmittanceTex, cosViewZenithAngle, altitude) -
+              opticalDepthToAtmosphereBorder(transmittanceTex, cosViewZenithAngleAtDist, altAtDist);
     }
     return exp(-depth);
 }
 
+vec4 transmittance(const float cosViewZenithAngle, const float altitude, const float dist,
+                   const bool viewRayIntersectsGround)
+{
+    return transmittance(transmittanceTexture, cosViewZenithAngle, altitude, dist, viewRayIntersectsGround);
+}
+
+// The functions below compute zero-order scattering. The values that depend on the wavelength set are passed as
+// arguments, so that the same code renders a single wavelength set and, through the versions taking the textures, all
+// of them at once.
+
+// Radiation scattered by the ground towards the camera
+vec4 groundRadiance(const vec4 transmittanceToGround, const vec4 groundIrradiance, const vec4 groundAlbedo,
+                    const vec4 solarIrradianceFixup, const float lightPollutionGroundLuminance,
+                    const vec4 lightPollutionRelativeRadiance)
+{
+    CONST float groundBRDF = 1/PI; // Assuming Lambertian BRDF, which is constant
+    return transmittanceToGround*groundAlbedo*groundIrradiance*solarIrradianceFixup*groundBRDF
+         + lightPollutionGroundLuminance*lightPollutionRelativeRadiance;
+}
+
+// XXX: keep in sync with the same code in computeScatteringDensity(), but don't forget about
+//      the difference in the usage of viewDir vs incDir.
+vec4 groundRadiance(const sampler2D transmittanceTex, const sampler2D irradianceTex,
+                    const float cosViewZenithAngle, const float altitude, const float distToGround,
+                    const float cosSunZenithAngleAtGround, const vec4 groundAlbedo, const vec4 solarIrradianceFixup,
+                    const float lightPollutionGroundLuminance, const vec4 lightPollutionRelativeRadiance)
+{
+    CONST vec4 transmittanceToGround=transmittance(transmittanceTex, cosViewZenithAngle, altitude, distToGround, true);
+    CONST vec4 groundIrradiance = irradiance(irradianceTex, cosSunZenithAngleAtGround, 0);
+    return groundRadiance(transmittanceToGround, groundIrradiance, groundAlbedo, solarIrradianceFixup,
+                          lightPollutionGroundLuminance, lightPollutionRelativeRadiance);
+}
+
+vec4 groundRadiance(const float cosViewZenithAngle, const float altitude, const float distToGround,
+                    const float cosSunZenithAngleAtGround, const vec4 groundAlbedo, const vec4 solarIrradianceFixup,
+                    const float lightPollutionGroundLuminance, const vec4 lightPollutionRelativeRadiance)
+{
+    return groundRadiance(transmittanceTexture, irradianceTexture, cosViewZenithAngle, altitude, distToGround,
+                          cosSunZenithAngleAtGround, groundAlbedo, solarIrradianceFixup,
+                          lightPollutionGroundLuminance, lightPollutionRelativeRadiance);
+}
+
+// Radiance of the solar disk outside the atmosphere
+vec4 solarRadiance(const vec4 solarIrradianceAtTOA, const vec4 solarIrradianceFixup)
+{
+    return solarIrradianceAtTOA*solarIrradianceFixup/(PI*sqr(sunAngularRadius));
+}
+
+// Radiance of the solar disk as seen from the camera
+vec4 sunRadiance(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude,
+                 const bool lookingIntoAtmosphere, const vec4 solarIrradianceAtTOA, const vec4 solarIrradianceFixup)
+{
+    if(lookingIntoAtmosphere)
+        return transmittanceToAtmosphereBorder(transmittanceTex, cosViewZenithAngle, altitude)*
+                    solarRadiance(solarIrradianceAtTOA, solarIrradianceFixup);
+    return solarRadiance(solarIrradianceAtTOA, solarIrradianceFixup);
+}
+
+vec4 sunRadiance(const float cosViewZenithAngle, const float altitude, const bool lookingIntoAtmosphere,
+                 const vec4 solarIrradianceAtTOA, const vec4 solarIrradianceFixup)
+{
+    return sunRadiance(transmittanceTexture, cosViewZenithAngle, altitude, lookingIntoAtmosphere,
+                       solarIrradianceAtTOA, solarIrradianceFixup);
+}
+
 vec4 calcFirstScattering(const float cosSunZenithAngle, const float cosViewZenithAngle,
                          const float dotViewSun, const float altitude, const bool viewRayIntersectsGround)
 {
@@ -1,9 +1,28 @@
 #ifndef INCLUDE_ONCE_AF5AE9F4_8A9A_4521_838A_F8281B8FEB53
 #define INCLUDE_ONCE_AF5AE9F4_8A9A_4521_838A_F8281B8FEB53
 vec4 transmittanceToAtmosphereBorder(const float cosViewZenithAngle, const float altitude);
+vec4 transmittanceToAtmosphereBorder(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude);
 vec4 transmittance(const float cosViewZenithAngle, const float altitude, const float dist,
                    const bool viewRayIntersectsGround);
+vec4 transmittance(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude,
+                   const float dist, const bool viewRayIntersectsGround);
 vec4 irradiance(const float cosSunZenithAngle, const float altitude);
+vec4 irradiance(const sampler2D irradianceTex, const float cosSunZenithAngle, const float altitude);
+vec4 groundRadiance(const vec4 transmittanceToGround, const vec4 groundIrradiance, const vec4 groundAlbedo,
+                    const vec4 solarIrradianceFixup, const float lightPollutionGroundLuminance,
+                    const vec4 lightPollutionRelativeRadiance);
+vec4 groundRadiance(const sampler2D transmittanceTex, const sampler2D irradianceTex,
+                    const float cosViewZenithAngle, const float altitude, const float distToGround,
+                    const float cosSunZenithAngleAtGround, const vec4 groundAlbedo, const vec4 solarIrradianceFixup,
+                    const float lightPollutionGroundLuminance, const vec4 lightPollutionRelativeRadiance);
+vec4 groundRadiance(const float cosViewZenithAngle, const float altitude, const float distToGround,
+                    const float cosSunZenithAngleAtGround, const vec4 groundAlbedo, const vec4 solarIrradianceFixup,
+                    const float lightPollutionGroundLuminance, const vec4 lightPollutionRelativeRadiance);
+vec4 solarRadiance(const vec4 solarIrradianceAtTOA, const vec4 solarIrradianceFixup);
+vec4 sunRadiance(const sampler2D transmittanceTex, const float cosViewZenithAngle, const float altitude,
+                 const bool lookingIntoAtmosphere, const vec4 solarIrradianceAtTOA, const vec4 solarIrradianceFixup);
+vec4 sunRadiance(const float cosViewZenithAngle, const float altitude, const bool lookingIntoAtmosphere,
+                 const vec4 solarIrradianceAtTOA, const vec4 solarIrradianceFixup);
 vec4 scattering(const float cosSunZenithAngle, const float cosViewZenithAngle,
                 const float dotViewSun, const float altitude, const bool viewRayIntersectsGround,
                 const int scatteringOrder);
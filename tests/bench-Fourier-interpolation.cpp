@@ -0,0 +1,91 @@
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <iostream>
+#include "../common/fourier-interpolation.hpp"
+
+// Compares the throughput of Fourier interpolation with a fresh FFT object for every row of every channel, as it used
+// to be done, to that of a reused FourierInterpolator processing all the rows and channels in one call
+
+// The way the rows used to be interpolated, kept here as the baseline
+void interpolateWithFreshFFT(float const*const points, const std::size_t inPointCount,
+                             std::complex<float>*const intermediate /* must fit interpolationPointCount elements */,
+                             float*const interpolated, std::size_t const interpolationPointCount)
+{
+    Eigen::FFT<float> fft;
+    fft.fwd(intermediate, points, inPointCount);
+    const auto numPreservedElems = inPointCount%2 ? (inPointCount+1)/2 : inPointCount/2+1;
+    std::fill_n(intermediate+numPreservedElems, interpolationPointCount-numPreservedElems, 0);
+    if(inPointCount%2 == 0)
+        intermediate[inPointCount/2] /= 2;
+    fft.inv(interpolated, intermediate, interpolationPointCount);
+    for(std::size_t i=0; i<interpolationPointCount; ++i)
+        interpolated[i] *= float(interpolationPointCount)/inPointCount;
+}
+
+template<typename Interpolate>
+double rowsPerSecond(Interpolate interpolate, const unsigned rowCount)
+{
+    using Clock=std::chrono::steady_clock;
+    unsigned calls=0;
+    const auto timeBegin=Clock::now();
+    auto timeEnd=timeBegin;
+    // Repeat until enough time is accumulated to make the clock resolution irrelevant
+    do
+    {
+        for(int i=0; i<4; ++i, ++calls)
+            interpolate();
+        timeEnd=Clock::now();
+    } while(timeEnd-timeBegin < std::chrono::milliseconds(200));
+    return double(calls)*rowCount/std::chrono::duration<double>(timeEnd-timeBegin).count();
+}
+
+int main()
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> value(-20,0);
+    constexpr unsigned channelCount=4;
+    constexpr unsigned rowCount=128; // like the number of texels by view elevation
+
+    std::cout << std::setw(6) << "in" << std::setw(6) << "out" << std::setw(18) << "per row, rows/s"
+              << std::setw(18) << "batched, rows/s" << std::setw(10) << "speedup" << "\n";
+    for(const auto& [inPointCount, outPointCount] : {std::pair{10u, 64u}, {16u, 128u}, {30u, 128u}, {31u, 255u},
+                                                     {64u, 512u}})
+    {
+        std::vector<float> input[channelCount];
+        float const* channels[channelCount];
+        for(unsigned c=0; c<channelCount; ++c)
+        {
+            input[c].resize(rowCount*inPointCount);
+            for(auto& v : input[c])
+                v=value(gen);
+            channels[c]=input[c].data();
+        }
+        std::vector<float> output(rowCount*outPointCount*channelCount);
+
+        std::vector<float> row(outPointCount);
+        std::vector<std::complex<float>> intermediate(outPointCount);
+        const auto perRow=rowsPerSecond([&]
+            {
+                for(unsigned r=0; r<rowCount; ++r)
+                {
+                    for(unsigned c=0; c<channelCount; ++c)
+                    {
+                        interpolateWithFreshFFT(channels[c]+r*inPointCount, inPointCount, intermediate.data(),
+                                                row.data(), outPointCount);
+                        for(unsigned k=0; k<outPointCount; ++k)
+                            output[(r*outPointCount+k)*channelCount+c]=row[k];
+                    }
+                }
+            }, rowCount);
+
+        FourierInterpolator interpolator(inPointCount, outPointCount);
+        const auto batched=rowsPerSecond([&]
+            {
+                interpolator.interpolate(channels, channelCount, rowCount, output.data());
+            }, rowCount);
+
+        std::cout << std::setw(6) << inPointCount << std::setw(6) << outPointCount << std::setw(18) << std::lround(perRow)
+                  << std::setw(18) << std::lround(batched) << std::setw(10) << batched/perRow << "\n";
+    }
+}
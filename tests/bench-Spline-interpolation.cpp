@@ -0,0 +1,51 @@
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <iostream>
+#include "../common/spline-interpolation.hpp"
+
+// Compares the speed of the banded solver for the spline coefficients with that of the dense one it replaced
+
+struct Point
+{
+    float x, y;
+};
+
+template<typename Interpolate>
+double secondsPerCall(Interpolate interpolate, std::vector<Point> const& points)
+{
+    using Clock=std::chrono::steady_clock;
+    volatile float sink=0;
+    unsigned calls=0;
+    const auto timeBegin=Clock::now();
+    auto timeEnd=timeBegin;
+    // Repeat until enough time is accumulated to make the clock resolution irrelevant
+    do
+    {
+        for(int i=0; i<16; ++i, ++calls)
+            sink=sink+interpolate(points.data(), points.size()).sample(points[calls%points.size()].x);
+        timeEnd=Clock::now();
+    } while(timeEnd-timeBegin < std::chrono::milliseconds(200));
+    return std::chrono::duration<double>(timeEnd-timeBegin).count()/calls;
+}
+
+int main()
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> jitter(-0.3,0.3);
+    std::uniform_real_distribution<float> value(-20,0);
+
+    std::cout << std::setw(6) << "points" << std::setw(14) << "dense, us" << std::setw(14) << "banded, us"
+              << std::setw(10) << "speedup" << "\n";
+    for(const unsigned pointCount : {4u, 8u, 16u, 32u, 64u, 128u, 256u})
+    {
+        std::vector<Point> points(pointCount);
+        for(unsigned k=0; k<pointCount; ++k)
+            points[k]={-1.5f+3*(k+jitter(gen))/pointCount, value(gen)};
+
+        const auto dense=secondsPerCall([](auto... args){ return splineInterpolationOrder2Dense(args...); }, points);
+        const auto banded=secondsPerCall([](auto... args){ return splineInterpolationOrder2(args...); }, points);
+        std::cout << std::setw(6) << pointCount << std::setw(14) << dense*1e6 << std::setw(14) << banded*1e6
+                  << std::setw(10) << dense/banded << "\n";
+    }
+}
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <iostream>
+#include "../common/spline-interpolation.hpp"
+
+// Compares sampling of a spline at sorted abscissas point by point with batched sampling
+
+struct Point
+{
+    float x, y;
+};
+
+template<typename Sample>
+double nanosecondsPerSample(Sample sample, const std::size_t sampleCount)
+{
+    using Clock=std::chrono::steady_clock;
+    unsigned calls=0;
+    const auto timeBegin=Clock::now();
+    auto timeEnd=timeBegin;
+    // Repeat until enough time is accumulated to make the clock resolution irrelevant
+    do
+    {
+        for(int i=0; i<16; ++i, ++calls)
+            sample();
+        timeEnd=Clock::now();
+    } while(timeEnd-timeBegin < std::chrono::milliseconds(200));
+    return std::chrono::duration<double,std::nano>(timeEnd-timeBegin).count()/calls/sampleCount;
+}
+
+int main()
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> jitter(-0.3,0.3);
+    std::uniform_real_distribution<float> value(-20,0);
+    constexpr unsigned sampleCount=1024; // like the number of texels by view elevation
+
+    std::cout << std::setw(6) << "points" << std::setw(16) << "single, ns" << std::setw(16) << "batched, ns"
+              << std::setw(10) << "speedup" << "\n";
+    for(const unsigned pointCount : {8u, 16u, 32u, 64u, 128u, 256u})
+    {
+        std::vector<Point> points(pointCount);
+        for(unsigned k=0; k<pointCount; ++k)
+            points[k]={-1.5f+3*(k+jitter(gen))/pointCount, value(gen)};
+        const auto spline=splineInterpolationOrder2(points.data(), points.size());
+
+        std::vector<float> xs(sampleCount), out(sampleCount);
+        for(unsigned k=0; k<sampleCount; ++k)
+            xs[k]=points.front().x + (points.back().x-points.front().x)*k/sampleCount;
+
+        volatile float sink=0;
+        const auto single=nanosecondsPerSample([&]
+            {
+                for(unsigned k=0; k<sampleCount; ++k)
+                    out[k]=spline.sample(xs[k]);
+                sink=sink+out[sampleCount/2];
+            }, sampleCount);
+        const auto batched=nanosecondsPerSample([&]
+            {
+                spline.sampleSorted(xs.data(), xs.size(), out.data());
+                sink=sink+out[sampleCount/2];
+            }, sampleCount);
+        std::cout << std::setw(6) << pointCount << std::setw(16) << single << std::setw(16) << batched
+                  << std::setw(10) << single/batched << "\n";
+    }
+}
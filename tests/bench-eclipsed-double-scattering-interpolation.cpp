@@ -0,0 +1,85 @@
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <array>
+#include <memory>
+#include <iomanip>
+#include <iostream>
+#include "../common/EclipsedDoubleScatteringInterpolator.hpp"
+#include "../common/parallel.hpp"
+
+// Measures the time of generation of the eclipsed double scattering texture slices from the coarse grid samples, like
+// the renderer does on loading of a pair of altitude slices, on one thread and on all the hardware threads
+
+template<typename Generate>
+double millisecondsPerCall(Generate generate)
+{
+    using Clock=std::chrono::steady_clock;
+    unsigned calls=0;
+    const auto timeBegin=Clock::now();
+    auto timeEnd=timeBegin;
+    // Repeat until enough time is accumulated to make the clock resolution irrelevant
+    do
+    {
+        generate();
+        ++calls;
+        timeEnd=Clock::now();
+    } while(timeEnd-timeBegin < std::chrono::milliseconds(500));
+    return std::chrono::duration<double,std::milli>(timeEnd-timeBegin).count()/calls;
+}
+
+int main()
+{
+    EclipsedDoubleScatteringInterpolationParameters params;
+    params.earthRadius=6371e3;
+    params.atmosphereHeight=120e3;
+    params.lengthOfHorizRayFromGroundToBorderOfAtmo=std::sqrt(std::pow(params.earthRadius+params.atmosphereHeight, 2.f) -
+                                                              std::pow(params.earthRadius, 2.f));
+    constexpr int texSizeBySZA=16;
+    constexpr int sliceCount=2*texSizeBySZA; // two altitude slices
+
+    std::cout << std::setw(10) << "azimuths" << std::setw(8) << "VZAs" << std::setw(12) << "az. pairs"
+              << std::setw(12) << "elev. pairs" << std::setw(14) << "1 thread, ms" << std::setw(16) << "parallel, ms"
+              << std::setw(10) << "speedup" << "\n";
+    for(const auto [texSizeByViewAzimuth, texSizeByViewElevation, azimuthPairs, elevationPairs] :
+            {std::array<unsigned,4>{16, 128, 2, 10}, {32, 256, 4, 10}, {64, 512, 8, 20}})
+    {
+        params.texSizeByViewAzimuth=texSizeByViewAzimuth;
+        params.texSizeByViewElevation=texSizeByViewElevation;
+        params.numberOfAzimuthPairsToSample=azimuthPairs;
+        params.numberOfElevationPairsToSample=elevationPairs;
+
+        EclipsedDoubleScatteringInterpolator interpolator(params);
+        std::mt19937 gen(1);
+        std::uniform_real_distribution<float> value(1e-6, 1e-3);
+        const auto samplesPerSlice=interpolator.coarseGridSampleCount();
+        std::vector<glm::vec4> samples(samplesPerSlice*sliceCount);
+        for(auto& s : samples)
+            s=glm::vec4(value(gen), value(gen), value(gen), value(gen));
+        const auto sliceAltitude=[&](const int n) { return 1 + 100e3f*n/sliceCount; };
+
+        std::vector<glm::vec4> texture(interpolator.textureSliceSize()*sliceCount);
+        const auto generateSlice=[&](EclipsedDoubleScatteringInterpolator& interpolator, const int n)
+        {
+            interpolator.loadCoarseGridSamples(sliceAltitude(n), &samples[n*samplesPerSlice], samplesPerSlice);
+            interpolator.generateTextureSlice(sliceAltitude(n), &texture[n*interpolator.textureSliceSize()]);
+        };
+
+        const auto sequential=millisecondsPerCall([&]
+            {
+                for(int n=0; n<sliceCount; ++n)
+                    generateSlice(interpolator, n);
+            });
+        std::vector<std::unique_ptr<EclipsedDoubleScatteringInterpolator>> interpolators;
+        for(int n=0; n<parallelWorkerCount(sliceCount); ++n)
+            interpolators.emplace_back(std::make_unique<EclipsedDoubleScatteringInterpolator>(params));
+        const auto parallel=millisecondsPerCall([&]
+            {
+                forEachInParallel(sliceCount, [&](const int n, const int worker)
+                                  { generateSlice(*interpolators[worker], n); });
+            });
+        std::cout << std::setw(10) << texSizeByViewAzimuth << std::setw(8) << texSizeByViewElevation
+                  << std::setw(12) << azimuthPairs << std::setw(12) << elevationPairs
+                  << std::setw(14) << sequential << std::setw(16) << parallel << std::setw(10) << sequential/parallel << "\n";
+    }
+}
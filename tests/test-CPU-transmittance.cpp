@@ -0,0 +1,102 @@
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include "../CalcMySky/cpu-transmittance.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+constexpr double earthRadius=6.371e6;
+constexpr double atmosphereHeight=120e3;
+constexpr double crossSection=1e-30;
+
+CPUTransmittanceParameters makeParameters()
+{
+    CPUTransmittanceParameters params;
+    params.earthRadius=earthRadius;
+    params.atmosphereHeight=atmosphereHeight;
+    params.sunAngularRadius=0.00459925;
+    params.transmittanceTexW=64;
+    params.transmittanceTexH=128;
+    params.irradianceTexW=32;
+    params.irradianceTexH=16;
+    params.numTransmittanceIntegrationPoints=500;
+    return params;
+}
+
+double relativeError(const double actual, const double expected)
+{
+    return std::abs(actual-expected)/std::abs(expected);
+}
+
+// The leftmost column of the transmittance texture corresponds to looking into zenith, the bottom row to
+// the ground level, and the rightmost texel of the bottom row to the horizontal direction on the ground.
+int main()
+{
+    std::cerr.precision(std::numeric_limits<double>::max_digits10);
+    const auto params=makeParameters();
+    const int W=params.transmittanceTexW, H=params.transmittanceTexH;
+    const glm::vec4 crossSections(crossSection, 2*crossSection, 3*crossSection, 4*crossSection);
+
+    {
+        // For constant density the midpoint rule is exact, so the optical depth is density times path length
+        constexpr double density=1e25;
+        const auto texture=computeTransmittanceOnCPU(params, {{[](float){ return float(density); }, crossSections}});
+        if(texture.size()!=size_t(W)*H)
+            FAIL("transmittance texture has wrong size " << texture.size());
+
+        const double zenithDepth=texture[0][0];
+        const double expectedZenithDepth=density*atmosphereHeight*crossSection;
+        if(relativeError(zenithDepth, expectedZenithDepth) > 1e-5)
+            FAIL("optical depth to zenith: expected " << expectedZenithDepth << ", actual " << zenithDepth);
+
+        const double horizonDepth=texture[W-1][0];
+        const double expectedHorizonDepth=density*std::sqrt(atmosphereHeight*(atmosphereHeight+2*earthRadius))*crossSection;
+        if(relativeError(horizonDepth, expectedHorizonDepth) > 1e-5)
+            FAIL("optical depth to horizon: expected " << expectedHorizonDepth << ", actual " << horizonDepth);
+
+        for(int i=0; i<4; ++i)
+        {
+            if(relativeError(texture[W/2][i], (i+1)*texture[W/2][0]) > 1e-6)
+                FAIL("optical depth isn't proportional to cross section: " << texture[W/2][i] << " vs " << texture[W/2][0]);
+        }
+    }
+
+    {
+        // Exponential profile has analytic optical depth for vertical paths
+        constexpr double density0=1e25, scaleHeight=8e3;
+        const auto texture=computeTransmittanceOnCPU(params, {{[](const float alt){ return float(density0*std::exp(-alt/scaleHeight)); },
+                                                               crossSections}});
+        const double expectedZenithDepth=crossSection*density0*scaleHeight*(1-std::exp(-atmosphereHeight/scaleHeight));
+        const double zenithDepth=texture[0][0];
+        if(relativeError(zenithDepth, expectedZenithDepth) > 1e-4)
+            FAIL("optical depth to zenith for exponential profile: expected " << expectedZenithDepth << ", actual " << zenithDepth);
+
+        // Rows are sampled uniformly in distance to horizon
+        for(const int row : {H/4, H/2, H-1})
+        {
+            const double distToHorizon=std::sqrt(atmosphereHeight*(atmosphereHeight+2*earthRadius))*row/(H-1);
+            const double altitude=std::sqrt(distToHorizon*distToHorizon+earthRadius*earthRadius)-earthRadius;
+            const double expected=crossSection*density0*scaleHeight*(std::exp(-altitude/scaleHeight)-
+                                                                     std::exp(-atmosphereHeight/scaleHeight));
+            const double actual=texture[row*W][0];
+            if(std::abs(actual-expected) > 1e-4*expectedZenithDepth)
+                FAIL("optical depth to zenith from altitude " << altitude << ": expected " << expected << ", actual " << actual);
+        }
+
+        const glm::vec4 solarIrradiance(1.5, 1.6, 1.7, 1.8);
+        const auto irradiance=computeDirectGroundIrradianceOnCPU(params, texture, solarIrradiance);
+        if(irradiance.size()!=size_t(params.irradianceTexW)*params.irradianceTexH)
+            FAIL("irradiance texture has wrong size " << irradiance.size());
+        // Sun in zenith, ground level
+        const auto zenithIrradiance=irradiance[params.irradianceTexW-1];
+        for(int i=0; i<4; ++i)
+        {
+            const double expected=solarIrradiance[i]*std::exp(-texture[0][i]);
+            if(relativeError(zenithIrradiance[i], expected) > 1e-5)
+                FAIL("irradiance from zenith Sun at component " << i << ": expected " << expected << ", actual " << zenithIrradiance[i]);
+        }
+        // Sun in nadir
+        if(irradiance[0]!=glm::vec4(0))
+            FAIL("irradiance from the Sun below horizon isn't zero");
+    }
+}
@@ -1,4 +1,6 @@
+#include <cmath>
 #include <limits>
+#include <complex>
 #include <iostream>
 #include "../common/fourier-interpolation.hpp"
 
@@ -48,8 +50,7 @@ int testIdentityTransformation(const bool oddInputSize)
         input.pop_back();
 
     std::vector<float> interpolated(input.size());
-    std::vector<std::complex<float>> intermediate(interpolated.size());
-    fourierInterpolate(input.data(), input.size(), intermediate.data(), interpolated.data(), interpolated.size());
+    fourierInterpolate(input.data(), input.size(), interpolated.data(), interpolated.size());
 
     for(unsigned k=0; k<input.size(); ++k)
     {
@@ -69,8 +70,7 @@ int testIntegralUpsampling(const bool oddInputSize)
 
     const auto scale=3;
     std::vector<float> interpolated(scale*input.size());
-    std::vector<std::complex<float>> intermediate(interpolated.size());
-    fourierInterpolate(input.data(), input.size(), intermediate.data(), interpolated.data(), interpolated.size());
+    fourierInterpolate(input.data(), input.size(), interpolated.data(), interpolated.size());
     for(unsigned inputIndex=0; inputIndex<input.size(); ++inputIndex)
     {
         const auto outputIndex = scale*inputIndex;
@@ -96,12 +96,10 @@ int testFractionalUpsampling(const bool oddInputSize)
         FAIL("output sizes chosen are not one multiple of another: small " << smallSize << ", large " << largeSize);
 
     std::vector<float> interpolatedSmall(smallSize);
-    std::vector<std::complex<float>> intermediate(interpolatedSmall.size());
-    fourierInterpolate(input.data(), input.size(), intermediate.data(), interpolatedSmall.data(), interpolatedSmall.size());
+    fourierInterpolate(input.data(), input.size(), interpolatedSmall.data(), interpolatedSmall.size());
 
     std::vector<float> interpolatedLarge(largeSize);
-    intermediate.resize(interpolatedLarge.size());
-    fourierInterpolate(input.data(), input.size(), intermediate.data(), interpolatedLarge.data(), interpolatedLarge.size());
+    fourierInterpolate(input.data(), input.size(), interpolatedLarge.data(), interpolatedLarge.size());
 
     // 1. interpolatedLarge must repeat each scaleInputToLarge element of input
     for(unsigned inputIndex=0; inputIndex<input.size(); ++inputIndex)
@@ -126,6 +124,97 @@ int testFractionalUpsampling(const bool oddInputSize)
     return 0;
 }
 
+int testBatchedInterpolation(const bool oddInputSize)
+{
+    if(int(oddInputSize) != input.size()%2)
+        input.pop_back();
+
+    // Split the input into rows of several channels and check that the interleaved output of the batched call matches
+    // interpolation of each row separately
+    constexpr unsigned channelCount=4, rowCount=3;
+    unsigned inPointCount = input.size()/(channelCount*rowCount);
+    if(inPointCount%2 != unsigned(oddInputSize))
+        --inPointCount;
+    const unsigned outPointCount = 5*inPointCount+2;
+    float const* channels[channelCount];
+    for(unsigned c=0; c<channelCount; ++c)
+        channels[c] = input.data() + c*rowCount*inPointCount;
+
+    FourierInterpolator interpolator(inPointCount, outPointCount);
+    std::vector<float> interpolated(rowCount*outPointCount*channelCount);
+    interpolator.interpolate(channels, channelCount, rowCount, interpolated.data());
+
+    std::vector<float> reference(outPointCount);
+    for(unsigned r=0; r<rowCount; ++r)
+    {
+        for(unsigned c=0; c<channelCount; ++c)
+        {
+            fourierInterpolate(channels[c]+r*inPointCount, inPointCount, reference.data(), reference.size());
+            for(unsigned k=0; k<outPointCount; ++k)
+            {
+                const auto diff = interpolated[(r*outPointCount+k)*channelCount+c]-reference[k];
+                if(std::abs(diff) > interpolationAbsoluteTolerance)
+                    FAIL("batched output at point " << k << " of row " << r << " in channel " << c << " differs from "
+                         "that of single-row interpolation by " << diff << ", which is more than "
+                         << interpolationAbsoluteTolerance << "\n");
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Evaluates the trigonometric polynomial through the input points directly from the definition of the DFT, in double
+// precision, at the points of a grid of outPointCount points over the period
+std::vector<double> directDFTInterpolation(std::vector<float> const& points, const unsigned outPointCount)
+{
+    const int N=points.size();
+    std::vector<std::complex<double>> spectrum(N);
+    for(int k=0; k<N; ++k)
+        for(int j=0; j<N; ++j)
+            spectrum[k] += double(points[j])*std::polar(1., -2*M_PI*k*j/N);
+
+    // Harmonics from -N/2 to N/2, with the Nyquist one (for even N) split between the two ends
+    std::vector<double> result(outPointCount);
+    for(unsigned n=0; n<outPointCount; ++n)
+    {
+        const double x=double(n)/outPointCount;
+        std::complex<double> sum=0;
+        for(int k=-N/2; k<=N/2; ++k)
+        {
+            const double weight = N%2==0 && std::abs(k)==N/2 ? 0.5 : 1;
+            sum += weight*spectrum[(k+N)%N]*std::polar(1., 2*M_PI*k*x);
+        }
+        result[n]=sum.real()/N;
+    }
+    return result;
+}
+
+int testDirectDFTReference(const bool oddInputSize)
+{
+    if(int(oddInputSize) != input.size()%2)
+        input.pop_back();
+
+    // Output sizes for which the interpolator uses the FFT (multiples of 4) and the precomputed matrix (the others)
+    for(const unsigned outPointCount : {unsigned(input.size()), unsigned(input.size()+1), unsigned(input.size()+3),
+                                        unsigned(2*input.size()), unsigned(4*input.size()), unsigned(5*input.size()+2)})
+    {
+        const auto reference=directDFTInterpolation(input, outPointCount);
+        std::vector<float> interpolated(outPointCount);
+        FourierInterpolator interpolator(input.size(), outPointCount);
+        interpolator.interpolate(input.data(), interpolated.data());
+        for(unsigned k=0; k<outPointCount; ++k)
+        {
+            const auto diff = interpolated[k]-reference[k];
+            if(std::abs(diff) > interpolationAbsoluteTolerance)
+                FAIL("output value at index " << k << " of " << outPointCount << " differs from direct DFT "
+                     "evaluation by " << diff << ", which is more than " << interpolationAbsoluteTolerance << "\n");
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     std::cerr.precision(std::numeric_limits<float>::max_digits10);
@@ -150,6 +239,10 @@ int main(int argc, char** argv)
         return testIntegralUpsampling(odd);
     if(arg=="fractional upsampling")
         return testFractionalUpsampling(odd);
+    if(arg=="batched interpolation")
+        return testBatchedInterpolation(odd);
+    if(arg=="direct DFT reference")
+        return testDirectDFTReference(odd);
 
     std::cerr << "Unknown test " << arg << "\n";
     return 1;
@@ -0,0 +1,223 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include "../common/GLSLSnippet.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+using Type=GLSLSnippet::Type;
+
+constexpr double PI=3.1415926535897932;
+constexpr double km=1000;
+
+const GLSLSnippet::Constants constants{
+    {"PI", {Type::Float, glm::vec4(PI)}},
+    {"km", {Type::Float, glm::vec4(km)}},
+    {"dobsonUnit", {Type::Float, glm::vec4(2.687e20)}},
+    {"wavelengths", {Type::Vec4, glm::vec4(400,500,600,700)}},
+    {"numTransmittanceIntegrationPoints", {Type::Int, glm::vec4(7)}},
+    {"earthCenter", {Type::Unsupported, {}}},
+};
+
+double relativeError(const double actual, const double expected)
+{
+    return expected==0 ? std::abs(actual) : std::abs(actual-expected)/std::abs(expected);
+}
+
+std::ostream& operator<<(std::ostream& os, glm::vec4 const& v)
+{
+    return os << "(" << v[0] << ", " << v[1] << ", " << v[2] << ", " << v[3] << ")";
+}
+
+template<typename Reference>
+int checkSnippet(const char* body, const Type returnType, const char* argumentName,
+                 std::initializer_list<float> arguments, Reference const& reference)
+{
+    try
+    {
+        const GLSLSnippet snippet(body, returnType, argumentName, constants);
+        for(const float arg : arguments)
+        {
+            const glm::vec4 expected=reference(arg), actual=snippet.evaluate(arg);
+            for(int i=0; i<4; ++i)
+            {
+                // Evaluation is done in single precision, like in GLSL
+                if(relativeError(actual[i], expected[i]) > 3e-5)
+                    FAIL("snippet\n" << body << "\nat " << arg << ": expected " << expected << ", actual " << actual);
+            }
+        }
+    }
+    catch(GLSLSnippet::Error const& error)
+    {
+        FAIL("snippet\n" << body << "\nfailed to compile at line " << error.lineNumber << ": " << error.message);
+    }
+    return 0;
+}
+
+int checkError(const char* body, const Type returnType, const int expectedLine, const bool expectUnsupported,
+               const char* expectedMessage=nullptr)
+{
+    try
+    {
+        GLSLSnippet(body, returnType, "altitude", constants);
+    }
+    catch(GLSLSnippet::Error const& error)
+    {
+        if(error.unsupported!=expectUnsupported)
+        {
+            FAIL("snippet\n" << body << "\nwas expected to be " << (expectUnsupported ? "unsupported" : "erroneous")
+                 << ", but got: " << error.message);
+        }
+        if(error.lineNumber!=expectedLine)
+        {
+            FAIL("snippet\n" << body << "\nerror \"" << error.message << "\" was expected at line " << expectedLine
+                 << ", but was reported at line " << error.lineNumber);
+        }
+        if(expectedMessage && error.message!=expectedMessage)
+            FAIL("snippet\n" << body << "\nerror message is \"" << error.message << "\" instead of \"" << expectedMessage << "\"");
+        return 0;
+    }
+    FAIL("snippet\n" << body << "\nwas expected to fail compilation");
+}
+
+int main()
+{
+    std::cerr.precision(std::numeric_limits<float>::max_digits10);
+
+    // Bodies from the example atmosphere descriptions
+    if(checkSnippet(R"(
+        CONST float rayleighScaleHeight=8*km;
+        return 3.08458e25*exp(-1/rayleighScaleHeight * altitude);
+        )", Type::Float, "altitude", {0, 1234.5, 50e3, 120e3},
+        [](double alt){ return glm::vec4(3.08458e25*std::exp(-alt/(8*km))); })) return 1;
+
+    if(checkSnippet(R"(
+        return vec4(3./(16*PI)*(1+sqr(dotViewSun)));
+        )", Type::Vec4, "dotViewSun", {-1, -0.3, 0, 0.7, 1},
+        [](double mu){ return glm::vec4(3/(16*PI)*(1+mu*mu)); })) return 1;
+
+    if(checkSnippet(R"(
+        CONST float g=0.76;
+        CONST float g2=g*g;
+        CONST float k = 3/(8*PI)*(1-g2)/(2+g2);
+        return vec4(k * (1+sqr(dotViewSun)) / pow(1+g2 - 2*g*dotViewSun, 1.5) + 1/((1-dotViewSun)*600+0.05))*0.904;
+        )", Type::Vec4, "dotViewSun", {-1, -0.3, 0, 0.7, 1},
+        [](double mu)
+        {
+            const double g=0.76, g2=g*g, k=3/(8*PI)*(1-g2)/(2+g2);
+            return glm::vec4((k*(1+mu*mu)/std::pow(1+g2-2*g*mu, 1.5) + 1/((1-mu)*600+0.05))*0.904);
+        })) return 1;
+
+    if(checkSnippet(R"(
+        CONST float totalOzoneAmount=370*dobsonUnit;
+
+        float density;
+
+        // A fit to AFGL atmospheric constituent profile. U.S. standard atmosphere 1976. (AFGL-TR-86-0110)
+        if(altitude < 8*km)
+            density = 7.2402403521159135e-6 - 1.206527437798165e-7/km * altitude;
+        else if(altitude < 21.5*km)
+            density = -0.000020590185333577628 + 3.3581504669318765e-6/km * altitude;
+        else if(altitude < 39*km)
+            density = 0.00010542813563268143 - 2.50316678731273e-6/km * altitude;
+        else
+            density = 0.04298160111157969 * exp(-0.2208669270720561/km * altitude);
+
+        density *= totalOzoneAmount;
+
+        return density;
+        )", Type::Float, "altitude", {0, 5e3, 15e3, 30e3, 60e3},
+        [](double alt)
+        {
+            double density;
+            if(alt < 8*km)
+                density = 7.2402403521159135e-6 - 1.206527437798165e-7/km * alt;
+            else if(alt < 21.5*km)
+                density = -0.000020590185333577628 + 3.3581504669318765e-6/km * alt;
+            else if(alt < 39*km)
+                density = 0.00010542813563268143 - 2.50316678731273e-6/km * alt;
+            else
+                density = 0.04298160111157969 * std::exp(-0.2208669270720561/km * alt);
+            return glm::vec4(density*370*2.687e20);
+        })) return 1;
+
+    if(checkSnippet(R"(
+        CONST vec4 g = 0.64 + 0.23*exp(-0.00002378121*sqr(wavelengths-310)); // a fit to data between 360 and 830 nm
+        CONST vec4 g2=g*g;
+        return vec4((1-g2) / pow(1 + g2 - 2*g*dotViewSun, vec4(1.5)) / (4*PI));
+        )", Type::Vec4, "dotViewSun", {-1, 0, 0.9},
+        [](double mu)
+        {
+            glm::vec4 result;
+            const double wavelengths[]={400,500,600,700};
+            for(int i=0; i<4; ++i)
+            {
+                const double g=0.64+0.23*std::exp(-0.00002378121*std::pow(wavelengths[i]-310, 2)), g2=g*g;
+                result[i]=(1-g2)/std::pow(1+g2-2*g*mu, 1.5)/(4*PI);
+            }
+            return result;
+        })) return 1;
+
+    // Other language features
+    if(checkSnippet(R"(
+        /* multi-line
+           comment */
+        int n = numTransmittanceIntegrationPoints / 2; // integer division
+        float x = altitude;
+        x -= 1.5e1;
+        x /= float(n);
+        bool big = x > 2. && !(x >= 100.);
+        {
+            float x = 10; // shadows the outer x
+            if(big) return x;
+        }
+        return big ? 0.f : x < 0 ? -x : clamp(x, 0., 1.) + mix(0.0, 1.0, 0.25) + max(n, 2);
+        )", Type::Float, "altitude", {0, 15, 16.5, 30, 500},
+        [](double alt)
+        {
+            const double x=(alt-15)/3;
+            if(x>2 && !(x>=100)) return glm::vec4(10);
+            return glm::vec4(x<0 ? -x : std::clamp(x,0.,1.)+0.25+3);
+        })) return 1;
+
+    if(checkSnippet(R"(
+        vec4 v = vec4(1, 2, altitude, 4);
+        v.x;
+        v *= 2;
+        if(v == vec4(2,4,6,8)) return vec4(-1);
+        return vec4(v.w, v.b, v.t, smoothstep(0., 10., altitude)) + step(vec4(5), vec4(altitude));
+        )", Type::Vec4, "altitude", {3, 5, 7},
+        [](double alt)
+        {
+            if(alt==3) return glm::vec4(-1);
+            const double t=std::clamp(alt/10, 0., 1.);
+            return glm::vec4(8, 2*alt, 4, t*t*(3-2*t)) + glm::vec4(alt<5 ? 0 : 1);
+        })) return 1;
+
+    if(checkSnippet(R"(
+        if(altitude < 0.) return 1.;
+        )", Type::Float, "altitude", {-1, 1},
+        [](double alt){ return glm::vec4(alt<0 ? 1 : 0); })) return 1;
+
+    // Errors in the snippets
+    if(checkError("\n return x;", Type::Float, 2, false)) return 1;
+    if(checkError("return vec4(altitude);", Type::Float, 1, false)) return 1;
+    if(checkError("float a = 1;\nreturn a < vec4(1) ? 1. : 0.;", Type::Float, 2, false)) return 1;
+    if(checkError("CONST float a = 1;\na = 2;\nreturn a;", Type::Float, 2, false)) return 1;
+    if(checkError("km = 2;", Type::Float, 1, false)) return 1;
+    if(checkError("float a = 1\nreturn a;", Type::Float, 2, false)) return 1;
+    if(checkError("if(altitude) return 1.;", Type::Float, 1, false)) return 1;
+    if(checkError("return pow(1., vec4(2));", Type::Float, 1, false)) return 1;
+    if(checkError("{ return 1.;", Type::Float, 1, false)) return 1;
+
+    // Valid GLSL that isn't supported by the compiler
+    if(checkError("float s = 0;\nfor(int i=0; i<3; ++i) s += altitude;\nreturn s;", Type::Float, 2, true)) return 1;
+    if(checkError("vec3 v = vec3(altitude);\nreturn v.x;", Type::Float, 1, true)) return 1;
+    if(checkError("\n\nreturn scattererNumberDensity_molecules(altitude);", Type::Float, 3, true)) return 1;
+    if(checkError("return earthCenter.z;", Type::Float, 1, true)) return 1;
+    if(checkError("return vec4(altitude).xy.x;", Type::Float, 1, true)) return 1;
+    if(checkError("#define H 8000.\nreturn exp(-altitude/H);", Type::Float, 1, true)) return 1;
+    if(checkError("vec4 v = vec4(1);\nv.x = 5.;\nreturn v;", Type::Vec4, 2, true,
+                  "assignment to 'v.x' is not supported")) return 1;
+}
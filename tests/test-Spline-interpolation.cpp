@@ -1,8 +1,11 @@
+#include <cmath>
+#include <random>
 #include <limits>
 #include <iostream>
 #include "../common/spline-interpolation.hpp"
 
 constexpr double interpolationAbsoluteTolerance=1.2e-10;
+constexpr double oracleRelativeTolerance=1e-9;
 #define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
 
 struct Point
@@ -68,5 +71,53 @@ int main()
                  << interpolationAbsoluteTolerance << "\n");
     }
 
+    {
+        // Batched sampling must give the same results as sampling one by one, up to contraction into FMA
+        std::vector<double> xs, values(reference.size());
+        for(const auto& p : reference)
+            xs.push_back(p.x);
+        interpolated.sampleSorted(xs.data(), xs.size(), values.data());
+        for(unsigned k=0; k<xs.size(); ++k)
+        {
+            if(std::abs(values[k]-interpolated.sample(xs[k])) > 1e-14*std::abs(values[k]))
+                FAIL("batched sample at x=" << xs[k] << " (k=" << k << ") is " << values[k] << " instead of "
+                     << interpolated.sample(xs[k]) << "\n");
+        }
+    }
+
+    /* The fast solver must agree with the dense one on random inputs of various sizes. Abscissas are taken on a jittered
+     * grid, like the elevations of the samples this is used for: when they come too close, the spline overshoots
+     * wildly, and the comparison only shows how ill-conditioned both solvers are.
+     */
+    std::mt19937 gen(4234);
+    std::uniform_real_distribution<double> dist(-5,5);
+    std::uniform_real_distribution<double> jitter(-0.3,0.3);
+    for(const unsigned pointCount : {3u, 4u, 5u, 10u, 33u, 100u, 257u})
+    {
+        for(int trial=0; trial<10; ++trial)
+        {
+            std::vector<Point> points(pointCount);
+            for(unsigned k=0; k<pointCount; ++k)
+                points[k]={-5+10*(k+jitter(gen))/pointCount, dist(gen)};
+
+            const auto fast=splineInterpolationOrder2(points.data(), points.size());
+            const auto dense=splineInterpolationOrder2Dense(points.data(), points.size());
+            double maxDense=0;
+            for(const auto& p : points)
+                maxDense=std::max(maxDense, std::abs(dense.sample(p.x)));
+            constexpr int samplesPerPoint=7;
+            for(unsigned k=0; k<=samplesPerPoint*(pointCount-1); ++k)
+            {
+                const auto x = std::min(points.back().x, points.front().x +
+                                        (points.back().x-points.front().x)*k/(samplesPerPoint*(pointCount-1)));
+                const auto diff = fast.sample(x)-dense.sample(x);
+                if(std::abs(diff) > oracleRelativeTolerance*maxDense)
+                    FAIL("with " << pointCount << " points, sample at x=" << x << " differs from that of the dense "
+                         "solver by " << diff << ", which is more than " << oracleRelativeTolerance << " times the "
+                         "largest value at the points, " << maxDense << "\n");
+            }
+        }
+    }
+
     return 0;
 }
@@ -0,0 +1,108 @@
+#include "../ShowMySky/AltitudeSliceCache.hpp"
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include <QDir>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include "../common/TextureFile.hpp"
+#include "../common/util.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+AltitudeSliceCache::Slice makeSlice(const size_t size, const char value)
+{
+    return std::make_shared<const AltitudeSliceCache::SliceData>(std::vector<char>(size, value));
+}
+
+// Returns false where open files can't be listed
+bool fileIsOpen(QString const& path)
+{
+#ifdef Q_OS_LINUX
+    const auto canonicalPath=QFileInfo(path).canonicalFilePath();
+    const QDir fdDir("/proc/self/fd");
+    for(const auto& fd : fdDir.entryList(QDir::Files|QDir::System))
+        if(QFileInfo(fdDir.filePath(fd)).symLinkTarget()==canonicalPath)
+            return true;
+#else
+    Q_UNUSED(path);
+#endif
+    return false;
+}
+
+int main()
+try
+{
+    {
+        AltitudeSliceCache cache(300);
+        cache.insert("a", 0, makeSlice(100, 0));
+        cache.insert("a", 1, makeSlice(100, 1));
+        cache.insert("b", 0, makeSlice(100, 2));
+        if(!cache.find("a", 0))
+            FAIL("slice is missing from the cache");
+        // Now ("a",1) is the least recently used one
+        cache.insert("b", 1, makeSlice(100, 3));
+        if(cache.contains("a", 1))
+            FAIL("least recently used slice wasn't evicted");
+        if(!cache.contains("a", 0) || !cache.contains("b", 0) || !cache.contains("b", 1))
+            FAIL("wrong slice was evicted");
+        if(const auto slice=cache.find("b", 0); !slice || slice->data()[50]!=2)
+            FAIL("slice found in the cache has wrong contents");
+
+        cache.insert("c", 0, makeSlice(400, 4));
+        if(cache.contains("c", 0))
+            FAIL("slice larger than the budget was cached");
+
+        cache.setMaxSize(150);
+        if(!cache.contains("b", 0) || cache.contains("a", 0) || cache.contains("b", 1))
+            FAIL("reduction of the budget didn't keep only the most recently used slice");
+    }
+
+    {
+        QTemporaryDir dir;
+        if(!dir.isValid())
+            FAIL("failed to create temporary directory");
+
+        const std::vector<uint64_t> sizes{3,2,2,6};
+        const size_t sliceSize=4*sizes[0]*sizes[1]*sizes[2];
+        std::vector<float> data(sliceSize*sizes[3]);
+        for(size_t n=0; n<data.size(); ++n)
+            data[n]=n;
+        const auto path=dir.filePath("texture.f32");
+        TextureFileWriter out(path, TextureElementType::Float32, 4, sizes);
+        out.write(data.data(), data.size()*sizeof data[0]);
+        out.finish();
+
+        AltitudeSliceCache cache(100*sliceSize*sizeof data[0]);
+        // Altitude index 2.25: the slices 2 and 3 are used for interpolation
+        cache.prefetch(path, 2.25/(sizes[3]-1), 1, 2);
+        for(const unsigned altIndex : {1,4,5})
+        {
+            const auto slice=cache.find(path, altIndex);
+            if(!slice)
+                FAIL("slice " << altIndex << " wasn't prefetched");
+            if(std::memcmp(slice->data(), &data[altIndex*sliceSize], slice->size()))
+                FAIL("prefetched slice " << altIndex << " has wrong contents");
+            // Where mapping works, the slices must not be copied
+            if(!slice->mapped() && TextureFileReader(path).mapChunks(altIndex, 1))
+                FAIL("prefetched slice " << altIndex << " was copied instead of being mapped");
+        }
+        for(const unsigned altIndex : {0,2,3})
+            if(cache.contains(path, altIndex))
+                FAIL("slice " << altIndex << " was prefetched, although it shouldn't have been");
+        // The reader used for prefetching is gone, and the cached mappings mustn't keep the file open
+        if(fileIsOpen(path))
+            FAIL("file remains open while only its slices are cached");
+
+        // Slices beyond the ends of the texture must be silently skipped
+        cache.prefetch(path, 1, 3, 3);
+        if(!cache.contains(path, 2))
+            FAIL("slice below the top pair wasn't prefetched");
+        cache.prefetch(dir.filePath("nonexistent"), 0.5, 1, 1);
+    }
+}
+catch(ShowMySky::Error const& ex)
+{
+    std::cerr << ex.what().toStdString() << "\n";
+    return 1;
+}
@@ -0,0 +1,108 @@
+#include "../ShowMySky/EclipseKeyframes.hpp"
+#include <cmath>
+#include <iostream>
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+constexpr double degree=M_PI/180;
+
+EclipseKeyframes::Samples makeSamples(const float value)
+{
+    return EclipseKeyframes::Samples(5, glm::vec4(value, 2*value, -value, 1));
+}
+
+int main()
+{
+    for(const double sunZA : {0., 30*degree, 89*degree, 100*degree})
+    {
+        for(const double separation : {0.1*degree, 0.5*degree, 20*degree})
+        {
+            for(const double positionAngle : {-170*degree, -30*degree, 0., 60*degree, 179*degree})
+            {
+                const auto [moonZA, moonAz] = EclipseKeyframes::moonZenithAngleAndRelativeAzimuth(sunZA, separation, positionAngle);
+                const auto [sep, pa] = EclipseKeyframes::moonSeparationAndPositionAngle(sunZA, moonZA, moonAz);
+                if(std::abs(sep-separation) > 1e-9 || std::abs(std::remainder(pa-positionAngle, 2*M_PI)) > 1e-6)
+                {
+                    FAIL("conversion of separation " << separation/degree << " deg and position angle "
+                         << positionAngle/degree << " deg with Sun zenith angle " << sunZA/degree
+                         << " deg doesn't round-trip: got " << sep/degree << " deg and " << pa/degree << " deg");
+                }
+            }
+        }
+    }
+
+    using Index=EclipseKeyframes::Index;
+    const double spacing=0.1*degree;
+    EclipseKeyframes::Context context;
+    context.altitude=100;
+    context.earthMoonDistance=370e6;
+    context.sunAngularRadius=0.25*degree;
+    EclipseKeyframes keyframes;
+    keyframes.setup(spacing, context, 0.35*degree);
+    const double sunZA=40.02*degree;
+    if(const auto index=keyframes.lowerIndex(0.35*degree, sunZA); !(index==Index{3,400}))
+        FAIL("wrong lower keyframe index: " << index.bySeparation << ", " << index.bySunZenithAngle);
+
+    // Samples quadratic in the separation index and linear in the Sun zenith angle index
+    const auto makeGridSamples=[](const int bySep, const int bySZA) { return makeSamples(bySep*bySep + 3*(bySZA-400)); };
+    for(int bySep=2; bySep<=5; ++bySep)
+        for(int bySZA=399; bySZA<=401; ++bySZA)
+            keyframes.insert({bySep, bySZA}, makeGridSamples(bySep, bySZA));
+    {
+        const auto samples=keyframes.interpolate(keyframes.separation({3,400})+0.25*spacing, sunZA);
+        const float expected=9+0.25*(16-9) + 3*0.2;
+        if(std::abs(samples[4].x-expected) > 1e-4 || std::abs(samples[4].z+expected) > 1e-4 || samples[4].w!=1)
+            FAIL("wrong interpolated sample: " << samples[4].x << ", expected " << expected);
+    }
+    {
+        const auto error=keyframes.interpolationErrorEstimate({3,400});
+        // Second difference of 2*bySep^2 is 4 and that along the Sun zenith angle is 0, the largest sample at the
+        // corners with neighbors along both axes is 2*(4^2+3)
+        const double expected=4./8/38;
+        if(std::abs(error-expected) > 1e-9)
+            FAIL("wrong interpolation error estimate: " << error << ", expected " << expected);
+        if(keyframes.interpolationErrorEstimate({6,400}) >= 0)
+            FAIL("error estimate was given without enough keyframes");
+    }
+
+    if(keyframes.indexToPrefetch(0.35*degree, sunZA))
+        FAIL("prefetch was requested without known direction of motion");
+    if(const auto index=keyframes.indexToPrefetch(0.39*degree, sunZA))
+        FAIL("prefetch of an existing keyframe was requested: " << index->bySeparation << ", " << index->bySunZenithAngle);
+    if(const auto index=keyframes.indexToPrefetch(0.41*degree, sunZA); !index || !(*index==Index{6,400}))
+        FAIL("wrong keyframe to prefetch for increasing separation");
+    if(const auto index=keyframes.indexToPrefetch(0.22*degree, sunZA); !index || !(*index==Index{1,400}))
+        FAIL("wrong keyframe to prefetch for decreasing separation");
+    if(const auto index=keyframes.indexToPrefetch(0.22*degree, sunZA+0.05*degree); !index || !(*index==Index{2,402}))
+        FAIL("wrong keyframe to prefetch for increasing Sun zenith angle");
+
+    for(int bySep=6; bySep<40; ++bySep)
+        keyframes.insert({bySep,400}, makeSamples(bySep));
+    if(keyframes.contains({5,400}) || !keyframes.contains({30,400}) || !keyframes.contains({39,400}))
+        FAIL("wrong keyframes were evicted");
+
+    {
+        auto slightlyChanged=context;
+        slightlyChanged.moonPositionAngle+=0.4*spacing/(4*degree);
+        if(!keyframes.setup(spacing, slightlyChanged, 4*degree))
+            FAIL("setup() reported dropping of keyframes after a change within tolerance");
+        if(!keyframes.contains({39,400}))
+            FAIL("keyframes were dropped after a change within tolerance");
+    }
+    {
+        auto changed=context;
+        changed.moonPositionAngle+=spacing/(4*degree);
+        if(keyframes.setup(spacing, changed, 4*degree))
+            FAIL("setup() reported keeping of keyframes after a change larger than tolerance");
+        if(keyframes.contains({39,400}))
+            FAIL("keyframes weren't dropped after a change of the position angle larger than tolerance");
+    }
+    keyframes.insert({39,400}, makeSamples(39));
+    {
+        auto changed=context;
+        changed.luminance=true;
+        keyframes.setup(spacing, changed, 4*degree);
+        if(keyframes.contains({39,400}))
+            FAIL("keyframes weren't dropped after a change of context");
+    }
+}
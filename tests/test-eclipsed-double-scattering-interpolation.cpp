@@ -0,0 +1,138 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include "../common/EclipsedDoubleScatteringInterpolator.hpp"
+#include "../common/parallel.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+EclipsedDoubleScatteringInterpolationParameters makeParameters()
+{
+    EclipsedDoubleScatteringInterpolationParameters params;
+    params.earthRadius=6371e3;
+    params.atmosphereHeight=120e3;
+    params.lengthOfHorizRayFromGroundToBorderOfAtmo=std::sqrt(std::pow(params.earthRadius+params.atmosphereHeight, 2.f) -
+                                                              std::pow(params.earthRadius, 2.f));
+    params.numberOfAzimuthPairsToSample=2;
+    params.numberOfElevationPairsToSample=10;
+    params.texSizeByViewAzimuth=16;
+    params.texSizeByViewElevation=128;
+    return params;
+}
+
+std::vector<glm::vec4> randomCoarseGridSamples(const size_t count, const unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> value(1e-6, 1e-3);
+    std::vector<glm::vec4> samples;
+    for(size_t n=0; n<count; ++n)
+        samples.emplace_back(value(gen), value(gen), value(gen), value(gen));
+    return samples;
+}
+
+int main()
+{
+    const auto params=makeParameters();
+    const float altitude=1000;
+    EclipsedDoubleScatteringInterpolator interpolator(params);
+    const auto sampleCount=interpolator.coarseGridSampleCount();
+
+    interpolator.generateElevations(altitude);
+    const auto elevCount=interpolator.elevationsAboveHorizon().size();
+    if(elevCount != 2*params.numberOfElevationPairsToSample || interpolator.elevationsBelowHorizon().size() != elevCount)
+        FAIL("wrong number of elevations: " << elevCount << " above and " << interpolator.elevationsBelowHorizon().size() << " below horizon");
+
+    // Constant radiance in each half of the sphere must be reproduced in the corresponding texels
+    {
+        const glm::vec4 above(1e-3, 2e-3, 3e-3, 4e-3), below(5e-5, 6e-5, 7e-5, 8e-5);
+        for(unsigned azimIndex=0; azimIndex<params.numberOfAzimuthPairsToSample; ++azimIndex)
+        {
+            for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+            {
+                interpolator.setSample(true, azimIndex, elevIndex, above);
+                interpolator.setSample(false, azimIndex, elevIndex, below);
+            }
+        }
+        std::vector<glm::vec4> texture(interpolator.textureSliceSize());
+        interpolator.generateTextureSlice(altitude, texture.data());
+        for(unsigned row=0; row<params.texSizeByViewElevation; ++row)
+        {
+            // The lower half of the rows is for the view rays that intersect the ground
+            const auto expected = 2*row < params.texSizeByViewElevation ? below : above;
+            for(unsigned col=0; col<params.texSizeByViewAzimuth; ++col)
+            {
+                const auto texel=texture[row*params.texSizeByViewAzimuth+col];
+                for(int i=0; i<4; ++i)
+                {
+                    if(std::abs(texel[i]-std::log(expected[i])) > 1e-5)
+                        FAIL("texel (" << col << "," << row << ")[" << i << "] is " << texel[i] << " instead of " << std::log(expected[i]));
+                }
+            }
+        }
+    }
+
+    // Loaded samples must be saved unchanged
+    const auto samples=randomCoarseGridSamples(sampleCount, 1);
+    interpolator.loadCoarseGridSamples(altitude, samples.data(), samples.size());
+    {
+        std::vector<glm::vec4> saved;
+        if(interpolator.appendCoarseGridSamplesTo(saved) != sampleCount || saved != samples)
+            FAIL("saved samples differ from the loaded ones");
+    }
+
+    // Conversion and accumulation act on each sample as a matrix multiplication
+    {
+        EclipsedDoubleScatteringInterpolator source(params);
+        const auto sourceSamples=randomCoarseGridSamples(sampleCount, 2);
+        source.loadCoarseGridSamples(altitude, sourceSamples.data(), sourceSamples.size());
+
+        interpolator.convertRadianceToLuminance(glm::mat4(2));
+        interpolator.accumulateLuminance(source, glm::mat4(3));
+        std::vector<glm::vec4> result;
+        interpolator.appendCoarseGridSamplesTo(result);
+        for(size_t n=0; n<sampleCount; ++n)
+        {
+            for(int i=0; i<4; ++i)
+            {
+                const float expected=2*samples[n][i]+3*sourceSamples[n][i];
+                if(std::abs(result[n][i]-expected) > 1e-6*expected)
+                    FAIL("sample " << n << "[" << i << "] is " << result[n][i] << " instead of " << expected);
+            }
+        }
+    }
+
+    // Slices generated concurrently by different interpolators must be the same as the ones generated sequentially
+    {
+        constexpr int sliceCount=8;
+        std::vector<std::vector<glm::vec4>> sliceSamples;
+        for(int n=0; n<sliceCount; ++n)
+            sliceSamples.push_back(randomCoarseGridSamples(sampleCount, 10+n));
+        const auto sliceAltitude=[](const int n) { return 1 + 5000.f*n; };
+
+        const auto sliceSize=interpolator.textureSliceSize();
+        std::vector<glm::vec4> sequential(sliceSize*sliceCount);
+        for(int n=0; n<sliceCount; ++n)
+        {
+            interpolator.loadCoarseGridSamples(sliceAltitude(n), sliceSamples[n].data(), sampleCount);
+            interpolator.generateTextureSlice(sliceAltitude(n), &sequential[n*sliceSize]);
+        }
+
+        std::vector<std::unique_ptr<EclipsedDoubleScatteringInterpolator>> interpolators;
+        for(int n=0; n<parallelWorkerCount(sliceCount); ++n)
+            interpolators.emplace_back(std::make_unique<EclipsedDoubleScatteringInterpolator>(params));
+        std::vector<glm::vec4> parallel(sliceSize*sliceCount);
+        forEachInParallel(sliceCount, [&](const int n, const int worker)
+        {
+            interpolators[worker]->loadCoarseGridSamples(sliceAltitude(n), sliceSamples[n].data(), sampleCount);
+            interpolators[worker]->generateTextureSlice(sliceAltitude(n), &parallel[n*sliceSize]);
+        });
+
+        for(size_t n=0; n<sequential.size(); ++n)
+        {
+            if(parallel[n] != sequential[n] || std::isnan(sequential[n].x))
+                FAIL("texel " << n << " differs between sequential and parallel generation: " << sequential[n].x << " vs " << parallel[n].x);
+        }
+    }
+}
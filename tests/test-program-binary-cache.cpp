@@ -0,0 +1,176 @@
+#include "../ShowMySky/ProgramBinaryCache.hpp"
+#include <iostream>
+#include <QDir>
+#include <QDateTime>
+#include <QTemporaryDir>
+#include <QOpenGLContext>
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include "../ShowMySky/util.hpp"
+#include "../common/util.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+#define SKIP(reason) { std::cerr << "Skipping the test: " << reason << "\n"; return SKIP_RETURN_CODE; }
+
+constexpr int SKIP_RETURN_CODE=77;
+
+// Stands for a scattering shader: it depends on the view direction shaders supplied by the application
+constexpr const char* fragShaderSrc=1+R"(
+#version 330
+vec3 calcViewDir();
+out vec4 color;
+void main()
+{
+    color=vec4(calcViewDir(),1);
+}
+)";
+constexpr const char* viewDirVertShaderSrc=1+R"(
+#version 330
+in vec3 vertex;
+out vec3 position;
+void main()
+{
+    position=vertex;
+    gl_Position=vec4(position,1);
+}
+)";
+constexpr const char* viewDirFragShaderSrcs[]={1+R"(
+#version 330
+in vec3 position;
+vec3 calcViewDir() { return normalize(position); }
+)", 1+R"(
+#version 330
+in vec3 position;
+vec3 calcViewDir() { return -normalize(position); }
+)"};
+const ProgramBinaryCache::AttribLocations attribLocations{{"vertex", 0}};
+
+// Does what AtmosphereRenderer::buildProgram() does, returning whether the program was found in the cache
+bool buildProgram(ProgramBinaryCache& cache, QOpenGLShaderProgram& program, const char*const viewDirFragShaderSrc)
+{
+    const auto key=cache.key({{QOpenGLShader::Fragment, fragShaderSrc},
+                              {QOpenGLShader::Fragment, viewDirFragShaderSrc},
+                              {QOpenGLShader::Vertex, viewDirVertShaderSrc}}, attribLocations);
+    if(cache.load(program, key))
+        return true;
+    addShaderCode(program, QOpenGLShader::Fragment, "fragment shader", fragShaderSrc);
+    addShaderCode(program, QOpenGLShader::Fragment, "view direction fragment shader", viewDirFragShaderSrc);
+    addShaderCode(program, QOpenGLShader::Vertex, "view direction vertex shader", viewDirVertShaderSrc);
+    for(const auto& [name, location] : attribLocations)
+        program.bindAttributeLocation(name.c_str(), location);
+    cache.prepareForLinking(program);
+    link(program, "shader program");
+    cache.save(program, key);
+    return false;
+}
+
+int main(int argc, char** argv)
+try
+{
+#ifdef Q_OS_LINUX
+    // Without a display the test would abort instead of being skipped
+    if(qEnvironmentVariableIsEmpty("DISPLAY") && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY") &&
+       qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+#endif
+    QGuiApplication app(argc, argv);
+    QOpenGLContext context;
+    QSurfaceFormat format;
+    format.setVersion(3,3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    context.setFormat(format);
+    if(!context.create())
+        SKIP("failed to create OpenGL context");
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if(!context.makeCurrent(&surface))
+        SKIP("failed to make OpenGL context current");
+
+    QTemporaryDir dir;
+    if(!dir.isValid())
+        FAIL("failed to create temporary directory");
+    ProgramBinaryCache cache(dir.path());
+    if(!cache.enabled())
+        SKIP("program binaries aren't supported");
+
+    {
+        QOpenGLShaderProgram program;
+        if(buildProgram(cache, program, viewDirFragShaderSrcs[0]))
+            FAIL("program was found in an empty cache");
+        if(ProgramBinaryCache::loadedFromBinary(program))
+            FAIL("compiled program is marked as made from a binary");
+    }
+
+    // The client starts again and changes the view direction shaders
+    QOpenGLShaderProgram program;
+    if(!buildProgram(cache, program, viewDirFragShaderSrcs[0]))
+        FAIL("program wasn't found in the cache");
+    if(!ProgramBinaryCache::loadedFromBinary(program))
+        FAIL("program made from a binary isn't marked as such");
+
+    QOpenGLShader oldVertShader(QOpenGLShader::Vertex), oldFragShader(QOpenGLShader::Fragment);
+    QOpenGLShader newVertShader(QOpenGLShader::Vertex), newFragShader(QOpenGLShader::Fragment);
+    if(!oldVertShader.compileSourceCode(viewDirVertShaderSrc) || !oldFragShader.compileSourceCode(viewDirFragShaderSrcs[0]) ||
+       !newVertShader.compileSourceCode(viewDirVertShaderSrc) || !newFragShader.compileSourceCode(viewDirFragShaderSrcs[1]))
+        FAIL("failed to compile view direction shaders");
+    bool rebuilt=false, foundInCache=true;
+    replaceShaders(program, {&oldVertShader, &oldFragShader}, {&newVertShader, &newFragShader}, attribLocations,
+                   "shader program", [&]{ rebuilt=true; foundInCache=buildProgram(cache, program, viewDirFragShaderSrcs[1]); });
+    if(!rebuilt)
+        FAIL("program made from a binary was relinked instead of being rebuilt");
+    if(foundInCache)
+        FAIL("program with the new view direction shaders was found in the cache");
+    if(ProgramBinaryCache::loadedFromBinary(program) || !program.isLinked())
+        FAIL("rebuilt program isn't linked from the sources");
+
+    // A compiled program has the shaders to replace
+    rebuilt=false;
+    replaceShaders(program, {}, {}, attribLocations, "shader program", [&]{ rebuilt=true; });
+    if(rebuilt || !program.isLinked())
+        FAIL("compiled program wasn't relinked");
+
+    // The rebuilt program must have been cached too
+    QOpenGLShaderProgram newProgram;
+    if(!buildProgram(cache, newProgram, viewDirFragShaderSrcs[1]))
+        FAIL("program with the new view direction shaders wasn't cached");
+
+    // The least recently used binaries are removed when the cache exceeds its size limit
+    {
+        QTemporaryDir limitedDir;
+        if(!limitedDir.isValid())
+            FAIL("failed to create temporary directory");
+        const auto binaries=[&]{ return QDir(limitedDir.path()).entryInfoList({"*.bin"}, QDir::Files); };
+        {
+            ProgramBinaryCache probe(limitedDir.path());
+            QOpenGLShaderProgram program;
+            buildProgram(probe, program, viewDirFragShaderSrcs[0]);
+        }
+        if(binaries().size()!=1)
+            FAIL("program binary wasn't saved");
+        const auto binarySize=binaries().front().size();
+
+        ProgramBinaryCache limitedCache(limitedDir.path(), binarySize*3/2);
+        {
+            QFile oldBinary(binaries().front().filePath());
+            if(!oldBinary.open(QFile::ReadOnly) ||
+               !oldBinary.setFileTime(QDateTime::currentDateTimeUtc().addSecs(-3600), QFileDevice::FileModificationTime))
+                FAIL("failed to make the program binary older");
+        }
+        QOpenGLShaderProgram program;
+        if(buildProgram(limitedCache, program, viewDirFragShaderSrcs[1]))
+            FAIL("program was found in the cache before it was saved");
+        if(binaries().size()!=1)
+            FAIL("cache over the size limit wasn't trimmed");
+        QOpenGLShaderProgram recentProgram, oldProgram;
+        if(!buildProgram(limitedCache, recentProgram, viewDirFragShaderSrcs[1]))
+            FAIL("the most recently used program binary was removed");
+        if(buildProgram(limitedCache, oldProgram, viewDirFragShaderSrcs[0]))
+            FAIL("the least recently used program binary wasn't removed");
+    }
+}
+catch(ShowMySky::Error const& ex)
+{
+    std::cerr << ex.what().toStdString() << "\n";
+    return 1;
+}
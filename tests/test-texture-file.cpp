@@ -0,0 +1,210 @@
+#include "../common/TextureFile.hpp"
+#include <cmath>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <QTemporaryDir>
+#include "../common/util.hpp"
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+
+bool loadFails(QString const& path)
+{
+    try
+    {
+        TextureFileReader file(path);
+        file.readAll();
+    }
+    catch(DataLoadError const&)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main()
+try
+{
+    QTemporaryDir dir;
+    if(!dir.isValid())
+        FAIL("failed to create temporary directory");
+
+    // The standard check value of CRC-32, long enough to go through the 8-byte steps and the tail
+    if(const auto crc=crc32("123456789", 9); crc!=0xcbf43926)
+        FAIL("wrong CRC-32 of the check string: " << std::hex << crc);
+
+    const std::vector<uint64_t> sizes{5,3,70000,4}; // 70000 wouldn't fit into the uint16 header of the old format
+    const uint64_t sliceSize=sizes[0]*sizes[1]*sizes[2];
+    std::vector<float> data(4*sliceSize*sizes[3]);
+    for(size_t n=0; n<data.size(); ++n)
+        data[n]=n*0.25f;
+
+    const auto path=dir.filePath("texture.f32");
+    {
+        TextureFileWriter out(path, TextureElementType::Float32, 4, sizes);
+        // Pieces not aligned to chunk boundaries
+        const size_t pieceSize=12345;
+        for(size_t pos=0; pos<data.size(); pos+=pieceSize)
+            out.write(&data[pos], std::min(pieceSize, data.size()-pos)*sizeof data[0]);
+        out.finish();
+    }
+
+    {
+        TextureFileReader in(path);
+        in.checkFormat(TextureElementType::Float32, 4, {0,3,70000,4});
+        if(in.sizes()!=sizes)
+            FAIL("sizes read from file don't match the ones written");
+        if(in.chunkCount()!=sizes[3] || in.chunkSize()!=4*sizeof(float)*sliceSize)
+            FAIL("unexpected chunk layout: " << in.chunkCount() << " chunks of " << in.chunkSize() << " bytes");
+
+        const auto all=in.readAll();
+        if(size_t(all.size())!=data.size()*sizeof data[0] || std::memcmp(all.data(), data.data(), all.size()))
+            FAIL("data read from file don't match the ones written");
+
+        std::vector<float> slices(2*4*sliceSize);
+        in.readChunks(2, 2, reinterpret_cast<char*>(slices.data()));
+        if(std::memcmp(slices.data(), &data[2*4*sliceSize], slices.size()*sizeof slices[0]))
+            FAIL("altitude slices read from file don't match the ones written");
+        if(const auto mapped=in.mapChunks(2, 2); mapped && std::memcmp(mapped.data(), &data[2*4*sliceSize], slices.size()*sizeof slices[0]))
+            FAIL("mapped altitude slices don't match the ones written");
+
+        bool threw=false;
+        try { in.checkFormat(TextureElementType::SNorm16, 1, {0,0,0,0}); }
+        catch(DataLoadError const&) { threw=true; }
+        if(!threw)
+            FAIL("element type mismatch wasn't detected");
+    }
+
+    {
+        // The mapping must stay valid after the reader closes the file
+        auto mapped=TextureFileReader(path).mapChunks(1, 1);
+        if(mapped && std::memcmp(mapped.data(), &data[4*sliceSize], mapped.size()))
+            FAIL("mapped altitude slice doesn't match the one written after the reader was destroyed");
+        mapped.unmap();
+        if(mapped || mapped.size())
+            FAIL("unmapped slice is still reported as mapped");
+    }
+
+    {
+        const auto guidesPath=dir.filePath("guides");
+        std::vector<int16_t> guides(2*3*4);
+        for(size_t n=0; n<guides.size(); ++n)
+            guides[n]=int16_t(n*1000)-10000;
+        TextureFileWriter out(guidesPath, TextureElementType::SNorm16, 1, {2,3,4});
+        out.write(guides.data(), guides.size()*sizeof guides[0]);
+        out.finish();
+
+        TextureFileReader in(guidesPath);
+        in.checkFormat(TextureElementType::SNorm16, 1, {2,3,4});
+        const auto all=in.readAll();
+        if(std::memcmp(all.data(), guides.data(), all.size()))
+            FAIL("guides read from file don't match the ones written");
+    }
+
+    {
+        // Values exceeding the largest half float and spanning 8 orders of magnitude
+        std::vector<float> values(4*3*2);
+        for(size_t n=0; n<values.size(); ++n)
+            values[n]=(n%2 ? -1 : 1) * 1.2345e6f * std::pow(0.45f, float(n));
+        const auto scale=halfFloatScale(values.data(), values.size());
+        std::vector<uint16_t> halfValues(values.size());
+        floatsToHalfFloats(values.data(), values.size(), scale, halfValues.data());
+
+        const auto halfPath=dir.filePath("half.f32");
+        TextureFileWriter out(halfPath, TextureElementType::Float16, 4, {3,2}, scale);
+        out.write(halfValues.data(), halfValues.size()*sizeof halfValues[0]);
+        out.finish();
+
+        TextureFileReader in(halfPath);
+        in.checkFormat(TextureElementType::Float16, 4, {3,2});
+        if(in.valueScale()!=scale)
+            FAIL("value scale read from file " << in.valueScale() << " doesn't match the one written " << scale);
+        const auto all=in.readAll();
+        std::vector<float> decoded(values.size());
+        halfFloatsToFloats(reinterpret_cast<const uint16_t*>(all.data()), decoded.size(), in.valueScale(), decoded.data());
+        for(size_t n=0; n<values.size(); ++n)
+        {
+            const auto relError=std::abs(decoded[n]-values[n])/std::abs(values[n]);
+            if(relError > std::pow(2.f, -11.f))
+                FAIL("half-float value " << decoded[n] << " differs too much from the original " << values[n]);
+        }
+
+        if(TextureFileReader(path).valueScale()!=1)
+            FAIL("value scale of a single-precision texture isn't 1");
+    }
+
+    {
+        const auto truncatedPath=dir.filePath("truncated.f32");
+        QFile::copy(path, truncatedPath);
+        QFile file(truncatedPath);
+        file.open(QFile::ReadWrite);
+        file.resize(file.size()-100);
+        file.close();
+        if(!loadFails(truncatedPath))
+            FAIL("truncation of file wasn't detected");
+    }
+
+    {
+        QFile file(path);
+        if(!file.open(QFile::ReadWrite))
+            FAIL("failed to open file for corruption");
+        const auto lastByteOffset=file.size()-1;
+        file.seek(lastByteOffset);
+        char c;
+        file.getChar(&c);
+        file.seek(lastByteOffset);
+        file.putChar(c^1);
+        file.close();
+        if(!loadFails(path))
+            FAIL("corruption of data wasn't detected");
+
+        bool threw=false;
+        try
+        {
+            TextureFileReader in(path);
+            if(!in.mapChunks(in.chunkCount()-1, 1))
+                threw=true; // Mapping isn't supported, nothing to check
+        }
+        catch(DataLoadError const&)
+        {
+            threw=true;
+        }
+        if(!threw)
+            FAIL("corruption of mapped data wasn't detected");
+    }
+
+    {
+        // Texture in the old format: uint16 sizes followed by the data
+        const auto oldPath=dir.filePath("old.f32");
+        QFile file(oldPath);
+        file.open(QFile::WriteOnly);
+        const uint16_t oldSizes[2]={2,2};
+        file.write(reinterpret_cast<const char*>(oldSizes), sizeof oldSizes);
+        file.write(reinterpret_cast<const char*>(data.data()), 16*sizeof data[0]);
+        file.close();
+        if(!loadFails(oldPath))
+            FAIL("file in the old format was accepted");
+    }
+
+    {
+        bool threw=false;
+        try
+        {
+            TextureFileWriter out(dir.filePath("incomplete"), TextureElementType::Float32, 4, {2,2});
+            out.write(data.data(), 4*3*sizeof data[0]);
+            out.finish();
+        }
+        catch(DataSaveError const&)
+        {
+            threw=true;
+        }
+        if(!threw)
+            FAIL("incomplete texture data weren't detected");
+    }
+}
+catch(ShowMySky::Error const& ex)
+{
+    std::cerr << ex.what().toStdString() << "\n";
+    return 1;
+}